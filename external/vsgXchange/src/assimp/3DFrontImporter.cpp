@@ -12,51 +12,198 @@
 #include <algorithm>
 #include <filesystem>
 #include <cstring>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
 
 
 namespace fs = std::filesystem;
 
-static void DeepCopyAiMesh(aiMesh* source, aiMesh*& target)
+struct AI3DFrontImporter::FurnitureModel
 {
-    target = new aiMesh;
-    *target = *source;
-    if (source->mNumVertices > 0)
+    // materials are edited for the scene, mesh material indices are relative to the materials of the model
+    std::vector<aiMesh*> meshes;
+    std::vector<aiMaterial*> materials;
+    std::string error;
+};
+
+struct AI3DFrontImporter::MeshBuffers
+{
+    std::vector<float> xyz;
+    std::vector<float> normal;
+    std::vector<float> uv;
+    std::vector<uint32_t> faces;
+};
+
+namespace
+{
+    // Builds the json of a scene without the vertex and index arrays of the room meshes. These are decoded directly
+    // into typed buffers, one per entry of the "mesh" array, instead of one json value per number.
+    class SceneSaxHandler : public nlohmann::json::json_sax_t
     {
-        target->mVertices = new aiVector3D[source->mNumVertices];
-        std::memcpy(target->mVertices, source->mVertices, target->mNumVertices * sizeof(aiVector3D));
-        if (source->mNormals != nullptr)
+    public:
+        SceneSaxHandler(nlohmann::json& root, std::vector<AI3DFrontImporter::MeshBuffers>& mesh_buffers) :
+            root(root), mesh_buffers(mesh_buffers) {}
+
+        const std::string& GetError() const { return error; }
+
+        bool null() override { return AddValue(nullptr) != nullptr; }
+        bool boolean(bool val) override { return AddValue(val) != nullptr; }
+        bool number_integer(number_integer_t val) override
         {
-            target->mNormals = new aiVector3D[source->mNumVertices];
-            std::memcpy(target->mNormals, source->mNormals, target->mNumVertices * sizeof(aiVector3D));
+            if (float_target) float_target->push_back(static_cast<float>(val));
+            else if (index_target) index_target->push_back(static_cast<uint32_t>(val));
+            else return AddValue(val) != nullptr;
+            return true;
         }
-        if (source->mTangents != nullptr)
+        bool number_unsigned(number_unsigned_t val) override
         {
-            target->mTangents = new aiVector3D[source->mNumVertices];
-            std::memcpy(target->mTangents, source->mTangents, target->mNumVertices * sizeof(aiVector3D));
+            if (float_target) float_target->push_back(static_cast<float>(val));
+            else if (index_target) index_target->push_back(static_cast<uint32_t>(val));
+            else return AddValue(val) != nullptr;
+            return true;
         }
-        if (source->mBitangents != nullptr)
+        bool number_float(number_float_t val, const string_t&) override
         {
-            target->mBitangents = new aiVector3D[source->mNumVertices];
-            std::memcpy(target->mBitangents, source->mBitangents, target->mNumVertices * sizeof(aiVector3D));
+            if (float_target) float_target->push_back(static_cast<float>(val));
+            else if (index_target) index_target->push_back(static_cast<uint32_t>(val));
+            else return AddValue(val) != nullptr;
+            return true;
         }
-        for (int i = 0; i < AI_MAX_NUMBER_OF_TEXTURECOORDS; i++)
+        bool string(string_t& val) override
+        {
+            // sometimes vertex data is stored as string instead of floats in the json
+            if (float_target) float_target->push_back(std::strtof(val.c_str(), nullptr));
+            else if (index_target) index_target->push_back(static_cast<uint32_t>(std::strtoul(val.c_str(), nullptr, 10)));
+            else return AddValue(std::move(val)) != nullptr;
+            return true;
+        }
+        bool binary(binary_t& val) override { return AddValue(std::move(val)) != nullptr; }
+
+        bool start_object(std::size_t) override
         {
-            if (source->mTextureCoords[i] != nullptr)
+            if (float_target || index_target)
             {
-                target->mTextureCoords[i] = new aiVector3D[source->mNumVertices];
-                std::memcpy(target->mTextureCoords[i], source->mTextureCoords[i], target->mNumVertices * sizeof(aiVector3D));
+                error = "unexpected object in mesh data";
+                return false;
             }
+            bool is_mesh = mesh_array && !containers.empty() && containers.back() == mesh_array;
+            containers.push_back(AddValue(nlohmann::json::value_t::object));
+            if (is_mesh)
+            {
+                mesh_object = containers.back();
+                mesh_buffers.emplace_back();
+            }
+            return true;
         }
-    }
-    target->mFaces = new aiFace[source->mNumFaces];
-    std::memcpy(target->mFaces, source->mFaces, target->mNumFaces * sizeof(aiFace));
-    for (int face_index = 0; face_index < target->mNumFaces; face_index++)
-    {
-        auto& face = target->mFaces[face_index];
-        face.mIndices = new unsigned[face.mNumIndices];
-        std::memcpy(face.mIndices, source->mFaces[face_index].mIndices, face.mNumIndices * sizeof(unsigned));
-    }
-    // TODO: copy remaining data
+        bool key(string_t& val) override
+        {
+            pending_float_target = nullptr;
+            pending_index_target = nullptr;
+            if (mesh_object && containers.back() == mesh_object)
+            {
+                auto& buffers = mesh_buffers.back();
+                if (val == "xyz") pending_float_target = &buffers.xyz;
+                else if (val == "normal") pending_float_target = &buffers.normal;
+                else if (val == "uv") pending_float_target = &buffers.uv;
+                else if (val == "faces") pending_index_target = &buffers.faces;
+            }
+            pending_key = std::move(val);
+            return true;
+        }
+        bool end_object() override
+        {
+            if (containers.back() == mesh_object)
+            {
+                mesh_object = nullptr;
+            }
+            containers.pop_back();
+            return true;
+        }
+        bool start_array(std::size_t elements) override
+        {
+            if (float_target || index_target)
+            {
+                error = "unexpected array in mesh data";
+                return false;
+            }
+            if (pending_float_target || pending_index_target)
+            {
+                float_target = pending_float_target;
+                index_target = pending_index_target;
+                pending_float_target = nullptr;
+                pending_index_target = nullptr;
+                // the size is only known for binary formats
+                if (elements != static_cast<std::size_t>(-1))
+                {
+                    if (float_target) float_target->reserve(elements);
+                    if (index_target) index_target->reserve(elements);
+                }
+                return true;
+            }
+            bool is_mesh_array = containers.size() == 1 && pending_key == "mesh";
+            containers.push_back(AddValue(nlohmann::json::value_t::array));
+            if (is_mesh_array)
+            {
+                mesh_array = containers.back();
+            }
+            return true;
+        }
+        bool end_array() override
+        {
+            if (float_target || index_target)
+            {
+                float_target = nullptr;
+                index_target = nullptr;
+                return true;
+            }
+            if (containers.back() == mesh_array)
+            {
+                mesh_array = nullptr;
+            }
+            containers.pop_back();
+            return true;
+        }
+        bool parse_error(std::size_t, const std::string&, const nlohmann::json::exception& ex) override
+        {
+            error = ex.what();
+            return false;
+        }
+
+    private:
+        template<typename Value>
+        nlohmann::json* AddValue(Value&& value)
+        {
+            pending_float_target = nullptr;
+            pending_index_target = nullptr;
+            if (containers.empty())
+            {
+                root = nlohmann::json(std::forward<Value>(value));
+                return &root;
+            }
+            auto& parent = *containers.back();
+            if (parent.is_array())
+            {
+                parent.emplace_back(std::forward<Value>(value));
+                return &parent.back();
+            }
+            auto& element = parent[pending_key];
+            element = nlohmann::json(std::forward<Value>(value));
+            return &element;
+        }
+
+        nlohmann::json& root;
+        std::vector<AI3DFrontImporter::MeshBuffers>& mesh_buffers;
+        std::vector<nlohmann::json*> containers;
+        std::string pending_key;
+        std::string error;
+        nlohmann::json* mesh_array = nullptr;
+        nlohmann::json* mesh_object = nullptr;
+        std::vector<float>* pending_float_target = nullptr;
+        std::vector<uint32_t>* pending_index_target = nullptr;
+        std::vector<float>* float_target = nullptr;
+        std::vector<uint32_t>* index_target = nullptr;
+    };
 }
 
 float AI3DFrontImporter::ceiling_light_strength = 0.8f;
@@ -126,116 +273,59 @@ void AI3DFrontImporter::InternReadFile(const std::string& pFile, aiScene* pScene
     {
         throw DeadlyImportError("Failed to open file " + pFile + ".");
     }
+    // mesh data is decoded while streaming through the file, the json of the scene holds everything else
     nlohmann::json scene_json;
-    scene_file >> scene_json;
+    std::vector<MeshBuffers> mesh_buffers;
+    SceneSaxHandler sax_handler(scene_json, mesh_buffers);
+    if (!nlohmann::json::sax_parse(scene_file, &sax_handler))
+    {
+        throw DeadlyImportError("Failed to parse file " + pFile + ": " + sax_handler.GetError());
+    }
 
     std::vector<fs::path> furniture_directories;
     std::vector<fs::path> texture_directories;
     FindDataDirectories(pFile, texture_directories, furniture_directories);
 
-    std::unordered_map<std::string, std::string> jid_to_category_map = LoadJidToCategoryMap(furniture_directories);
+    auto model_indices = LoadModelIndices(furniture_directories);
 
     std::unordered_map<std::string, uint32_t> material_id_to_index_map;
     std::vector<float> material_uv_rotations;
     LoadMaterials(texture_directories, scene_json, pScene, material_id_to_index_map, material_uv_rotations);
 
     std::unordered_map<std::string, std::vector<uint32_t>> model_uid_to_mesh_indices_map;
-    LoadMeshes(scene_json, material_id_to_index_map, material_uv_rotations, pScene, model_uid_to_mesh_indices_map);
+    LoadMeshes(scene_json, mesh_buffers, material_id_to_index_map, material_uv_rotations, pScene, model_uid_to_mesh_indices_map);
 
-    // load furniture
-    Assimp::Importer importer;
+    // load furniture, every model is loaded once and shared by all pieces with the same jid
     const auto& furniture = scene_json["furniture"];
+    auto furniture_models = LoadFurnitureModels(furniture, model_indices);
     std::vector<aiMesh*> furniture_meshes;
     uint32_t total_mesh_count = pScene->mNumMeshes;
     std::vector<aiMaterial*> furniture_materials;
     uint32_t total_material_count = pScene->mNumMaterials;
+    std::unordered_map<std::string, std::vector<uint32_t>> jid_to_mesh_indices_map;
     for (const auto& piece_of_furniture : furniture)
     {
-        const auto& model_id = piece_of_furniture["jid"];
-        std::string model_category_name = jid_to_category_map[model_id];
-        std::transform(model_category_name.begin(), model_category_name.end(), model_category_name.begin(),
-                       [](unsigned char c) { return std::tolower(c); });
-        for (const auto& furniture_directory : furniture_directories)
+        std::string model_id = piece_of_furniture["jid"];
+        auto mesh_indices_iterator = jid_to_mesh_indices_map.find(model_id);
+        if (mesh_indices_iterator == jid_to_mesh_indices_map.end())
         {
-            fs::path furniture_model_path = furniture_directory / fs::path(std::string(model_id));
-            if (!fs::exists(furniture_model_path))
-            {
-                continue;
-            }
-            std::string obj_path_str = (furniture_model_path / fs::path("raw_model.obj")).string();
-            const aiScene* furniture_model_scene = importer.ReadFile(
-                obj_path_str.c_str(),
-                aiProcess_Triangulate | aiProcess_OptimizeMeshes | aiProcess_SortByPType |
-                aiProcess_ImproveCacheLocality | aiProcess_GenUVCoords // same flags as in assimp.cpp
-            );
-            assert(furniture_model_scene->mNumTextures == 0);
-
-            // copy materials
-            std::unordered_map<uint32_t, uint32_t> original_to_new_material_index_map;
-            for (int i = 0; i < furniture_model_scene->mNumMaterials; i++)
-            {
-                auto* material_copy = new aiMaterial;
-                aiMaterial::CopyPropertyList(material_copy, furniture_model_scene->mMaterials[i]);
-
-                // edit texture path
-                for (int prop_index = 0; prop_index < material_copy->mNumProperties; prop_index++)
-                {
-                    auto& property = material_copy->mProperties[prop_index];
-                    if (property->mKey == aiString(_AI_MATKEY_TEXTURE_BASE))
-                    {
-                        // make texture path absolute so that vsg can find the file
-                        std::string full_path = (furniture_model_path / fs::path(&property->mData[6])).string();
-                        property->mDataLength = full_path.length() + 1;
-                        char* new_data = new char[property->mDataLength + 4];
-                        strncpy(&new_data[4], full_path.c_str(), property->mDataLength);
-                        delete property->mData;
-                        property->mData = new_data;
-                        property->mDataLength += 4;
-
-                        // set prefix
-                        property->mData[0] = static_cast<char>(full_path.length());
-                        property->mData[1] = 0;
-                        property->mData[2] = 0;
-                        property->mData[3] = 0;
-                    }
-                }
-                // add emission property if it is a lamp
-                if (model_category_name.find("lamp") != std::string::npos)
-                {
-                    aiString material_name;
-                    if (material_copy->Get(AI_MATKEY_NAME, material_name) == AI_SUCCESS)
-                    {
-                        // apparently all subobjects of lamps use the same material
-                        // so there is no way to make just the light bulb emissive
-                        //if (std::string{ material_name.C_Str() }.find("glass") == std::string::npos)
-                        {
-                            aiColor3D emissive_color(lamp_light_strength);
-                            material_copy->AddProperty(&emissive_color, 1, AI_MATKEY_COLOR_EMISSIVE);
-                        }
-                    }
-                }
-                uint32_t category_id = 0;
-                if (const auto& iterator = category_to_id_map.find(model_category_name); iterator != category_to_id_map.end())
-                {
-                    category_id = iterator->second;
-                }
-                material_copy->AddProperty(&category_id, 1, AI_MATKEY_CATEGORY_ID);
-
-
-                furniture_materials.push_back(material_copy);
-                original_to_new_material_index_map[i] = total_material_count++;
-            }
-            // copy meshes
-            for (int i = 0; i < furniture_model_scene->mNumMeshes; i++)
+            // first piece with this model, move its meshes and materials to the scene
+            auto& model = furniture_models[model_id];
+            auto& mesh_indices = jid_to_mesh_indices_map[model_id];
+            for (auto* mesh : model.meshes)
             {
-                aiMesh* mesh_copy;
-                DeepCopyAiMesh(furniture_model_scene->mMeshes[i], mesh_copy);
-                mesh_copy->mMaterialIndex = original_to_new_material_index_map[mesh_copy->mMaterialIndex];
-
-                furniture_meshes.push_back(mesh_copy);
-                model_uid_to_mesh_indices_map[piece_of_furniture["uid"]].push_back(total_mesh_count++);
+                mesh->mMaterialIndex += total_material_count;
+                furniture_meshes.push_back(mesh);
+                mesh_indices.push_back(total_mesh_count++);
             }
+            furniture_materials.insert(furniture_materials.end(), model.materials.begin(), model.materials.end());
+            total_material_count += static_cast<uint32_t>(model.materials.size());
+            model.meshes.clear();
+            model.materials.clear();
+            mesh_indices_iterator = jid_to_mesh_indices_map.find(model_id);
         }
+        auto& piece_mesh_indices = model_uid_to_mesh_indices_map[piece_of_furniture["uid"]];
+        piece_mesh_indices.insert(piece_mesh_indices.end(), mesh_indices_iterator->second.begin(), mesh_indices_iterator->second.end());
     }
     // copy mesh data pointers to main scene
     auto* meshes_with_furniture = new aiMesh*[total_mesh_count];
@@ -309,6 +399,173 @@ void AI3DFrontImporter::InternReadFile(const std::string& pFile, aiScene* pScene
         }
     }
 }
+static void LoadFurnitureModel(Assimp::Importer& importer, const std::vector<fs::path>& furniture_model_paths,
+                               const std::string& model_category_name, uint32_t category_id, float lamp_light_strength,
+                               AI3DFrontImporter::FurnitureModel& model)
+{
+    for (const auto& furniture_model_path : furniture_model_paths)
+    {
+        std::string obj_path_str = (furniture_model_path / fs::path("raw_model.obj")).string();
+        if (!importer.ReadFile(
+            obj_path_str.c_str(),
+            aiProcess_Triangulate | aiProcess_OptimizeMeshes | aiProcess_SortByPType |
+            aiProcess_ImproveCacheLocality | aiProcess_GenUVCoords // same flags as in assimp.cpp
+        ))
+        {
+            model.error = "Failed to load furniture model " + obj_path_str + ": " + importer.GetErrorString();
+            return;
+        }
+        // take the meshes and materials out of the imported scene instead of copying them
+        aiScene* furniture_model_scene = importer.GetOrphanedScene();
+        assert(furniture_model_scene->mNumTextures == 0);
+
+        auto material_offset = static_cast<uint32_t>(model.materials.size());
+        for (unsigned int i = 0; i < furniture_model_scene->mNumMaterials; i++)
+        {
+            auto* material = furniture_model_scene->mMaterials[i];
+            furniture_model_scene->mMaterials[i] = nullptr;
+
+            // edit texture path
+            for (unsigned int prop_index = 0; prop_index < material->mNumProperties; prop_index++)
+            {
+                auto& property = material->mProperties[prop_index];
+                if (property->mKey == aiString(_AI_MATKEY_TEXTURE_BASE))
+                {
+                    // make texture path absolute so that vsg can find the file
+                    std::string full_path = (furniture_model_path / fs::path(&property->mData[6])).string();
+                    property->mDataLength = full_path.length() + 1;
+                    char* new_data = new char[property->mDataLength + 4];
+                    strncpy(&new_data[4], full_path.c_str(), property->mDataLength);
+                    delete[] property->mData;
+                    property->mData = new_data;
+                    property->mDataLength += 4;
+
+                    // set prefix
+                    property->mData[0] = static_cast<char>(full_path.length());
+                    property->mData[1] = 0;
+                    property->mData[2] = 0;
+                    property->mData[3] = 0;
+                }
+            }
+            // add emission property if it is a lamp
+            if (model_category_name.find("lamp") != std::string::npos)
+            {
+                aiString material_name;
+                if (material->Get(AI_MATKEY_NAME, material_name) == AI_SUCCESS)
+                {
+                    // apparently all subobjects of lamps use the same material
+                    // so there is no way to make just the light bulb emissive
+                    aiColor3D emissive_color(lamp_light_strength);
+                    material->AddProperty(&emissive_color, 1, AI_MATKEY_COLOR_EMISSIVE);
+                }
+            }
+            material->AddProperty(&category_id, 1, AI_MATKEY_CATEGORY_ID);
+            model.materials.push_back(material);
+        }
+        for (unsigned int i = 0; i < furniture_model_scene->mNumMeshes; i++)
+        {
+            auto* mesh = furniture_model_scene->mMeshes[i];
+            furniture_model_scene->mMeshes[i] = nullptr;
+            mesh->mMaterialIndex += material_offset;
+            model.meshes.push_back(mesh);
+        }
+        delete furniture_model_scene;
+    }
+}
+std::unordered_map<std::string, AI3DFrontImporter::FurnitureModel> AI3DFrontImporter::LoadFurnitureModels(
+    const nlohmann::json& furniture, const std::vector<std::shared_ptr<const AI3DFrontModelIndex>>& model_indices)
+{
+    // unique models in order of appearance
+    std::unordered_map<std::string, FurnitureModel> models;
+    std::vector<std::string> model_ids;
+    for (const auto& piece_of_furniture : furniture)
+    {
+        std::string model_id = piece_of_furniture["jid"];
+        if (models.emplace(model_id, FurnitureModel{}).second)
+        {
+            model_ids.push_back(model_id);
+        }
+    }
+
+    // every thread uses its own importer, the models are independent of each other
+    std::atomic<size_t> next_model{0};
+    auto load_models = [&]()
+    {
+        Assimp::Importer importer;
+        for (size_t i = next_model++; i < model_ids.size(); i = next_model++)
+        {
+            const auto& model_id = model_ids[i];
+            // the category of the last directory listing the model is used, the model is loaded from all directories
+            std::string model_category_name;
+            std::vector<fs::path> furniture_model_paths;
+            bool indexed = false;
+            for (const auto& model_index : model_indices)
+            {
+                AI3DFrontModelIndex::Entry entry;
+                if (!model_index->Find(model_id, entry))
+                {
+                    continue;
+                }
+                indexed = true;
+                model_category_name = entry.category;
+                fs::path furniture_model_path = model_index->GetDirectory() / fs::path(model_id);
+                std::error_code error_code;
+                if (fs::is_directory(furniture_model_path, error_code))
+                {
+                    furniture_model_paths.push_back(furniture_model_path);
+                }
+            }
+            // models missing in model_info.json are still loaded without category
+            for (size_t index = 0; !indexed && index < model_indices.size(); index++)
+            {
+                fs::path furniture_model_path = model_indices[index]->GetDirectory() / fs::path(model_id);
+                std::error_code error_code;
+                if (fs::exists(furniture_model_path, error_code))
+                {
+                    furniture_model_paths.push_back(furniture_model_path);
+                }
+            }
+            std::transform(model_category_name.begin(), model_category_name.end(), model_category_name.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+            uint32_t category_id = 0;
+            if (const auto& iterator = category_to_id_map.find(model_category_name); iterator != category_to_id_map.end())
+            {
+                category_id = iterator->second;
+            }
+            // the map is not modified while loading, so the references to the models stay valid
+            LoadFurnitureModel(importer, furniture_model_paths, model_category_name, category_id,
+                               lamp_light_strength, models.find(model_id)->second);
+        }
+    };
+    size_t thread_count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), model_ids.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; i++)
+    {
+        threads.emplace_back(load_models);
+    }
+    load_models();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (const auto& model_id : model_ids)
+    {
+        auto& model = models[model_id];
+        if (model.error.empty())
+        {
+            continue;
+        }
+        std::string error = model.error;
+        for (auto& [id, other_model] : models)
+        {
+            for (auto* mesh : other_model.meshes) delete mesh;
+            for (auto* material : other_model.materials) delete material;
+        }
+        throw DeadlyImportError(error);
+    }
+    return models;
+}
 void AI3DFrontImporter::FindDataDirectories(const std::string& file_path,
                                             std::vector<fs::path>& texture_directories, std::vector<fs::path>& furniture_directories)
 {
@@ -331,33 +588,16 @@ void AI3DFrontImporter::FindDataDirectories(const std::string& file_path,
         }
     }
 }
-std::unordered_map<std::string, std::string> AI3DFrontImporter::LoadJidToCategoryMap(
+std::vector<std::shared_ptr<const AI3DFrontModelIndex>> AI3DFrontImporter::LoadModelIndices(
     const std::vector<std::filesystem::path>& furniture_directories)
 {
-    std::unordered_map<std::string, std::string> jid_to_category_map;
+    // model_info.json is only parsed when its index does not exist yet
+    std::vector<std::shared_ptr<const AI3DFrontModelIndex>> model_indices;
     for (const auto& furniture_directory : furniture_directories)
     {
-        fs::path model_info_path = furniture_directory / fs::path("model_info.json");
-        std::ifstream model_info_file(model_info_path.string());
-        if (!model_info_file)
-        {
-            throw DeadlyImportError("Failed to open file " + model_info_path.string() + ".");
-        }
-        nlohmann::json model_info_json;
-        model_info_file >> model_info_json;
-
-        for (const auto& mapping : model_info_json)
-        {
-            auto category = mapping["category"];
-            std::string category_str;
-            if (category != nullptr)
-            {
-                category_str = category;
-            }
-            jid_to_category_map[mapping["model_id"]] = category_str;
-        }
+        model_indices.push_back(AI3DFrontModelIndex::Get(furniture_directory));
     }
-    return jid_to_category_map;
+    return model_indices;
 }
 void AI3DFrontImporter::LoadMaterials(const std::vector<std::filesystem::path>& texture_directories, const nlohmann::json& scene_json,
                                       aiScene* pScene, std::unordered_map<std::string, uint32_t>& material_id_to_index_map,
@@ -424,12 +664,16 @@ void AI3DFrontImporter::LoadMaterials(const std::vector<std::filesystem::path>&
         }
     }
 }
-void AI3DFrontImporter::LoadMeshes(const nlohmann::json& scene_json,
+void AI3DFrontImporter::LoadMeshes(const nlohmann::json& scene_json, std::vector<MeshBuffers>& mesh_buffers,
                                    const std::unordered_map<std::string, uint32_t>& material_id_to_index_map,
                                    const std::vector<float>& material_uv_rotations, aiScene* pScene,
                                    std::unordered_map<std::string, std::vector<uint32_t>>& model_uid_to_mesh_indices_map)
 {
     const auto& room_meshes = scene_json["mesh"];
+    if (room_meshes.size() != mesh_buffers.size())
+    {
+        throw DeadlyImportError("Mesh data of the scene is malformed.");
+    }
     pScene->mNumMeshes = room_meshes.size();
     if (pScene->mNumMeshes > 0)
     {
@@ -440,7 +684,6 @@ void AI3DFrontImporter::LoadMeshes(const nlohmann::json& scene_json,
             pScene->mMeshes[mesh_index] = new aiMesh;
             auto& ai_mesh = pScene->mMeshes[mesh_index];
             ai_mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
-            ai_mesh->mNumUVComponents[0] = 2;
 
             auto material_index_iterator = material_id_to_index_map.find(std::string(raw_mesh["material"]));
             assert(material_index_iterator != material_id_to_index_map.end());
@@ -448,9 +691,12 @@ void AI3DFrontImporter::LoadMeshes(const nlohmann::json& scene_json,
 
             aiMaterial* material = pScene->mMaterials[ai_mesh->mMaterialIndex];
             aiUVTransform ai_uv_transform;
-            if (material->Get(AI_MATKEY_UVTRANSFORM_DIFFUSE(0), ai_uv_transform) == AI_SUCCESS)
+            bool has_uv_transform = material->Get(AI_MATKEY_UVTRANSFORM_DIFFUSE(0), ai_uv_transform) == AI_SUCCESS;
+            aiMatrix3x3 uv_rotation_matrix;
+            if (has_uv_transform)
             {
                 ai_uv_transform.mRotation = material_uv_rotations[ai_mesh->mMaterialIndex];
+                aiMatrix3x3::RotationZ(ai_uv_transform.mRotation, uv_rotation_matrix);
             }
             auto obj_type = std::string(raw_mesh["type"]);
             std::transform(obj_type.begin(), obj_type.end(), obj_type.begin(),
@@ -470,100 +716,66 @@ void AI3DFrontImporter::LoadMeshes(const nlohmann::json& scene_json,
             }
             material->AddProperty(&category_id, 1, AI_MATKEY_CATEGORY_ID);
 
-            // parse vertices, normals and tex coords
-            const auto& raw_vertices = raw_mesh["xyz"];
-            ai_mesh->mNumVertices = raw_vertices.size() / 3;
+            // copy vertices, normals and tex coords
+            auto& buffers = mesh_buffers[mesh_index];
+            ai_mesh->mNumVertices = buffers.xyz.size() / 3;
             if (ai_mesh->mNumVertices > 0)
             {
-                const auto& raw_normals = raw_mesh["normal"];
-                const auto& raw_tex_coords = raw_mesh["uv"];
-
                 ai_mesh->mVertices = new aiVector3D[ai_mesh->mNumVertices];
-                ai_mesh->mNormals = new aiVector3D[ai_mesh->mNumVertices];
-                ai_mesh->mTextureCoords[0] = new aiVector3D[ai_mesh->mNumVertices];
-                for (int i = 0; i < ai_mesh->mNumVertices; i++)
+                for (uint32_t i = 0; i < ai_mesh->mNumVertices; i++)
                 {
-                    int x_index = i * 3;
-                    int y_index = x_index + 1;
-                    int z_index = x_index + 2;
-                    int u_index = i * 2;
-                    int v_index = u_index + 1;
-
-                    // sometimes vertex data is stored as string instead of floats in the json
-                    if (raw_vertices[x_index].is_string())
-                    {
-                        ai_mesh->mVertices[i] = aiVector3D(
-                            std::stof(std::string(raw_vertices[x_index])),
-                            std::stof(std::string(raw_vertices[y_index])),
-                            std::stof(std::string(raw_vertices[z_index]))
-                        );
-                    }
-                    else
-                    {
-                        ai_mesh->mVertices[i] = aiVector3D(raw_vertices[x_index], raw_vertices[y_index], raw_vertices[z_index]);
-                    }
-                    if (raw_normals[x_index].is_string())
-                    {
-                        ai_mesh->mNormals[i] = aiVector3D(
-                            std::stof(std::string(raw_normals[x_index])),
-                            std::stof(std::string(raw_normals[y_index])),
-                            std::stof(std::string(raw_normals[z_index]))
-                        );
-                    }
-                    else
-                    {
-                        ai_mesh->mNormals[i] = aiVector3D(raw_normals[x_index], raw_normals[y_index], raw_normals[z_index]);
-                    }
-                    if (raw_tex_coords[u_index].is_string())
-                    {
-                        ai_mesh->mTextureCoords[0][i] = aiVector3D(
-                            std::stof(std::string(raw_normals[u_index])),
-                            std::stof(std::string(raw_tex_coords[v_index])),
-                            0
-                        );
-                    }
-                    else
+                    const float* xyz = &buffers.xyz[i * 3];
+                    // small offset to prevent z-fighting with objects on the floor
+                    ai_mesh->mVertices[i] = aiVector3D(xyz[0], xyz[1] + 0.0001f, xyz[2]);
+                }
+                if (buffers.normal.size() >= ai_mesh->mNumVertices * 3)
+                {
+                    ai_mesh->mNormals = new aiVector3D[ai_mesh->mNumVertices];
+                    for (uint32_t i = 0; i < ai_mesh->mNumVertices; i++)
                     {
-                        ai_mesh->mTextureCoords[0][i] = aiVector3D(raw_tex_coords[u_index], raw_tex_coords[v_index], 0);
+                        const float* normal = &buffers.normal[i * 3];
+                        ai_mesh->mNormals[i] = aiVector3D(normal[0], normal[1], normal[2]);
                     }
-                    // small offset to prevent z-fighting with objects on the floor
-                    ai_mesh->mVertices[i].y += 0.0001;
-
-                    // transform uv coords based on material
-                    if (material->Get(AI_MATKEY_UVTRANSFORM_DIFFUSE(0), ai_uv_transform) == AI_SUCCESS)
+                }
+                if (buffers.uv.size() >= ai_mesh->mNumVertices * 2)
+                {
+                    ai_mesh->mNumUVComponents[0] = 2;
+                    ai_mesh->mTextureCoords[0] = new aiVector3D[ai_mesh->mNumVertices];
+                    for (uint32_t i = 0; i < ai_mesh->mNumVertices; i++)
                     {
                         auto& tex_coord = ai_mesh->mTextureCoords[0][i];
-                        tex_coord.x *= ai_uv_transform.mScaling.x;
-                        tex_coord.y *= ai_uv_transform.mScaling.y;
-                        aiMatrix3x3 rotation_matrix;
-                        aiMatrix3x3::RotationZ(ai_uv_transform.mRotation, rotation_matrix);
-                        tex_coord = rotation_matrix * tex_coord;
-                        tex_coord.x += ai_uv_transform.mTranslation.x;
-                        tex_coord.y += ai_uv_transform.mTranslation.y;
+                        tex_coord = aiVector3D(buffers.uv[i * 2], buffers.uv[i * 2 + 1], 0);
+
+                        // transform uv coords based on material
+                        if (has_uv_transform)
+                        {
+                            tex_coord.x *= ai_uv_transform.mScaling.x;
+                            tex_coord.y *= ai_uv_transform.mScaling.y;
+                            tex_coord = uv_rotation_matrix * tex_coord;
+                            tex_coord.x += ai_uv_transform.mTranslation.x;
+                            tex_coord.y += ai_uv_transform.mTranslation.y;
+                        }
                     }
                 }
             }
-            // parse indices
-            const auto& raw_indices = raw_mesh["faces"];
-            ai_mesh->mNumFaces = raw_indices.size() / 3;
+            // copy indices
+            ai_mesh->mNumFaces = buffers.faces.size() / 3;
             if (ai_mesh->mNumFaces > 0)
             {
                 ai_mesh->mFaces = new aiFace[ai_mesh->mNumFaces];
-                for (int i = 0; i < ai_mesh->mNumFaces; i++)
+                for (uint32_t i = 0; i < ai_mesh->mNumFaces; i++)
                 {
-                    int index_0 = i * 3;
-                    int index_1 = index_0 + 1;
-                    int index_2 = index_0 + 2;
-
-                    ai_mesh->mFaces[i] = aiFace();
+                    const uint32_t* indices = &buffers.faces[i * 3];
                     auto& face = ai_mesh->mFaces[i];
                     face.mNumIndices = 3;
                     face.mIndices = new unsigned int[3];
-                    face.mIndices[0] = raw_indices[index_2];
-                    face.mIndices[1] = raw_indices[index_1];
-                    face.mIndices[2] = raw_indices[index_0];
+                    face.mIndices[0] = indices[2];
+                    face.mIndices[1] = indices[1];
+                    face.mIndices[2] = indices[0];
                 }
             }
+            // the decoded data is released as soon as it is copied to keep the peak memory low
+            buffers = MeshBuffers();
             model_uid_to_mesh_indices_map[raw_mesh["uid"]].push_back(mesh_index++);
         }
     }
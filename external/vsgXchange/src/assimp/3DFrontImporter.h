@@ -1,6 +1,8 @@
 #pragma once
 #include <assimp/BaseImporter.h>
 
+#include "3DFrontModelIndex.h"
+
 #include <nlohmann/json.hpp>
 
 #include <string>
@@ -23,15 +25,20 @@ public:
     
     bool CanRead(const std::string& pFile, Assimp::IOSystem* pIOHandler, bool checkSig) const override;
     const aiImporterDesc* GetInfo() const override;
+    struct FurnitureModel;
+    struct MeshBuffers;
 protected:
     void InternReadFile(const std::string& pFile, aiScene* pScene, Assimp::IOSystem* pIOHandler) override;
 private:
     void FindDataDirectories(const std::string& file_path, std::vector<std::filesystem::path>& texture_directories,
                              std::vector<std::filesystem::path>& furniture_directories);
-    std::unordered_map<std::string, std::string> LoadJidToCategoryMap(const std::vector<std::filesystem::path>& furniture_directories);
+    std::vector<std::shared_ptr<const AI3DFrontModelIndex>> LoadModelIndices(const std::vector<std::filesystem::path>& furniture_directories);
+    std::unordered_map<std::string, FurnitureModel> LoadFurnitureModels(const nlohmann::json& furniture,
+                                                                        const std::vector<std::shared_ptr<const AI3DFrontModelIndex>>& model_indices);
     void LoadMaterials(const std::vector<std::filesystem::path>& texture_directories, const nlohmann::json& scene_json, aiScene* pScene,
                        std::unordered_map<std::string, uint32_t>& material_id_to_index_map, std::vector<float>& material_uv_rotations);
-    void LoadMeshes(const nlohmann::json& scene_json, const std::unordered_map<std::string, uint32_t>& material_id_to_index_map,
+    void LoadMeshes(const nlohmann::json& scene_json, std::vector<MeshBuffers>& mesh_buffers,
+                    const std::unordered_map<std::string, uint32_t>& material_id_to_index_map,
                     const std::vector<float>& material_uv_rotations, aiScene* pScene,
                     std::unordered_map<std::string, std::vector<uint32_t>>& model_uid_to_mesh_indices_map);
 
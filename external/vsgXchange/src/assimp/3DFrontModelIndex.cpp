@@ -0,0 +1,268 @@
+#include "3DFrontModelIndex.h"
+
+#include <assimp/Exceptional.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+struct AI3DFrontModelIndex::Header
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_time;
+    uint32_t entry_count;
+    uint32_t strings_size;
+};
+struct AI3DFrontModelIndex::IndexEntry
+{
+    uint32_t jid_offset;
+    uint32_t jid_length;
+    uint32_t category_offset;
+    uint32_t category_length;
+};
+
+static const char index_magic[4] = {'3', 'D', 'F', 'I'};
+static const uint32_t index_version = 2;
+
+std::shared_ptr<const AI3DFrontModelIndex> AI3DFrontModelIndex::Get(const fs::path& furniture_directory)
+{
+    // indices stay loaded for the following scenes of the process
+    static std::mutex indices_mutex;
+    static std::unordered_map<std::string, std::shared_ptr<const AI3DFrontModelIndex>> indices;
+    std::lock_guard<std::mutex> lock(indices_mutex);
+    auto& index = indices[fs::absolute(furniture_directory).string()];
+    if (!index)
+    {
+        index = std::make_shared<AI3DFrontModelIndex>(furniture_directory);
+    }
+    return index;
+}
+
+AI3DFrontModelIndex::AI3DFrontModelIndex(const fs::path& furniture_directory) :
+    directory(furniture_directory)
+{
+    fs::path model_info_path = furniture_directory / fs::path("model_info.json");
+    fs::path index_path = furniture_directory / fs::path("model_info.index");
+    std::error_code error_code;
+    uint64_t source_size = fs::file_size(model_info_path, error_code);
+    if (error_code)
+    {
+        throw DeadlyImportError("Failed to open file " + model_info_path.string() + ".");
+    }
+    int64_t source_time = fs::last_write_time(model_info_path, error_code).time_since_epoch().count();
+
+    if (Map(index_path, source_size, source_time))
+    {
+        return;
+    }
+    memory = Build(model_info_path, source_size, source_time);
+    // written to a temporary file first, so that concurrent loads never map a partial index
+    fs::path temporary_path = index_path;
+#ifdef _WIN32
+    temporary_path += ".tmp" + std::to_string(GetCurrentProcessId());
+#else
+    temporary_path += ".tmp" + std::to_string(getpid());
+#endif
+    {
+        std::ofstream index_file(temporary_path, std::ios::binary);
+        if (index_file)
+        {
+            index_file.write(memory.data(), static_cast<std::streamsize>(memory.size()));
+        }
+    }
+    fs::rename(temporary_path, index_path, error_code);
+    if (error_code)
+    {
+        fs::remove(temporary_path, error_code);
+    }
+    data = memory.data();
+    data_size = memory.size();
+}
+
+AI3DFrontModelIndex::~AI3DFrontModelIndex()
+{
+    Unmap();
+}
+
+bool AI3DFrontModelIndex::Find(std::string_view jid, Entry& entry) const
+{
+    const auto* header = reinterpret_cast<const Header*>(data);
+    const auto* entries = reinterpret_cast<const IndexEntry*>(data + sizeof(Header));
+    const char* strings = data + sizeof(Header) + header->entry_count * sizeof(IndexEntry);
+    auto jid_of = [strings](const IndexEntry& index_entry)
+    {
+        return std::string_view(strings + index_entry.jid_offset, index_entry.jid_length);
+    };
+    const auto* end = entries + header->entry_count;
+    const auto* iterator = std::lower_bound(entries, end, jid,
+                                            [&](const IndexEntry& index_entry, std::string_view value) { return jid_of(index_entry) < value; });
+    if (iterator == end || jid_of(*iterator) != jid)
+    {
+        return false;
+    }
+    entry.category = std::string_view(strings + iterator->category_offset, iterator->category_length);
+    return true;
+}
+
+std::vector<char> AI3DFrontModelIndex::Build(const fs::path& model_info_path, uint64_t source_size, int64_t source_time)
+{
+    std::ifstream model_info_file(model_info_path.string());
+    if (!model_info_file)
+    {
+        throw DeadlyImportError("Failed to open file " + model_info_path.string() + ".");
+    }
+    nlohmann::json model_info_json;
+    model_info_file >> model_info_json;
+
+    // later entries of a jid replace earlier ones, as with the map built from the json before
+    std::unordered_map<std::string, std::string> jid_to_category_map;
+    for (const auto& mapping : model_info_json)
+    {
+        auto category = mapping["category"];
+        std::string category_str;
+        if (category != nullptr)
+        {
+            category_str = category;
+        }
+        jid_to_category_map[mapping["model_id"]] = category_str;
+    }
+    std::vector<std::pair<std::string, std::string>> sorted(jid_to_category_map.begin(), jid_to_category_map.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    // equal categories are stored once
+    std::vector<IndexEntry> entries;
+    std::string strings;
+    std::unordered_map<std::string, uint32_t> category_offsets;
+    for (const auto& [jid, category] : sorted)
+    {
+        IndexEntry entry{};
+        entry.jid_offset = static_cast<uint32_t>(strings.size());
+        entry.jid_length = static_cast<uint32_t>(jid.size());
+        strings += jid;
+        auto [category_iterator, inserted] = category_offsets.emplace(category, static_cast<uint32_t>(strings.size()));
+        if (inserted)
+        {
+            strings += category;
+        }
+        entry.category_offset = category_iterator->second;
+        entry.category_length = static_cast<uint32_t>(category.size());
+        entries.push_back(entry);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, index_magic, sizeof(index_magic));
+    header.version = index_version;
+    header.source_size = source_size;
+    header.source_time = source_time;
+    header.entry_count = static_cast<uint32_t>(entries.size());
+    header.strings_size = static_cast<uint32_t>(strings.size());
+
+    std::vector<char> index(sizeof(Header) + entries.size() * sizeof(IndexEntry) + strings.size());
+    std::memcpy(index.data(), &header, sizeof(Header));
+    std::memcpy(index.data() + sizeof(Header), entries.data(), entries.size() * sizeof(IndexEntry));
+    std::memcpy(index.data() + sizeof(Header) + entries.size() * sizeof(IndexEntry), strings.data(), strings.size());
+    return index;
+}
+
+bool AI3DFrontModelIndex::Map(const fs::path& index_path, uint64_t source_size, int64_t source_time)
+{
+#ifdef _WIN32
+    file_handle = CreateFileW(index_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        file_handle = nullptr;
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart < static_cast<LONGLONG>(sizeof(Header)))
+    {
+        Unmap();
+        return false;
+    }
+    mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_handle)
+    {
+        Unmap();
+        return false;
+    }
+    data = static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    data_size = static_cast<size_t>(file_size.QuadPart);
+#else
+    int file = open(index_path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(file, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(sizeof(Header)))
+    {
+        close(file);
+        return false;
+    }
+    void* mapped = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, file, 0);
+    close(file);
+    if (mapped == MAP_FAILED)
+    {
+        return false;
+    }
+    data = static_cast<const char*>(mapped);
+    data_size = static_cast<size_t>(file_stat.st_size);
+#endif
+    if (!data)
+    {
+        Unmap();
+        return false;
+    }
+
+    // outdated or broken indices are rebuilt
+    const auto* header = reinterpret_cast<const Header*>(data);
+    uint64_t expected_size = sizeof(Header) + uint64_t(header->entry_count) * sizeof(IndexEntry) + header->strings_size;
+    if (std::memcmp(header->magic, index_magic, sizeof(index_magic)) != 0 || header->version != index_version ||
+        header->source_size != source_size || header->source_time != source_time || expected_size != data_size)
+    {
+        Unmap();
+        return false;
+    }
+    return true;
+}
+
+void AI3DFrontModelIndex::Unmap()
+{
+    if (!memory.empty())
+    {
+        memory.clear();
+        data = nullptr;
+        data_size = 0;
+        return;
+    }
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mapping_handle) CloseHandle(mapping_handle);
+    if (file_handle) CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    if (data) munmap(const_cast<char*>(data), data_size);
+#endif
+    data = nullptr;
+    data_size = 0;
+}
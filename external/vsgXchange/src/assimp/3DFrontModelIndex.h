@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Compact index of the model_info.json of a 3D-FUTURE-model directory.
+ *
+ * model_info.json is the same for all scenes of the data set, so it is parsed once and stored as a sorted binary
+ * table next to it (model_info.index). Later loads map the file and look models up by binary search.
+ * The index is rebuilt when the size or modification time of model_info.json changes. If the directory is not
+ * writable the index is only kept in memory. Whether the directory of a model exists is not part of the index, models
+ * may be extracted after it was built.
+ */
+class AI3DFrontModelIndex
+{
+public:
+    struct Entry
+    {
+        std::string_view category;
+    };
+
+    // returns the shared index of the furniture directory, building it if needed. Throws DeadlyImportError
+    // if model_info.json can not be read
+    static std::shared_ptr<const AI3DFrontModelIndex> Get(const std::filesystem::path& furniture_directory);
+
+    explicit AI3DFrontModelIndex(const std::filesystem::path& furniture_directory);
+    ~AI3DFrontModelIndex();
+    AI3DFrontModelIndex(const AI3DFrontModelIndex&) = delete;
+    AI3DFrontModelIndex& operator=(const AI3DFrontModelIndex&) = delete;
+
+    bool Find(std::string_view jid, Entry& entry) const;
+    const std::filesystem::path& GetDirectory() const { return directory; }
+
+private:
+    struct Header;
+    struct IndexEntry;
+
+    static std::vector<char> Build(const std::filesystem::path& model_info_path, uint64_t source_size, int64_t source_time);
+    bool Map(const std::filesystem::path& index_path, uint64_t source_size, int64_t source_time);
+    void Unmap();
+
+    std::filesystem::path directory;
+    // either the mapped index file or the index built in memory
+    const char* data = nullptr;
+    size_t data_size = 0;
+    std::vector<char> memory;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+};
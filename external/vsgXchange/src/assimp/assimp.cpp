@@ -18,9 +18,11 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 #include "assimp_phong.h"
 #include "assimp_vertex.h"
 
+#include <algorithm>
 #include <cmath>
 #include <sstream>
 #include <stack>
+#include <thread>
 
 #include <vsg/all.h>
 
@@ -119,6 +121,11 @@ namespace
     static auto kBlackData = createTexture(kBlackColor);
     static auto kNormalData = createTexture(kNormalColor);
 
+    // texture types that are read by processMaterials()
+    const std::array<aiTextureType, 7> kMaterialTextureTypes{
+        aiTextureType_DIFFUSE, aiTextureType_EMISSIVE, aiTextureType_LIGHTMAP, aiTextureType_AMBIENT,
+        aiTextureType_NORMALS, aiTextureType_UNKNOWN, aiTextureType_SPECULAR};
+
 } // namespace
 
 using namespace vsgXchange;
@@ -136,11 +143,14 @@ private:
     using StateCommandPtr = vsg::ref_ptr<vsg::StateCommand>;
     using State = std::pair<StateCommandPtr, StateCommandPtr>;
     using BindState = std::vector<State>;
+    // decoded textures by their path in the materials, shared by all materials using the same file
+    using TextureCache = std::map<std::string, vsg::ref_ptr<vsg::Data>>;
 
     vsg::ref_ptr<vsg::GraphicsPipeline> createPipeline(vsg::ref_ptr<vsg::ShaderStage> vs, vsg::ref_ptr<vsg::ShaderStage> fs, vsg::ref_ptr<vsg::DescriptorSetLayout> descriptorSetLayout, bool doubleSided = false, bool enableBlend = false) const;
     void createDefaultPipelineAndState();
     vsg::ref_ptr<vsg::Object> processScene(const aiScene* scene, vsg::ref_ptr<const vsg::Options> options, const vsg::Path& ext) const;
     BindState processMaterials(const aiScene* scene, vsg::ref_ptr<const vsg::Options> options) const;
+    TextureCache loadTextures(const aiScene* scene, vsg::ref_ptr<const vsg::Options> options) const;
 
     VkSamplerAddressMode getWrapMode(aiTextureMapMode mode) const
     {
@@ -155,7 +165,7 @@ private:
         return VK_SAMPLER_ADDRESS_MODE_REPEAT;
     }
 
-    SamplerData getTexture(const aiScene* scene, vsg::ref_ptr<const vsg::Options> options, aiMaterial& material, aiTextureType type, std::vector<std::string>& defines) const
+    SamplerData getTexture(const aiScene* scene, vsg::ref_ptr<const vsg::Options> options, TextureCache& textures, aiMaterial& material, aiTextureType type, std::vector<std::string>& defines) const
     {
         aiString texPath;
         std::array<aiTextureMapMode, 3> wrapMode{{aiTextureMapMode_Wrap, aiTextureMapMode_Wrap, aiTextureMapMode_Wrap}};
@@ -173,21 +183,24 @@ private:
 
                 if (texture->mWidth > 0 && texture->mHeight == 0)
                 {
-                    auto imageOptions = vsg::Options::create(*options);
-                    imageOptions->extensionHint = texture->achFormatHint;
-                    if (samplerImage.data = vsg::read_cast<vsg::Data>(reinterpret_cast<const uint8_t*>(texture->pcData), texture->mWidth, imageOptions); !samplerImage.data.valid())
+                    auto& data = textures[texPath.C_Str()];
+                    if (!data)
+                    {
+                        auto imageOptions = vsg::Options::create(*options);
+                        imageOptions->extensionHint = texture->achFormatHint;
+                        data = vsg::read_cast<vsg::Data>(reinterpret_cast<const uint8_t*>(texture->pcData), texture->mWidth, imageOptions);
+                    }
+                    if (samplerImage.data = data; !samplerImage.data.valid())
                         return {};
                 }
             }
             else
             {
-                const std::string filename = vsg::findFile(texPath.C_Str(), options);
-
-                if (samplerImage.data = vsg::read_cast<vsg::Data>(filename, options); !samplerImage.data.valid())
-                {
-                    std::cerr << "Failed to load texture: " << filename << " texPath = " << texPath.C_Str() << std::endl;
+                // external textures are decoded up front by loadTextures(), failures are reported there
+                if (auto itr = textures.find(texPath.C_Str()); itr != textures.end())
+                    samplerImage.data = itr->second;
+                if (!samplerImage.data.valid())
                     return {};
-                }
             }
 
             switch (type)
@@ -530,11 +543,55 @@ vsg::ref_ptr<vsg::Object> assimp::Implementation::processScene(const aiScene* sc
 
 }
 
+assimp::Implementation::TextureCache assimp::Implementation::loadTextures(const aiScene* scene, vsg::ref_ptr<const vsg::Options> options) const
+{
+    // collect the unique files of all materials
+    TextureCache textures;
+    std::map<std::string, std::string> texPathToFilename;
+    vsg::Paths filenames;
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    {
+        const auto material = scene->mMaterials[i];
+        for (auto type : kMaterialTextureTypes)
+        {
+            aiString texPath;
+            if (material->GetTexture(type, 0, &texPath) != AI_SUCCESS || texPath.data[0] == '*' || texPathToFilename.count(texPath.C_Str()))
+                continue;
+
+            const std::string filename = vsg::findFile(texPath.C_Str(), options);
+            texPathToFilename[texPath.C_Str()] = filename;
+            if (!filename.empty())
+                filenames.push_back(filename);
+        }
+    }
+    std::sort(filenames.begin(), filenames.end());
+    filenames.erase(std::unique(filenames.begin(), filenames.end()), filenames.end());
+
+    // decode them in parallel, vsg::read() uses the operation threads of the options
+    auto readOptions = vsg::Options::create(*options);
+    if (!readOptions->operationThreads)
+        readOptions->operationThreads = vsg::OperationThreads::create(std::max(1u, std::thread::hardware_concurrency()));
+    auto objects = vsg::read(filenames, readOptions);
+
+    for (const auto& [texPath, filename] : texPathToFilename)
+    {
+        vsg::ref_ptr<vsg::Data> data;
+        if (auto itr = objects.find(filename); itr != objects.end())
+            data = itr->second.cast<vsg::Data>();
+        if (!data)
+            std::cerr << "Failed to load texture: " << filename << " texPath = " << texPath << std::endl;
+        textures[texPath] = data;
+    }
+    return textures;
+}
+
 assimp::Implementation::BindState assimp::Implementation::processMaterials(const aiScene* scene, vsg::ref_ptr<const vsg::Options> options) const
 {
     BindState bindDescriptorSets;
     bindDescriptorSets.reserve(scene->mNumMaterials);
 
+    auto textures = loadTextures(scene, options);
+
     for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
     {
         const auto material = scene->mMaterials[i];
@@ -589,42 +646,42 @@ assimp::Implementation::BindState assimp::Implementation::processMaterials(const
             descList.push_back(buffer);
 
             SamplerData samplerImage;
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_DIFFUSE, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_DIFFUSE, defines); samplerImage.data.valid())
             {
                 auto diffuseTexture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(diffuseTexture);
                 descriptorBindings.push_back({0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
             }
 
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_EMISSIVE, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_EMISSIVE, defines); samplerImage.data.valid())
             {
                 auto emissiveTexture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 4, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(emissiveTexture);
                 descriptorBindings.push_back({4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
             }
 
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_LIGHTMAP, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_LIGHTMAP, defines); samplerImage.data.valid())
             {
                 auto aoTexture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 3, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(aoTexture);
                 descriptorBindings.push_back({3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
             }
 
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_NORMALS, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_NORMALS, defines); samplerImage.data.valid())
             {
                 auto normalTexture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 2, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(normalTexture);
                 descriptorBindings.push_back({2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
             }
 
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_UNKNOWN, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_UNKNOWN, defines); samplerImage.data.valid())
             {
                 auto mrTexture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 1, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(mrTexture);
                 descriptorBindings.push_back({1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
             }
 
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_SPECULAR, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_SPECULAR, defines); samplerImage.data.valid())
             {
                 auto texture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 5, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(texture);
@@ -694,7 +751,7 @@ assimp::Implementation::BindState assimp::Implementation::processMaterials(const
             vsg::Descriptors descList;
 
             SamplerData samplerImage;
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_DIFFUSE, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_DIFFUSE, defines); samplerImage.data.valid())
             {
                 auto diffuseTexture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(diffuseTexture);
@@ -704,7 +761,7 @@ assimp::Implementation::BindState assimp::Implementation::processMaterials(const
                     mat.diffuse.set(1.0f, 1.0f, 1.0f, 1.0f);
             }
 
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_EMISSIVE, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_EMISSIVE, defines); samplerImage.data.valid())
             {
                 auto emissiveTexture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 4, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(emissiveTexture);
@@ -714,27 +771,27 @@ assimp::Implementation::BindState assimp::Implementation::processMaterials(const
                     mat.emissive.set(1.0f, 1.0f, 1.0f, 1.0f);
             }
 
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_LIGHTMAP, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_LIGHTMAP, defines); samplerImage.data.valid())
             {
                 auto aoTexture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 3, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(aoTexture);
                 descriptorBindings.push_back({3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
             }
-            else if (samplerImage = getTexture(scene, options, *material, aiTextureType_AMBIENT, defines); samplerImage.data.valid())
+            else if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_AMBIENT, defines); samplerImage.data.valid())
             {
                 auto texture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 3, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(texture);
                 descriptorBindings.push_back({3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
             }
 
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_NORMALS, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_NORMALS, defines); samplerImage.data.valid())
             {
                 auto normalTexture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 2, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(normalTexture);
                 descriptorBindings.push_back({2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr});
             }
 
-            if (samplerImage = getTexture(scene, options, *material, aiTextureType_SPECULAR, defines); samplerImage.data.valid())
+            if (samplerImage = getTexture(scene, options, textures, *material, aiTextureType_SPECULAR, defines); samplerImage.data.valid())
             {
                 auto texture = vsg::DescriptorImage::create(samplerImage.sampler, samplerImage.data, 5, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
                 descList.push_back(texture);
@@ -10,113 +10,294 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 
 </editor-fold> */
 
+
 #include <vsgXchange/volumes.h>
 #include <vsg/all.h>
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
 
-using namespace vsgXchange;
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
 
-xyz::xyz(bool use16bit) : use16bit(use16bit) {}
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-bool xyz::getFeatures(Features& features) const
-{
-    features.extensionFeatureMap["xyz"] = static_cast<vsg::ReaderWriter::FeatureMask>(vsg::ReaderWriter::READ_FILENAME | vsg::ReaderWriter::READ_ISTREAM);
-    return true;
-}
+using namespace vsgXchange;
 
-vsg::ref_ptr<vsg::Object> xyz::read(const vsg::Path& filename, vsg::ref_ptr<const vsg::Options> options) const
+namespace
 {
-    vsg::Path filenameToUse = vsg::findFile(filename, options);
-    std::ifstream file(filenameToUse, std::ifstream::in | std::ifstream::binary);
-    return xyz::read(file, options);
-}
+    // 3 uint32 voxel counts followed by 3 double voxel sizes, the floats follow with z changing fastest
+    const size_t headerSize = 3 * sizeof(uint32_t) + 3 * sizeof(double);
+    // edge length of the tiles in which the y/z swap transposes the voxels
+    const uint32_t tileSize = 32;
 
-uint32_t floatToBits(float f)
-{
-    uint32_t ret;
-    std::memcpy(&ret, &f, sizeof(float));
-    return ret;
-}
+    uint16_t floatToHalf(float f)
+    {
+        // round to nearest even, subnormal halfs are kept
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(float));
+        uint16_t sign = (bits >> 16) & 0x8000;
+        bits &= 0x7FFFFFFF;
+        if (bits >= 0x7F800000) return sign | 0x7C00 | (bits > 0x7F800000 ? 0x200 : 0); // inf, nan
+        if (bits >= 0x477FF000) return sign | 0x7C00;                                      // rounds to inf
+        if (bits < 0x38800000)
+        {
+            if (bits < 0x33000000) return sign; // rounds to zero
+            uint32_t shift = 126 - (bits >> 23);
+            uint32_t mantissa = (bits & 0x7FFFFF) | 0x800000;
+            uint32_t half = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+            half += remainder > halfway || (remainder == halfway && (half & 1));
+            return sign | half;
+        }
+        uint32_t half = (bits >> 13) - (112u << 10);
+        uint32_t remainder = bits & 0x1FFF;
+        half += remainder > 0x1000 || (remainder == 0x1000 && (half & 1)); // a carry moves into the exponent
+        return sign | half;
+    }
 
-uint16_t floatToHalf(float f)
-{
-    auto bits = floatToBits(f);
-    uint16_t sign = (bits >> 16) & 0x8000;
-    int exp = int((bits >> 23) & 0xFF) - 127;
-    uint16_t m = (bits >> 13) & 0x3FF; // FIXME: inaccurate, always rounds down
-    uint16_t expb = uint16_t(exp + 15) << 10;
-    if (exp > 15) { m = 0; expb = 31; } // inf
-    if (exp < -14) { m = 0; expb = 0; } // subnormal -> zero
-    return sign | expb | m;
-}
+    void floatsToHalfs(const float* source, uint16_t* target, size_t count)
+    {
+        size_t i = 0;
+#if defined(__F16C__)
+        for (; i + 8 <= count; i += 8)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + i), _mm256_cvtps_ph(_mm256_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+        for (; i < count; ++i)
+            target[i] = floatToHalf(source[i]);
+    }
 
-vsg::ref_ptr<vsg::Object> xyz::read(std::istream& fin, vsg::ref_ptr<const vsg::Options> options) const
-{
-    uint32_t sizeX, sizeY, sizeZ;
-    double voxelSizeX, voxelSizeY, voxelSizeZ;
+    // read only mapping of a whole file, data stays null if the file can not be mapped
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const vsg::Path& filename)
+        {
+#ifdef _WIN32
+            file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            LARGE_INTEGER fileSize;
+            if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping) return;
+            data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            size = static_cast<size_t>(fileSize.QuadPart);
+#else
+            int file = open(filename.c_str(), O_RDONLY);
+            if (file < 0) return;
+            struct stat fileStat;
+            if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+            {
+                void* mapped = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+                if (mapped != MAP_FAILED)
+                {
+                    data = static_cast<const char*>(mapped);
+                    size = static_cast<size_t>(fileStat.st_size);
+                    madvise(mapped, size, MADV_SEQUENTIAL);
+                }
+            }
+            close(file);
+#endif
+        }
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if (data) UnmapViewOfFile(data);
+            if (mapping) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+            if (data) munmap(const_cast<char*>(data), size);
+#endif
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
 
-    fin.read(reinterpret_cast<char*>(&sizeX), sizeof(uint32_t));
-    fin.read(reinterpret_cast<char*>(&sizeY), sizeof(uint32_t));
-    fin.read(reinterpret_cast<char*>(&sizeZ), sizeof(uint32_t));
+        const char* data = nullptr;
+        size_t size = 0;
 
-    fin.read(reinterpret_cast<char*>(&voxelSizeX), sizeof(double));
-    fin.read(reinterpret_cast<char*>(&voxelSizeY), sizeof(double));
-    fin.read(reinterpret_cast<char*>(&voxelSizeZ), sizeof(double));
+    private:
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+    };
 
-    std::vector<float> raw_data(static_cast<size_t>(sizeX * sizeY * sizeZ), 0.0f);
-    fin.read(reinterpret_cast<char *>(raw_data.data()), sizeof(float) * raw_data.size());
+    class RangeOperation : public vsg::Inherit<vsg::Operation, RangeOperation>
+    {
+    public:
+        RangeOperation(std::function<void()> function, vsg::ref_ptr<vsg::Latch> latch) :
+            function(std::move(function)), latch(latch) {}
 
-    // swap y/z to convert coordinate systems
-    auto data = vsg::floatArray3D::create(sizeX, sizeZ, sizeY, vsg::Data::Layout{ VK_FORMAT_R32_SFLOAT });
-    size_t i = 0;
-    float maxVal = 0;
+        void run() override
+        {
+            function();
+            latch->count_down();
+        }
+
+    private:
+        std::function<void()> function;
+        vsg::ref_ptr<vsg::Latch> latch;
+    };
 
-    // rearrange axes
-    for (uint32_t x = 0; x < sizeX; x++)
+    // calls function(begin, end) for about equally sized parts of [0, count) on all cores
+    void parallelFor(size_t count, const std::function<void(size_t, size_t)>& function)
     {
-        for (uint32_t y = 0; y < sizeY; y++)
+        uint32_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+        size_t partCount = std::min<size_t>(count, numThreads * 4);
+        if (partCount <= 1)
         {
-            for (uint32_t z = 0; z < sizeZ; z++)
-            {
-                float d = raw_data[i++];
-                // swap y/z again
-                data->at(x, z, y) = d;
-                if (d > maxVal) maxVal = d;
-            }
+            function(0, count);
+            return;
         }
+        auto threads = vsg::OperationThreads::create(numThreads - 1);
+        auto latch = vsg::Latch::create(static_cast<int>(partCount));
+        for (size_t part = 0; part < partCount; ++part)
+        {
+            size_t begin = count * part / partCount, end = count * (part + 1) / partCount;
+            threads->add(RangeOperation::create([&function, begin, end]() { function(begin, end); }, latch));
+        }
+        threads->run();
+        latch->wait();
     }
 
-    // normalize data
-    float rcpMaxVal = 1.0f / maxVal;
-    vsg::ref_ptr<vsg::ushortArray3D> data16;
-    if (use16bit) data16 = vsg::ushortArray3D::create(sizeX, sizeZ, sizeY, vsg::Data::Layout{ VK_FORMAT_R16_SFLOAT });
-    for (size_t j = 0; j < data->size(); j++)
+    vsg::ref_ptr<vsg::Object> createVolume(const char* file, size_t fileSize, bool use16bit)
     {
-        data->at(j) *= rcpMaxVal;
+        if (fileSize < headerSize)
+            return {};
+        uint32_t sizeX, sizeY, sizeZ;
+        double voxelSizeX, voxelSizeY, voxelSizeZ;
+        std::memcpy(&sizeX, file, sizeof(uint32_t));
+        std::memcpy(&sizeY, file + 4, sizeof(uint32_t));
+        std::memcpy(&sizeZ, file + 8, sizeof(uint32_t));
+        std::memcpy(&voxelSizeX, file + 12, sizeof(double));
+        std::memcpy(&voxelSizeY, file + 20, sizeof(double));
+        std::memcpy(&voxelSizeZ, file + 28, sizeof(double));
+        size_t voxelCount = size_t(sizeX) * sizeY * sizeZ;
+        if (voxelCount == 0 || fileSize < headerSize + voxelCount * sizeof(float))
+        {
+            std::cout << "Error: xyz::read(...) the file is smaller than its " << sizeX << "x" << sizeY << "x" << sizeZ << " voxels." << std::endl;
+            return {};
+        }
+        // the floats are only aligned when the mapping is, otherwise they are read with memcpy
+        const char* raw = file + headerSize;
+        auto rawAt = [raw](size_t index) {
+            float value;
+            std::memcpy(&value, raw + index * sizeof(float), sizeof(float));
+            return value;
+        };
+
+        // maximum for the normalization
+        std::vector<float> partMax(std::max(1u, std::thread::hardware_concurrency()) * 4, 0.0f);
+        std::atomic<size_t> partIndex{0};
+        parallelFor(voxelCount, [&](size_t begin, size_t end) {
+            float maxVal = 0;
+            for (size_t i = begin; i < end; ++i)
+                maxVal = std::max(maxVal, rawAt(i));
+            partMax[partIndex++] = maxVal;
+        });
+        float maxVal = *std::max_element(partMax.begin(), partMax.end());
+        float rcpMaxVal = maxVal > 0 ? 1.0f / maxVal : 1.0f;
+
+        // swap y/z to convert coordinate systems, each plane of the output is transposed in tiles, normalized and
+        // written straight into the final array
+        vsg::ref_ptr<vsg::floatArray3D> data;
+        vsg::ref_ptr<vsg::ushortArray3D> data16;
         if (use16bit)
-            data16->at(j) = floatToHalf(data->at(j));
+            data16 = vsg::ushortArray3D::create(sizeX, sizeZ, sizeY, vsg::Data::Layout{VK_FORMAT_R16_SFLOAT});
+        else
+            data = vsg::floatArray3D::create(sizeX, sizeZ, sizeY, vsg::Data::Layout{VK_FORMAT_R32_SFLOAT});
+        parallelFor(sizeY, [&](size_t yBegin, size_t yEnd) {
+            std::vector<float> tile(tileSize * tileSize);
+            for (size_t y = yBegin; y < yEnd; ++y)
+            {
+                for (uint32_t z0 = 0; z0 < sizeZ; z0 += tileSize)
+                {
+                    uint32_t zCount = std::min(tileSize, sizeZ - z0);
+                    for (uint32_t x0 = 0; x0 < sizeX; x0 += tileSize)
+                    {
+                        uint32_t xCount = std::min(tileSize, sizeX - x0);
+                        for (uint32_t x = 0; x < xCount; ++x)
+                        {
+                            size_t row = ((x0 + x) * size_t(sizeY) + y) * sizeZ + z0;
+                            for (uint32_t z = 0; z < zCount; ++z)
+                                tile[z * tileSize + x] = rawAt(row + z) * rcpMaxVal;
+                        }
+                        for (uint32_t z = 0; z < zCount; ++z)
+                        {
+                            size_t target = (y * sizeZ + z0 + z) * size_t(sizeX) + x0;
+                            if (use16bit)
+                                floatsToHalfs(&tile[z * tileSize], data16->data() + target, xCount);
+                            else
+                                std::memcpy(data->data() + target, &tile[z * tileSize], xCount * sizeof(float));
+                        }
+                    }
+                }
+            }
+        });
+
+        auto container = vsg::MatrixTransform::create();
+        auto vol = vsg::Volumetric::create();
+        if (use16bit)
+            vol->voxels = data16;
+        else
+            vol->voxels = data;
+        vol->box.minX = vol->box.minY = vol->box.minZ = 0;
+        vol->box.maxX = vol->box.maxY = vol->box.maxZ = 1.0f;
+
+        auto& mat = container->matrix;
+        // swap y/z here as well
+        mat(0, 0) = static_cast<float>(voxelSizeX * sizeX);
+        mat(1, 1) = static_cast<float>(voxelSizeZ * sizeZ);
+        mat(2, 2) = static_cast<float>(voxelSizeY * sizeY);
+        mat(3, 0) = -0.5f * mat(0, 0);
+        mat(3, 1) = -0.5f * mat(1, 1);
+        mat(3, 2) = -0.5f * mat(2, 2);
+
+        container->addChild(vol);
+        return container;
     }
+}
 
-    auto container = vsg::MatrixTransform::create();
-    auto vol = vsg::Volumetric::create();
-    if (use16bit)
-        vol->voxels = data16;
-    else
-        vol->voxels = data;
-    vol->box.minX = vol->box.minY = vol->box.minZ = 0;
-    vol->box.maxX = vol->box.maxY = vol->box.maxZ = 1.0f;
-
-    auto& mat = container->matrix;
-    // swap y/z here as well
-    mat(0, 0) = static_cast<float>(voxelSizeX * sizeX);
-    mat(1, 1) = static_cast<float>(voxelSizeZ * sizeZ);
-    mat(2, 2) = static_cast<float>(voxelSizeY * sizeY);
-    mat(3, 0) = -0.5f * mat(0, 0);
-    mat(3, 1) = -0.5f * mat(1, 1);
-    mat(3, 2) = -0.5f * mat(2, 2);
-
-    container->addChild(vol);
-    return container;
+xyz::xyz(bool use16bit) : use16bit(use16bit) {}
+
+bool xyz::getFeatures(Features& features) const
+{
+    features.extensionFeatureMap["xyz"] = static_cast<vsg::ReaderWriter::FeatureMask>(vsg::ReaderWriter::READ_FILENAME | vsg::ReaderWriter::READ_ISTREAM);
+    return true;
+}
+
+vsg::ref_ptr<vsg::Object> xyz::read(const vsg::Path& filename, vsg::ref_ptr<const vsg::Options> options) const
+{
+    vsg::Path filenameToUse = vsg::findFile(filename, options);
+    // the voxels are read from the mapped file, streams are the fallback
+    MappedFile mappedFile(filenameToUse);
+    if (mappedFile.data)
+        return createVolume(mappedFile.data, mappedFile.size, use16bit);
+    std::ifstream file(filenameToUse, std::ifstream::in | std::ifstream::binary);
+    if (!file)
+        return {};
+    return xyz::read(file, options);
+}
+
+vsg::ref_ptr<vsg::Object> xyz::read(std::istream& fin, vsg::ref_ptr<const vsg::Options> options) const
+{
+    std::vector<char> file;
+    char buffer[1 << 16];
+    while (fin.read(buffer, sizeof(buffer)) || fin.gcount() > 0)
+        file.insert(file.end(), buffer, buffer + fin.gcount());
+    return createVolume(file.data(), file.size(), use16bit);
 }
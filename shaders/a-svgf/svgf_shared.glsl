@@ -125,13 +125,19 @@ layout(constant_id=0) const int FILTER_KERNEL = 0;
 // for TemporalAccumulation
 layout(constant_id=1) const int CLOUD_SAMPLE_COUNT = 5;
 
-layout(push_constant) uniform PerImageCB {
+layout(set=0, binding=17) uniform PerFrameCB {
     mat4 mat_reproj; // VP-matrix times inverse of previous VP-matrix
+    uint reset_history; // the previous images belong to an older frame
+};
+
+layout(push_constant) uniform PerImageCB {
     int iteration;
     int step_size;
     int gradientDownsample;
     float temporal_alpha;
     int modulate_albedo;
+    int level_count;    // AtrousFused only
+    int history_level;  // AtrousFused only
 };
 
 layout (local_size_x=8, local_size_y=8, local_size_z=1) in;
@@ -20,4 +20,9 @@ void createRay(uvec2 pixelPos, uvec2 imSize, bool antiAlias,inout RandomEngine r
     dir = camParams.inverseViewMatrix * vec4(normalize(dir.xyz), 0) ;
 }
 
+// spread angle of the ray cones of primary rays, the angle covered by one pixel
+float pixelSpreadAngle(uint imHeight){
+    return atan(2.0 * abs(camParams.inverseProjectionMatrix[1][1]) / float(imHeight));
+}
+
 #endif //CAMERA_H
\ No newline at end of file
@@ -7,7 +7,7 @@ uvec3 unpackIndex(uint objId, uint primitiveID, uint indexStride){
         index = ivec3(ind[nonuniformEXT(objId)].i[3 * primitiveID], ind[nonuniformEXT(objId)].i[3 * primitiveID + 1], ind[nonuniformEXT(objId)].i[3 * primitiveID + 2]);
     else                  //only ushorts are in the indexbuffer
     {
-        int full = 3 * gl_PrimitiveID;
+        uint full = 3 * primitiveID;
         uint p = uint(full * .5f);
         if(bool(full & 1)){   //not dividable by 2, second half of p + both places of p + 1
             index.x = ind[nonuniformEXT(objId)].i[p] >> 16;
@@ -81,12 +81,31 @@ mat3 gramSchmidt(vec3 T, vec3 B, vec3 N){
     return mat3(normalize(t), normalize(b), N);
 }
 
-vec3 getNormal(mat3 TBN, sampler2D normalMap, vec2 uv)
+// texture lod for ray cones, see "Improved Shader and Texture Level of Detail Using Ray Cones" (Akenine-Moeller et al.)
+// the returned base is independent of the texture, textureLodLevel adds the texture size
+float rayConeLodBase(vec3 A, vec3 B, vec3 C, vec2 Auv, vec2 Buv, vec2 Cuv, mat4 objectMat, vec3 rayDir, float coneWidth)
+{
+    vec3 n = cross((objectMat * vec4(B - A, 0)).xyz, (objectMat * vec4(C - A, 0)).xyz);
+    float worldArea = max(length(n), 1e-20);
+    float uvArea = abs((Buv.x - Auv.x) * (Cuv.y - Auv.y) - (Cuv.x - Auv.x) * (Buv.y - Auv.y));
+    float cosine = max(abs(dot(normalize(rayDir), n / worldArea)), 1e-3);
+    return 0.5 * log2(uvArea / worldArea) + log2(coneWidth / cosine);
+}
+float textureLodLevel(sampler2D tex, float lodBase)
+{
+    ivec2 size = textureSize(tex, 0);
+    return max(lodBase + 0.5 * log2(float(size.x) * float(size.y)), 0.0);
+}
+
+vec3 getNormal(mat3 TBN, sampler2D normalMap, vec2 uv, float lodBase)
 {
     if(textureSize(normalMap, 0) == ivec2(1,1)) 
         return TBN[2];
     // Perturb normal, see http://www.thetenthplanet.de/archives/1180
-    vec3 tangentNormal = texture(normalMap, uv).xyz * 2.0 - 1.0;
+    // z is reconstructed, block compressed normal maps only store x and y
+    vec3 tangentNormal;
+    tangentNormal.xy = textureLod(normalMap, uv, textureLodLevel(normalMap, lodBase)).xy * 2.0 - 1.0;
+    tangentNormal.z = sqrt(max(1.0 - dot(tangentNormal.xy, tangentNormal.xy), 0.0));
   
     return normalize(TBN * tangentNormal);
 }
@@ -17,8 +17,20 @@ layout(binding = 31, rgba32f) uniform image2D volumeImage;
 layout(binding = 25, rgba32f) uniform image2D illumination;
 #endif
 
+#ifdef ADAPTIVE_SAMPLING
+const int c_AdaptiveTileSize = 8;
+layout(binding = 32, rgba32f) uniform image2D sampleMoments;      // sum of luminance, sum of squared luminance, sample count
+layout(binding = 33, r32ui) uniform readonly uimage2D convergedTiles;
+#endif
+
 #ifdef TEMP_GRADIENT
 layout(binding = 29, rgba32f) uniform image2D merged_vbuf;
 #endif
 
+#ifdef PRIMARY_VBUFFER
+// rasterized primary visibility, mesh id 0 is the background and ids with the highest bit set are volumes
+layout(binding = 39) uniform usampler2D primaryMeshIds;
+layout(binding = 40) uniform usampler2D primaryPrimitiveIds;
+#endif
+
 #endif //LAYOUTPTIMAGES_H
\ No newline at end of file
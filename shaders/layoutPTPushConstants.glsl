@@ -1,13 +1,15 @@
 #ifndef LAYOUTPTPUSHCONSTANTS_H 
 #define LAYOUTPTPUSHCONSTANTS_H
 
-layout(push_constant) uniform PushConstants 
+// written every frame from the host, a uniform buffer so the recorded commands do not change
+layout(binding = 41) uniform FrameParameters
 {
 	mat4 inverseViewMatrix;
 	mat4 inverseProjectionMatrix;
 	mat4 prevView;
 	uint frameNumber;
 	uint sampleNumber;
+	uint cameraInVolume;
 } camParams;
 
 #endif //LAYOUTPTPUSHCONSTANTS_H
\ No newline at end of file
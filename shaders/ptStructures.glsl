@@ -96,6 +96,9 @@ struct RayPayload {
 	vec3 position;
     SurfaceInfo si;
     uint category_id;
+    // ray cone for the texture lod, width at the last hit and spread angle
+    float coneWidth;
+    float coneSpread;
 };
 
 #endif //PTSTRUCTURES_H
\ No newline at end of file
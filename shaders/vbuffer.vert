@@ -2,15 +2,26 @@
 
 layout(push_constant) uniform PushConstants {
     mat4 mat_vp; // view-projection matrix
-    layout(row_major) mat4x3 mat_model; // model matrix, last row is assumed identity
-    uint in_mesh_id;
 };
 
+struct Instance
+{
+    vec4 mat_model[3]; // rows of the model matrix, last row is assumed identity
+    uint mesh_id;
+    uint pad0, pad1, pad2;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances { Instance instances[]; };
+
 layout (location=0) in vec3 in_pos;
 layout (location=0) out flat uint mesh_id;
 
 void main()
 {
-    gl_Position = mat_vp * vec4(mat_model * vec4(in_pos, 1), 1);
-    mesh_id = in_mesh_id + gl_InstanceIndex;
+    // firstInstance of the indirect draw points to the instances of the draw
+    Instance instance = instances[gl_InstanceIndex];
+    vec4 pos = vec4(in_pos, 1);
+    vec3 world = vec3(dot(instance.mat_model[0], pos), dot(instance.mat_model[1], pos), dot(instance.mat_model[2], pos));
+    gl_Position = mat_vp * vec4(world, 1);
+    mesh_id = instance.mesh_id;
 }
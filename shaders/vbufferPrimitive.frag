@@ -0,0 +1,12 @@
+#version 450
+
+layout (location=0) in flat uint mesh_id;
+layout (location=0) out uint color;
+layout (location=1) out uint primitive;
+
+// additionally stores the triangle for the primary hits of the ray tracing
+void main()
+{
+    color = mesh_id;
+    primitive = gl_PrimitiveID;
+}
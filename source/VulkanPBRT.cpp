@@ -1,19 +1,33 @@
 
 
 #include "scene/CountTrianglesVisitor.hpp"
+#include "scene/MipmapGenerator.hpp"
+#include "scene/TextureCompressor.hpp"
 
 #include "renderModules/PipelineStructs.hpp"
 
 #include "renderModules/PBRTPipeline.hpp"
+#include "renderModules/AdaptiveSampler.hpp"
 #include "renderModules/Accumulator.hpp"
 #include "renderModules/FormatConverter.hpp"
+#include "renderModules/AsyncCompute.hpp"
 #include "renderModules/denoisers/BFR.hpp"
 #include "renderModules/denoisers/BFRBlender.hpp"
 #include "renderModules/denoisers/BMFR.hpp"
 #include "renderModules/denoisers/A_SVGF.hpp"
+#include "renderModules/denoisers/BMFRMultiScale.hpp"
+#include "renderModules/denoisers/CpuDenoiser.hpp"
 #include "buffers/VBuffer.hpp"
 #include "renderModules/Taa.hpp"
+#include "renderModules/TemporalUpscaler.hpp"
+#include "renderModules/DynamicResolution.hpp"
+#include "renderModules/QualityController.hpp"
+#include "renderModules/StaticCommands.hpp"
+#include "buffers/FrameParameters.hpp"
 #include "io/RenderIO.hpp"
+#include "io/SweepIO.hpp"
+#include "io/Profiler.hpp"
+#include "io/ImageMetrics.hpp"
 
 #include "Gui.hpp"
 
@@ -24,7 +38,10 @@
 
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <chrono>
+#include <filesystem>
 
 #include "../external/vsgXchange/src/assimp/3DFrontImporter.h"
 
@@ -44,7 +61,6 @@ enum class DenoisingType
     ASVGF,
     SVG
 };
-DenoisingType denoisingType = DenoisingType::None;
 
 enum class DenoisingBlockSize
 {
@@ -56,6 +72,84 @@ enum class DenoisingBlockSize
 };
 DenoisingBlockSize denoisingBlockSize = DenoisingBlockSize::x32;
 
+DenoisingType parseDenoisingType(const std::string& denoisingTypeStr, DenoisingType fallback)
+{
+    if (denoisingTypeStr == "bmfr")
+        return DenoisingType::BMFR;
+    if (denoisingTypeStr == "bfr")
+        return DenoisingType::BFR;
+    if (denoisingTypeStr == "asvgf")
+        return DenoisingType::ASVGF;
+    if (denoisingTypeStr == "svgf")
+        return DenoisingType::SVG;
+    if (denoisingTypeStr == "none")
+        return DenoisingType::None;
+    std::cout << "Unknown denoising type: " << denoisingTypeStr << std::endl;
+    return fallback;
+}
+
+// the indirect VBuffer draw selects the instances of each mesh through firstInstance. The features are checked before the
+// device is created, its creation would fail without naming them
+void checkVBufferFeatures(const vsg::PhysicalDevice& physicalDevice, const vsg::WindowTraits& traits)
+{
+    if (!traits.deviceFeatures->get().drawIndirectFirstInstance)
+        return;
+    const auto& features = physicalDevice.getFeatures();
+    auto features12 = physicalDevice.getFeatures<VkPhysicalDeviceVulkan12Features, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES>();
+    if (!features.multiDrawIndirect || !features.drawIndirectFirstInstance || !features12.drawIndirectCount)
+        throw vsg::Exception{"Error: the VBuffer needs the device features multiDrawIndirect, drawIndirectFirstInstance and drawIndirectCount.", VK_ERROR_FEATURE_NOT_PRESENT};
+}
+
+// creates a device without surface and swapchain support for offscreen rendering. With asyncCompute a second queue is
+// created for the compute work, from a family without graphics support if there is one
+vsg::ref_ptr<vsg::Device> createHeadlessDevice(const vsg::WindowTraits& traits, int& queueFamily, bool asyncCompute, int& computeQueueFamily, uint32_t& computeQueueIndex)
+{
+    vsg::Names instanceExtensions = traits.instanceExtensionNames;
+    vsg::Names requestedLayers;
+    if (traits.debugLayer || traits.apiDumpLayer)
+    {
+        instanceExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+        requestedLayers.push_back("VK_LAYER_KHRONOS_validation");
+        if (traits.apiDumpLayer) requestedLayers.push_back("VK_LAYER_LUNARG_api_dump");
+    }
+    vsg::Names validatedNames = vsg::validateInstancelayerNames(requestedLayers);
+    auto instance = vsg::Instance::create(instanceExtensions, validatedNames, traits.vulkanVersion);
+
+    auto physicalDevice = instance->getPhysicalDevice(traits.queueFlags, traits.deviceTypePreferences);
+    if (!physicalDevice)
+        throw vsg::Exception{"Error: createHeadlessDevice(...) no suitable Vulkan PhysicalDevice available.", VK_ERROR_INITIALIZATION_FAILED};
+    checkVBufferFeatures(*physicalDevice, traits);
+    queueFamily = physicalDevice->getQueueFamily(traits.queueFlags);
+    if (queueFamily < 0)
+        throw vsg::Exception{"Error: createHeadlessDevice(...) no suitable queue family available.", VK_ERROR_INITIALIZATION_FAILED};
+
+    vsg::QueueSettings queueSettings{vsg::QueueSetting{queueFamily, {1.0}}};
+    computeQueueFamily = -1;
+    computeQueueIndex = 0;
+    if (asyncCompute)
+    {
+        const auto& queueFamilies = physicalDevice->getQueueFamilyProperties();
+        for (int i = 0; i < static_cast<int>(queueFamilies.size()) && computeQueueFamily < 0; ++i)
+        {
+            if ((queueFamilies[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+                computeQueueFamily = i;
+        }
+        if (computeQueueFamily >= 0)
+        {
+            queueSettings.push_back(vsg::QueueSetting{computeQueueFamily, {1.0}});
+        }
+        else if (queueFamilies[queueFamily].queueCount > 1)
+        {
+            computeQueueFamily = queueFamily;
+            computeQueueIndex = 1;
+            queueSettings[0].queuePiorities.push_back(1.0);
+        }
+        else
+            throw vsg::Exception{"Error: createHeadlessDevice(...) no second queue for async compute available.", VK_ERROR_INITIALIZATION_FAILED};
+    }
+    return vsg::Device::create(physicalDevice, queueSettings, validatedNames, traits.deviceExtensionNames, traits.deviceFeatures, instance->getAllocationCallbacks());
+}
+
 class LoggingRedirectSentry
 {
 public:
@@ -74,6 +168,1147 @@ private:
     std::streambuf *originalBuffer;
 };
 
+// values of the command line. The values a sweep case can override are read again for every run by readRunOptions(),
+// the main command line gives their defaults
+struct Options
+{
+    int numFrames = -1;
+    int samplesPerPixel = 1;
+    std::string depthPath, exportDepthPath, positionPath, exportPositionPath, normalPath, exportNormalPath;
+    std::string albedoPath, exportAlbedoPath, materialPath, exportMaterialPath, illuminationPath, exportIlluminationPath;
+    std::string matricesPath, exportMatricesPath, sceneFilename, cameraPath, sweepPath;
+    bool useExternalBuffers = false;
+    bool exportIllumination = false;
+    bool exportGBuffer = false;
+    bool storeMatrices = false;
+    // the final image is read back for the export and for the comparison with the reference
+    bool readbackIllumination = false;
+    DenoisingType denoisingType = DenoisingType::None;
+    bool useTaa = false;
+    bool useFlyNavigation = false;
+    bool headless = false;
+    std::string profileCsvPath, profileJsonPath, profileTracePath;
+    std::string metricsReferencePath, metricsPath;
+    float adaptiveThreshold = 0;
+    uint32_t adaptiveMinSamples = 16;
+    std::string textureCachePath;
+    bool cpuDenoising = false;
+    bool asyncCompute = false;
+    bool staticCommands = false;
+    bool vBufferPrimary = false;
+    bool compressTextures = false;
+    float renderScale = 1;
+    float frameBudget = 0;
+    uint32_t resolutionLevels = 1;
+    bool upscaling = false;
+    float qualityBudget = 0;
+    uint32_t qualityLevels = 4;
+};
+
+// ray tracing pipelines together with their buffers, keyed by buffer layout. Runs of a sweep which only differ
+// in denoiser settings or specialization constants reuse them instead of reloading shaders and textures
+struct ScenePipeline
+{
+    vsg::ref_ptr<GBuffer> gBuffer;
+    vsg::ref_ptr<IlluminationBuffer> illuminationBuffer;
+    vsg::ref_ptr<VBuffer> vBuffer;
+    vsg::ref_ptr<GradientProjector> gradientProjector;
+    vsg::ref_ptr<AdaptiveSampler> adaptiveSampler;
+    vsg::ref_ptr<PBRTPipeline> pbrtPipeline;
+};
+
+// everything shared by the runs: the device, the scene with its acceleration structures and the reused pipelines
+struct Session
+{
+    Options options;
+    vsg::ref_ptr<vsg::WindowTraits> windowTraits;
+    // in headless mode there is no window, swapchain or gui. Frames are paced by the fences of the viewer
+    vsg::ref_ptr<vsg::Window> window;
+    vsg::ref_ptr<vsg::Device> device;
+    int queueFamily = -1, computeQueueFamily = -1;
+    uint32_t computeQueueIndex = 0;
+
+    vsg::ref_ptr<vsg::Node> scene;
+    vsg::ref_ptr<vsg::AccelerationStructure> tlas;
+    // textures are compressed once, pipelines created for later runs reuse the compressed images
+    vsg::ref_ptr<TextureCompressor> textureCompressor;
+    std::vector<vsg::ref_ptr<OfflineGBuffer>> offlineGBuffers;
+    std::vector<vsg::ref_ptr<OfflineIllumination>> offlineIlluminations;
+    std::vector<CameraMatrices> cameraMatrices;
+
+    std::map<std::string, ScenePipeline> scenePipelines;
+    // pipelines which own the scene descriptors and textures, keyed by buffer layout without the resolution. The
+    // other resolutions trace the same scene with their own output images
+    std::map<std::string, vsg::ref_ptr<PBRTPipeline>> sceneOwners;
+};
+
+// the buffers and modules of one internal resolution
+struct RenderLevel
+{
+    vsg::ref_ptr<GBuffer> gBuffer;
+    vsg::ref_ptr<VBuffer> vBuffer;
+    vsg::ref_ptr<GradientProjector> gradientProjector;
+    vsg::ref_ptr<AdaptiveSampler> adaptiveSampler;
+    vsg::ref_ptr<Accumulator> accumulator;
+    vsg::ref_ptr<PBRTPipeline> pbrtPipeline;
+    vsg::ref_ptr<A_SVGF> a_svgf;
+    vsg::ref_ptr<AsyncCompute> async;
+    vsg::ref_ptr<vsg::Commands> graphicsCommands, commands;
+    vsg::ref_ptr<StaticCommands> staticCommands;
+    // the last loop iteration the level was recorded in
+    int64_t lastSample = -1;
+};
+
+// everything created for one run, of a sweep or of the main command line
+struct Run
+{
+    Options options;
+    // not set without a sweep
+    const SweepRun* sweepRun = nullptr;
+    std::vector<vsg::dvec3> camPositions;
+
+    vsg::ref_ptr<vsg::Viewer> viewer;
+    vsg::ref_ptr<vsg::Perspective> perspective;
+    vsg::ref_ptr<vsg::LookAt> lookAt;
+    // camera of the ray tracing, read from uniform buffers. The push constants are left for BFR and BMFR
+    vsg::ref_ptr<RayTracingPushConstantsValue> rayTracingPushConstantsValue;
+    vsg::ref_ptr<vsg::PushConstants> computeConstants;
+    vsg::ref_ptr<Profiler> profiler;
+    // the slots of the per frame values follow the query pools of the profiler
+    vsg::ref_ptr<FrameParameters> frameParameters;
+    // with async compute the values of the compute queue are copied there, its frame overlaps the next graphics frame
+    vsg::ref_ptr<FrameParameters> computeFrameParameters;
+    vsg::ref_ptr<OfflineGBuffer> offlineGBufferStager;
+    vsg::ref_ptr<OfflineIllumination> offlineIlluminationBufferStager;
+
+    // with upscaling every resolution level traces and denoises into its own buffers and the temporal upscaler
+    // reconstructs the window resolution. Without it there is one level at the window resolution
+    std::vector<vsg::uivec2> levelResolutions;
+    std::vector<RenderLevel> levels;
+    vsg::ref_ptr<TemporalUpscaler> upscaler;
+    // the levels of the quality controller are variants of the pipelines of every resolution level
+    vsg::ref_ptr<QualityController> qualityController;
+    vsg::ref_ptr<DynamicResolution> dynamicResolution;
+    // only the level picked for a frame is recorded
+    vsg::ref_ptr<vsg::Switch> levelSwitch;
+    // readback and conversion of the final image, shared by the levels
+    vsg::ref_ptr<vsg::Commands> outputCommands;
+    vsg::ref_ptr<vsg::DescriptorImage> finalDescriptorImage;
+    vsg::ref_ptr<Gui::Values> guiValues;
+    vsg::ref_ptr<ImageMetrics> metrics;
+};
+
+// reads the main command line, returns false if it is not usable
+bool readOptions(vsg::CommandLine& arguments, vsg::WindowTraits& windowTraits, Options& options)
+{
+    windowTraits.windowTitle = "VulkanPBRT";
+    windowTraits.debugLayer = arguments.read({"--debug", "-d"});
+    windowTraits.apiDumpLayer = arguments.read({"--api", "-a"});
+    windowTraits.fullscreen = arguments.read({"--fullscreen", "-fs"});
+    if (arguments.read({"--window", "-w"}, windowTraits.width, windowTraits.height))
+        windowTraits.fullscreen = false;
+    arguments.read("--screen", windowTraits.screenNum);
+
+    options.numFrames = arguments.value(-1, "-f");
+    options.samplesPerPixel = arguments.value(1, "--spp");
+    options.depthPath = arguments.value(std::string(), "--depths");
+    options.exportDepthPath = arguments.value(std::string(), "--exportDepth");
+    options.positionPath = arguments.value(std::string(), "--positions");
+    options.exportPositionPath = arguments.value(std::string(), "--exportPosition");
+    options.normalPath = arguments.value(std::string(), "--normals");
+    options.exportNormalPath = arguments.value(std::string(), "--exportNormal");
+    options.albedoPath = arguments.value(std::string(), "--albedos");
+    options.exportAlbedoPath = arguments.value(std::string(), "--exportAlbedo");
+    options.materialPath = arguments.value(std::string(), "--materials");
+    options.exportMaterialPath = arguments.value(std::string(), "--exportMaterial");
+    options.illuminationPath = arguments.value(std::string(), "--illuminations");
+    options.exportIlluminationPath = arguments.value(std::string(), "--exportIllumination");
+    options.matricesPath = arguments.value(std::string(), "--matrices");
+    options.exportMatricesPath = arguments.value(std::string(), "--exportMatrices");
+    options.sceneFilename = arguments.value(std::string(), "-i");
+    options.cameraPath = arguments.value(std::string(), "--cam");
+    options.useExternalBuffers = options.normalPath.size();
+    options.exportIllumination = options.exportIlluminationPath.size();
+    options.exportGBuffer = options.exportNormalPath.size() || options.exportDepthPath.size() || options.exportPositionPath.size() ||
+                            options.exportAlbedoPath.size() || options.exportMaterialPath.size();
+    options.storeMatrices = options.exportGBuffer || options.exportMatricesPath.size();
+    if (options.sceneFilename.empty() && !options.useExternalBuffers)
+    {
+        std::cout << "Missing input parameter \"-i <path_to_model>\"." << std::endl;
+    }
+    if (arguments.read("m"))
+        options.sceneFilename = "models/raytracing_scene.vsgt";
+    if (arguments.errors())
+    {
+        arguments.writeErrorMessages(std::cerr);
+        return false;
+    }
+
+    std::string denoisingTypeStr;
+    if (arguments.read("--denoiser", denoisingTypeStr))
+        options.denoisingType = parseDenoisingType(denoisingTypeStr, options.denoisingType);
+    options.sweepPath = arguments.value(std::string(), "--sweep");
+    options.useTaa = arguments.read("--taa");
+    options.useFlyNavigation = arguments.read("--fly");
+    options.headless = arguments.read("--headless");
+    options.profileCsvPath = arguments.value(std::string(), "--profile");
+    options.profileJsonPath = arguments.value(std::string(), "--profileJson");
+    options.profileTracePath = arguments.value(std::string(), "--profileTrace");
+    options.metricsReferencePath = arguments.value(std::string(), "--metricsReference");
+    options.metricsPath = arguments.value(std::string(), "--metrics");
+    options.adaptiveThreshold = arguments.value(0.0f, "--adaptive");
+    options.adaptiveMinSamples = arguments.value(16u, "--adaptiveMinSpp");
+    options.textureCachePath = arguments.value(std::string(), "--textureCache");
+    options.cpuDenoising = arguments.read("--cpuDenoiser");
+    options.asyncCompute = arguments.read("--asyncCompute");
+    // records the commands of every level once per frame slot and replays them, the values changing per frame are
+    // copied from a uniform buffer ring instead of being pushed
+    options.staticCommands = arguments.read("--staticCommands");
+    // "vbuffer" takes the primary hits from the rasterized VBuffer, "rt" traces them
+    auto primaryVisibility = arguments.value(std::string("rt"), "--primaryVisibility");
+    options.vBufferPrimary = primaryVisibility == "vbuffer";
+    if (!options.vBufferPrimary && primaryVisibility != "rt")
+    {
+        std::cout << "Unknown primary visibility \"" << primaryVisibility << "\", use \"rt\" or \"vbuffer\"." << std::endl;
+        return false;
+    }
+    options.compressTextures = arguments.read("--compressTextures") || !options.textureCachePath.empty();
+    // tracing and denoising at a fraction of the window resolution, upscaled temporally. With a frame budget in ms
+    // the resolution is picked per frame from precompiled levels, each halving the pixel count of the previous one
+    options.renderScale = arguments.value(1.0f, "--renderScale");
+    options.frameBudget = arguments.value(0.0f, "--frameBudget");
+    options.resolutionLevels = arguments.value(options.frameBudget > 0 ? 4u : 1u, "--resolutionLevels");
+    options.upscaling = options.renderScale != 1.0f || options.frameBudget > 0;
+    if (options.renderScale <= 0 || options.renderScale > 1 || options.resolutionLevels == 0)
+    {
+        std::cout << "The render scale has to be in (0, 1] and there has to be at least one resolution level." << std::endl;
+        return false;
+    }
+    // with a quality budget in ms the cloud and A-SVGF settings are picked per frame from precompiled levels, the
+    // first one uses the command line values. Together with a frame budget the quality is lowered first, the
+    // resolution only drops once the lowest quality level is reached
+    options.qualityBudget = arguments.value(0.0f, "--qualityBudget");
+    options.qualityLevels = arguments.value(4u, "--qualityLevels");
+    if (options.qualityLevels == 0)
+    {
+        std::cout << "There has to be at least one quality level." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// reads the values a sweep case can override on top of the main command line and prepares the buffers of the
+// readback, returns false if the run is not usable
+bool readRunOptions(vsg::CommandLine& runArguments, Session& session, Run& run)
+{
+    const auto& defaults = session.options;
+    auto& options = run.options;
+    options = defaults;
+    options.numFrames = runArguments.value(defaults.numFrames, "-f");
+    options.samplesPerPixel = runArguments.value(defaults.samplesPerPixel, "--spp");
+    options.exportIlluminationPath = runArguments.value(defaults.exportIlluminationPath, "--exportIllumination");
+    options.cameraPath = runArguments.value(defaults.cameraPath, "--cam");
+    std::string denoisingTypeStr;
+    if (runArguments.read("--denoiser", denoisingTypeStr))
+        options.denoisingType = parseDenoisingType(denoisingTypeStr, options.denoisingType);
+    options.useTaa = defaults.useTaa || runArguments.read("--taa");
+    options.exportIllumination = options.exportIlluminationPath.size();
+    options.metricsReferencePath = runArguments.value(defaults.metricsReferencePath, "--metricsReference");
+    options.metricsPath = runArguments.value(defaults.metricsPath, "--metrics");
+    if (run.sweepRun && options.metricsPath.empty())
+        options.metricsPath = (std::filesystem::path(run.sweepRun->outputDirectory) / ("out_" + std::to_string(run.sweepRun->caseIndex) + ".metrics.csv")).string();
+    options.adaptiveThreshold = runArguments.value(defaults.adaptiveThreshold, "--adaptive");
+    options.adaptiveMinSamples = runArguments.value(defaults.adaptiveMinSamples, "--adaptiveMinSpp");
+    options.readbackIllumination = options.exportIllumination || options.metricsReferencePath.size();
+    if (run.sweepRun && options.numFrames <= 0)
+    {
+        std::cout << "No number of frames given. Every sweep run needs \"-f\" in its case or config." << std::endl;
+        return false;
+    }
+    if (options.adaptiveThreshold > 0 && (options.denoisingType != DenoisingType::None || options.useExternalBuffers))
+    {
+        std::cout << "Adaptive sampling is only supported for rendered scenes without denoiser (\"--denoiser none\")." << std::endl;
+        return false;
+    }
+    if (options.asyncCompute && options.denoisingType == DenoisingType::ASVGF)
+    {
+        // the gradient projection of the next frame needs the denoiser history of the current one
+        std::cout << "Async compute is not supported with \"--denoiser asvgf\"." << std::endl;
+        return false;
+    }
+    if (options.staticCommands && (options.adaptiveThreshold > 0 || options.useTaa || (options.denoisingType != DenoisingType::None && options.denoisingType != DenoisingType::ASVGF)))
+    {
+        // BFR, BMFR, the taa and the adaptive sampling still take their per frame values as push constants
+        std::cout << "Static command buffers are only supported with \"--denoiser none\" or \"asvgf\", without \"--taa\" and adaptive sampling." << std::endl;
+        return false;
+    }
+    if (options.upscaling && (options.denoisingType == DenoisingType::None || options.useTaa))
+    {
+        // the upscaler reprojects with the motion of the accumulator and replaces the taa
+        std::cout << "Upscaling needs a denoiser and can not be combined with \"--taa\"." << std::endl;
+        return false;
+    }
+    if (options.headless && options.numFrames <= 0)
+    {
+        std::cout << "No number of frames given. For headless rendering use \"-f\" to inform about the number of frames." << std::endl;
+        return false;
+    }
+
+    const auto& windowTraits = session.windowTraits;
+    if (options.readbackIllumination)
+    {
+        if (options.numFrames <= 0)
+        {
+            std::cout << "No number of frames given. For usage of Illumination export or metrics use \"-f\" to inform about the number of frames." << std::endl;
+            return false;
+        }
+        auto& offlineIlluminations = session.offlineIlluminations;
+        if (offlineIlluminations.size() < static_cast<size_t>(options.numFrames))
+        {
+            auto first = offlineIlluminations.size();
+            offlineIlluminations.resize(options.numFrames);
+            for (auto i = first; i < offlineIlluminations.size(); ++i)
+            {
+                offlineIlluminations[i] = OfflineIllumination::create();
+                offlineIlluminations[i]->noisy = vsg::vec4Array2D::create(windowTraits->width, windowTraits->height);
+            }
+        }
+    }
+    if (options.exportGBuffer)
+    {
+        if (options.numFrames <= 0)
+        {
+            std::cout << "No number of frames given. For usage of GBuffer export use \"-f\" to inform about the number of frames." << std::endl;
+            return false;
+        }
+        if (session.offlineGBuffers.empty())
+        {
+            session.offlineGBuffers.resize(options.numFrames);
+            for (auto &i : session.offlineGBuffers)
+            {
+                i = OfflineGBuffer::create();
+                i->depth = vsg::floatArray2D::create(windowTraits->width, windowTraits->height);
+                i->normal = vsg::vec2Array2D::create(windowTraits->width, windowTraits->height);
+                i->albedo = vsg::ubvec4Array2D::create(windowTraits->width, windowTraits->height);
+                i->material = vsg::ubvec4Array2D::create(windowTraits->width, windowTraits->height);
+            }
+        }
+    }
+    if (options.storeMatrices)
+    {
+        session.cameraMatrices.resize(options.numFrames);
+        for (auto &matrix : session.cameraMatrices)
+        {
+            matrix.proj = vsg::mat4();
+            matrix.invProj = vsg::mat4();
+        }
+    }
+    if (!options.cameraPath.empty())
+    {
+        std::ifstream positionsFile{options.cameraPath};
+        if (!positionsFile)
+        {
+            std::cerr << "File could not be opened: " << options.cameraPath << std::endl;
+            return false;
+        }
+        nlohmann::json positions;
+        positionsFile >> positions;
+        if (!positions.is_array())
+        {
+            std::cerr << "Camera positions file does not contain a JSON array" << std::endl;
+            return false;
+        }
+
+        for (const auto& v : positions)
+        {
+            if (v.size() != 3)
+            {
+                std::cerr << "Some position is not a 3d vector" << std::endl;
+                return false;
+            }
+            run.camPositions.emplace_back(v[0].get<double>(), v[1].get<double>(), v[2].get<double>());
+        }
+    }
+    if (runArguments.errors())
+    {
+        runArguments.writeErrorMessages(std::cerr);
+        return false;
+    }
+    return true;
+}
+
+// creates the buffers and modules of one resolution level and appends it to the levels of the run, returns false if
+// the level can not be created
+bool createLevel(Session& session, Run& run, vsg::CommandLine& runArguments, vsg::Context& context, const vsg::uivec2& resolution)
+{
+    const auto& options = run.options;
+    const auto denoisingType = options.denoisingType;
+    auto& profiler = run.profiler;
+    uint32_t renderWidth = resolution.x, renderHeight = resolution.y;
+    vsg::ref_ptr<GBuffer> gBuffer;
+    vsg::ref_ptr<IlluminationBuffer> illuminationBuffer;
+    vsg::ref_ptr<AccumulationBuffer> accumulationBuffer;
+    bool writeGBuffer;
+    if (denoisingType == DenoisingType::ASVGF)
+    {
+        gBuffer = GBuffer::create(renderWidth, renderHeight);
+        accumulationBuffer = AccumulationBuffer::create(renderWidth, renderHeight);
+        writeGBuffer = true;
+        illuminationBuffer = IlluminationBufferDemodulatedFloat::create(renderWidth, renderHeight);
+    }
+    else if (denoisingType != DenoisingType::None)
+    {
+        writeGBuffer = true;
+        gBuffer = GBuffer::create(renderWidth, renderHeight);
+        illuminationBuffer = IlluminationBufferDemodulatedFloat::create(renderWidth, renderHeight);
+    }
+    else
+    {
+        writeGBuffer = false;
+        illuminationBuffer = IlluminationBufferFinalFloat::create(renderWidth, renderHeight);
+    }
+    if (options.readbackIllumination && !gBuffer)
+    {
+        writeGBuffer = true;
+        gBuffer = GBuffer::create(renderWidth, renderHeight);
+    }
+    if (options.useTaa && !accumulationBuffer)
+    {
+        // TODO: need the velocity buffer
+    }
+
+    // raytracing pipeline setup
+    vsg::ref_ptr<PBRTPipeline> pbrtPipeline;
+    vsg::ref_ptr<GradientProjector> gradientProjector;
+    vsg::ref_ptr<AdaptiveSampler> adaptiveSampler;
+    vsg::ref_ptr<VBuffer> vBuffer;
+    if(!options.useExternalBuffers)
+    {
+        // --quantizeVolumes is only read when the pipeline is created, runs with another volume encoding need their own
+        bool quantizeVolumes = run.sweepRun && std::find(run.sweepRun->arguments.begin(), run.sweepRun->arguments.end(), "--quantizeVolumes") != run.sweepRun->arguments.end();
+        auto sceneKey = std::to_string(static_cast<int>(denoisingType)) + (writeGBuffer ? "_gbuffer" : "") + (options.adaptiveThreshold > 0 ? "_adaptive" : "") +
+                        (quantizeVolumes ? "_quantized" : "");
+        auto pipelineKey = sceneKey + "_" + std::to_string(renderWidth) + "x" + std::to_string(renderHeight);
+        auto &scenePipeline = session.scenePipelines[pipelineKey];
+        if (scenePipeline.pbrtPipeline)
+        {
+            gBuffer = scenePipeline.gBuffer;
+            illuminationBuffer = scenePipeline.illuminationBuffer;
+            vBuffer = scenePipeline.vBuffer;
+            gradientProjector = scenePipeline.gradientProjector;
+            adaptiveSampler = scenePipeline.adaptiveSampler;
+            pbrtPipeline = scenePipeline.pbrtPipeline;
+            pbrtPipeline->updateSpecializationConstants(runArguments);
+            if (adaptiveSampler)
+            {
+                adaptiveSampler->errorThreshold = options.adaptiveThreshold;
+                adaptiveSampler->minSamples = options.adaptiveMinSamples;
+            }
+        }
+        else
+        {
+            // A-SVGF and the primary visibility share one VBuffer
+            if (denoisingType == DenoisingType::ASVGF || options.vBufferPrimary) {
+                vBuffer = VBuffer::create(renderWidth, renderHeight, options.vBufferPrimary);
+                vBuffer->setScene(*session.scene);
+            }
+            if (denoisingType == DenoisingType::ASVGF)
+                gradientProjector = GradientProjector::create(vBuffer);
+            if (options.adaptiveThreshold > 0)
+                adaptiveSampler = AdaptiveSampler::create(renderWidth, renderHeight, options.adaptiveThreshold, options.adaptiveMinSamples, profiler->getQueryPoolCount());
+            auto &sceneOwner = session.sceneOwners[sceneKey];
+            if (sceneOwner)
+            {
+                pbrtPipeline = PBRTPipeline::create(sceneOwner, gBuffer, illuminationBuffer, gradientProjector, adaptiveSampler,
+                                                    options.vBufferPrimary ? vBuffer : vsg::ref_ptr<VBuffer>());
+                pbrtPipeline->updateSpecializationConstants(runArguments);
+            }
+            else
+            {
+                pbrtPipeline = PBRTPipeline::create(session.scene, gBuffer, illuminationBuffer, gradientProjector, writeGBuffer, RayTracingRayOrigin::CAMERA, runArguments, adaptiveSampler, session.textureCompressor,
+                                                    options.vBufferPrimary ? vBuffer : vsg::ref_ptr<VBuffer>());
+                sceneOwner = pbrtPipeline;
+            }
+            pbrtPipeline->setTlas(session.tlas);
+            scenePipeline = {gBuffer, illuminationBuffer, vBuffer, gradientProjector, adaptiveSampler, pbrtPipeline};
+        }
+    }
+    else
+    {
+        const auto& offlineGBuffers = session.offlineGBuffers;
+        const auto& offlineIlluminations = session.offlineIlluminations;
+        if (!gBuffer)
+            gBuffer = GBuffer::create(offlineGBuffers[0]->depth->width(), offlineGBuffers[0]->depth->height());
+        switch (offlineIlluminations[0]->noisy->getLayout().format)
+        {
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            illuminationBuffer = IlluminationBufferDemodulated::create(offlineIlluminations[0]->noisy->width(), offlineIlluminations[0]->noisy->height());
+            break;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            illuminationBuffer = IlluminationBufferDemodulatedFloat::create(offlineIlluminations[0]->noisy->width(), offlineIlluminations[0]->noisy->height());
+            break;
+        default:
+            std::cout << "Offline illumination buffer image format not compatible" << std::endl;
+            return false;
+        }
+    }
+    auto commands = vsg::Commands::create();
+    profiler->addFrameBegin(commands);
+    // every level copies all values, the levels which are not recorded stay up to date
+    run.frameParameters->addCopyToCommandGraph(commands);
+
+    if (vBuffer) {
+        vBuffer->compile(context);
+    }
+    if (gradientProjector) {
+        gradientProjector->compile(context);
+        gradientProjector->updateImageLayouts(context);
+        gradientProjector->addDispatchToCommandGraph(commands);
+        gradientProjector->addFrameParameters(*run.frameParameters);
+        profiler->addGpuScope(commands, "ProjGrad");
+    }
+    if (pbrtPipeline)
+    {
+        pbrtPipeline->setCloudVariants(run.qualityController ? run.qualityController->createCloudLevels(pbrtPipeline->getCloudQuality())
+                                                             : std::vector<PBRTPipeline::CloudQuality>{});
+        pbrtPipeline->addTraceRaysToCommandGraph(commands);
+        run.frameParameters->add(run.rayTracingPushConstantsValue, pbrtPipeline->frameParametersBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+        profiler->addGpuScope(commands, "RT", VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+        if (adaptiveSampler)
+        {
+            adaptiveSampler->compile(context);
+            adaptiveSampler->updateImageLayouts(context);
+            adaptiveSampler->addDispatchToCommandGraph(commands);
+            profiler->addGpuScope(commands, "Adaptive");
+        }
+        illuminationBuffer = pbrtPipeline->getIlluminationBuffer();
+    }
+    else
+    {
+        if (session.offlineGBuffers.size() < options.numFrames || session.offlineIlluminations.size() < options.numFrames)
+        {
+            std::cout << "Missing offline GBuffer or offline Illumination Buffer info" << std::endl;
+            return false;
+        }
+        run.offlineGBufferStager->uploadToGBufferCommand(gBuffer, commands, context);
+        run.offlineIlluminationBufferStager->uploadToIlluminationBufferCommand(illuminationBuffer, commands, context);
+    }
+    // everything after the ray tracing runs on the compute queue and reads copies of the buffers
+    auto graphicsCommands = commands;
+    auto levelParameters = run.frameParameters;
+    vsg::ref_ptr<AsyncCompute> async;
+    if (options.asyncCompute)
+    {
+        async = AsyncCompute::create(session.device, session.queueFamily, session.computeQueueFamily, session.computeQueueIndex, gBuffer, illuminationBuffer);
+        async->compile(context);
+        async->updateImageLayouts(context);
+        async->addCopyToCommandGraph(graphicsCommands);
+        profiler->addGpuScope(graphicsCommands, "Handoff", VK_PIPELINE_STAGE_TRANSFER_BIT);
+        gBuffer = async->computeGBuffer;
+        illuminationBuffer = async->computeIlluminationBuffer;
+        commands = vsg::Commands::create();
+        levelParameters = run.computeFrameParameters = FrameParameters::create(profiler->getQueryPoolCount());
+        levelParameters->addCopyToCommandGraph(commands);
+    }
+
+    vsg::ref_ptr<Accumulator> accumulator;
+    if(denoisingType != DenoisingType::None){
+        if (denoisingType == DenoisingType::ASVGF)
+            accumulator = Accumulator::create(gBuffer, illuminationBuffer, !options.useExternalBuffers, 1.0f);
+        else
+            accumulator = Accumulator::create(gBuffer, illuminationBuffer, !options.useExternalBuffers);
+        accumulator->addDispatchToCommandGraph(commands);
+        accumulator->addFrameParameters(*levelParameters);
+        profiler->addGpuScope(commands, "Accum");
+        accumulationBuffer = accumulator->accumulationBuffer;
+        illuminationBuffer->compile(context);
+        illuminationBuffer->updateImageLayouts(context);
+        illuminationBuffer = accumulator->accumulatedIllumination; //swap illumination buffer to accumulated illumination for correct use in the following pipelines
+    }
+
+    auto& finalDescriptorImage = run.finalDescriptorImage;
+    const auto& computeConstants = run.computeConstants;
+    vsg::ref_ptr<A_SVGF> a_svgf;
+    switch (denoisingType)
+    {
+    case DenoisingType::None:
+        finalDescriptorImage = illuminationBuffer->illuminationImages[0];
+        break;
+    case DenoisingType::BFR:
+        switch (denoisingBlockSize)
+        {
+        case DenoisingBlockSize::x8:
+        {
+            auto bfr8 = BFR::create(renderWidth, renderHeight, 8, 8, gBuffer, illuminationBuffer, accumulationBuffer);
+            bfr8->compile(context);
+            bfr8->updateImageLayouts(context);
+            bfr8->addDispatchToCommandGraph(commands, computeConstants);
+            finalDescriptorImage = bfr8->getFinalDescriptorImage();
+            break;
+        }
+        case DenoisingBlockSize::x16:
+        {
+            auto bfr16 = BFR::create(renderWidth, renderHeight, 16, 16, gBuffer, illuminationBuffer, accumulationBuffer);
+            bfr16->compile(context);
+            bfr16->updateImageLayouts(context);
+            bfr16->addDispatchToCommandGraph(commands, computeConstants);
+            finalDescriptorImage = bfr16->getFinalDescriptorImage();
+            break;
+        }
+        case DenoisingBlockSize::x32:
+        {
+            auto bfr32 = BFR::create(renderWidth, renderHeight, 32, 32, gBuffer, illuminationBuffer, accumulationBuffer);
+            bfr32->compile(context);
+            bfr32->updateImageLayouts(context);
+            bfr32->addDispatchToCommandGraph(commands, computeConstants);
+            finalDescriptorImage = bfr32->getFinalDescriptorImage();
+            break;
+        }
+        case DenoisingBlockSize::x8x16x32:
+        {
+            auto bfr8 = BFR::create(renderWidth, renderHeight, 8, 8, gBuffer, illuminationBuffer, accumulationBuffer);
+            auto bfr16 = BFR::create(renderWidth, renderHeight, 16, 16, gBuffer, illuminationBuffer, accumulationBuffer);
+            auto bfr32 = BFR::create(renderWidth, renderHeight, 32, 32, gBuffer, illuminationBuffer, accumulationBuffer);
+            auto blender = BFRBlender::create(renderWidth, renderHeight,
+                                              illuminationBuffer->illuminationImages[0], illuminationBuffer->illuminationImages[1],
+                                              bfr8->getFinalDescriptorImage(), bfr16->getFinalDescriptorImage(), bfr32->getFinalDescriptorImage());
+            bfr8->compile(context);
+            bfr8->updateImageLayouts(context);
+            bfr16->compile(context);
+            bfr16->updateImageLayouts(context);
+            bfr32->compile(context);
+            bfr32->updateImageLayouts(context);
+            blender->compile(context);
+            blender->updateImageLayouts(context);
+            bfr8->addDispatchToCommandGraph(commands, computeConstants);
+            bfr16->addDispatchToCommandGraph(commands, computeConstants);
+            bfr32->addDispatchToCommandGraph(commands, computeConstants);
+            blender->addDispatchToCommandGraph(commands);
+            finalDescriptorImage = blender->getFinalDescriptorImage();
+            break;
+        }
+        }
+        break;
+    case DenoisingType::BMFR:
+        switch (denoisingBlockSize)
+        {
+        case DenoisingBlockSize::x8:
+        {
+            auto bmfr8 = BMFR::create(renderWidth, renderHeight, 8, 8, gBuffer, illuminationBuffer, accumulationBuffer, 64);
+            bmfr8->compile(context);
+            bmfr8->updateImageLayouts(context);
+            bmfr8->addDispatchToCommandGraph(commands, computeConstants);
+            finalDescriptorImage = bmfr8->getFinalDescriptorImage();
+            break;
+        }
+        case DenoisingBlockSize::x16:
+        {
+            auto bmfr16 = BMFR::create(renderWidth, renderHeight, 16, 16, gBuffer, illuminationBuffer, accumulationBuffer);
+            bmfr16->compile(context);
+            bmfr16->updateImageLayouts(context);
+            bmfr16->addDispatchToCommandGraph(commands, computeConstants);
+            finalDescriptorImage = bmfr16->getFinalDescriptorImage();
+            break;
+        }
+        case DenoisingBlockSize::x32:
+        {
+            auto bmfr32 = BMFR::create(renderWidth, renderHeight, 32, 32, gBuffer, illuminationBuffer, accumulationBuffer);
+            bmfr32->compile(context);
+            bmfr32->updateImageLayouts(context);
+            bmfr32->addDispatchToCommandGraph(commands, computeConstants);
+            finalDescriptorImage = bmfr32->getFinalDescriptorImage();
+            break;
+        }
+        case DenoisingBlockSize::x8x16x32:
+            // one module sharing the pre pass and the accumulation between the block sizes
+            auto bmfr = BMFRMultiScale::create(renderWidth, renderHeight, gBuffer, illuminationBuffer, accumulationBuffer,
+                                               illuminationBuffer->illuminationImages[1], illuminationBuffer->illuminationImages[2]);
+            bmfr->compile(context);
+            bmfr->updateImageLayouts(context);
+            bmfr->addDispatchToCommandGraph(commands, computeConstants);
+            finalDescriptorImage = bmfr->getFinalDescriptorImage();
+            break;
+        }
+        break;
+    case DenoisingType::ASVGF: {
+        a_svgf = A_SVGF::create(renderWidth, renderHeight, gBuffer, illuminationBuffer, accumulationBuffer, gradientProjector, runArguments);
+        if (run.qualityController)
+            a_svgf->setQualityVariants(run.qualityController->createDenoiserLevels(a_svgf->getQuality()));
+        a_svgf->compile(context);
+        a_svgf->updateImageLayouts(context);
+        a_svgf->addDispatchToCommandGraph(commands, profiler);
+        a_svgf->addFrameParameters(*levelParameters);
+        finalDescriptorImage = a_svgf->getFinalDescriptorImage();
+        break;
+    }
+    case DenoisingType::SVG:
+        std::cout << "Not yet implemented" << std::endl;
+        break;
+    }
+
+    if (options.useTaa && accumulationBuffer)
+    {
+        auto taa = Taa::create(renderWidth, renderHeight, 16, 16, gBuffer, accumulationBuffer, finalDescriptorImage);
+        taa->compile(context);
+        taa->updateImageLayouts(context);
+        taa->addDispatchToCommandGraph(commands);
+        finalDescriptorImage = taa->getFinalDescriptorImage();
+    }
+    if (run.upscaler)
+    {
+        auto input = run.upscaler->addInput(accumulationBuffer, finalDescriptorImage);
+        run.upscaler->addDispatchToCommandGraph(commands, input);
+        profiler->addGpuScope(commands, "Upscale");
+        finalDescriptorImage = run.upscaler->getFinalDescriptorImage();
+    }
+    if (gBuffer)
+    {
+        gBuffer->compile(context);
+        gBuffer->updateImageLayouts(context);
+    }
+    if (accumulationBuffer)
+    {
+        accumulationBuffer->compile(context);
+        accumulationBuffer->updateImageLayouts(context);
+    }
+    if (illuminationBuffer)
+    {
+        illuminationBuffer->compile(context);
+        illuminationBuffer->updateImageLayouts(context);
+    }
+
+    if (accumulationBuffer)
+    {
+        accumulationBuffer->copyToBackImages(commands, gBuffer, illuminationBuffer);
+    }
+    commands->addChild(run.outputCommands);
+    run.levels.push_back({gBuffer, vBuffer, gradientProjector, adaptiveSampler, accumulator, pbrtPipeline, a_svgf, async, graphicsCommands, commands, {}});
+    return true;
+}
+
+// creates the resolution levels of the run and the readback and conversion of their final image, returns false if
+// they can not be created
+bool createLevels(Session& session, Run& run, vsg::CommandLine& runArguments, vsg::Context& context)
+{
+    const auto& options = run.options;
+    const auto& windowTraits = session.windowTraits;
+    run.levelResolutions = {{windowTraits->width, windowTraits->height}};
+    if (options.upscaling)
+    {
+        run.levelResolutions.clear();
+        // every level halves the pixel count of the previous one
+        for (uint32_t i = 0; i < options.resolutionLevels; ++i)
+        {
+            double scale = options.renderScale * std::pow(0.5, 0.5 * i);
+            run.levelResolutions.emplace_back(std::max(1u, static_cast<uint32_t>(windowTraits->width * scale)),
+                                              std::max(1u, static_cast<uint32_t>(windowTraits->height * scale)));
+        }
+        run.upscaler = TemporalUpscaler::create(windowTraits->width, windowTraits->height);
+        run.upscaler->compile(context);
+        run.upscaler->updateImageLayouts(context);
+        run.frameParameters->add(run.rayTracingPushConstantsValue, run.upscaler->frameParametersBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+    if (options.qualityBudget > 0)
+        run.qualityController = QualityController::create(run.profiler, options.qualityLevels, options.qualityBudget, std::vector<std::string>{"RT", "TempAcc", "Atrous"});
+    run.outputCommands = vsg::Commands::create();
+    for (const auto& resolution : run.levelResolutions)
+    {
+        if (!createLevel(session, run, runArguments, context, resolution))
+            return false;
+    }
+
+    auto& finalDescriptorImage = run.finalDescriptorImage;
+    if (options.exportGBuffer)
+    {
+        auto gBuffer = run.levels.front().gBuffer;
+        if (!gBuffer)
+        {
+            std::cout << "GBuffer information not available, export not possible" << std::endl;
+            return false;
+        }
+        run.offlineGBufferStager->downloadFromGBufferCommand(gBuffer, run.outputCommands, context);
+    }
+    if (options.readbackIllumination)
+    {
+        if (finalDescriptorImage->imageInfoList[0]->imageView->image->format != VK_FORMAT_R32G32B32A32_SFLOAT)
+        {
+            std::cout << "Final image layout is not compatible illumination buffer export" << std::endl;
+            return false;
+        }
+        run.offlineIlluminationBufferStager->downloadFromIlluminationBufferCommand(finalDescriptorImage, run.outputCommands, context);
+    }
+    // the conversion is only needed for the copy to the swapchain
+    if (session.window && finalDescriptorImage->imageInfoList[0]->imageView->image->format != VK_FORMAT_B8G8R8A8_UNORM)
+    {
+        auto converter = FormatConverter::create(finalDescriptorImage->imageInfoList[0]->imageView, VK_FORMAT_B8G8R8A8_UNORM);
+        converter->compileImages(context);
+        converter->updateImageLayouts(context);
+        converter->addDispatchToCommandGraph(run.outputCommands);
+        finalDescriptorImage = converter->finalImage;
+    }
+    return true;
+}
+
+// records the levels into the command graph of the viewer, only the level picked for a frame is recorded. With a window
+// the final image is copied to the swapchain below the gui
+void createCommandGraph(Session& session, Run& run)
+{
+    const auto& options = run.options;
+    const auto& windowTraits = session.windowTraits;
+    const auto& window = session.window;
+    auto& viewer = run.viewer;
+    // set GUI values
+    uint32_t maxRecursionDepth = 2;
+    run.guiValues = Gui::Values::create();
+    run.guiValues->width = windowTraits->width;
+    run.guiValues->height = windowTraits->height;
+
+    auto commandGraph = window ? vsg::CommandGraph::create(window) : vsg::CommandGraph::create(session.device.get(), session.queueFamily);
+    run.levelSwitch = vsg::Switch::create();
+    for (auto& level : run.levels)
+    {
+        auto levelCommands = vsg::Group::create();
+        if (level.vBuffer)
+        {
+            levelCommands->addChild(level.vBuffer->cullCommands);
+            levelCommands->addChild(level.vBuffer->renderGraph);
+        }
+        if (options.staticCommands)
+        {
+            level.staticCommands = StaticCommands::create(level.graphicsCommands, run.profiler->getQueryPoolCount(), commandGraph->queueFamily);
+            levelCommands->addChild(level.staticCommands);
+        }
+        else
+            levelCommands->addChild(level.graphicsCommands);
+        run.levelSwitch->addChild(run.levelSwitch->children.empty(), levelCommands);
+    }
+    commandGraph->addChild(run.levelSwitch);
+    if (options.frameBudget > 0)
+        run.dynamicResolution = DynamicResolution::create(run.profiler, run.levelResolutions, options.frameBudget, std::vector<std::string>{"Upscale"});
+    if (run.qualityController && run.dynamicResolution)
+        run.qualityController->setFallback(run.dynamicResolution);
+    if (window)
+    {
+        CountTrianglesVisitor counter;
+        if (session.scene)
+            session.scene->accept(counter);
+        run.guiValues->triangleCount = counter.triangleCount;
+        run.guiValues->raysPerPixel = maxRecursionDepth * 2; //for each depth recursion one next event estimate is done
+
+        auto viewport = vsg::ViewportState::create(0, 0, windowTraits->width, windowTraits->height);
+        auto camera = vsg::Camera::create(run.perspective, run.lookAt, viewport);
+        auto renderGraph = vsg::createRenderGraphForView(window, camera, vsgImGui::RenderImGui::create(window, Gui(run.guiValues))); // render graph for gui rendering
+        renderGraph->clearValues.clear();                                                                                            //removing clear values to avoid clearing the raytraced image
+
+        commandGraph->addChild(vsg::CopyImageViewToWindow::create(run.finalDescriptorImage->imageInfoList[0]->imageView, window));
+        commandGraph->addChild(renderGraph);
+
+        //close handler to close and imgui handler to forward to imgui
+        viewer->addEventHandler(vsgImGui::SendEventsToImGui::create());
+        viewer->addEventHandler(vsg::CloseHandler::create(viewer));
+        if (options.useFlyNavigation)
+            viewer->addEventHandler(vsg::FlyNavigation::create(camera));
+        else
+            viewer->addEventHandler(vsg::Trackball::create(camera));
+    }
+    if (auto async = run.levels.front().async)
+        async->assignRecordAndSubmitTasks(viewer, commandGraph, run.levels.front().commands);
+    else
+        viewer->assignRecordAndSubmitTaskAndPresentation({commandGraph});
+    viewer->compile();
+}
+
+// renders the frames of the run and prints its statistics
+void renderFrames(Session& session, Run& run)
+{
+    const auto& options = run.options;
+    auto& viewer = run.viewer;
+    auto& profiler = run.profiler;
+    auto& levels = run.levels;
+    auto& lookAt = run.lookAt;
+    auto& perspective = run.perspective;
+    auto& pushConstants = run.rayTracingPushConstantsValue->value();
+    auto& offlineGBuffers = session.offlineGBuffers;
+    auto& offlineIlluminations = session.offlineIlluminations;
+    auto& cameraMatrices = session.cameraMatrices;
+    auto adaptiveSampler = levels.front().adaptiveSampler;
+    int frame_index = 0;
+    int sample_index = 0;
+    int64_t totalSamples = 0;
+    while(viewer->advanceToNextFrame() && (options.numFrames < 0 || frame_index < options.numFrames))
+    {
+        profiler->beginFrame();
+        size_t activeLevel = 0;
+        // the fallback of the quality controller is updated first
+        if (run.dynamicResolution)
+        {
+            activeLevel = run.dynamicResolution->update();
+            run.levelSwitch->setSingleChildOn(activeLevel);
+        }
+        {
+            // the history of a level which did not render the previous frame belongs to an older camera
+            auto& level = levels[activeLevel];
+            if (level.lastSample + 1 != totalSamples)
+            {
+                if (level.accumulator)
+                    level.accumulator->resetHistory();
+                if (level.a_svgf)
+                    level.a_svgf->resetHistory();
+            }
+            level.lastSample = totalSamples;
+        }
+        if (run.qualityController)
+        {
+            auto previousQuality = run.qualityController->getLevel();
+            auto quality = run.qualityController->update();
+            for (const auto& level : levels)
+            {
+                if (level.pbrtPipeline)
+                    level.pbrtPipeline->selectCloudVariant(quality);
+                if (level.a_svgf)
+                    level.a_svgf->selectQualityVariant(quality);
+                // the selected variants are part of the recorded commands
+                if (level.staticCommands && quality != previousQuality)
+                    level.staticCommands->invalidate();
+            }
+        }
+        {
+            auto scope = profiler->cpuScope("Events");
+            viewer->handleEvents();
+        }
+        if (!run.camPositions.empty())
+        {
+            auto posIdx = (size_t)frame_index;
+            if (posIdx >= run.camPositions.size())
+                posIdx = run.camPositions.size() - 1;
+            lookAt->eye = run.camPositions[posIdx];
+        }
+        if ((vsg::mat4)vsg::lookAt(lookAt->eye, lookAt->center, lookAt->up) != pushConstants.prevView)
+        {
+            // clear samples when the camera has moved
+            sample_index = 0;
+        }
+
+        // the levels which are not recorded are updated as well, their previous matrices follow the camera
+        for (const auto& level : levels)
+        {
+            if (level.vBuffer)
+                level.vBuffer->viewProjectMatrixValue->value() = perspective->transform() * lookAt->transform();
+            if (level.gradientProjector)
+                level.gradientProjector->updatePushConstants(perspective->transform(), lookAt->transform(), frame_index);
+            if (level.a_svgf)
+                level.a_svgf->updatePushConstants(perspective->transform(), lookAt->transform());
+        }
+        pushConstants.viewInverse = lookAt->inverse();
+        // all levels share the scene, the volumes of the first VBuffer are those of every level
+        pushConstants.cameraInVolume = options.vBufferPrimary && levels.front().vBuffer && levels.front().vBuffer->insideVolume(lookAt->eye);
+
+        pushConstants.frameNumber = frame_index * options.samplesPerPixel + sample_index;
+        pushConstants.sampleNumber = sample_index;
+        run.guiValues->sampleNumber = sample_index;
+        if (adaptiveSampler)
+            adaptiveSampler->beginSample(sample_index);
+
+        if (options.useExternalBuffers)
+        {
+            auto scope = profiler->cpuScope("Staging");
+            run.offlineGBufferStager->transferStagingDataFrom(offlineGBuffers[frame_index]);
+            run.offlineIlluminationBufferStager->transferStagingDataFrom(offlineIlluminations[frame_index]);
+            if (auto accumulator = levels.front().accumulator)
+               accumulator->setCameraMatrices(frame_index, cameraMatrices[frame_index], cameraMatrices[frame_index ? frame_index - 1 : frame_index]);
+        }
+        else
+        {
+            CameraMatrices a{}, b{};
+            a.invView = lookAt->inverse();
+            a.invProj = perspective->inverse();
+            a.proj = perspective->transform();
+            b.view = pushConstants.prevView;
+            for (const auto& level : levels)
+            {
+                if (level.accumulator)
+                    level.accumulator->setCameraMatrices(pushConstants.frameNumber, a, b);
+            }
+        }
+
+        // the slot of the frame is not in flight anymore, the static commands of the slot copy from its values
+        auto slot = profiler->getCurrentPool();
+        run.frameParameters->update(slot);
+        if (run.computeFrameParameters)
+            run.computeFrameParameters->update(slot);
+        for (const auto& level : levels)
+        {
+            if (level.staticCommands)
+                level.staticCommands->slot = slot;
+        }
+        {
+            auto scope = profiler->cpuScope("Update");
+            viewer->update();
+        }
+        {
+            auto scope = profiler->cpuScope("RecordAndSubmit");
+            viewer->recordAndSubmit();
+        }
+        {
+            auto scope = profiler->cpuScope("Present");
+            viewer->present();
+        }
+
+        pushConstants.prevView = lookAt->transform();
+        ++totalSamples;
+
+        // with adaptive sampling the frame is done as soon as all tiles converged
+        bool frameFinished = sample_index + 1 >= options.samplesPerPixel;
+        if (!frameFinished && adaptiveSampler)
+            frameFinished = adaptiveSampler->converged();
+        if (frameFinished) {
+            if (options.exportGBuffer || options.readbackIllumination) {
+                auto scope = profiler->cpuScope("Staging");
+                viewer->deviceWaitIdle();
+                if (options.readbackIllumination) {
+                    run.offlineIlluminationBufferStager->transferStagingDataTo(offlineIlluminations[frame_index]);
+                }
+                if (run.metrics) {
+                    run.metrics->compare(frame_index, offlineIlluminations[frame_index]->noisy);
+                }
+                if (options.exportGBuffer) {
+                    run.offlineGBufferStager->transferStagingDataTo(offlineGBuffers[frame_index]);
+                }
+            }
+            if (options.storeMatrices) {
+                cameraMatrices[frame_index].view = lookAt->transform();
+                cameraMatrices[frame_index].invView = lookAt->inverse();
+                cameraMatrices[frame_index].proj.value() = perspective->transform();
+                cameraMatrices[frame_index].invProj.value() = perspective->inverse();
+            }
+            frame_index++;
+        }
+        sample_index++;
+        profiler->endFrame();
+    }
+
+    viewer->deviceWaitIdle();
+    profiler->finish();
+    profiler->printStatistics(std::cout);
+    if (run.dynamicResolution)
+        run.dynamicResolution->printStatistics(std::cout);
+    if (run.qualityController)
+        run.qualityController->printStatistics(std::cout);
+    if (adaptiveSampler && frame_index > 0)
+        std::cout << "Adaptive sampling: " << static_cast<double>(totalSamples) / frame_index << " samples per frame on average" << std::endl;
+}
+
+// sets up and renders one run, of the sweep or of the main command line, and exports its results. Returns the exit
+// code of main if the run fails
+int renderRun(Session& session, vsg::CommandLine& arguments, const SweepRuns& sweepRuns, size_t runIndex)
+{
+    const auto& windowTraits = session.windowTraits;
+    const auto& window = session.window;
+    Run run;
+    vsg::ref_ptr<SweepArguments> sweepArguments;
+    std::ofstream runLog;
+    LoggingRedirectSentry runCoutSentry(&std::cout, std::cout.rdbuf());
+    if (!sweepRuns.empty())
+    {
+        run.sweepRun = &sweepRuns[runIndex];
+        const auto &sweepRun = *run.sweepRun;
+        std::cout << sweepRun.configName << " case " << sweepRun.caseIndex << " (" << runIndex + 1 << "/" << sweepRuns.size() << ")" << std::endl;
+        sweepArguments = SweepArguments::create(sweepRun);
+        // per run output like tests/run.py: argument line followed by the perf summary, per frame timings go to the CSV
+        runLog.open((std::filesystem::path(sweepRun.outputDirectory) / ("out_" + std::to_string(sweepRun.caseIndex) + ".txt")).string());
+        for (const auto &arg : sweepRun.arguments)
+            runLog << arg << " ";
+        runLog << std::endl;
+        std::cout.rdbuf(runLog.rdbuf());
+    }
+    // without a sweep the main command line is used, its values were already consumed by readOptions()
+    auto &runArguments = sweepArguments ? sweepArguments->commandLine : arguments;
+    if (!readRunOptions(runArguments, session, run))
+        return 1;
+    const auto& options = run.options;
+
+    run.viewer = vsg::Viewer::create();
+    if (window)
+        run.viewer->addWindow(window);
+
+    //create camera matrices
+    run.perspective = vsg::Perspective::create(60, static_cast<double>(windowTraits->width) / static_cast<double>(windowTraits->height), .1, 1000);
+    run.lookAt = vsg::LookAt::create(vsg::dvec3(0.0, -2, 0), vsg::dvec3(0.0, 0.0, 0), vsg::dvec3(0.0, 0.0, 1.0));
+
+    run.rayTracingPushConstantsValue = RayTracingPushConstantsValue::create();
+    auto& pushConstants = run.rayTracingPushConstantsValue->value();
+    pushConstants.projInverse = run.perspective->inverse();
+    pushConstants.viewInverse = run.lookAt->inverse();
+    pushConstants.prevView = run.lookAt->transform();
+    pushConstants.frameNumber = 0;
+    pushConstants.sampleNumber = 0;
+    pushConstants.cameraInVolume = 0;
+    run.computeConstants = vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, run.rayTracingPushConstantsValue);
+
+    // -------------------------------------------------------------------------------------
+    // image layout conversions and correct binding of different denoising tequniques
+    // -------------------------------------------------------------------------------------
+    vsg::CompileTraversal imageLayoutCompile = window ? vsg::CompileTraversal(window) : vsg::CompileTraversal(session.device);
+    run.profiler = Profiler::create();
+    auto runProfileCsvPath = options.profileCsvPath, runProfileTracePath = options.profileTracePath, runProfileJsonPath = options.profileJsonPath;
+    if (run.sweepRun)
+    {
+        // every sweep run profiles into the directory of its config
+        auto runPrefix = std::filesystem::path(run.sweepRun->outputDirectory) / ("out_" + std::to_string(run.sweepRun->caseIndex));
+        runProfileCsvPath = runPrefix.string() + ".csv";
+        if (options.profileTracePath.size())
+            runProfileTracePath = runPrefix.string() + ".trace.json";
+        if (options.profileJsonPath.size())
+            runProfileJsonPath = runPrefix.string() + ".profile.json";
+    }
+    if (runProfileCsvPath.size() && !run.profiler->setCsvOutput(runProfileCsvPath))
+        std::cout << "Failed to open profile file " << runProfileCsvPath << std::endl;
+    if (runProfileTracePath.size() && !run.profiler->setTraceOutput(runProfileTracePath))
+        std::cout << "Failed to open profile trace file " << runProfileTracePath << std::endl;
+    if (runProfileJsonPath.size())
+        run.profiler->setJsonOutput(runProfileJsonPath);
+    run.frameParameters = FrameParameters::create(run.profiler->getQueryPoolCount());
+
+    run.offlineGBufferStager = OfflineGBuffer::create();
+    run.offlineIlluminationBufferStager = OfflineIllumination::create();
+
+    if (!createLevels(session, run, runArguments, imageLayoutCompile.context))
+        return 1;
+    imageLayoutCompile.context.record();
+
+    createCommandGraph(session, run);
+
+    // waiting for image layout transitions
+    imageLayoutCompile.context.waitForCompletion();
+
+    if (options.metricsReferencePath.size())
+        run.metrics = ImageMetrics::create(options.metricsReferencePath);
+
+    auto runStart = std::chrono::steady_clock::now();
+    renderFrames(session, run);
+    if (run.sweepRun)
+    {
+        std::chrono::duration<double> runDuration = std::chrono::steady_clock::now() - runStart;
+        SweepIO::exportRunTiming("sweep_timing.csv", *run.sweepRun, options.numFrames, runDuration.count());
+    }
+    if (run.metrics)
+    {
+        run.metrics->finish(options.metricsPath);
+        auto mean = run.metrics->getMean();
+        std::cout << "Metrics mean over " << run.metrics->getResults().size() << " frames: PSNR " << mean.psnr << ", SSIM " << mean.ssim << ", FLIP " << mean.flip << std::endl;
+    }
+
+    // exporting all images
+    if (options.exportGBuffer)
+        GBufferIO::exportGBuffer(options.exportPositionPath, options.exportDepthPath, options.exportNormalPath, options.exportMaterialPath, options.exportAlbedoPath,
+                                 options.numFrames, session.offlineGBuffers, session.cameraMatrices);
+    if (options.exportIllumination)
+        IlluminationBufferIO::exportIllumination(options.exportIlluminationPath, options.numFrames, session.offlineIlluminations, 0);
+    if (options.exportMatricesPath.size())
+        MatrixIO::exportMatrices(options.exportMatricesPath, session.cameraMatrices);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     try
@@ -108,65 +1343,12 @@ int main(int argc, char **argv)
             std::cerr.rdbuf(err_log.rdbuf());
         }
 
-        auto windowTraits = vsg::WindowTraits::create();
-        windowTraits->windowTitle = "VulkanPBRT";
-        windowTraits->debugLayer = arguments.read({"--debug", "-d"});
-        windowTraits->apiDumpLayer = arguments.read({"--api", "-a"});
-        windowTraits->fullscreen = arguments.read({"--fullscreen", "-fs"});
-        if (arguments.read({"--window", "-w"}, windowTraits->width, windowTraits->height))
-            windowTraits->fullscreen = false;
-        arguments.read("--screen", windowTraits->screenNum);
-
-        auto numFrames = arguments.value(-1, "-f");
-        auto samplesPerPixel = arguments.value(1, "--spp");
-        auto depthPath = arguments.value(std::string(), "--depths");
-        auto exportDepthPath = arguments.value(std::string(), "--exportDepth");
-        auto positionPath = arguments.value(std::string(), "--positions");
-        auto exportPositionPath = arguments.value(std::string(), "--exportPosition");
-        auto normalPath = arguments.value(std::string(), "--normals");
-        auto exportNormalPath = arguments.value(std::string(), "--exportNormal");
-        auto albedoPath = arguments.value(std::string(), "--albedos");
-        auto exportAlbedoPath = arguments.value(std::string(), "--exportAlbedo");
-        auto materialPath = arguments.value(std::string(), "--materials");
-        auto exportMaterialPath = arguments.value(std::string(), "--exportMaterial");
-        auto illuminationPath = arguments.value(std::string(), "--illuminations");
-        auto exportIlluminationPath = arguments.value(std::string(), "--exportIllumination");
-        auto matricesPath = arguments.value(std::string(), "--matrices");
-        auto exportMatricesPath = arguments.value(std::string(), "--exportMatrices");
-        auto sceneFilename = arguments.value(std::string(), "-i");
-        auto cameraPath = arguments.value(std::string(), "--cam");
-        bool use_external_buffers = normalPath.size();
-        bool exportIllumination = exportIlluminationPath.size();
-        bool exportGBuffer = exportNormalPath.size() || exportDepthPath.size() || exportPositionPath.size() || exportAlbedoPath.size() || exportMaterialPath.size();
-        bool storeMatrices = exportGBuffer || exportMatricesPath.size();
-        if (sceneFilename.empty() && !use_external_buffers)
-        {
-            std::cout << "Missing input parameter \"-i <path_to_model>\"." << std::endl;
-        }
-        if (arguments.read("m"))
-            sceneFilename = "models/raytracing_scene.vsgt";
-        if (arguments.errors())
-            return arguments.writeErrorMessages(std::cerr);
-
-        std::string denoisingTypeStr;
-        if (arguments.read("--denoiser", denoisingTypeStr))
-        {
-            if (denoisingTypeStr == "bmfr")
-                denoisingType = DenoisingType::BMFR;
-            else if (denoisingTypeStr == "bfr")
-                denoisingType = DenoisingType::BFR;
-            else if (denoisingTypeStr == "asvgf")
-                denoisingType = DenoisingType::ASVGF;
-            else if(denoisingTypeStr == "svgf")
-                denoisingType = DenoisingType::SVG;
-            else if(denoisingTypeStr == "none")
-            {
-            }
-            else
-                std::cout << "Unknown denoising type: " << denoisingTypeStr << std::endl;
-        }
-        bool useTaa = arguments.read("--taa");
-        bool useFlyNavigation = arguments.read("--fly");
+        Session session;
+        session.windowTraits = vsg::WindowTraits::create();
+        auto& windowTraits = session.windowTraits;
+        if (!readOptions(arguments, *windowTraits, session.options))
+            return 1;
+        const auto& options = session.options;
 #ifdef _DEBUG
         // overwriting command line options for debug
         //windowTraits->debugLayer = true;
@@ -188,642 +1370,265 @@ int main(int argc, char **argv)
         enabledPhysicalDeviceVk12Feature.descriptorIndexing = VK_TRUE;
         enabledPhysicalDeviceVk12Feature.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
         enabledPhysicalDeviceVk12Feature.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        enabledPhysicalDeviceVk12Feature.timelineSemaphore = options.asyncCompute;
+        // the primitive ids of the vbuffer are written by the fragment shader
+        windowTraits->deviceFeatures->get().geometryShader = options.vBufferPrimary;
 
         // load scene or images
-        vsg::ref_ptr<vsg::Node> loaded_scene;
-        std::vector<vsg::ref_ptr<OfflineGBuffer>> offlineGBuffers;
-        std::vector<vsg::ref_ptr<OfflineIllumination>> offlineIlluminations;
-        std::vector<CameraMatrices> cameraMatrices;
-        if(!use_external_buffers){
+        auto& loaded_scene = session.scene;
+        auto& offlineGBuffers = session.offlineGBuffers;
+        auto& offlineIlluminations = session.offlineIlluminations;
+        auto& cameraMatrices = session.cameraMatrices;
+        if(!options.useExternalBuffers){
             AI3DFrontImporter::ReadConfig(config_json);
-            auto options = vsg::Options::create(vsgXchange::assimp::create(), vsgXchange::dds::create(), vsgXchange::stbi::create(), vsgXchange::xyz::create()); //using the assimp loader
-            loaded_scene = vsg::read_cast<vsg::Node>(sceneFilename, options);
+            auto sceneOptions = vsg::Options::create(vsgXchange::assimp::create(), vsgXchange::dds::create(), vsgXchange::stbi::create(), vsgXchange::xyz::create()); //using the assimp loader
+            loaded_scene = vsg::read_cast<vsg::Node>(options.sceneFilename, sceneOptions);
             if (!loaded_scene)
             {
-                std::cout << "Scene not found: " << sceneFilename << std::endl;
+                std::cout << "Scene not found: " << options.sceneFilename << std::endl;
                 return 1;
             }
+            // full mip chains for the ray cone texture lookups of the ray tracing shaders
+            MipmapGenerator mipmapGenerator;
+            loaded_scene->accept(mipmapGenerator);
+            mipmapGenerator.generate();
         }
         else
         {
-            if (numFrames <= 0)
+            if (options.numFrames <= 0)
             {
                 std::cout << "No number of frames given. For usage of external GBuffer and Illumination information use \"-f\" to inform about the number of frames." << std::endl;
                 return 1;
             }
-            if (matricesPath.empty())
+            if (options.matricesPath.empty())
             {
                 std::cout << "Camera matrices are missing. Insert location of file with camera information via \"--matrices\"." << std::endl;
                 return 1;
             }
-            cameraMatrices = MatrixIO::importMatrices(matricesPath);
+            cameraMatrices = MatrixIO::importMatrices(options.matricesPath);
             if (cameraMatrices.empty())
             {
                 std::cout << "Camera matrices could not be loaded" << std::endl;
                 return 1;
             }
-            if (positionPath.size())
+            if (options.positionPath.size())
             {
-                offlineGBuffers = GBufferIO::importGBufferPosition(positionPath, normalPath, materialPath, albedoPath, cameraMatrices, numFrames);
+                offlineGBuffers = GBufferIO::importGBufferPosition(options.positionPath, options.normalPath, options.materialPath, options.albedoPath, cameraMatrices, options.numFrames);
             }
             else
             {
-                offlineGBuffers = GBufferIO::importGBufferDepth(depthPath, normalPath, materialPath, albedoPath, numFrames);
+                offlineGBuffers = GBufferIO::importGBufferDepth(options.depthPath, options.normalPath, options.materialPath, options.albedoPath, options.numFrames);
             }
-            offlineIlluminations = IlluminationBufferIO::importIllumination(illuminationPath, numFrames);
+            offlineIlluminations = IlluminationBufferIO::importIllumination(options.illuminationPath, options.numFrames);
             windowTraits->width = offlineGBuffers[0]->depth->width();
             windowTraits->height = offlineGBuffers[0]->depth->height();
         }
-        if (exportIllumination)
+        if (options.cpuDenoising)
         {
-            if (numFrames <= 0)
+            // denoising the offline buffers without a device or window
+            if (!options.useExternalBuffers)
             {
-                std::cout << "No number of frames given. For usage of Illumination export use \"-f\" to inform about the number of frames." << std::endl;
+                std::cout << "The CPU denoiser only works on external buffers given via \"--normals\" and \"--illuminations\"." << std::endl;
                 return 1;
             }
-            if (offlineIlluminations.empty())
+            const auto numFrames = options.numFrames;
+            if (offlineGBuffers.size() < static_cast<size_t>(numFrames) || offlineIlluminations.size() < static_cast<size_t>(numFrames) || cameraMatrices.size() < static_cast<size_t>(numFrames))
             {
-                offlineIlluminations.resize(numFrames);
-                for (auto &i : offlineIlluminations)
-                {
-                    i = OfflineIllumination::create();
-                    i->noisy = vsg::vec4Array2D::create(windowTraits->width, windowTraits->height);
-                }
+                std::cout << "Missing offline GBuffer, offline Illumination Buffer or camera matrices info" << std::endl;
+                return 1;
             }
-        }
-        if (exportGBuffer)
-        {
-            if (numFrames <= 0)
+            CpuDenoiser::Type cpuDenoiserType;
+            switch (options.denoisingType)
             {
-                std::cout << "No number of frames given. For usage of GBuffer export use \"-f\" to inform about the number of frames." << std::endl;
+            case DenoisingType::BMFR:
+                cpuDenoiserType = CpuDenoiser::Type::BMFR;
+                break;
+            case DenoisingType::ASVGF:
+            case DenoisingType::SVG:
+                cpuDenoiserType = CpuDenoiser::Type::SVGF;
+                break;
+            default:
+                std::cout << "The CPU denoiser supports \"--denoiser bmfr|asvgf|svgf\"." << std::endl;
                 return 1;
             }
-            if (offlineGBuffers.empty())
+            uint32_t cpuBlockSize = 32;
+            switch (denoisingBlockSize)
             {
-                offlineGBuffers.resize(numFrames);
-                for (auto &i : offlineGBuffers)
-                {
-                    i = OfflineGBuffer::create();
-                    i->depth = vsg::floatArray2D::create(windowTraits->width, windowTraits->height);
-                    i->normal = vsg::vec2Array2D::create(windowTraits->width, windowTraits->height);
-                    i->albedo = vsg::ubvec4Array2D::create(windowTraits->width, windowTraits->height);
-                    i->material = vsg::ubvec4Array2D::create(windowTraits->width, windowTraits->height);
-                }
+            case DenoisingBlockSize::x8: cpuBlockSize = 8; break;
+            case DenoisingBlockSize::x16: cpuBlockSize = 16; break;
+            case DenoisingBlockSize::x64: cpuBlockSize = 64; break;
+            default: break;
             }
-        }
-        if (storeMatrices)
-        {
-            cameraMatrices.resize(numFrames);
-            for (auto &matrix : cameraMatrices)
+            auto cpuDenoiser = CpuDenoiser::create(windowTraits->width, windowTraits->height, cpuDenoiserType, cpuBlockSize, arguments);
+            vsg::ref_ptr<ImageMetrics> metrics;
+            if (options.metricsReferencePath.size())
+                metrics = ImageMetrics::create(options.metricsReferencePath);
+
+            auto denoiseStart = std::chrono::steady_clock::now();
+            for (int frame = 0; frame < numFrames; ++frame)
             {
-                matrix.proj = vsg::mat4();
-                matrix.invProj = vsg::mat4();
+                offlineIlluminations[frame]->noisy = cpuDenoiser->denoise(frame, *offlineGBuffers[frame], *offlineIlluminations[frame], cameraMatrices[frame], cameraMatrices[frame ? frame - 1 : frame]);
+                if (metrics)
+                    metrics->compare(frame, offlineIlluminations[frame]->noisy);
             }
+            std::chrono::duration<double, std::milli> denoiseDuration = std::chrono::steady_clock::now() - denoiseStart;
+            std::cout << "CPU denoising: " << denoiseDuration.count() / numFrames << " ms per frame" << std::endl;
+
+            if (metrics)
+            {
+                metrics->finish(options.metricsPath);
+                auto mean = metrics->getMean();
+                std::cout << "Metrics mean over " << metrics->getResults().size() << " frames: PSNR " << mean.psnr << ", SSIM " << mean.ssim << ", FLIP " << mean.flip << std::endl;
+            }
+            if (options.exportIllumination)
+                IlluminationBufferIO::exportIllumination(options.exportIlluminationPath, numFrames, offlineIlluminations, 0);
+            return 0;
         }
-        std::vector<vsg::dvec3> camPositions;
-        if (!cameraPath.empty())
+        SweepRuns sweepRuns;
+        if (!options.sweepPath.empty())
         {
-            std::ifstream positionsFile{cameraPath};
-            if (!positionsFile)
+            if (options.useExternalBuffers)
             {
-                std::cerr << "File could not be opened: " << cameraPath << std::endl;
+                std::cout << "Parameter sweeps are only supported for scenes, not for external buffers." << std::endl;
                 return 1;
             }
-            nlohmann::json positions;
-            positionsFile >> positions;
-            if (!positions.is_array())
+            sweepRuns = SweepIO::importSweep(options.sweepPath);
+            if (sweepRuns.empty())
             {
-                std::cerr << "Camera positions file does not contain a JSON array" << std::endl;
+                std::cout << "Sweep file " << options.sweepPath << " does not contain any runs." << std::endl;
                 return 1;
             }
-
-            for (const auto& v : positions)
-            {
-                if (v.size() != 3)
-                {
-                    std::cerr << "Some position is not a 3d vector" << std::endl;
-                    return 1;
-                }
-                camPositions.emplace_back(v[0].get<double>(), v[1].get<double>(), v[2].get<double>());
-            }
         }
-
-        auto window = vsg::Window::create(windowTraits);
-        if (!window)
+        // the vbuffer is drawn with one indirect draw of all visible meshes, its features are only required by the runs using it
+        bool useVBuffer = options.vBufferPrimary || (!options.useExternalBuffers && options.denoisingType == DenoisingType::ASVGF);
+        for (const auto &run : sweepRuns)
         {
-            std::cout << "Could not create windows." << std::endl;
-            return 1;
+            auto denoiser = std::find(run.arguments.begin(), run.arguments.end(), "--denoiser");
+            useVBuffer |= denoiser != run.arguments.end() && std::next(denoiser) != run.arguments.end() && *std::next(denoiser) == "asvgf";
         }
-        auto viewer = vsg::Viewer::create();
-        viewer->addWindow(window);
-
-        vsg::ref_ptr<vsg::Device> device(window->getOrCreateDevice());
-
-        //setting a custom render pass for imgui non clear rendering
-        {
-            vsg::AttachmentDescription colorAttachment = vsg::defaultColorAttachment(window->surfaceFormat().format);
-            colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-            colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-            colorAttachment.initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-            vsg::AttachmentDescription depthAttachment = vsg::defaultDepthAttachment(window->depthFormat());
-            depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-            depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-            vsg::RenderPass::Attachments attachments{
-                colorAttachment,
-                depthAttachment};
-
-            VkAttachmentReference colorAttachmentRef = {};
-            colorAttachmentRef.attachment = 0;
-            colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-            VkAttachmentReference depthAttachmentRef = {};
-            depthAttachmentRef.attachment = 1;
-            depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-            vsg::SubpassDescription subpass = {};
-            subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-            subpass.colorAttachments.emplace_back(colorAttachmentRef);
-            subpass.depthStencilAttachments.emplace_back(depthAttachmentRef);
-
-            vsg::RenderPass::Subpasses subpasses{subpass};
-
-            // image layout transition
-            VkSubpassDependency colorDependency = {};
-            colorDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-            colorDependency.dstSubpass = 0;
-            colorDependency.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            colorDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-            colorDependency.srcAccessMask = 0;
-            colorDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-            colorDependency.dependencyFlags = 0;
-
-            // depth buffer is shared between swap chain images
-            VkSubpassDependency depthDependency = {};
-            depthDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-            depthDependency.dstSubpass = 0;
-            depthDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-            depthDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-            depthDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-            depthDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-            depthDependency.dependencyFlags = 0;
-
-            vsg::RenderPass::Dependencies dependencies{colorDependency, depthDependency};
-
-            auto renderPass = vsg::RenderPass::create(device, attachments, subpasses, dependencies);
-            window->setRenderPass(renderPass);
-        }
-
-        //create camera matrices
-        auto perspective = vsg::Perspective::create(60, static_cast<double>(windowTraits->width) / static_cast<double>(windowTraits->height), .1, 1000);
-        auto lookAt = vsg::LookAt::create(vsg::dvec3(0.0, -2, 0), vsg::dvec3(0.0, 0.0, 0), vsg::dvec3(0.0, 0.0, 1.0));
-
-        // set push constants
-        auto rayTracingPushConstantsValue = RayTracingPushConstantsValue::create();
-        rayTracingPushConstantsValue->value().projInverse = perspective->inverse();
-        rayTracingPushConstantsValue->value().viewInverse = lookAt->inverse();
-        rayTracingPushConstantsValue->value().prevView = lookAt->transform();
-        rayTracingPushConstantsValue->value().frameNumber = 0;
-        rayTracingPushConstantsValue->value().sampleNumber = 0;
-        auto pushConstants = vsg::PushConstants::create(VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, 0, rayTracingPushConstantsValue);
-        auto computeConstants = vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, rayTracingPushConstantsValue);
-
-        vsg::ref_ptr<GBuffer> gBuffer;
-        vsg::ref_ptr<IlluminationBuffer> illuminationBuffer;
-        vsg::ref_ptr<AccumulationBuffer> accumulationBuffer;
-        bool writeGBuffer;
-        if (denoisingType == DenoisingType::ASVGF)
+        if (useVBuffer)
         {
-            gBuffer = GBuffer::create(windowTraits->width, windowTraits->height);
-            accumulationBuffer = AccumulationBuffer::create(windowTraits->width, windowTraits->height);
-            writeGBuffer = true;
-            illuminationBuffer = IlluminationBufferDemodulatedFloat::create(windowTraits->width, windowTraits->height);
+            windowTraits->deviceFeatures->get<VkPhysicalDeviceVulkan12Features, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES>().drawIndirectCount = VK_TRUE;
+            windowTraits->deviceFeatures->get().multiDrawIndirect = VK_TRUE;
+            windowTraits->deviceFeatures->get().drawIndirectFirstInstance = VK_TRUE;
         }
-        else if (denoisingType != DenoisingType::None)
-        {
-            writeGBuffer = true;
-            gBuffer = GBuffer::create(windowTraits->width, windowTraits->height);
-            illuminationBuffer = IlluminationBufferDemodulatedFloat::create(windowTraits->width, windowTraits->height);
-        }
-        else
+
+        auto& window = session.window;
+        auto& device = session.device;
+        if (options.asyncCompute && (!options.headless || options.useExternalBuffers))
         {
-            writeGBuffer = false;
-            illuminationBuffer = IlluminationBufferFinalFloat::create(windowTraits->width, windowTraits->height);
+            std::cout << "Async compute is only supported for rendered scenes with \"--headless\"." << std::endl;
+            return 1;
         }
-        if (exportIllumination && !gBuffer)
+        if (options.staticCommands && options.asyncCompute)
         {
-            writeGBuffer = true;
-            gBuffer = GBuffer::create(windowTraits->width, windowTraits->height);
+            std::cout << "Static command buffers can not be combined with \"--asyncCompute\"." << std::endl;
+            return 1;
         }
-        if (useTaa && !accumulationBuffer)
+        if (options.upscaling && (options.useExternalBuffers || options.asyncCompute || options.exportGBuffer))
         {
-            // TODO: need the velocity buffer
-        }
-
-        // raytracing pipeline setup
-        uint32_t maxRecursionDepth = 2;
-        vsg::ref_ptr<PBRTPipeline> pbrtPipeline;
-        vsg::ref_ptr<GradientProjector> gradientProjector;
-        vsg::ref_ptr<VBuffer> vBuffer;
-        if (denoisingType == DenoisingType::ASVGF) {
-            vBuffer = VBuffer::create(windowTraits->width, windowTraits->height);
-            vBuffer->setScene(*loaded_scene);
-            gradientProjector = GradientProjector::create(vBuffer);
+            std::cout << "Upscaling is only supported for rendered scenes without \"--asyncCompute\" and GBuffer export." << std::endl;
+            return 1;
         }
-        if(!use_external_buffers)
+        if (options.qualityBudget > 0 && options.useExternalBuffers)
         {
-            pbrtPipeline = PBRTPipeline::create(loaded_scene, gBuffer, illuminationBuffer, gradientProjector, writeGBuffer, RayTracingRayOrigin::CAMERA, arguments);
-
-            // setup tlas
-            vsg::BuildAccelerationStructureTraversal buildAccelStruct(device);
-            loaded_scene->accept(buildAccelStruct);
-            pbrtPipeline->setTlas(buildAccelStruct.tlas);
+            std::cout << "Quality control is only supported for rendered scenes." << std::endl;
+            return 1;
         }
-        else
+        if (options.vBufferPrimary && options.useExternalBuffers)
         {
-            if (!gBuffer)
-                gBuffer = GBuffer::create(offlineGBuffers[0]->depth->width(), offlineGBuffers[0]->depth->height());
-            switch (offlineIlluminations[0]->noisy->getLayout().format)
-            {
-            case VK_FORMAT_R16G16B16A16_SFLOAT:
-                illuminationBuffer = IlluminationBufferDemodulated::create(offlineIlluminations[0]->noisy->width(), offlineIlluminations[0]->noisy->height());
-                break;
-            case VK_FORMAT_R32G32B32A32_SFLOAT:
-                illuminationBuffer = IlluminationBufferDemodulatedFloat::create(offlineIlluminations[0]->noisy->width(), offlineIlluminations[0]->noisy->height());
-                break;
-            default:
-                std::cout << "Offline illumination buffer image format not compatible" << std::endl;
-                return 1;
-            }
-        }
-        // -------------------------------------------------------------------------------------
-        // image layout conversions and correct binding of different denoising tequniques
-        // -------------------------------------------------------------------------------------
-        vsg::CompileTraversal imageLayoutCompile(window);
-        vsg::ref_ptr<vsg::QueryPool> queryPool = vsg::QueryPool::create();
-        std::vector<std::string> queryNames = {};
-
-        auto commands = vsg::Commands::create();
-        commands->addChild(vsg::ResetQueryPool::create(queryPool));
-        commands->addChild(vsg::WriteTimestamp::create(queryPool, 0, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT));
-
-        auto offlineGBufferStager = OfflineGBuffer::create();
-        auto offlineIlluminationBufferStager = OfflineIllumination::create();
-        if (vBuffer) {
-            vBuffer->compile(imageLayoutCompile.context);
-        }
-        if (gradientProjector) {
-            gradientProjector->compile(imageLayoutCompile.context);
-            gradientProjector->updateImageLayouts(imageLayoutCompile.context);
-            gradientProjector->addDispatchToCommandGraph(commands);
-            commands->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-            queryNames.emplace_back("ProjGrad");
+            std::cout << "VBuffer primary visibility is only supported for rendered scenes." << std::endl;
+            return 1;
         }
-        if (pbrtPipeline)
+        if (options.headless)
         {
-            pbrtPipeline->addTraceRaysToCommandGraph(commands, pushConstants);
-            commands->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR));
-            queryNames.emplace_back("RT");
-            illuminationBuffer = pbrtPipeline->getIlluminationBuffer();
+            device = createHeadlessDevice(*windowTraits, session.queueFamily, options.asyncCompute, session.computeQueueFamily, session.computeQueueIndex);
         }
         else
         {
-            if (offlineGBuffers.size() < numFrames || offlineIlluminations.size() < numFrames)
+            window = vsg::Window::create(windowTraits);
+            if (!window)
             {
-                std::cout << "Missing offline GBuffer or offline Illumination Buffer info" << std::endl;
+                std::cout << "Could not create windows." << std::endl;
                 return 1;
             }
-            offlineGBufferStager->uploadToGBufferCommand(gBuffer, commands, imageLayoutCompile.context);
-            offlineIlluminationBufferStager->uploadToIlluminationBufferCommand(illuminationBuffer, commands, imageLayoutCompile.context);
-        }
 
-        vsg::ref_ptr<Accumulator> accumulator;
-        if(denoisingType != DenoisingType::None){
-            if (denoisingType == DenoisingType::ASVGF)
-                accumulator = Accumulator::create(gBuffer, illuminationBuffer, !use_external_buffers, 1.0f);
-            else
-                accumulator = Accumulator::create(gBuffer, illuminationBuffer, !use_external_buffers);
-            accumulator->addDispatchToCommandGraph(commands);
-            commands->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-            queryNames.emplace_back("Accum");
-            accumulationBuffer = accumulator->accumulationBuffer;
-            illuminationBuffer->compile(imageLayoutCompile.context);
-            illuminationBuffer->updateImageLayouts(imageLayoutCompile.context);
-            illuminationBuffer = accumulator->accumulatedIllumination; //swap illumination buffer to accumulated illumination for correct use in the following pipelines
-        }
-
-        vsg::ref_ptr<A_SVGF> a_svgf;
-        vsg::ref_ptr<vsg::DescriptorImage> finalDescriptorImage;
-        switch (denoisingType)
-        {
-        case DenoisingType::None:
-            finalDescriptorImage = illuminationBuffer->illuminationImages[0];
-            break;
-        case DenoisingType::BFR:
-            switch (denoisingBlockSize)
-            {
-            case DenoisingBlockSize::x8:
-            {
-                auto bfr8 = BFR::create(windowTraits->width, windowTraits->height, 8, 8, gBuffer, illuminationBuffer, accumulationBuffer);
-                bfr8->compile(imageLayoutCompile.context);
-                bfr8->updateImageLayouts(imageLayoutCompile.context);
-                bfr8->addDispatchToCommandGraph(commands, computeConstants);
-                finalDescriptorImage = bfr8->getFinalDescriptorImage();
-                break;
-            }
-            case DenoisingBlockSize::x16:
-            {
-                auto bfr16 = BFR::create(windowTraits->width, windowTraits->height, 16, 16, gBuffer, illuminationBuffer, accumulationBuffer);
-                bfr16->compile(imageLayoutCompile.context);
-                bfr16->updateImageLayouts(imageLayoutCompile.context);
-                bfr16->addDispatchToCommandGraph(commands, computeConstants);
-                finalDescriptorImage = bfr16->getFinalDescriptorImage();
-                break;
-            }
-            case DenoisingBlockSize::x32:
-            {
-                auto bfr32 = BFR::create(windowTraits->width, windowTraits->height, 32, 32, gBuffer, illuminationBuffer, accumulationBuffer);
-                bfr32->compile(imageLayoutCompile.context);
-                bfr32->updateImageLayouts(imageLayoutCompile.context);
-                bfr32->addDispatchToCommandGraph(commands, computeConstants);
-                finalDescriptorImage = bfr32->getFinalDescriptorImage();
-                break;
-            }
-            case DenoisingBlockSize::x8x16x32:
-            {
-                auto bfr8 = BFR::create(windowTraits->width, windowTraits->height, 8, 8, gBuffer, illuminationBuffer, accumulationBuffer);
-                auto bfr16 = BFR::create(windowTraits->width, windowTraits->height, 16, 16, gBuffer, illuminationBuffer, accumulationBuffer);
-                auto bfr32 = BFR::create(windowTraits->width, windowTraits->height, 32, 32, gBuffer, illuminationBuffer, accumulationBuffer);
-                auto blender = BFRBlender::create(windowTraits->width, windowTraits->height,
-                                                  illuminationBuffer->illuminationImages[0], illuminationBuffer->illuminationImages[1],
-                                                  bfr8->getFinalDescriptorImage(), bfr16->getFinalDescriptorImage(), bfr32->getFinalDescriptorImage());
-                bfr8->compile(imageLayoutCompile.context);
-                bfr8->updateImageLayouts(imageLayoutCompile.context);
-                bfr16->compile(imageLayoutCompile.context);
-                bfr16->updateImageLayouts(imageLayoutCompile.context);
-                bfr32->compile(imageLayoutCompile.context);
-                bfr32->updateImageLayouts(imageLayoutCompile.context);
-                blender->compile(imageLayoutCompile.context);
-                blender->updateImageLayouts(imageLayoutCompile.context);
-                bfr8->addDispatchToCommandGraph(commands, computeConstants);
-                bfr16->addDispatchToCommandGraph(commands, computeConstants);
-                bfr32->addDispatchToCommandGraph(commands, computeConstants);
-                blender->addDispatchToCommandGraph(commands);
-                finalDescriptorImage = blender->getFinalDescriptorImage();
-                break;
-            }
-            }
-            break;
-        case DenoisingType::BMFR:
-            switch (denoisingBlockSize)
-            {
-            case DenoisingBlockSize::x8:
-            {
-                auto bmfr8 = BMFR::create(windowTraits->width, windowTraits->height, 8, 8, gBuffer, illuminationBuffer, accumulationBuffer, 64);
-                bmfr8->compile(imageLayoutCompile.context);
-                bmfr8->updateImageLayouts(imageLayoutCompile.context);
-                bmfr8->addDispatchToCommandGraph(commands, computeConstants);
-                finalDescriptorImage = bmfr8->getFinalDescriptorImage();
-                break;
-            }
-            case DenoisingBlockSize::x16:
-            {
-                auto bmfr16 = BMFR::create(windowTraits->width, windowTraits->height, 16, 16, gBuffer, illuminationBuffer, accumulationBuffer);
-                bmfr16->compile(imageLayoutCompile.context);
-                bmfr16->updateImageLayouts(imageLayoutCompile.context);
-                bmfr16->addDispatchToCommandGraph(commands, computeConstants);
-                finalDescriptorImage = bmfr16->getFinalDescriptorImage();
-                break;
-            }
-            case DenoisingBlockSize::x32:
-            {
-                auto bmfr32 = BMFR::create(windowTraits->width, windowTraits->height, 32, 32, gBuffer, illuminationBuffer, accumulationBuffer);
-                bmfr32->compile(imageLayoutCompile.context);
-                bmfr32->updateImageLayouts(imageLayoutCompile.context);
-                bmfr32->addDispatchToCommandGraph(commands, computeConstants);
-                finalDescriptorImage = bmfr32->getFinalDescriptorImage();
-                break;
-            }
-            case DenoisingBlockSize::x8x16x32:
-                auto bmfr8 = BMFR::create(windowTraits->width, windowTraits->height, 8, 8, gBuffer, illuminationBuffer, accumulationBuffer, 64);
-                auto bmfr16 = BMFR::create(windowTraits->width, windowTraits->height, 16, 16, gBuffer, illuminationBuffer, accumulationBuffer);
-                auto bmfr32 = BMFR::create(windowTraits->width, windowTraits->height, 32, 32, gBuffer, illuminationBuffer, accumulationBuffer);
-                auto blender = BFRBlender::create(windowTraits->width, windowTraits->height,
-                                                  illuminationBuffer->illuminationImages[1], illuminationBuffer->illuminationImages[2],
-                                                  bmfr8->getFinalDescriptorImage(), bmfr16->getFinalDescriptorImage(), bmfr32->getFinalDescriptorImage());
-                bmfr8->compile(imageLayoutCompile.context);
-                bmfr8->updateImageLayouts(imageLayoutCompile.context);
-                bmfr16->compile(imageLayoutCompile.context);
-                bmfr16->updateImageLayouts(imageLayoutCompile.context);
-                bmfr32->compile(imageLayoutCompile.context);
-                bmfr32->updateImageLayouts(imageLayoutCompile.context);
-                blender->compile(imageLayoutCompile.context);
-                blender->updateImageLayouts(imageLayoutCompile.context);
-                bmfr8->addDispatchToCommandGraph(commands, computeConstants);
-                bmfr16->addDispatchToCommandGraph(commands, computeConstants);
-                bmfr32->addDispatchToCommandGraph(commands, computeConstants);
-                blender->addDispatchToCommandGraph(commands);
-                finalDescriptorImage = blender->getFinalDescriptorImage();
-                break;
-            }
-            break;
-        case DenoisingType::ASVGF: {
-            a_svgf = A_SVGF::create(windowTraits->width, windowTraits->height, gBuffer, illuminationBuffer, accumulationBuffer, gradientProjector, arguments);
-            a_svgf->compile(imageLayoutCompile.context);
-            a_svgf->updateImageLayouts(imageLayoutCompile.context);
-            a_svgf->addDispatchToCommandGraph(commands, queryPool, queryNames);
-            finalDescriptorImage = a_svgf->getFinalDescriptorImage();
-            break;
-        }
-        case DenoisingType::SVG:
-            std::cout << "Not yet implemented" << std::endl;
-            break;
-        }
+            checkVBufferFeatures(*window->getOrCreatePhysicalDevice(), *windowTraits);
+            device = window->getOrCreateDevice();
 
-        if (useTaa && accumulationBuffer)
-        {
-            auto taa = Taa::create(windowTraits->width, windowTraits->height, 16, 16, gBuffer, accumulationBuffer, finalDescriptorImage);
-            taa->compile(imageLayoutCompile.context);
-            taa->updateImageLayouts(imageLayoutCompile.context);
-            taa->addDispatchToCommandGraph(commands);
-            finalDescriptorImage = taa->getFinalDescriptorImage();
-        }
-        if (exportGBuffer)
-        {
-            if (!gBuffer)
+            //setting a custom render pass for imgui non clear rendering
             {
-                std::cout << "GBuffer information not available, export not possible" << std::endl;
-                return 1;
-            }
-            offlineGBufferStager->downloadFromGBufferCommand(gBuffer, commands, imageLayoutCompile.context);
-        }
-        if (exportIllumination)
-        {
-            if (finalDescriptorImage->imageInfoList[0]->imageView->image->format != VK_FORMAT_R32G32B32A32_SFLOAT)
-            {
-                std::cout << "Final image layout is not compatible illumination buffer export" << std::endl;
-                return 1;
-            }
-            offlineIlluminationBufferStager->downloadFromIlluminationBufferCommand(finalDescriptorImage, commands, imageLayoutCompile.context);
-        }
-        if (finalDescriptorImage->imageInfoList[0]->imageView->image->format != VK_FORMAT_B8G8R8A8_UNORM)
-        {
-            auto converter = FormatConverter::create(finalDescriptorImage->imageInfoList[0]->imageView, VK_FORMAT_B8G8R8A8_UNORM);
-            converter->compileImages(imageLayoutCompile.context);
-            converter->updateImageLayouts(imageLayoutCompile.context);
-            converter->addDispatchToCommandGraph(commands);
-            finalDescriptorImage = converter->finalImage;
-        }
-        if (gBuffer)
-        {
-            gBuffer->compile(imageLayoutCompile.context);
-            gBuffer->updateImageLayouts(imageLayoutCompile.context);
-        }
-        if (accumulationBuffer)
-        {
-            accumulationBuffer->compile(imageLayoutCompile.context);
-            accumulationBuffer->updateImageLayouts(imageLayoutCompile.context);
-        }
-        if (illuminationBuffer)
-        {
-            illuminationBuffer->compile(imageLayoutCompile.context);
-            illuminationBuffer->updateImageLayouts(imageLayoutCompile.context);
-        }
-        imageLayoutCompile.context.record();
-
-        if (accumulationBuffer)
-        {
-            accumulationBuffer->copyToBackImages(commands, gBuffer, illuminationBuffer);
-        }
+                vsg::AttachmentDescription colorAttachment = vsg::defaultColorAttachment(window->surfaceFormat().format);
+                colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                colorAttachment.initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+                vsg::AttachmentDescription depthAttachment = vsg::defaultDepthAttachment(window->depthFormat());
+                depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                vsg::RenderPass::Attachments attachments{
+                    colorAttachment,
+                    depthAttachment};
 
-        // set GUI values
-        auto guiValues = Gui::Values::create();
-        guiValues->width = windowTraits->width;
-        guiValues->height = windowTraits->height;
-        CountTrianglesVisitor counter;
-        if (loaded_scene)
-            loaded_scene->accept(counter);
-        guiValues->triangleCount = counter.triangleCount;
-        guiValues->raysPerPixel = maxRecursionDepth * 2; //for each depth recursion one next event estimate is done
+                VkAttachmentReference colorAttachmentRef = {};
+                colorAttachmentRef.attachment = 0;
+                colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-        auto viewport = vsg::ViewportState::create(0, 0, windowTraits->width, windowTraits->height);
-        auto camera = vsg::Camera::create(perspective, lookAt, viewport);
-        auto renderGraph = vsg::createRenderGraphForView(window, camera, vsgImGui::RenderImGui::create(window, Gui(guiValues))); // render graph for gui rendering
-        renderGraph->clearValues.clear();                                                                                        //removing clear values to avoid clearing the raytraced image
-
-        auto commandGraph = vsg::CommandGraph::create(window);
-        if (vBuffer) commandGraph->addChild(vBuffer->renderGraph);
-        commandGraph->addChild(commands);
-        commandGraph->addChild(vsg::CopyImageViewToWindow::create(finalDescriptorImage->imageInfoList[0]->imageView, window));
-        commandGraph->addChild(renderGraph);
-
-        //close handler to close and imgui handler to forward to imgui
-        viewer->addEventHandler(vsgImGui::SendEventsToImGui::create());
-        viewer->addEventHandler(vsg::CloseHandler::create(viewer));
-        if (useFlyNavigation)
-            viewer->addEventHandler(vsg::FlyNavigation::create(camera));
-        else
-            viewer->addEventHandler(vsg::Trackball::create(camera));
-        viewer->assignRecordAndSubmitTaskAndPresentation({commandGraph});
-        viewer->compile();
+                VkAttachmentReference depthAttachmentRef = {};
+                depthAttachmentRef.attachment = 1;
+                depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-        // waiting for image layout transitions
-        imageLayoutCompile.context.waitForCompletion();
+                vsg::SubpassDescription subpass = {};
+                subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+                subpass.colorAttachments.emplace_back(colorAttachmentRef);
+                subpass.depthStencilAttachments.emplace_back(depthAttachmentRef);
 
-        // write perf CSV header
-        for (const auto &name : queryNames) {
-            std::cout << name << ",";
-        }
-        std::cout << std::endl;
-        auto nsPerTick = static_cast<double>(device->getPhysicalDevice()->getProperties().limits.timestampPeriod);
+                vsg::RenderPass::Subpasses subpasses{subpass};
 
-        int frame_index = 0;
-        int sample_index = 0;
-        while(viewer->advanceToNextFrame() && (numFrames < 0 || frame_index < numFrames))
-        {
-            viewer->handleEvents();
-            if (!camPositions.empty())
-            {
-                auto posIdx = (size_t)frame_index;
-                if (posIdx >= camPositions.size())
-                    posIdx = camPositions.size() - 1;
-                lookAt->eye = camPositions[posIdx];
-            }
-            if ((vsg::mat4)vsg::lookAt(lookAt->eye, lookAt->center, lookAt->up) != rayTracingPushConstantsValue->value().prevView)
-            {
-                // clear samples when the camera has moved
-                sample_index = 0;
-            }
+                // image layout transition
+                VkSubpassDependency colorDependency = {};
+                colorDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+                colorDependency.dstSubpass = 0;
+                colorDependency.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+                colorDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+                colorDependency.srcAccessMask = 0;
+                colorDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+                colorDependency.dependencyFlags = 0;
 
-            if (vBuffer)
-                vBuffer->viewProjectMatrixValue->value() = perspective->transform() * lookAt->transform();
-            rayTracingPushConstantsValue->value().viewInverse = lookAt->inverse();
-            if (gradientProjector)
-                gradientProjector->updatePushConstants(perspective->transform(), lookAt->transform(), frame_index);
-            if (a_svgf)
-                a_svgf->updatePushConstants(perspective->transform(), lookAt->transform());
+                // depth buffer is shared between swap chain images
+                VkSubpassDependency depthDependency = {};
+                depthDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+                depthDependency.dstSubpass = 0;
+                depthDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+                depthDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+                depthDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+                depthDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+                depthDependency.dependencyFlags = 0;
 
-            rayTracingPushConstantsValue->value().frameNumber = frame_index * samplesPerPixel + sample_index;
-            rayTracingPushConstantsValue->value().sampleNumber = sample_index;
-            guiValues->sampleNumber = sample_index;
+                vsg::RenderPass::Dependencies dependencies{colorDependency, depthDependency};
 
-            if (use_external_buffers)
-            {
-                offlineGBufferStager->transferStagingDataFrom(offlineGBuffers[frame_index]);
-                offlineIlluminationBufferStager->transferStagingDataFrom(offlineIlluminations[frame_index]);
-                if (accumulator)
-                   accumulator->setCameraMatrices(frame_index, cameraMatrices[frame_index], cameraMatrices[frame_index ? frame_index - 1 : frame_index]);
-            }
-            else if (accumulator)
-            {
-                CameraMatrices a{}, b{};
-                a.invView = lookAt->inverse();
-                a.invProj = perspective->inverse();
-                a.proj = perspective->transform();
-                b.view = rayTracingPushConstantsValue->value().prevView;
-                accumulator->setCameraMatrices(rayTracingPushConstantsValue->value().frameNumber, a, b);
+                auto renderPass = vsg::RenderPass::create(device, attachments, subpasses, dependencies);
+                window->setRenderPass(renderPass);
             }
+        }
 
-            viewer->update();
-            viewer->recordAndSubmit();
-            viewer->present();
+        // the acceleration structures are built once and shared by all runs
+        if (!options.useExternalBuffers)
+        {
+            vsg::BuildAccelerationStructureTraversal buildAccelStruct(device);
+            loaded_scene->accept(buildAccelStruct);
+            session.tlas = buildAccelStruct.tlas;
+        }
 
-            rayTracingPushConstantsValue->value().prevView = lookAt->transform();
-
-            if (sample_index + 1 >= samplesPerPixel) {
-                if (exportGBuffer || exportIllumination) {
-                    viewer->deviceWaitIdle();
-                    if (exportIllumination) {
-                        offlineIlluminationBufferStager->transferStagingDataTo(offlineIlluminations[frame_index]);
-                    }
-                    if (exportGBuffer) {
-                        offlineGBufferStager->transferStagingDataTo(offlineGBuffers[frame_index]);
-                    }
-                }
-                if (storeMatrices) {
-                    cameraMatrices[frame_index].view = lookAt->transform();
-                    cameraMatrices[frame_index].invView = lookAt->inverse();
-                    cameraMatrices[frame_index].proj.value() = perspective->transform();
-                    cameraMatrices[frame_index].invProj.value() = perspective->inverse();
-                }
-                frame_index++;
-            }
-            sample_index++;
+        if (options.compressTextures && !options.useExternalBuffers)
+            session.textureCompressor = TextureCompressor::create(options.textureCachePath);
 
-            // print perf data (microseconds)
-            auto perfRes = queryPool->getResults();
-            for (size_t i = 1; i < perfRes.size(); i++) {
-                std::cout << std::fixed << std::setprecision(2) << double(perfRes[i] - perfRes[i-1]) * nsPerTick * 0.001 << ",";
-            }
-            std::cout << std::endl;
+        // the runs of a sweep share the device, the scene and the pipelines created by earlier runs
+        size_t runCount = std::max<size_t>(1, sweepRuns.size());
+        for (size_t runIndex = 0; runIndex < runCount; ++runIndex)
+        {
+            if (int result = renderRun(session, arguments, sweepRuns, runIndex))
+                return result;
         }
-
-        // exporting all images
-        if (exportGBuffer)
-            GBufferIO::exportGBuffer(exportPositionPath, exportDepthPath, exportNormalPath, exportMaterialPath, exportAlbedoPath, numFrames, offlineGBuffers, cameraMatrices);
-        if (exportIllumination)
-            IlluminationBufferIO::exportIllumination(exportIlluminationPath, numFrames, offlineIlluminations, 0);
-        if (exportMatricesPath.size())
-            MatrixIO::exportMatrices(exportMatricesPath, cameraMatrices);
     }
     catch (const vsg::Exception &e)
     {
@@ -831,4 +1636,4 @@ int main(int argc, char **argv)
         return 0;
     }
     return 0;
-}
\ No newline at end of file
+}
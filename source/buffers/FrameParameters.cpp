@@ -0,0 +1,95 @@
+#include <buffers/FrameParameters.hpp>
+
+#include <cstring>
+
+// copies the slot of the current frame into the uniform buffers
+class FrameParameters::CopyToUniforms : public vsg::Inherit<vsg::Command, FrameParameters::CopyToUniforms>
+{
+public:
+    explicit CopyToUniforms(vsg::ref_ptr<FrameParameters> parameters) :
+        parameters(parameters) {}
+
+    void compile(vsg::Context& context) override
+    {
+        parameters->compile(context);
+    }
+    void record(vsg::CommandBuffer& commandBuffer) const override
+    {
+        if (parameters->entries.empty())
+            return;
+        auto deviceID = commandBuffer.deviceID;
+        // the shaders of the previous frame have to be done reading the uniform buffers before they are overwritten,
+        // other work of the previous frame may still overlap
+        vkCmdPipelineBarrier(commandBuffer, parameters->readStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+        for (const auto& entry : parameters->entries)
+        {
+            VkBufferCopy region{parameters->slot * parameters->slotSize + entry.offset, entry.uniformBuffer->offset, entry.value->dataSize()};
+            vkCmdCopyBuffer(commandBuffer, parameters->stagingBuffer->vk(deviceID), entry.uniformBuffer->buffer->vk(deviceID), 1, &region);
+        }
+        VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, parameters->readStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+private:
+    vsg::ref_ptr<FrameParameters> parameters;
+};
+
+FrameParameters::FrameParameters(uint32_t slotCount) :
+    slotCount(slotCount)
+{
+}
+
+vsg::ref_ptr<vsg::BufferInfo> FrameParameters::createUniformBuffer(VkDeviceSize size)
+{
+    auto buffer = vsg::Buffer::create(size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_SHARING_MODE_EXCLUSIVE);
+    return vsg::BufferInfo::create(buffer, 0, size);
+}
+
+void FrameParameters::add(vsg::ref_ptr<vsg::Data> value, vsg::ref_ptr<vsg::BufferInfo> uniformBuffer, VkPipelineStageFlags readStages)
+{
+    if (stagingBuffer)
+        throw vsg::Exception{"Error: FrameParameters::add(...) values have to be added before compile()."};
+    if (value->dataSize() > uniformBuffer->range)
+        throw vsg::Exception{"Error: FrameParameters::add(...) value is larger than its uniform buffer."};
+    entries.push_back({value, uniformBuffer, slotSize});
+    this->readStages |= readStages;
+    // 16 byte aligned like the members of a uniform block
+    slotSize += (value->dataSize() + 15) & ~VkDeviceSize(15);
+}
+
+void FrameParameters::addCopyToCommandGraph(vsg::ref_ptr<vsg::Commands> commands)
+{
+    commands->addChild(CopyToUniforms::create(vsg::ref_ptr<FrameParameters>(this)));
+}
+
+void FrameParameters::compile(vsg::Context& context)
+{
+    if (stagingBuffer || entries.empty())
+        return;
+    device = context.device;
+    stagingBuffer = vsg::createBufferAndMemory(device, slotCount * slotSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE,
+                                               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    // a uniform buffer whose descriptor was not compiled yet gets device local memory
+    for (auto& entry : entries)
+    {
+        auto buffer = entry.uniformBuffer->buffer;
+        if (buffer->compile(device))
+            buffer->bind(vsg::DeviceMemory::create(device, buffer->getMemoryRequirements(device->deviceID), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT), 0);
+    }
+    for (uint32_t i = 0; i < slotCount; ++i)
+        update(i);
+}
+
+void FrameParameters::update(uint32_t frameSlot)
+{
+    slot = frameSlot % slotCount;
+    if (!stagingBuffer)
+        return;
+    auto deviceID = device->deviceID;
+    auto memory = stagingBuffer->getDeviceMemory(deviceID);
+    void* gpu_data;
+    memory->map(stagingBuffer->getMemoryOffset(deviceID) + slot * slotSize, slotSize, 0, &gpu_data);
+    for (const auto& entry : entries)
+        std::memcpy(static_cast<char*>(gpu_data) + entry.offset, entry.value->dataPointer(), entry.value->dataSize());
+    memory->unmap();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vsg/all.h>
+
+#include <cstdint>
+#include <vector>
+
+// Frame parameters -------------------------------------------------------------------------
+// Values which change every frame, read by the shaders from uniform buffers instead of push constants, so the
+// recorded commands stay the same from frame to frame. update() writes all values into the host visible staging
+// memory of a slot, the copy command of the frame copies them from there into the uniform buffers of the modules.
+// A slot may only be written when no frame in flight still copies from it, the slots follow the query pools of the
+// profiler.
+class FrameParameters : public vsg::Inherit<vsg::Object, FrameParameters>
+{
+public:
+    explicit FrameParameters(uint32_t slotCount);
+
+    // device local uniform buffer of a module, written by the copy command
+    static vsg::ref_ptr<vsg::BufferInfo> createUniformBuffer(VkDeviceSize size);
+
+    // the value is copied into the uniform buffer every frame, neither may change its size. readStages are the
+    // pipeline stages of the shaders reading the uniform buffer, the copy only waits for those of the previous frame
+    void add(vsg::ref_ptr<vsg::Data> value, vsg::ref_ptr<vsg::BufferInfo> uniformBuffer, VkPipelineStageFlags readStages);
+    // appends the copy of the current slot, has to come before all commands reading the uniform buffers
+    void addCopyToCommandGraph(vsg::ref_ptr<vsg::Commands> commands);
+    // writes the current values into the slot of the frame, before the frame is recorded
+    void update(uint32_t slot);
+
+private:
+    class CopyToUniforms;
+
+    struct Entry
+    {
+        vsg::ref_ptr<vsg::Data> value;
+        vsg::ref_ptr<vsg::BufferInfo> uniformBuffer;
+        VkDeviceSize offset;
+    };
+
+    void compile(vsg::Context& context);
+
+    uint32_t slotCount, slot = 0;
+    std::vector<Entry> entries;
+    VkDeviceSize slotSize = 0;
+    VkPipelineStageFlags readStages = 0;
+    vsg::ref_ptr<vsg::Buffer> stagingBuffer;
+    vsg::ref_ptr<vsg::Device> device;
+};
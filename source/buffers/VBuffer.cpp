@@ -11,20 +11,31 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 
 #include "VBuffer.hpp"
 
+#include <algorithm>
+#include <limits>
+#include <map>
+
 /*
  * Note about this pass: ideally this would be run in parallel with compute/post-proc work from the previous frame
  * to make better use of the hardware (run fixed function work parallel to compute),
  * but that would take a lot of refactoring in this application.
+ *
+ * The scene is drawn GPU driven: all meshes are merged into one vertex and index buffer, a compute pass frustum culls
+ * the mesh instances against their bounding boxes and the visible ones are drawn with one vkCmdDrawIndexedIndirectCount.
+ * With primitive ids the VBuffer also replaces the primary rays of the path tracer (--primaryVisibility vbuffer).
  */
 
-VBuffer::VBuffer(uint32_t width, uint32_t height)
+VBuffer::VBuffer(uint32_t width, uint32_t height, bool writePrimitiveIds)
     : width(width), height(height)
 {
     auto vertStage = vsg::ShaderStage::read(VK_SHADER_STAGE_VERTEX_BIT, "main", "shaders/vbuffer.vert.spv");
-    auto fragStage = vsg::ShaderStage::read(VK_SHADER_STAGE_FRAGMENT_BIT, "main", "shaders/vbuffer.frag.spv");
+    auto fragStage = vsg::ShaderStage::read(VK_SHADER_STAGE_FRAGMENT_BIT, "main",
+                                            writePrimitiveIds ? "shaders/vbufferPrimitive.frag.spv" : "shaders/vbuffer.frag.spv");
 
     const auto &pushConstRanges = vertStage->getPushConstantRanges();
-    auto pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{}, pushConstRanges);
+    auto bindingMap = vertStage->getDescriptorSetLayoutBindingsMap();
+    auto descriptorSetLayout = vsg::DescriptorSetLayout::create(bindingMap.begin()->second.bindings);
+    auto pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{descriptorSetLayout}, pushConstRanges);
 
     vsg::ShaderStages shaderStages{vertStage, fragStage};
 
@@ -40,9 +51,9 @@ VBuffer::VBuffer(uint32_t width, uint32_t height)
         rasterState,
         vsg::MultisampleState::create(), // default settings
         vsg::DepthStencilState::create(), // default settings
-        vsg::ColorBlendState::create(vsg::ColorBlendState::ColorBlendAttachments{{
+        vsg::ColorBlendState::create(vsg::ColorBlendState::ColorBlendAttachments(writePrimitiveIds ? 2 : 1,
             VkPipelineColorBlendAttachmentState{VK_FALSE, {}, {}, {}, {}, {}, {}, VkColorComponentFlagBits::VK_COLOR_COMPONENT_R_BIT}
-        }}),
+        )),
         vsg::ViewportState::create(0, 0, width, height),
     };
 
@@ -83,7 +94,85 @@ VBuffer::VBuffer(uint32_t width, uint32_t height)
     imageInfo->sampler->minFilter = imageInfo->sampler->magFilter = VK_FILTER_NEAREST;
     visBuffer = vsg::DescriptorImage::create(imageInfo, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
 
+    if (writePrimitiveIds)
+    {
+        image = vsg::Image::create();
+        image->imageType = VK_IMAGE_TYPE_2D;
+        image->format = VK_FORMAT_R32_UINT;
+        image->extent.width = width;
+        image->extent.height = height;
+        image->extent.depth = 1;
+        image->mipLevels = 1;
+        image->arrayLayers = 1;
+        image->samples = VK_SAMPLE_COUNT_1_BIT;
+        image->tiling = VK_IMAGE_TILING_OPTIMAL;
+        image->usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        image->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        image->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageView = vsg::ImageView::create(image, VK_IMAGE_ASPECT_COLOR_BIT);
+        imageInfo = vsg::ImageInfo::create(imageInfo->sampler, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        primitiveBuffer = vsg::DescriptorImage::create(imageInfo, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    }
+
     viewProjectMatrixValue = vsg::mat4Value::create();
+
+    auto cullStage = vsg::ShaderStage::read(VK_SHADER_STAGE_COMPUTE_BIT, "main", "shaders/vbufferCull.comp.spv");
+    bindingMap = cullStage->getDescriptorSetLayoutBindingsMap();
+    descriptorSetLayout = vsg::DescriptorSetLayout::create(bindingMap.begin()->second.bindings);
+    pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{descriptorSetLayout}, cullStage->getPushConstantRanges());
+    cullPipeline = vsg::ComputePipeline::create(pipelineLayout, cullStage);
+}
+
+namespace
+{
+    // layouts of the buffers in vbuffer.vert and vbufferCull.comp
+    struct Instance
+    {
+        vsg::vec4 matModel3x4[3];
+        uint32_t meshId;
+        uint32_t pad[3];
+    };
+
+    struct Draw
+    {
+        vsg::vec4 boundsMin, boundsMax;
+        uint32_t indexCount;
+        uint32_t firstIndex;
+        int32_t vertexOffset;
+        uint32_t firstInstance;
+        uint32_t instanceCount;
+        uint32_t pad[3];
+    };
+
+    class FillBuffer : public vsg::Inherit<vsg::Command, FillBuffer>
+    {
+    public:
+        FillBuffer(vsg::ref_ptr<vsg::Buffer> buffer, uint32_t value) : buffer(buffer), value(value) {}
+
+        void record(vsg::CommandBuffer& commandBuffer) const override
+        {
+            vkCmdFillBuffer(commandBuffer, buffer->vk(commandBuffer.deviceID), 0, VK_WHOLE_SIZE, value);
+        }
+
+        vsg::ref_ptr<vsg::Buffer> buffer;
+        uint32_t value;
+    };
+
+    class DrawIndexedIndirectCount : public vsg::Inherit<vsg::Command, DrawIndexedIndirectCount>
+    {
+    public:
+        DrawIndexedIndirectCount(vsg::ref_ptr<vsg::Buffer> drawBuffer, vsg::ref_ptr<vsg::Buffer> countBuffer, uint32_t maxDrawCount) :
+            drawBuffer(drawBuffer), countBuffer(countBuffer), maxDrawCount(maxDrawCount) {}
+
+        void record(vsg::CommandBuffer& commandBuffer) const override
+        {
+            vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer->vk(commandBuffer.deviceID), 0, countBuffer->vk(commandBuffer.deviceID), 0,
+                                          maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+        }
+
+        vsg::ref_ptr<vsg::Buffer> drawBuffer, countBuffer;
+        uint32_t maxDrawCount;
+    };
 }
 
 class VBufferRenderVisitor : public vsg::Visitor
@@ -91,17 +180,65 @@ class VBufferRenderVisitor : public vsg::Visitor
     vsg::MatrixStack transform;
     uint32_t meshId = 1;
     uint32_t volId = 0x8000'0001;
+    // meshes referenced by several transforms are only stored once, volumes share one cube
+    std::map<const vsg::VertexIndexDraw*, Draw> meshes;
+    vsg::ref_ptr<vsg::VertexIndexDraw> cube;
 
-    struct PushConst
+    Draw addMesh(const vsg::VertexIndexDraw &draw)
     {
-        float matModel3x4[12];
-        uint32_t meshId;
-    };
+        auto positions = draw.arrays[0]->data.cast<vsg::vec3Array>();
+        if (!positions) throw vsg::Exception{"Error: VBufferRenderVisitor::addMesh(...) Vertex positions have to be vec3."};
+        Draw mesh{};
+        mesh.boundsMin = vsg::vec4(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), 1);
+        mesh.boundsMax = vsg::vec4(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), 1);
+        for (const auto &position : *positions)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                mesh.boundsMin[i] = std::min(mesh.boundsMin[i], position[i]);
+                mesh.boundsMax[i] = std::max(mesh.boundsMax[i], position[i]);
+            }
+        }
+        mesh.indexCount = draw.indexCount;
+        mesh.firstIndex = static_cast<uint32_t>(indices.size()) + draw.firstIndex;
+        mesh.vertexOffset = static_cast<int32_t>(vertices.size()) + draw.vertexOffset;
+        vertices.insert(vertices.end(), positions->begin(), positions->end());
+        if (auto shortIndices = draw.indices->data.cast<vsg::ushortArray>())
+            indices.insert(indices.end(), shortIndices->begin(), shortIndices->end());
+        else if (auto intIndices = draw.indices->data.cast<vsg::uintArray>())
+            indices.insert(indices.end(), intIndices->begin(), intIndices->end());
+        else
+            throw vsg::Exception{"Error: VBufferRenderVisitor::addMesh(...) Indices have to be 16 or 32 bit."};
+        return mesh;
+    }
 
-    using PushConstValue = vsg::Value<PushConst>;
+    void addInstances(const vsg::VertexIndexDraw &draw, uint32_t firstMeshId)
+    {
+        auto mesh = meshes.find(&draw);
+        if (mesh == meshes.end())
+            mesh = meshes.emplace(&draw, addMesh(draw)).first;
+
+        Instance instance{};
+        auto modelMat = vsg::transpose(transform.top());
+        for (size_t i = 0; i < 12; i++)
+            instance.matModel3x4[i / 4][i % 4] = (float)modelMat.data()[i];
+        Draw meshDraw = mesh->second;
+        meshDraw.firstInstance = static_cast<uint32_t>(instances.size());
+        meshDraw.instanceCount = draw.instanceCount;
+        for (uint32_t i = 0; i < draw.instanceCount; ++i)
+        {
+            instance.meshId = firstMeshId + i;
+            instances.push_back(instance);
+        }
+        draws.push_back(meshDraw);
+    }
 
 public:
-    vsg::ref_ptr<vsg::Commands> commands;
+    std::vector<vsg::vec3> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<Instance> instances;
+    std::vector<Draw> draws;
+    std::vector<vsg::dmat4> inverseVolumeTransforms;
 
     VBufferRenderVisitor() = default;
 
@@ -119,33 +256,25 @@ public:
 
     void apply(vsg::VertexIndexDraw &draw) override
     {
-        auto pushVal = PushConstValue::create();
-        auto modelMat = vsg::transpose(transform.top());
-        for (size_t i = 0; i < 12; i++)
-            pushVal->value().matModel3x4[i] = (float)modelMat.data()[i];
-        pushVal->value().meshId = meshId;
-        auto pushConst = vsg::PushConstants::create(VK_SHADER_STAGE_VERTEX_BIT, 64, pushVal);
-        commands->addChild(pushConst);
-        commands->addChild(vsg::ref_ptr(&draw));
+        // skipped by the acceleration structures as well
+        if (draw.arrays.empty()) return;
+        addInstances(draw, meshId);
         meshId += draw.instanceCount;
         if (meshId > 0x8000'0000) throw vsg::Exception{"Too many mesh ids used!"};
     }
 
-    void apply(vsg::Volumetric &volumetric) override
+    void apply(vsg::Volumetric &) override
     {
-        auto pushVal = PushConstValue::create();
-        auto modelMat = vsg::transpose(transform.top());
-        for (size_t i = 0; i < 12; i++)
-            pushVal->value().matModel3x4[i] = (float)modelMat.data()[i];
-        pushVal->value().meshId = volId;
-        auto pushConst = vsg::PushConstants::create(VK_SHADER_STAGE_VERTEX_BIT, 64, pushVal);
-        commands->addChild(pushConst);
-        auto draw = vsg::VertexIndexDraw::create();
-        draw->assignArrays(vsg::DataList{vsg::floatArray::create({0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 1, 1, 1, 0, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1})});
-        draw->assignIndices(vsg::ushortArray::create({0,4,1,1,4,5, 4,6,5,5,6,7, 1,5,3,3,5,7, 0,2,4,4,2,6, 0,1,2,2,1,3, 2,3,6,6,3,7}));
-        draw->instanceCount = 1;
-        draw->indexCount = 36;
-        commands->addChild(draw);
+        if (!cube)
+        {
+            cube = vsg::VertexIndexDraw::create();
+            cube->assignArrays(vsg::DataList{vsg::vec3Array::create({{0, 0, 0}, {0, 0, 1}, {0, 1, 0}, {0, 1, 1}, {1, 0, 0}, {1, 0, 1}, {1, 1, 0}, {1, 1, 1}})});
+            cube->assignIndices(vsg::ushortArray::create({0,4,1,1,4,5, 4,6,5,5,6,7, 1,5,3,3,5,7, 0,2,4,4,2,6, 0,1,2,2,1,3, 2,3,6,6,3,7}));
+            cube->instanceCount = 1;
+            cube->indexCount = 36;
+        }
+        addInstances(*cube, volId);
+        inverseVolumeTransforms.push_back(vsg::inverse(transform.top()));
         volId++;
     }
 };
@@ -153,17 +282,81 @@ public:
 void VBuffer::setScene(vsg::Node& scene)
 {
     VBufferRenderVisitor visitor;
-    visitor.commands = vsg::Commands::create();
-    visitor.commands->addChild(vsg::BindGraphicsPipeline::create(pipeline));
-    visitor.commands->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_VERTEX_BIT, 0, viewProjectMatrixValue));
     scene.accept(visitor);
-    commands = visitor.commands;
-    if (renderGraph) renderGraph->children = {commands};
+    if (visitor.draws.empty())
+        throw vsg::Exception{"Error: VBuffer::setScene(...) The scene does not contain any meshes."};
+
+    auto vertexArray = vsg::vec3Array::create(visitor.vertices.size());
+    std::copy(visitor.vertices.begin(), visitor.vertices.end(), vertexArray->data());
+    auto indexArray = vsg::uintArray::create(visitor.indices.size());
+    std::copy(visitor.indices.begin(), visitor.indices.end(), indexArray->data());
+    auto instanceArray = vsg::Array<Instance>::create(visitor.instances.size());
+    std::copy(visitor.instances.begin(), visitor.instances.end(), instanceArray->data());
+    auto drawArray = vsg::Array<Draw>::create(visitor.draws.size());
+    std::copy(visitor.draws.begin(), visitor.draws.end(), drawArray->data());
+    vertices = vertexArray;
+    indices = indexArray;
+    instances = instanceArray;
+    draws = drawArray;
+    drawCount = static_cast<uint32_t>(visitor.draws.size());
+    inverseVolumeTransforms = std::move(visitor.inverseVolumeTransforms);
+    cullPipeline->stage->specializationConstants = vsg::ShaderStage::SpecializationConstants{{0, vsg::uintValue::create(drawCount)}};
+
+    // the commands are created with the indirect buffers in compile()
+    drawCommandBuffer = {};
+    commands = {};
+    cullCommands = vsg::Commands::create();
 }
 
 void VBuffer::compile(vsg::Context &context) {
     depthBuffer->compile(context);
     visBuffer->compile(context);
+    if (primitiveBuffer)
+        primitiveBuffer->compile(context);
+
+    if (!drawCommandBuffer && drawCount)
+    {
+        drawCommandBuffer = vsg::createBufferAndMemory(context.device, drawCount * sizeof(VkDrawIndexedIndirectCommand),
+                                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                                       VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        drawCountBuffer = vsg::createBufferAndMemory(context.device, sizeof(uint32_t),
+                                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                     VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        auto instanceDescriptor = vsg::DescriptorBuffer::create(instances, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+        auto cullLayout = cullPipeline->layout;
+        auto cullDescriptorSet = vsg::DescriptorSet::create(cullLayout->setLayouts[0], vsg::Descriptors{
+            instanceDescriptor,
+            vsg::DescriptorBuffer::create(draws, 1, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+            vsg::DescriptorBuffer::create(vsg::BufferInfoList{vsg::BufferInfo::create(drawCommandBuffer, 0, VK_WHOLE_SIZE)}, 2, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+            vsg::DescriptorBuffer::create(vsg::BufferInfoList{vsg::BufferInfo::create(drawCountBuffer, 0, VK_WHOLE_SIZE)}, 3, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)});
+
+        // the draws of the previous frame have to be done before the buffers are overwritten
+        cullCommands->addChild(vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0));
+        cullCommands->addChild(FillBuffer::create(drawCountBuffer, 0));
+        cullCommands->addChild(vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            vsg::BufferMemoryBarrier::create(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                             VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, drawCountBuffer, 0, VK_WHOLE_SIZE)));
+        cullCommands->addChild(vsg::BindComputePipeline::create(cullPipeline));
+        cullCommands->addChild(vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, cullDescriptorSet));
+        cullCommands->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, viewProjectMatrixValue));
+        cullCommands->addChild(vsg::Dispatch::create((drawCount + 63) / 64, 1, 1));
+        cullCommands->addChild(vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+            vsg::BufferMemoryBarrier::create(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+                                             VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, drawCommandBuffer, 0, VK_WHOLE_SIZE),
+            vsg::BufferMemoryBarrier::create(VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+                                             VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, drawCountBuffer, 0, VK_WHOLE_SIZE)));
+
+        auto drawLayout = pipeline->layout;
+        commands = vsg::Commands::create();
+        commands->addChild(vsg::BindGraphicsPipeline::create(pipeline));
+        commands->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_VERTEX_BIT, 0, viewProjectMatrixValue));
+        commands->addChild(vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_GRAPHICS, drawLayout,
+                                                          vsg::DescriptorSet::create(drawLayout->setLayouts[0], vsg::Descriptors{instanceDescriptor})));
+        commands->addChild(vsg::BindVertexBuffers::create(0, vsg::DataList{vertices}));
+        commands->addChild(vsg::BindIndexBuffer::create(indices));
+        commands->addChild(DrawIndexedIndirectCount::create(drawCommandBuffer, drawCountBuffer, drawCount));
+    }
 
     vsg::AttachmentDescription depthAttachment = vsg::defaultDepthAttachment(VK_FORMAT_D32_SFLOAT);
     depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
@@ -171,24 +364,34 @@ void VBuffer::compile(vsg::Context &context) {
     vsg::AttachmentDescription visAttachment = vsg::defaultColorAttachment(VK_FORMAT_R32_UINT);
     visAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     vsg::RenderPass::Attachments attachments{depthAttachment, visAttachment};
+    std::vector<vsg::AttachmentReference> colorReferences{vsg::AttachmentReference{1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}};
+    if (primitiveBuffer)
+    {
+        attachments.push_back(visAttachment);
+        colorReferences.push_back(vsg::AttachmentReference{2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+    }
     vsg::RenderPass::Subpasses subpasses{
             vsg::SubpassDescription{
-                    0, VK_PIPELINE_BIND_POINT_GRAPHICS, {}, {
-                            VkAttachmentReference{1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}
-                    }, {}, {
+                    0, VK_PIPELINE_BIND_POINT_GRAPHICS, {}, colorReferences, {}, {
                             VkAttachmentReference{0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL},
                     }, {}
             }
     };
+    // the images are read by compute and ray tracing shaders of the previous and the current frame
     vsg::RenderPass::Dependencies dependencies{
         VkSubpassDependency{
-            VK_SUBPASS_EXTERNAL, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_SUBPASS_EXTERNAL, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
             0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0
         },
         VkSubpassDependency{
                 VK_SUBPASS_EXTERNAL, 0, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, 0
         },
+        VkSubpassDependency{
+            0, VK_SUBPASS_EXTERNAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, 0
+        },
     };
 
     auto renderPass = vsg::RenderPass::create(context.device, attachments, subpasses, dependencies);
@@ -198,6 +401,8 @@ void VBuffer::compile(vsg::Context &context) {
 
     renderGraph = vsg::RenderGraph::create();
     vsg::ImageViews imageViews{depthBuffer->imageInfoList[0]->imageView, visBuffer->imageInfoList[0]->imageView};
+    if (primitiveBuffer)
+        imageViews.push_back(primitiveBuffer->imageInfoList[0]->imageView);
     renderGraph->framebuffer = vsg::Framebuffer::create(renderPass, imageViews, width, height, 1);
     renderGraph->renderArea = {0, 0, width, height};
     VkClearValue depthClear, visClear;
@@ -208,5 +413,28 @@ void VBuffer::compile(vsg::Context &context) {
     visClear.color.uint32[2] = 0;
     visClear.color.uint32[3] = 0;
     renderGraph->clearValues = {depthClear, visClear};
+    if (primitiveBuffer)
+        renderGraph->clearValues.push_back(visClear);
     if (commands) renderGraph->addChild(commands);
 }
+
+void VBuffer::updateDescriptor(vsg::BindDescriptorSet* descSet, const vsg::BindingMap& bindingMap) const
+{
+    if (!primitiveBuffer)
+        throw vsg::Exception{"Error: VBuffer::updateDescriptor(...) The VBuffer was created without primitive ids."};
+    int visInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "primaryMeshIds").second;
+    int primitiveInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "primaryPrimitiveIds").second;
+    descSet->descriptorSet->descriptors.push_back(vsg::DescriptorImage::create(visBuffer->imageInfoList, visInd, 0, visBuffer->descriptorType));
+    descSet->descriptorSet->descriptors.push_back(vsg::DescriptorImage::create(primitiveBuffer->imageInfoList, primitiveInd, 0, primitiveBuffer->descriptorType));
+}
+
+bool VBuffer::insideVolume(const vsg::dvec3& position) const
+{
+    for (const auto& inverseTransform : inverseVolumeTransforms)
+    {
+        auto local = inverseTransform * position;
+        if (local.x >= 0 && local.y >= 0 && local.z >= 0 && local.x <= 1 && local.y <= 1 && local.z <= 1)
+            return true;
+    }
+    return false;
+}
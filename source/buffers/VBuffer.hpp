@@ -14,17 +14,35 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 
 class VBuffer : public vsg::Inherit<vsg::Object, VBuffer> {
 public:
-    VBuffer(uint32_t width, uint32_t height);
+    // with writePrimitiveIds the triangle of each pixel is stored in primitiveBuffer
+    VBuffer(uint32_t width, uint32_t height, bool writePrimitiveIds = false);
 
     uint32_t width, height;
     vsg::ref_ptr<vsg::DescriptorImage> depthBuffer, visBuffer;
+    // R32 uint gl_PrimitiveID of the mesh in visBuffer, null without primitive ids
+    vsg::ref_ptr<vsg::DescriptorImage> primitiveBuffer;
     vsg::ref_ptr<vsg::mat4Value> viewProjectMatrixValue;
     vsg::ref_ptr<vsg::RenderGraph> renderGraph;
+    // frustum culls the instances and writes the indirect draws of renderGraph, has to be recorded before it
+    vsg::ref_ptr<vsg::Commands> cullCommands;
 
     void setScene(vsg::Node& scene);
     void compile(vsg::Context& context);
+    // binds visBuffer and primitiveBuffer to the primary visibility of the ray tracing
+    void updateDescriptor(vsg::BindDescriptorSet* descSet, const vsg::BindingMap& bindingMap) const;
+    // true if the position is inside the unit cube of a volume of the scene
+    bool insideVolume(const vsg::dvec3& position) const;
 
 private:
     vsg::ref_ptr<vsg::GraphicsPipeline> pipeline;
+    vsg::ref_ptr<vsg::ComputePipeline> cullPipeline;
     vsg::ref_ptr<vsg::Commands> commands;
+
+    // the scene merged into one vertex and index buffer, one instance per mesh id and one draw per mesh instance
+    vsg::ref_ptr<vsg::Data> vertices, indices, instances, draws;
+    uint32_t drawCount = 0;
+    // world to the unit cube of each volume
+    std::vector<vsg::dmat4> inverseVolumeTransforms;
+    // indirect draw commands and their count, written by the culling
+    vsg::ref_ptr<vsg::Buffer> drawCommandBuffer, drawCountBuffer;
 };
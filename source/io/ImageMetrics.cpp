@@ -0,0 +1,562 @@
+#include <io/ImageMetrics.hpp>
+#include <io/HalfFloat.hpp>
+#include <vsgXchange/images.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+namespace
+{
+    constexpr float PI = 3.14159265358979f;
+
+    // single channel float image. All kernels below loop over whole rows so that the compiler vectorizes them
+    struct Plane
+    {
+        uint32_t width = 0, height = 0;
+        std::vector<float> values;
+
+        Plane() = default;
+        Plane(uint32_t width, uint32_t height) :
+            width(width), height(height), values(size_t(width) * height, 0.0f) {}
+
+        size_t size() const { return values.size(); }
+        float* row(uint32_t y) { return values.data() + size_t(y) * width; }
+        const float* row(uint32_t y) const { return values.data() + size_t(y) * width; }
+    };
+    struct RGB
+    {
+        Plane r, g, b;
+    };
+    using Kernel = std::vector<float>; // odd length, centered
+
+    bool toRGB(const vsg::Data& data, RGB& rgb)
+    {
+        auto width = data.width(), height = data.height();
+        rgb.r = rgb.g = rgb.b = Plane(width, height);
+        auto count = rgb.r.size();
+        switch (data.getLayout().format)
+        {
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+        {
+            auto src = static_cast<const float*>(data.dataPointer());
+            for (size_t i = 0; i < count; ++i)
+            {
+                rgb.r.values[i] = src[4 * i];
+                rgb.g.values[i] = src[4 * i + 1];
+                rgb.b.values[i] = src[4 * i + 2];
+            }
+            return true;
+        }
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        {
+            auto src = static_cast<const uint16_t*>(data.dataPointer());
+            for (size_t i = 0; i < count; ++i)
+            {
+                rgb.r.values[i] = halfToFloat(src[4 * i]);
+                rgb.g.values[i] = halfToFloat(src[4 * i + 1]);
+                rgb.b.values[i] = halfToFloat(src[4 * i + 2]);
+            }
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // separable convolution with clamped borders
+    Plane convolve(const Plane& in, const Kernel& kx, const Kernel& ky)
+    {
+        int width = int(in.width), height = int(in.height);
+        int rx = int(kx.size() / 2), ry = int(ky.size() / 2);
+        Plane tmp(in.width, in.height), out(in.width, in.height);
+        std::vector<float> padded(width + 2 * rx);
+        for (int y = 0; y < height; ++y)
+        {
+            const float* src = in.row(y);
+            for (int x = 0; x < int(padded.size()); ++x)
+                padded[x] = src[std::clamp(x - rx, 0, width - 1)];
+            float* dst = tmp.row(y);
+            for (size_t t = 0; t < kx.size(); ++t)
+            {
+                const float k = kx[t];
+                const float* p = padded.data() + t;
+                for (int x = 0; x < width; ++x)
+                    dst[x] += k * p[x];
+            }
+        }
+        for (int y = 0; y < height; ++y)
+        {
+            float* dst = out.row(y);
+            for (size_t t = 0; t < ky.size(); ++t)
+            {
+                const float k = ky[t];
+                const float* p = tmp.row(std::clamp(y + int(t) - ry, 0, height - 1));
+                for (int x = 0; x < width; ++x)
+                    dst[x] += k * p[x];
+            }
+        }
+        return out;
+    }
+
+    Kernel gaussian(float sigma, int radius)
+    {
+        Kernel kernel(2 * radius + 1);
+        float sum = 0;
+        for (int x = -radius; x <= radius; ++x)
+            sum += kernel[x + radius] = std::exp(-float(x * x) / (2 * sigma * sigma));
+        for (auto& k : kernel)
+            k /= sum;
+        return kernel;
+    }
+
+    // ACES fit used by FLIP, including its 0.6 exposure adjustment
+    constexpr float acesK[6] = {0.6f * 0.6f * 2.51f, 0.6f * 0.03f, 0.0f, 0.6f * 0.6f * 2.43f, 0.6f * 0.59f, 0.14f};
+
+    Plane toneMap(const Plane& in, float exposureScale)
+    {
+        Plane out(in.width, in.height);
+        for (size_t i = 0; i < in.size(); ++i)
+        {
+            float x = in.values[i] * exposureScale;
+            float y = (acesK[0] * x * x + acesK[1] * x + acesK[2]) / (acesK[3] * x * x + acesK[4] * x + acesK[5]);
+            out.values[i] = std::clamp(y, 0.0f, 1.0f);
+        }
+        return out;
+    }
+    RGB toneMap(const RGB& in, float exposureScale)
+    {
+        return {toneMap(in.r, exposureScale), toneMap(in.g, exposureScale), toneMap(in.b, exposureScale)};
+    }
+
+    Plane luminance(const RGB& rgb)
+    {
+        Plane y(rgb.r.width, rgb.r.height);
+        for (size_t i = 0; i < y.size(); ++i)
+            y.values[i] = 0.2126729f * rgb.r.values[i] + 0.7151522f * rgb.g.values[i] + 0.0721750f * rgb.b.values[i];
+        return y;
+    }
+
+    // PSNR and SSIM ------------------------------------------------------------------
+    double psnr(const RGB& test, const RGB& reference)
+    {
+        double sum = 0;
+        const Plane* t[3] = {&test.r, &test.g, &test.b};
+        const Plane* r[3] = {&reference.r, &reference.g, &reference.b};
+        for (int c = 0; c < 3; ++c)
+        {
+            for (uint32_t y = 0; y < test.r.height; ++y)
+            {
+                const float* a = t[c]->row(y);
+                const float* b = r[c]->row(y);
+                float rowSum = 0;
+                for (uint32_t x = 0; x < test.r.width; ++x)
+                    rowSum += (a[x] - b[x]) * (a[x] - b[x]);
+                sum += rowSum;
+            }
+        }
+        double mse = sum / (3.0 * test.r.size());
+        if (mse == 0)
+            return std::numeric_limits<double>::infinity();
+        return 10.0 * std::log10(1.0 / mse);
+    }
+
+    // SSIM with the usual 11x11 gaussian window (sigma 1.5) and a dynamic range of 1
+    double ssim(const Plane& x, const Plane& y)
+    {
+        const float c1 = 0.01f * 0.01f, c2 = 0.03f * 0.03f;
+        auto window = gaussian(1.5f, 5);
+        Plane xx(x.width, x.height), yy(x.width, x.height), xy(x.width, x.height);
+        for (size_t i = 0; i < x.size(); ++i)
+        {
+            xx.values[i] = x.values[i] * x.values[i];
+            yy.values[i] = y.values[i] * y.values[i];
+            xy.values[i] = x.values[i] * y.values[i];
+        }
+        auto muX = convolve(x, window, window);
+        auto muY = convolve(y, window, window);
+        auto sigmaXX = convolve(xx, window, window);
+        auto sigmaYY = convolve(yy, window, window);
+        auto sigmaXY = convolve(xy, window, window);
+        double sum = 0;
+        for (uint32_t row = 0; row < x.height; ++row)
+        {
+            float rowSum = 0;
+            const size_t offset = size_t(row) * x.width;
+            for (size_t i = offset; i < offset + x.width; ++i)
+            {
+                float mx = muX.values[i], my = muY.values[i];
+                float vx = sigmaXX.values[i] - mx * mx, vy = sigmaYY.values[i] - my * my, cxy = sigmaXY.values[i] - mx * my;
+                rowSum += ((2 * mx * my + c1) * (2 * cxy + c2)) / ((mx * mx + my * my + c1) * (vx + vy + c2));
+            }
+            sum += rowSum;
+        }
+        return sum / double(x.size());
+    }
+
+    // FLIP ---------------------------------------------------------------------------
+    // Implemented after "FLIP: A Difference Evaluator for Alternating Images" (Andersson et al. 2020) and the HDR
+    // extension, following the constants of the reference implementation.
+    constexpr float whiteX = 0.950428545f, whiteY = 1.0f, whiteZ = 1.088900371f;
+    constexpr float qc = 0.7f, qf = 0.5f, pc = 0.4f, pt = 0.95f;
+
+    struct Lab
+    {
+        float l, a, b;
+    };
+
+    float labF(float t)
+    {
+        constexpr float delta = 6.0f / 29.0f;
+        return t > delta * delta * delta ? std::cbrt(t) : t / (3 * delta * delta) + 4.0f / 29.0f;
+    }
+    // linear RGB to Hunt adjusted L*a*b*
+    Lab huntLab(float r, float g, float b)
+    {
+        float x = (0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / whiteX;
+        float y = (0.2126729f * r + 0.7151522f * g + 0.0721750f * b) / whiteY;
+        float z = (0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / whiteZ;
+        float fx = labF(x), fy = labF(y), fz = labF(z);
+        float l = 116 * fy - 16;
+        return {l, 0.01f * l * 500 * (fx - fy), 0.01f * l * 200 * (fy - fz)};
+    }
+    float hyab(const Lab& a, const Lab& b)
+    {
+        float da = a.a - b.a, db = a.b - b.b;
+        return std::abs(a.l - b.l) + std::sqrt(da * da + db * db);
+    }
+
+    // opponent color space YCxCz in which the contrast sensitivity filters are applied
+    struct YCxCz
+    {
+        Plane y, cx, cz;
+    };
+    YCxCz toYCxCz(const RGB& rgb)
+    {
+        YCxCz out{Plane(rgb.r.width, rgb.r.height), Plane(rgb.r.width, rgb.r.height), Plane(rgb.r.width, rgb.r.height)};
+        for (size_t i = 0; i < rgb.r.size(); ++i)
+        {
+            float r = rgb.r.values[i], g = rgb.g.values[i], b = rgb.b.values[i];
+            float x = (0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / whiteX;
+            float y = (0.2126729f * r + 0.7151522f * g + 0.0721750f * b) / whiteY;
+            float z = (0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / whiteZ;
+            out.y.values[i] = 116 * y - 16;
+            out.cx.values[i] = 500 * (x - y);
+            out.cz.values[i] = 200 * (y - z);
+        }
+        return out;
+    }
+
+    // a sum of 2D gaussians a * sqrt(pi / b) * exp(-pi^2 * r^2 / b), r in degrees. Each term is separable, so the
+    // filter is applied as one separable convolution per term
+    struct CsfTerm
+    {
+        float weight;
+        Kernel kernel;
+    };
+    std::vector<CsfTerm> csfFilter(std::initializer_list<std::pair<float, float>> ab, int radius, float pixelsPerDegree)
+    {
+        std::vector<CsfTerm> terms;
+        float total = 0;
+        for (auto [a, b] : ab)
+        {
+            CsfTerm term{a * std::sqrt(PI / b), Kernel(2 * radius + 1)};
+            float sum = 0;
+            for (int x = -radius; x <= radius; ++x)
+            {
+                float d = float(x) / pixelsPerDegree;
+                sum += term.kernel[x + radius] = std::exp(-PI * PI * d * d / b);
+            }
+            total += term.weight * sum * sum;
+            terms.push_back(std::move(term));
+        }
+        for (auto& term : terms)
+            term.weight /= total;
+        return terms;
+    }
+    Plane applyCsf(const Plane& in, const std::vector<CsfTerm>& terms)
+    {
+        Plane out(in.width, in.height);
+        for (const auto& term : terms)
+        {
+            auto filtered = convolve(in, term.kernel, term.kernel);
+            for (size_t i = 0; i < out.size(); ++i)
+                out.values[i] += term.weight * filtered.values[i];
+        }
+        return out;
+    }
+
+    // gaussian derivative kernels for edge and point detection. The 2D kernels g'(x) * g(y) are normalized so that
+    // the positive and the negative weights each sum to 1, which stays separable as the sign only depends on x
+    struct FeatureKernels
+    {
+        Kernel gauss, edge, point;
+    };
+    FeatureKernels featureKernels(float pixelsPerDegree)
+    {
+        const float sigma = 0.5f * 0.082f * pixelsPerDegree;
+        const int radius = int(std::ceil(3 * sigma));
+        FeatureKernels kernels{gaussian(sigma, radius), Kernel(2 * radius + 1), Kernel(2 * radius + 1)};
+        auto normalizeSigns = [](Kernel& kernel) {
+            float positive = 0, negative = 0;
+            for (auto k : kernel)
+                (k > 0 ? positive : negative) += k;
+            for (auto& k : kernel)
+                k /= k > 0 ? positive : -negative;
+        };
+        for (int x = -radius; x <= radius; ++x)
+        {
+            float g = std::exp(-float(x * x) / (2 * sigma * sigma));
+            kernels.edge[x + radius] = -float(x) * g;
+            kernels.point[x + radius] = (float(x * x) / (sigma * sigma) - 1) * g;
+        }
+        normalizeSigns(kernels.edge);
+        normalizeSigns(kernels.point);
+        return kernels;
+    }
+    struct Features
+    {
+        Plane edge, point; // magnitudes
+    };
+    Features detectFeatures(const Plane& normalizedY, const FeatureKernels& kernels)
+    {
+        auto edgeX = convolve(normalizedY, kernels.edge, kernels.gauss);
+        auto edgeY = convolve(normalizedY, kernels.gauss, kernels.edge);
+        auto pointX = convolve(normalizedY, kernels.point, kernels.gauss);
+        auto pointY = convolve(normalizedY, kernels.gauss, kernels.point);
+        Features features{Plane(normalizedY.width, normalizedY.height), Plane(normalizedY.width, normalizedY.height)};
+        for (size_t i = 0; i < normalizedY.size(); ++i)
+        {
+            features.edge.values[i] = std::sqrt(edgeX.values[i] * edgeX.values[i] + edgeY.values[i] * edgeY.values[i]);
+            features.point.values[i] = std::sqrt(pointX.values[i] * pointX.values[i] + pointY.values[i] * pointY.values[i]);
+        }
+        return features;
+    }
+
+    struct FlipSetup
+    {
+        std::vector<CsfTerm> csfY, csfCx, csfCz;
+        FeatureKernels features;
+        float cmax;
+    };
+    FlipSetup flipSetup(float pixelsPerDegree)
+    {
+        const float maxB = 0.04f;
+        const int radius = int(std::ceil(3 * std::sqrt(maxB / (2 * PI * PI)) * pixelsPerDegree));
+        FlipSetup setup;
+        setup.csfY = csfFilter({{1.0f, 0.0047f}}, radius, pixelsPerDegree);
+        setup.csfCx = csfFilter({{1.0f, 0.0053f}}, radius, pixelsPerDegree);
+        setup.csfCz = csfFilter({{34.1f, 0.04f}, {13.5f, 0.025f}}, radius, pixelsPerDegree);
+        setup.features = featureKernels(pixelsPerDegree);
+        setup.cmax = std::pow(hyab(huntLab(0, 1, 0), huntLab(0, 0, 1)), qc);
+        return setup;
+    }
+
+    // per pixel LDR-FLIP of linear RGB images in [0, 1]
+    Plane flipLdr(const RGB& test, const RGB& reference, const FlipSetup& setup)
+    {
+        auto prepare = [&](const RGB& rgb, std::vector<Lab>& lab, Plane& normalizedY) {
+            auto ycc = toYCxCz(rgb);
+            normalizedY = Plane(rgb.r.width, rgb.r.height);
+            for (size_t i = 0; i < normalizedY.size(); ++i)
+                normalizedY.values[i] = (ycc.y.values[i] + 16) / 116;
+            auto y = applyCsf(ycc.y, setup.csfY);
+            auto cx = applyCsf(ycc.cx, setup.csfCx);
+            auto cz = applyCsf(ycc.cz, setup.csfCz);
+            lab.resize(y.size());
+            for (size_t i = 0; i < y.size(); ++i)
+            {
+                // back to linear RGB, clamped to the displayable range
+                float yy = (y.values[i] + 16) / 116;
+                float x = (cx.values[i] / 500 + yy) * whiteX;
+                float z = (yy - cz.values[i] / 200) * whiteZ;
+                yy *= whiteY;
+                float r = std::clamp(3.2404542f * x - 1.5371385f * yy - 0.4985314f * z, 0.0f, 1.0f);
+                float g = std::clamp(-0.9692660f * x + 1.8760108f * yy + 0.0415560f * z, 0.0f, 1.0f);
+                float b = std::clamp(0.0556434f * x - 0.2040259f * yy + 1.0572252f * z, 0.0f, 1.0f);
+                lab[i] = huntLab(r, g, b);
+            }
+        };
+        std::vector<Lab> testLab, referenceLab;
+        Plane testY, referenceY;
+        prepare(test, testLab, testY);
+        prepare(reference, referenceLab, referenceY);
+        auto testFeatures = detectFeatures(testY, setup.features);
+        auto referenceFeatures = detectFeatures(referenceY, setup.features);
+
+        Plane error(test.r.width, test.r.height);
+        const float cmax = setup.cmax;
+        for (size_t i = 0; i < error.size(); ++i)
+        {
+            float colorDiff = std::pow(hyab(testLab[i], referenceLab[i]), qc);
+            colorDiff = colorDiff < pc * cmax ? pt / (pc * cmax) * colorDiff
+                                              : pt + (colorDiff - pc * cmax) / (cmax - pc * cmax) * (1 - pt);
+            float edgeDiff = std::abs(referenceFeatures.edge.values[i] - testFeatures.edge.values[i]);
+            float pointDiff = std::abs(referenceFeatures.point.values[i] - testFeatures.point.values[i]);
+            float featureDiff = std::pow(std::max(edgeDiff, pointDiff) / std::sqrt(2.0f), qf);
+            error.values[i] = std::pow(colorDiff, 1 - featureDiff);
+        }
+        return error;
+    }
+
+    // HDR-FLIP: LDR-FLIP of tone mapped images over the exposure range of the reference, maximum per pixel
+    double flipHdr(const RGB& test, const RGB& reference, const FlipSetup& setup)
+    {
+        auto y = luminance(reference);
+        auto median = y.values.begin() + y.size() / 2;
+        std::nth_element(y.values.begin(), median, y.values.end());
+        float yMedian = std::max(*median, 1e-6f);
+        float yMax = std::max(*std::max_element(y.values.begin(), y.values.end()), 1e-6f);
+
+        // input value which the tone mapper maps to 0.85
+        const float t = 0.85f;
+        float a = acesK[0] - t * acesK[3], b = acesK[1] - t * acesK[4], c = acesK[2] - t * acesK[5];
+        float xTarget = (-b + std::sqrt(b * b - 4 * a * c)) / (2 * a);
+        float startExposure = std::log2(xTarget / yMax);
+        float stopExposure = std::log2(xTarget / yMedian);
+        int exposureCount = std::max(2, int(std::ceil(stopExposure - startExposure)));
+        float step = (stopExposure - startExposure) / float(exposureCount - 1);
+
+        Plane maxError(test.r.width, test.r.height);
+        for (int i = 0; i < exposureCount; ++i)
+        {
+            float scale = std::exp2(startExposure + float(i) * step);
+            auto error = flipLdr(toneMap(test, scale), toneMap(reference, scale), setup);
+            for (size_t p = 0; p < maxError.size(); ++p)
+                maxError.values[p] = std::max(maxError.values[p], error.values[p]);
+        }
+        double sum = 0;
+        for (uint32_t row = 0; row < maxError.height; ++row)
+        {
+            float rowSum = 0;
+            const float* values = maxError.row(row);
+            for (uint32_t x = 0; x < maxError.width; ++x)
+                rowSum += values[x];
+            sum += rowSum;
+        }
+        return sum / double(maxError.size());
+    }
+}
+
+// compares one frame on a worker thread
+class ImageMetrics::CompareOperation : public vsg::Inherit<vsg::Operation, ImageMetrics::CompareOperation>
+{
+public:
+    CompareOperation(ImageMetrics* metrics, int frame, vsg::ref_ptr<vsg::Data> image) :
+        metrics(metrics), frame(frame), image(image) {}
+
+    void run() override
+    {
+        char buff[200];
+        snprintf(buff, sizeof(buff), metrics->referenceFormat.c_str(), frame);
+        auto options = vsg::Options::create(vsgXchange::openexr::create());
+        auto filename = vsg::findFile(buff, options);
+        Result result;
+        result.frame = frame;
+        if (auto reference = vsg::read_cast<vsg::Data>(filename, options); !reference)
+            std::cerr << "Failed to load reference image: " << buff << std::endl;
+        else if (!compareImages(*image, *reference, metrics->pixelsPerDegree, result))
+            std::cerr << "Reference image " << buff << " does not match the rendered frame" << std::endl;
+        else
+        {
+            std::scoped_lock lock(metrics->resultsMutex);
+            metrics->results.push_back(result);
+        }
+        metrics->pending->count_down();
+    }
+
+private:
+    ImageMetrics* metrics; // outlives the operation, finish() waits for all operations
+    int frame;
+    vsg::ref_ptr<vsg::Data> image;
+};
+
+ImageMetrics::ImageMetrics(const std::string& referenceFormat, uint32_t numThreads, float pixelsPerDegree) :
+    referenceFormat(referenceFormat),
+    pixelsPerDegree(pixelsPerDegree),
+    threads(vsg::OperationThreads::create(numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency()))),
+    pending(vsg::Latch::create(0))
+{
+}
+
+ImageMetrics::~ImageMetrics()
+{
+    pending->wait();
+}
+
+void ImageMetrics::compare(int frame, vsg::ref_ptr<vsg::Data> image)
+{
+    pending->count_up();
+    threads->add(CompareOperation::create(this, frame, image));
+}
+
+bool ImageMetrics::finish(const std::string& csvPath)
+{
+    pending->wait();
+    std::sort(results.begin(), results.end(), [](const Result& a, const Result& b) { return a.frame < b.frame; });
+    if (csvPath.empty())
+        return true;
+
+    std::ofstream csvFile(csvPath);
+    if (!csvFile)
+    {
+        std::cerr << "Failed to open metrics file " << csvPath << std::endl;
+        return false;
+    }
+    csvFile << "frame,psnr,ssim,flip" << std::endl;
+    for (const auto& result : results)
+        csvFile << result.frame << "," << result.psnr << "," << result.ssim << "," << result.flip << std::endl;
+    return true;
+}
+
+ImageMetrics::Result ImageMetrics::getMean() const
+{
+    Result mean;
+    for (const auto& result : results)
+    {
+        mean.psnr += result.psnr;
+        mean.ssim += result.ssim;
+        mean.flip += result.flip;
+    }
+    if (!results.empty())
+    {
+        mean.psnr /= double(results.size());
+        mean.ssim /= double(results.size());
+        mean.flip /= double(results.size());
+    }
+    return mean;
+}
+
+bool ImageMetrics::compareImages(const vsg::Data& test, const vsg::Data& reference, float pixelsPerDegree, Result& result)
+{
+    if (test.width() != reference.width() || test.height() != reference.height())
+        return false;
+    RGB testRGB, referenceRGB;
+    if (!toRGB(test, testRGB) || !toRGB(reference, referenceRGB))
+        return false;
+
+    auto testMapped = toneMap(testRGB, 1.0f), referenceMapped = toneMap(referenceRGB, 1.0f);
+    result.psnr = psnr(testMapped, referenceMapped);
+    result.ssim = ssim(luminance(testMapped), luminance(referenceMapped));
+
+    // the filter kernels only depend on the viewing setup
+    static std::mutex setupMutex;
+    static std::deque<std::pair<float, FlipSetup>> setups; // references stay valid when adding setups
+    const FlipSetup* setup;
+    {
+        std::scoped_lock lock(setupMutex);
+        auto it = std::find_if(setups.begin(), setups.end(), [&](const auto& s) { return s.first == pixelsPerDegree; });
+        if (it == setups.end())
+        {
+            setups.emplace_back(pixelsPerDegree, flipSetup(pixelsPerDegree));
+            it = setups.end() - 1;
+        }
+        setup = &it->second;
+    }
+    result.flip = flipHdr(testRGB, referenceRGB, *setup);
+    return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vsg/all.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Image quality metrics --------------------------------------------------------------
+// Compares rendered frames against a reference sequence right after readback, so regression runs do not have to
+// export every frame and run the FLIP tool on it afterwards.
+// PSNR and SSIM are computed on the ACES tone mapped images (SSIM on luminance), FLIP is HDR-FLIP: the maximum of
+// LDR-FLIP over the exposure range of the reference, as the FLIP tool does for EXR files.
+// The comparisons run on a pool of worker threads, finish() waits for them and writes one CSV row per frame.
+class ImageMetrics : public vsg::Inherit<vsg::Object, ImageMetrics>
+{
+public:
+    struct Result
+    {
+        int frame = -1;
+        double psnr = 0, ssim = 0, flip = 0;
+    };
+
+    // referenceFormat is a printf style path with the frame index, same as the illumination export
+    explicit ImageMetrics(const std::string& referenceFormat, uint32_t numThreads = 0, float pixelsPerDegree = 67.0f);
+
+    // queues the comparison of a frame, the image must not be changed until finish() returns
+    void compare(int frame, vsg::ref_ptr<vsg::Data> image);
+    // waits for all queued comparisons and writes the results sorted by frame, the CSV is skipped for an empty path
+    bool finish(const std::string& csvPath);
+
+    const std::vector<Result>& getResults() const { return results; }
+    Result getMean() const;
+
+    // compares two images with RGBA float or half float layout, returns false if they are not comparable
+    static bool compareImages(const vsg::Data& test, const vsg::Data& reference, float pixelsPerDegree, Result& result);
+
+protected:
+    ~ImageMetrics();
+
+private:
+    class CompareOperation;
+
+    std::string referenceFormat;
+    float pixelsPerDegree;
+    vsg::ref_ptr<vsg::OperationThreads> threads;
+    vsg::ref_ptr<vsg::Latch> pending;
+    std::mutex resultsMutex;
+    std::vector<Result> results;
+};
@@ -0,0 +1,458 @@
+#include <io/Profiler.hpp>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+// writes a timestamp into the query pool of the current frame
+class Profiler::Timestamp : public vsg::Inherit<vsg::Command, Profiler::Timestamp>
+{
+public:
+    Timestamp(vsg::ref_ptr<Profiler> profiler, uint32_t index, VkPipelineStageFlagBits stage) :
+        profiler(profiler), index(index), stage(stage) {}
+
+    void compile(vsg::Context& context) override
+    {
+        profiler->compile(context);
+    }
+    void record(vsg::CommandBuffer& commandBuffer) const override
+    {
+        vkCmdWriteTimestamp(commandBuffer, stage, *profiler->queryPools[profiler->currentPool], index);
+    }
+
+private:
+    vsg::ref_ptr<Profiler> profiler;
+    uint32_t index;
+    VkPipelineStageFlagBits stage;
+};
+
+// resets the query pool of the current frame
+class Profiler::ResetPool : public vsg::Inherit<vsg::Command, Profiler::ResetPool>
+{
+public:
+    explicit ResetPool(vsg::ref_ptr<Profiler> profiler) :
+        profiler(profiler) {}
+
+    void compile(vsg::Context& context) override
+    {
+        profiler->compile(context);
+    }
+    void record(vsg::CommandBuffer& commandBuffer) const override
+    {
+        auto& pool = profiler->queryPools[profiler->currentPool];
+        vkCmdResetQueryPool(commandBuffer, *pool, 0, pool->queryCount);
+    }
+
+private:
+    vsg::ref_ptr<Profiler> profiler;
+};
+
+Profiler::CpuScope::CpuScope(Profiler* profiler, std::string name) :
+    profiler(profiler), name(std::move(name)), start(std::chrono::steady_clock::now())
+{
+}
+
+Profiler::CpuScope::CpuScope(CpuScope&& other) noexcept :
+    profiler(other.profiler), name(std::move(other.name)), start(other.start)
+{
+    other.profiler = nullptr;
+}
+
+Profiler::CpuScope::~CpuScope()
+{
+    if (!profiler)
+        return;
+    std::chrono::duration<double, std::micro> duration = std::chrono::steady_clock::now() - start;
+    profiler->addCpuTime(name, duration.count(), start);
+}
+
+void Profiler::History::add(double value, size_t historySize)
+{
+    if (values.size() < historySize)
+        values.push_back(value);
+    else
+        values[next] = value;
+    next = (next + 1) % historySize;
+}
+
+Profiler::Statistics Profiler::History::statistics() const
+{
+    Statistics stats;
+    stats.count = values.size();
+    if (values.empty())
+        return stats;
+    auto sorted = values;
+    auto p95 = sorted.begin() + static_cast<size_t>(std::ceil(0.95 * sorted.size())) - 1;
+    std::nth_element(sorted.begin(), p95, sorted.end());
+    stats.p95 = *p95;
+    stats.min = *std::min_element(values.begin(), values.end());
+    double sum = 0;
+    for (auto v : values)
+        sum += v;
+    stats.avg = sum / values.size();
+    return stats;
+}
+
+Profiler::Profiler(uint32_t historySize, uint32_t queryPoolCount) :
+    historySize(historySize),
+    queryPools(queryPoolCount),
+    pendingFrames(queryPoolCount),
+    creationTime(std::chrono::steady_clock::now())
+{
+    for (auto& pool : queryPools)
+    {
+        pool = vsg::QueryPool::create();
+        pool->queryCount = 1;
+    }
+    writerThread = std::thread(&Profiler::writerLoop, this);
+}
+
+Profiler::~Profiler()
+{
+    {
+        std::scoped_lock lock(writerMutex);
+        writerStop = true;
+    }
+    writerCondition.notify_all();
+    if (writerThread.joinable())
+        writerThread.join();
+}
+
+void Profiler::addFrameBegin(vsg::ref_ptr<vsg::Commands> commands)
+{
+    commands->addChild(ResetPool::create(vsg::ref_ptr<Profiler>(this)));
+    commands->addChild(Timestamp::create(vsg::ref_ptr<Profiler>(this), 0, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT));
+}
+
+void Profiler::addGpuScope(vsg::ref_ptr<vsg::Commands> commands, const std::string& name, VkPipelineStageFlagBits stage)
+{
+    if (device)
+        throw vsg::Exception{"Error: Profiler::addGpuScope(...) scopes have to be added before compilation."};
+    auto it = std::find(gpuScopeNames.begin(), gpuScopeNames.end(), name);
+    if (it != gpuScopeNames.end())
+    {
+        auto index = static_cast<uint32_t>(it - gpuScopeNames.begin()) + 1;
+        commands->addChild(Timestamp::create(vsg::ref_ptr<Profiler>(this), index, stage));
+        return;
+    }
+    gpuScopeNames.push_back(name);
+    gpuHistory.emplace_back();
+    for (auto& pool : queryPools)
+        pool->queryCount = static_cast<uint32_t>(gpuScopeNames.size() + 1);
+    commands->addChild(Timestamp::create(vsg::ref_ptr<Profiler>(this), static_cast<uint32_t>(gpuScopeNames.size()), stage));
+}
+
+void Profiler::compile(vsg::Context& context)
+{
+    if (device)
+        return;
+    device = context.device;
+    const auto& properties = device->getPhysicalDevice()->getProperties();
+    usPerTick = static_cast<double>(properties.limits.timestampPeriod) * 0.001;
+    auto queueFamily = device->getPhysicalDevice()->getQueueFamily(VK_QUEUE_GRAPHICS_BIT);
+    auto validBits = device->getPhysicalDevice()->getQueueFamilyProperties()[queueFamily].timestampValidBits;
+    if (validBits > 0 && validBits < 64)
+        timestampMask = (uint64_t(1) << validBits) - 1;
+    for (auto& pool : queryPools)
+        pool->compile(context);
+}
+
+Profiler::CpuScope Profiler::cpuScope(const std::string& name)
+{
+    return CpuScope(this, name);
+}
+
+size_t Profiler::cpuScopeIndex(const std::string& name)
+{
+    auto it = std::find(cpuScopeNames.begin(), cpuScopeNames.end(), name);
+    if (it != cpuScopeNames.end())
+        return static_cast<size_t>(it - cpuScopeNames.begin());
+    std::scoped_lock lock(writerMutex); // the writer reads the names
+    cpuScopeNames.push_back(name);
+    cpuHistory.emplace_back();
+    return cpuScopeNames.size() - 1;
+}
+
+void Profiler::addCpuTime(const std::string& name, double microseconds, std::chrono::steady_clock::time_point start)
+{
+    auto index = cpuScopeIndex(name);
+    cpuHistory[index].add(microseconds, historySize);
+    if (frameOpen)
+    {
+        std::chrono::duration<double, std::micro> startTime = start - creationTime;
+        pendingFrames[currentPool].cpuTimes.push_back({index, {startTime.count(), microseconds}});
+    }
+}
+
+bool Profiler::readGpuResults(uint32_t pool, FrameRecord& record)
+{
+    if (!device || gpuScopeNames.empty())
+        return true;
+    // every query is followed by its availability, scopes of command graphs which were not recorded stay unavailable
+    auto count = queryPools[pool]->queryCount;
+    std::vector<uint64_t> results(2 * count);
+    VkQueryResultFlags flags = VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT;
+    auto result = vkGetQueryPoolResults(*device, *queryPools[pool], 0, count, results.size() * sizeof(uint64_t), results.data(),
+                                        2 * sizeof(uint64_t), flags);
+    if (result != VK_SUCCESS && result != VK_NOT_READY)
+        return false;
+    // without the frame begin the frame has not run yet
+    if (!results[1])
+        return false;
+
+    uint64_t begin = results[0];
+    if (!haveFirstGpuTick)
+    {
+        firstGpuTick = begin;
+        haveFirstGpuTick = true;
+    }
+    record.gpuStart = static_cast<double>((begin - firstGpuTick) & timestampMask) * usPerTick;
+
+    // the scopes are ordered by their timestamps, so scopes added out of recording order are timed correctly
+    std::vector<std::pair<uint64_t, uint32_t>> recorded;
+    for (uint32_t i = 1; i < count; ++i)
+        if (results[2 * i + 1])
+            recorded.push_back({(results[2 * i] - begin) & timestampMask, i - 1});
+    std::sort(recorded.begin(), recorded.end());
+    record.gpuTimes.assign(count - 1, -1.0);
+    record.gpuStarts.assign(count - 1, -1.0);
+    uint64_t previous = 0;
+    for (const auto& [ticks, scope] : recorded)
+    {
+        record.gpuStarts[scope] = static_cast<double>(previous) * usPerTick;
+        record.gpuTimes[scope] = static_cast<double>(ticks - previous) * usPerTick;
+        previous = ticks;
+    }
+    return true;
+}
+
+void Profiler::finalizeFrame(FrameRecord&& record)
+{
+    for (size_t i = 0; i < record.gpuTimes.size(); ++i)
+        if (record.gpuTimes[i] >= 0)
+            gpuHistory[i].add(record.gpuTimes[i], historySize);
+    latestGpuFrameIndex = record.frameIndex;
+    latestGpuTimes = record.gpuTimes;
+    {
+        std::scoped_lock lock(writerMutex);
+        writerQueue.push_back(std::move(record));
+    }
+    writerCondition.notify_one();
+}
+
+void Profiler::beginFrame()
+{
+    ++frameCounter;
+    currentPool = static_cast<uint32_t>(frameCounter % queryPools.size());
+
+    // the pool of this frame was last used queryPools.size() frames ago, its results are collected before it is reset
+    auto& pending = pendingFrames[currentPool];
+    if (pending.frameIndex >= 0)
+    {
+        if (readGpuResults(currentPool, pending))
+            finalizeFrame(std::move(pending));
+        else
+            ++droppedFrames;
+    }
+    pending = FrameRecord{};
+    pending.frameIndex = frameCounter;
+    std::chrono::duration<double, std::micro> startTime = std::chrono::steady_clock::now() - creationTime;
+    pending.cpuStart = startTime.count();
+    frameOpen = true;
+}
+
+void Profiler::endFrame()
+{
+    if (!frameOpen)
+        return;
+    frameOpen = false;
+    auto& pending = pendingFrames[currentPool];
+    std::chrono::duration<double, std::micro> now = std::chrono::steady_clock::now() - creationTime;
+    auto frameIndex = cpuScopeIndex("Frame");
+    cpuHistory[frameIndex].add(now.count() - pending.cpuStart, historySize);
+    pending.cpuTimes.push_back({frameIndex, {pending.cpuStart, now.count() - pending.cpuStart}});
+}
+
+void Profiler::finish()
+{
+    if (finished)
+        return;
+    finished = true;
+    endFrame();
+
+    // collect the outstanding frames in submission order
+    std::vector<FrameRecord*> outstanding;
+    for (auto& pending : pendingFrames)
+        if (pending.frameIndex >= 0)
+            outstanding.push_back(&pending);
+    std::sort(outstanding.begin(), outstanding.end(), [](auto a, auto b) { return a->frameIndex < b->frameIndex; });
+    for (auto pending : outstanding)
+    {
+        auto pool = static_cast<uint32_t>(pending->frameIndex % queryPools.size());
+        if (readGpuResults(pool, *pending))
+            finalizeFrame(std::move(*pending));
+        else
+            ++droppedFrames;
+        pending->frameIndex = -1;
+    }
+
+    {
+        std::scoped_lock lock(writerMutex);
+        writerStop = true;
+    }
+    writerCondition.notify_all();
+    if (writerThread.joinable())
+        writerThread.join();
+
+    if (traceFile.is_open())
+    {
+        traceFile << "\n]}" << std::endl;
+        traceFile.close();
+    }
+    csvFile.close();
+
+    if (!jsonPath.empty())
+    {
+        auto toJson = [](const std::string& name, const Statistics& stats) {
+            return nlohmann::json{{"name", name}, {"min", stats.min}, {"avg", stats.avg}, {"p95", stats.p95}, {"count", stats.count}};
+        };
+        nlohmann::json summary;
+        summary["frames"] = frameCounter + 1;
+        summary["droppedFrames"] = droppedFrames;
+        summary["gpu"] = nlohmann::json::array();
+        for (size_t i = 0; i < gpuScopeNames.size(); ++i)
+            summary["gpu"].push_back(toJson(gpuScopeNames[i], getGpuStatistics(i)));
+        summary["cpu"] = nlohmann::json::array();
+        for (const auto& name : cpuScopeNames)
+            summary["cpu"].push_back(toJson(name, getCpuStatistics(name)));
+        std::ofstream jsonFile(jsonPath);
+        if (!jsonFile)
+            std::cerr << "Failed to write profiler summary " << jsonPath << std::endl;
+        else
+            jsonFile << summary.dump(4) << std::endl;
+    }
+}
+
+bool Profiler::setCsvOutput(const std::string& path)
+{
+    std::scoped_lock lock(writerMutex);
+    csvFile.open(path);
+    if (!csvFile)
+        std::cerr << "Failed to open profiler CSV output " << path << std::endl;
+    return csvFile.is_open();
+}
+
+bool Profiler::setTraceOutput(const std::string& path)
+{
+    std::scoped_lock lock(writerMutex);
+    traceFile.open(path);
+    if (!traceFile)
+    {
+        std::cerr << "Failed to open profiler trace output " << path << std::endl;
+        return false;
+    }
+    traceFile << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    return true;
+}
+
+bool Profiler::setJsonOutput(const std::string& path)
+{
+    jsonPath = path;
+    return true;
+}
+
+Profiler::Statistics Profiler::getGpuStatistics(size_t scope) const
+{
+    if (scope >= gpuHistory.size())
+        return {};
+    return gpuHistory[scope].statistics();
+}
+
+Profiler::Statistics Profiler::getCpuStatistics(const std::string& name) const
+{
+    auto it = std::find(cpuScopeNames.begin(), cpuScopeNames.end(), name);
+    if (it == cpuScopeNames.end())
+        return {};
+    return cpuHistory[it - cpuScopeNames.begin()].statistics();
+}
+
+void Profiler::printStatistics(std::ostream& out) const
+{
+    auto print = [&](const char* kind, const std::string& name, const Statistics& stats) {
+        out << kind << "," << name << "," << std::fixed << std::setprecision(2) << stats.min << "," << stats.avg << "," << stats.p95 << std::endl;
+    };
+    out << "type,scope,min,avg,p95 (microseconds over the last " << historySize << " frames)" << std::endl;
+    for (size_t i = 0; i < gpuScopeNames.size(); ++i)
+        print("gpu", gpuScopeNames[i], getGpuStatistics(i));
+    for (const auto& name : cpuScopeNames)
+        print("cpu", name, getCpuStatistics(name));
+    if (droppedFrames)
+        out << "dropped frames: " << droppedFrames << std::endl;
+}
+
+void Profiler::writerLoop()
+{
+    std::unique_lock lock(writerMutex);
+    while (true)
+    {
+        writerCondition.wait(lock, [&] { return writerStop || !writerQueue.empty(); });
+        if (writerQueue.empty() && writerStop)
+            break;
+        auto record = std::move(writerQueue.front());
+        writerQueue.pop_front();
+        // new cpu scopes can be added while writing, so the writer works on a copy of the names
+        auto cpuNames = cpuScopeNames;
+        lock.unlock();
+
+        if (csvFile.is_open())
+        {
+            // the columns are fixed by the first frame
+            if (!csvHeaderWritten)
+            {
+                csvFile << "frame";
+                for (const auto& name : gpuScopeNames)
+                    csvFile << ",gpu:" << name;
+                for (const auto& name : cpuNames)
+                    csvFile << ",cpu:" << name;
+                csvFile << "\n";
+                csvHeaderWritten = true;
+                csvCpuColumns = cpuNames.size();
+            }
+            // scopes which first appeared after the header are only part of the trace and the summary
+            std::vector<double> cpuSums(csvCpuColumns, 0.0);
+            for (const auto& [index, time] : record.cpuTimes)
+                if (index < csvCpuColumns)
+                    cpuSums[index] += time.second;
+            csvFile << record.frameIndex << std::fixed << std::setprecision(2);
+            // scopes which were not recorded in the frame stay empty
+            for (auto t : record.gpuTimes)
+            {
+                csvFile << ",";
+                if (t >= 0)
+                    csvFile << t;
+            }
+            for (auto t : cpuSums)
+                csvFile << "," << t;
+            csvFile << "\n";
+        }
+        if (traceFile.is_open())
+        {
+            auto writeEvent = [&](const std::string& name, int tid, double start, double duration) {
+                if (traceEventWritten)
+                    traceFile << ",\n";
+                traceEventWritten = true;
+                traceFile << std::fixed << std::setprecision(3) << "{\"name\": \"" << name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << tid
+                          << ", \"ts\": " << start << ", \"dur\": " << duration << ", \"args\": {\"frame\": " << record.frameIndex << "}}";
+            };
+            for (size_t i = 0; i < record.gpuTimes.size(); ++i)
+                if (record.gpuTimes[i] >= 0)
+                    writeEvent(gpuScopeNames[i], 1, record.gpuStart + record.gpuStarts[i], record.gpuTimes[i]);
+            for (const auto& [index, time] : record.cpuTimes)
+                writeEvent(cpuNames[index], 0, time.first, time.second);
+        }
+        lock.lock();
+    }
+    if (csvFile.is_open())
+        csvFile.flush();
+}
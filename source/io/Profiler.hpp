@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vsg/all.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Profiler ---------------------------------------------------------------------------
+// Collects named GPU timestamp scopes and CPU sections per frame.
+// GPU scopes are timestamps in the command graph, the duration of a scope is the time since the previous timestamp.
+// Scopes which were not recorded in a frame have a negative time and are left out of the statistics.
+// Every frame writes into its own query pool of a ring, a pool is only read back when it is reused. The ring is
+// longer than the frames in flight, so reading the results never waits on the GPU.
+// Finished frames are written to CSV and/or a Chrome trace file on a background thread.
+class Profiler : public vsg::Inherit<vsg::Object, Profiler>
+{
+public:
+    struct Statistics
+    {
+        double min = 0, avg = 0, p95 = 0; // microseconds
+        size_t count = 0;
+    };
+
+    explicit Profiler(uint32_t historySize = 256, uint32_t queryPoolCount = 4);
+    ~Profiler();
+
+    // resets the query pool of the frame and writes the start timestamp, has to be the first command of the frame
+    void addFrameBegin(vsg::ref_ptr<vsg::Commands> commands);
+    // a scope added again under the same name shares the query of the first one. Alternative command graphs of which
+    // only one is recorded per frame can be timed like this, each name may only be recorded once per frame
+    void addGpuScope(vsg::ref_ptr<vsg::Commands> commands, const std::string& name, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    void compile(vsg::Context& context);
+
+    // measures a CPU section until it goes out of scope
+    class CpuScope
+    {
+    public:
+        CpuScope(Profiler* profiler, std::string name);
+        CpuScope(CpuScope&& other) noexcept;
+        ~CpuScope();
+    private:
+        Profiler* profiler;
+        std::string name;
+        std::chrono::steady_clock::time_point start;
+    };
+    CpuScope cpuScope(const std::string& name);
+    void addCpuTime(const std::string& name, double microseconds, std::chrono::steady_clock::time_point start);
+
+    // beginFrame() selects the query pool of the frame and collects the oldest finished frame
+    void beginFrame();
+    void endFrame();
+    // the query pool of the current frame. Its previous frame is done, other per frame resources can share the ring
+    uint32_t getCurrentPool() const { return currentPool; }
+    uint32_t getQueryPoolCount() const { return static_cast<uint32_t>(queryPools.size()); }
+    // collects all outstanding frames, the device has to be idle. Also writes the JSON summary and closes all files
+    void finish();
+
+    bool setCsvOutput(const std::string& path);
+    bool setTraceOutput(const std::string& path);
+    bool setJsonOutput(const std::string& path);
+
+    Statistics getGpuStatistics(size_t scope) const;
+    Statistics getCpuStatistics(const std::string& name) const;
+    void printStatistics(std::ostream& out) const;
+
+    const std::vector<std::string>& getGpuScopeNames() const { return gpuScopeNames; }
+    // gpu scope times of the latest frame whose results were collected, in microseconds and negative for scopes which
+    // were not recorded. Lags queryPoolCount frames behind the current frame, the frame index is -1 before the first results
+    int64_t getLatestGpuFrameIndex() const { return latestGpuFrameIndex; }
+    const std::vector<double>& getLatestGpuTimes() const { return latestGpuTimes; }
+
+private:
+    class Timestamp;
+    class ResetPool;
+
+    struct FrameRecord
+    {
+        int64_t frameIndex = -1;
+        double cpuStart = 0; // microseconds since profiler creation
+        double gpuStart = 0; // microseconds since the first gpu timestamp, gpu and cpu clocks are not correlated
+        std::vector<std::pair<size_t, std::pair<double, double>>> cpuTimes; // cpu scope index -> (start, duration)
+        std::vector<double> gpuTimes, gpuStarts; // negative for scopes which were not recorded, starts relative to gpuStart
+    };
+    struct History
+    {
+        std::vector<double> values;
+        size_t next = 0;
+        void add(double value, size_t historySize);
+        Statistics statistics() const;
+    };
+
+    size_t cpuScopeIndex(const std::string& name);
+    bool readGpuResults(uint32_t pool, FrameRecord& record);
+    void finalizeFrame(FrameRecord&& record);
+    void writerLoop();
+
+    uint32_t historySize;
+    std::vector<vsg::ref_ptr<vsg::QueryPool>> queryPools;
+    std::vector<FrameRecord> pendingFrames; // per query pool, waiting for its GPU results
+    uint32_t currentPool = 0;
+    int64_t frameCounter = -1;
+    bool frameOpen = false;
+    vsg::ref_ptr<vsg::Device> device;
+    double usPerTick = 0.001;
+    uint64_t timestampMask = ~uint64_t(0);
+    uint64_t firstGpuTick = 0;
+    bool haveFirstGpuTick = false, finished = false;
+    std::chrono::steady_clock::time_point creationTime;
+
+    std::vector<std::string> gpuScopeNames;
+    std::vector<std::string> cpuScopeNames;
+    std::vector<History> gpuHistory, cpuHistory;
+    uint64_t droppedFrames = 0;
+    int64_t latestGpuFrameIndex = -1;
+    std::vector<double> latestGpuTimes;
+
+    // background writer
+    std::mutex writerMutex;
+    std::condition_variable writerCondition;
+    std::deque<FrameRecord> writerQueue;
+    bool writerStop = false;
+    std::thread writerThread;
+    std::ofstream csvFile, traceFile;
+    std::string jsonPath;
+    bool csvHeaderWritten = false, traceEventWritten = false;
+    size_t csvCpuColumns = 0;
+};
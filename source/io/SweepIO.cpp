@@ -0,0 +1,115 @@
+#include <io/SweepIO.hpp>
+#include <nlohmann/json.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+    std::vector<std::string> withProgramName(const std::vector<std::string>& arguments)
+    {
+        std::vector<std::string> result{"VulkanPBRT"};
+        result.insert(result.end(), arguments.begin(), arguments.end());
+        return result;
+    }
+    std::vector<char*> toArgv(std::vector<std::string>& arguments)
+    {
+        std::vector<char*> result;
+        for (auto& arg : arguments)
+            result.push_back(arg.data());
+        result.push_back(nullptr);
+        return result;
+    }
+}
+
+SweepArguments::SweepArguments(const SweepRun& run):
+    storage(withProgramName(run.arguments)),
+    argvStorage(toArgv(storage)),
+    argc(static_cast<int>(storage.size())),
+    commandLine(&argc, argvStorage.data())
+{
+}
+
+SweepRuns SweepIO::importSweep(const std::string& sweepPath)
+{
+    std::ifstream sweepFile(sweepPath);
+    if (!sweepFile)
+    {
+        std::cerr << "Failed to load sweep file " << sweepPath << std::endl;
+        return {};
+    }
+    nlohmann::json sweep;
+    sweepFile >> sweep;
+    if (!sweep.contains("cases") || !sweep["cases"].is_array() || !sweep.contains("configs") || !sweep["configs"].is_object())
+    {
+        std::cerr << "Sweep file needs a \"cases\" array and a \"configs\" object" << std::endl;
+        return {};
+    }
+
+    SweepRuns runs;
+    for (const auto& [name, overrides] : sweep["configs"].items())
+    {
+        std::vector<int> disabled;
+        if (overrides.contains("disabled"))
+            disabled = overrides["disabled"].get<std::vector<int>>();
+        auto outputDirectory = std::filesystem::path(name);
+        std::filesystem::create_directories(outputDirectory);
+
+        const auto& cases = sweep["cases"];
+        for (int i = 0; i < static_cast<int>(cases.size()); ++i)
+        {
+            if (std::find(disabled.begin(), disabled.end(), i) != disabled.end())
+                continue;
+
+            // merge arguments, the config overrides the case
+            nlohmann::json config = cases[i];
+            config.update(overrides);
+
+            SweepRun run;
+            run.configName = name;
+            run.caseIndex = i;
+            run.outputDirectory = outputDirectory.string();
+            for (const auto& [key, value] : config.items())
+            {
+                if (key.empty() || key[0] != '-')
+                    continue;
+                if (key == "-i")
+                {
+                    std::cerr << "Sweep config " << name << " sets \"-i\" for case " << i << ", the scene of all runs is given on the main command line" << std::endl;
+                    return {};
+                }
+                if (value.is_boolean())
+                {
+                    if (value.get<bool>())
+                        run.arguments.push_back(key);
+                    continue;
+                }
+                std::string valueStr = value.is_string() ? value.get<std::string>() : value.dump();
+                // exported files end up in the directory of the config
+                if (key.rfind("--export", 0) == 0)
+                    valueStr = (outputDirectory / valueStr).string();
+                run.arguments.push_back(key);
+                run.arguments.push_back(valueStr);
+            }
+            runs.push_back(run);
+        }
+    }
+    return runs;
+}
+
+bool SweepIO::exportRunTiming(const std::string& timingPath, const SweepRun& run, int numFrames, double seconds)
+{
+    bool writeHeader = !std::filesystem::exists(timingPath);
+    std::ofstream timingFile(timingPath, std::ios::app);
+    if (!timingFile)
+    {
+        std::cerr << "Failed to open sweep timing file " << timingPath << std::endl;
+        return false;
+    }
+    if (writeHeader)
+        timingFile << "config,case,frames,seconds,msPerFrame" << std::endl;
+    timingFile << run.configName << "," << run.caseIndex << "," << numFrames << "," << seconds << ","
+               << (numFrames > 0 ? seconds * 1000.0 / numFrames : 0.0) << std::endl;
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vsg/all.h>
+#include <vector>
+#include <string>
+
+// Parameter sweep ------------------------------------------------------------------
+// A sweep file mirrors tests/run.py:
+// {
+//     "cases":   [{"-f": 1, "--spp": 1, "--cam": "test1.json", "--exportIllumination": "t0.exr"}, ...],
+//     "configs": {"fast": {"--denoiser": "asvgf", "--atrousIters": 4, "disabled": [1, 3]}, ...}
+// }
+// Every config is run on every case which is not disabled, the config overrides the case arguments.
+// Outputs of a config are written into a directory named after the config.
+// The scene is loaded once from the main command line for all runs, a case or config setting "-i" is rejected.
+class SweepRun{
+public:
+    std::string configName;
+    int caseIndex;
+    std::string outputDirectory;
+    std::vector<std::string> arguments;     // command line style, "--key value"
+};
+using SweepRuns = std::vector<SweepRun>;
+
+// owns the argv storage of a sweep run, so that the render modules can read their settings from a command line
+class SweepArguments: public vsg::Inherit<vsg::Object, SweepArguments>{
+public:
+    explicit SweepArguments(const SweepRun& run);
+private:
+    std::vector<std::string> storage;
+    std::vector<char*> argvStorage;
+    int argc;
+public:
+    vsg::CommandLine commandLine;
+};
+
+class SweepIO{
+public:
+    static SweepRuns importSweep(const std::string& sweepPath);
+    // appends one line to the timing summary of the sweep, the header is written for new files
+    static bool exportRunTiming(const std::string& timingPath, const SweepRun& run, int numFrames, double seconds);
+};
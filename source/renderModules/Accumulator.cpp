@@ -40,15 +40,16 @@ Accumulator::Accumulator(vsg::ref_ptr<GBuffer> gBuffer, vsg::ref_ptr<Illuminatio
     int srcIndex = vsg::ShaderStage::getSetBindingIndex(bindingMap, "srcImage").second;
     auto descriptorImage = vsg::DescriptorImage::create(imageInfo, srcIndex);
     descriptors.push_back(descriptorImage);
+    pushConstantsValue = PCValue::create();
+    cameraParametersBuffer = FrameParameters::createUniformBuffer(sizeof(PushConstants));
+    int cameraIndex = vsg::ShaderStage::getSetBindingIndex(bindingMap, "CameraParameters").second;
+    descriptors.push_back(vsg::DescriptorBuffer::create(vsg::BufferInfoList{cameraParametersBuffer}, cameraIndex, 0));
     auto descriptorSet = vsg::DescriptorSet::create(descriptorSetLayout, descriptors);
     bindDescriptorSet = vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, descriptorSet);
 
     gBuffer->updateDescriptor(bindDescriptorSet, bindingMap);
     accumulationBuffer->updateDescriptor(bindDescriptorSet, bindingMap);
     accumulatedIllumination->updateDescriptor(bindDescriptorSet, bindingMap);
-    
-    pushConstantsValue = PCValue::create();
-    pushConstants = vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantsValue);
 }
 
 void Accumulator::compileImages(vsg::Context &context) 
@@ -69,14 +70,22 @@ void Accumulator::addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandG
         0);
     commandGraph->addChild(bindPipeline);
     commandGraph->addChild(bindDescriptorSet);
-    commandGraph->addChild(pushConstants);
     commandGraph->addChild(vsg::Dispatch::create(uint32_t(ceil(float(width) / float(workWidth))), uint32_t(ceil(float(height) / float(workHeight))),
                                                  1));
     commandGraph->addChild(pipelineBarrier);
 }
 
+void Accumulator::addFrameParameters(FrameParameters& frameParameters)
+{
+    frameParameters.add(pushConstantsValue, cameraParametersBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
 void Accumulator::setCameraMatrices(int frameIndex, const CameraMatrices& cur, const CameraMatrices& prev)
 {
+    if(_historyReset){
+        frameIndex = 0;
+        _historyReset = false;
+    }
     if(_separateMatrices){
         if(!cur.proj || !cur.invProj) throw vsg::Exception{"Accumulator::setDoubleMatrix(...) Accumulator was created with separateMatrices = true, but DubleMatrix is missing seperate matrices"};
         pushConstantsValue->value().view = cur.invProj.value();
@@ -99,3 +108,8 @@ void Accumulator::setCameraMatrices(int frameIndex, const CameraMatrices& cur, c
         pushConstantsValue->value().frameNumber = frameIndex;
     }
 }
+
+void Accumulator::resetHistory()
+{
+    _historyReset = true;
+}
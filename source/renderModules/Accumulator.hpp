@@ -4,6 +4,7 @@
 #include <buffers/GBuffer.hpp>
 #include <buffers/IlluminationBuffer.hpp>
 #include <buffers/AccumulationBuffer.hpp>
+#include <buffers/FrameParameters.hpp>
 
 class Accumulator : public vsg::Inherit<vsg::Object, Accumulator>
 {
@@ -18,6 +19,10 @@ public:
     void addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph);
     // Frameindex is needed to upload the correct matrix
     void setCameraMatrices(int frameIndex, const CameraMatrices& cur, const CameraMatrices& prev);
+    // the next frame is accumulated as if it was the first one
+    void resetHistory();
+    // the camera matrices are read from a uniform buffer written by the frame parameters
+    void addFrameParameters(FrameParameters& frameParameters);
 
     vsg::ref_ptr<IlluminationBuffer> accumulatedIllumination;
     vsg::ref_ptr<AccumulationBuffer> accumulationBuffer;
@@ -40,7 +45,8 @@ private:
     vsg::ref_ptr<IlluminationBuffer> originalIllumination;
     vsg::ref_ptr<vsg::BindComputePipeline> bindPipeline;
     vsg::ref_ptr<vsg::BindDescriptorSet> bindDescriptorSet;
-    vsg::ref_ptr<vsg::PushConstants> pushConstants;
     vsg::ref_ptr<PCValue> pushConstantsValue;
+    vsg::ref_ptr<vsg::BufferInfo> cameraParametersBuffer;
     bool _separateMatrices;
+    bool _historyReset = false;
 };
\ No newline at end of file
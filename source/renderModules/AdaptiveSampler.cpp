@@ -0,0 +1,155 @@
+#include <renderModules/AdaptiveSampler.hpp>
+
+#include <algorithm>
+
+namespace
+{
+    vsg::ref_ptr<vsg::DescriptorImage> createStorageImage(uint32_t width, uint32_t height, VkFormat format, uint32_t binding)
+    {
+        auto image = vsg::Image::create();
+        image->imageType = VK_IMAGE_TYPE_2D;
+        image->format = format;
+        image->extent.width = width;
+        image->extent.height = height;
+        image->extent.depth = 1;
+        image->mipLevels = 1;
+        image->arrayLayers = 1;
+        image->samples = VK_SAMPLE_COUNT_1_BIT;
+        image->tiling = VK_IMAGE_TILING_OPTIMAL;
+        image->usage = VK_IMAGE_USAGE_STORAGE_BIT;
+        image->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        image->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        auto imageView = vsg::ImageView::create(image, VK_IMAGE_ASPECT_COLOR_BIT);
+        auto imageInfo = vsg::ImageInfo::create(vsg::ref_ptr<vsg::Sampler>{}, imageView, VK_IMAGE_LAYOUT_GENERAL);
+        return vsg::DescriptorImage::create(imageInfo, binding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    }
+}
+
+AdaptiveSampler::AdaptiveSampler(uint32_t width, uint32_t height, float errorThreshold, uint32_t minSamples, uint32_t slotCount) :
+    width(width),
+    height(height),
+    errorThreshold(errorThreshold),
+    minSamples(minSamples),
+    slotCount(slotCount)
+{
+    if (slotCount < 2 || slotCount > MaxSlots)
+        throw vsg::Exception{"Error: AdaptiveSampler::AdaptiveSampler(...) slotCount has to be between 2 and " + std::to_string(MaxSlots) + "."};
+    uint32_t tileWidth = (width + TileSize - 1) / TileSize, tileHeight = (height + TileSize - 1) / TileSize;
+    sampleMoments = createStorageImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, 0);
+    convergedTiles = createStorageImage(tileWidth, tileHeight, VK_FORMAT_R32_UINT, 1);
+    // storage buffers get host visible memory, the counters are reset and read by the CPU
+    unconvergedTiles = vsg::DescriptorBuffer::create(vsg::uintArray::create(slotCount, 0u), 2, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+    auto shader = vsg::ShaderStage::read(VK_SHADER_STAGE_COMPUTE_BIT, "main", "shaders/adaptiveMask.comp.spv");
+    if (!shader)
+        throw vsg::Exception{"Error: AdaptiveSampler::AdaptiveSampler(...) failed to load the adaptive mask shader."};
+    auto bindingMap = shader->getDescriptorSetLayoutBindingsMap();
+    auto dsetLayout = vsg::DescriptorSetLayout::create(bindingMap.begin()->second.bindings);
+    auto descriptorSet = vsg::DescriptorSet::create(dsetLayout, vsg::Descriptors{sampleMoments, convergedTiles, unconvergedTiles});
+    auto pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{dsetLayout}, vsg::PushConstantRanges{
+        {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants)}
+    });
+    bindPipeline = vsg::BindComputePipeline::create(vsg::ComputePipeline::create(pipelineLayout, shader));
+    bindDescriptorSet = vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, descriptorSet);
+    pushConstValue = vsg::Value<PushConstants>::create(PushConstants{errorThreshold, std::max(minSamples, 2u), 0});
+}
+
+void AdaptiveSampler::compile(vsg::Context& context)
+{
+    device = context.device;
+    for (auto& desc : bindDescriptorSet->descriptorSet->descriptors)
+        desc->compile(context);
+}
+
+void AdaptiveSampler::updateImageLayouts(vsg::Context& context) const
+{
+    auto barr = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+    VkImageSubresourceRange rr{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    barr->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_NONE_KHR, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, 0, sampleMoments->imageInfoList[0]->imageView->image, rr));
+    barr->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_NONE_KHR, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, 0, convergedTiles->imageInfoList[0]->imageView->image, rr));
+    context.commands.emplace_back(barr);
+}
+
+void AdaptiveSampler::updateDescriptor(vsg::BindDescriptorSet* descSet, const vsg::BindingMap& bindingMap) const
+{
+    int momentsIdx = vsg::ShaderStage::getSetBindingIndex(bindingMap, "sampleMoments").second;
+    int tilesIdx = vsg::ShaderStage::getSetBindingIndex(bindingMap, "convergedTiles").second;
+    descSet->descriptorSet->descriptors.push_back(vsg::DescriptorImage::create(sampleMoments->imageInfoList, momentsIdx, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE));
+    descSet->descriptorSet->descriptors.push_back(vsg::DescriptorImage::create(convergedTiles->imageInfoList, tilesIdx, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE));
+}
+
+void AdaptiveSampler::addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph)
+{
+    VkImageSubresourceRange rr{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    auto barrier = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+    barrier->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, 0, 0, sampleMoments->imageInfoList[0]->imageView->image, rr));
+    // the ray generation shader of this sample has read the tiles of the previous one
+    barrier->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, 0, 0, convergedTiles->imageInfoList[0]->imageView->image, rr));
+    commandGraph->addChild(barrier);
+
+    commandGraph->addChild(bindPipeline);
+    commandGraph->addChild(bindDescriptorSet);
+    commandGraph->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstValue));
+    commandGraph->addChild(vsg::Dispatch::create((width + TileSize - 1) / TileSize, (height + TileSize - 1) / TileSize, 1));
+
+    barrier = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_HOST_BIT, 0);
+    barrier->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, 0, 0, convergedTiles->imageInfoList[0]->imageView->image, rr));
+    barrier->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, 0, 0, sampleMoments->imageInfoList[0]->imageView->image, rr));
+    barrier->add(vsg::BufferMemoryBarrier::create(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                                                  unconvergedTiles->bufferInfoList[0]->buffer, 0, VK_WHOLE_SIZE));
+    commandGraph->addChild(barrier);
+}
+
+void AdaptiveSampler::beginSample(uint32_t sampleIndex)
+{
+    ++submission;
+    if (sampleIndex == 0 || accumulation < 0)
+        ++accumulation;
+    // the previous submission with this slot is older than the frames in flight and thus finished
+    uint32_t slot = static_cast<uint32_t>(submission % slotCount);
+    slots[slot] = {accumulation, sampleIndex};
+    writeCounter(slot, 0);
+    pushConstValue->value() = PushConstants{errorThreshold, std::max(minSamples, 2u), slot};
+}
+
+bool AdaptiveSampler::converged()
+{
+    int64_t finished = submission - static_cast<int64_t>(slotCount - 1);
+    if (finished < 0)
+        return false;
+    uint32_t slot = static_cast<uint32_t>(finished % slotCount);
+    if (slots[slot].accumulation != accumulation || slots[slot].sampleIndex + 1 < std::max(minSamples, 2u))
+        return false;
+    return readCounter(slot) == 0;
+}
+
+uint32_t AdaptiveSampler::readCounter(uint32_t slot) const
+{
+    auto& bufferInfo = unconvergedTiles->bufferInfoList[0];
+    if (!device || !bufferInfo->buffer)
+        return ~0u;
+    auto deviceID = device->deviceID;
+    vsg::ref_ptr<vsg::DeviceMemory> memory(bufferInfo->buffer->getDeviceMemory(deviceID));
+    if (!memory)
+        return ~0u;
+    void* gpu_data;
+    memory->map(bufferInfo->buffer->getMemoryOffset(deviceID) + bufferInfo->offset, bufferInfo->range, 0, &gpu_data);
+    uint32_t value = static_cast<const uint32_t*>(gpu_data)[slot];
+    memory->unmap();
+    return value;
+}
+
+void AdaptiveSampler::writeCounter(uint32_t slot, uint32_t value) const
+{
+    auto& bufferInfo = unconvergedTiles->bufferInfoList[0];
+    if (!device || !bufferInfo->buffer)
+        return;
+    auto deviceID = device->deviceID;
+    vsg::ref_ptr<vsg::DeviceMemory> memory(bufferInfo->buffer->getDeviceMemory(deviceID));
+    if (!memory)
+        return;
+    void* gpu_data;
+    memory->map(bufferInfo->buffer->getMemoryOffset(deviceID) + bufferInfo->offset, bufferInfo->range, 0, &gpu_data);
+    static_cast<uint32_t*>(gpu_data)[slot] = value;
+    memory->unmap();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vsg/all.h>
+
+#include <array>
+#include <cstdint>
+
+// Adaptive sampling for the progressively accumulated final image --------------------
+// The ray generation shader keeps per pixel luminance moments and skips pixels of converged tiles. After every sample
+// a compute pass marks the tiles whose relative standard error is below the threshold and counts the unconverged
+// ones into a host visible buffer. The counts are read back with the latency of the frames in flight, so the CPU
+// never waits on the GPU to decide whether a frame needs further samples.
+class AdaptiveSampler : public vsg::Inherit<vsg::Object, AdaptiveSampler>
+{
+public:
+    static constexpr uint32_t TileSize = 8;
+
+    // the counters are read back slotCount - 1 samples later, slotCount has to be larger than the frames in flight like
+    // the query pool ring of the profiler
+    AdaptiveSampler(uint32_t width, uint32_t height, float errorThreshold, uint32_t minSamples, uint32_t slotCount);
+
+    void compile(vsg::Context& context);
+    void updateImageLayouts(vsg::Context& context) const;
+    void updateDescriptor(vsg::BindDescriptorSet* descSet, const vsg::BindingMap& bindingMap) const;
+    // has to be added after the trace rays command, compile() has to be called before
+    void addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph);
+
+    // has to be called before the sample is submitted, sample index 0 restarts the accumulation
+    void beginSample(uint32_t sampleIndex);
+    // true if all tiles of the current accumulation converged. Uses the latest finished sample, has to be called
+    // after the sample of beginSample() was submitted
+    bool converged();
+
+    uint32_t width, height;
+    // can be changed between samples, at least 2 samples are taken
+    float errorThreshold;
+    uint32_t minSamples;
+    vsg::ref_ptr<vsg::DescriptorImage> sampleMoments;   // RGBA32F: sum of luminance, sum of squared luminance, sample count
+    vsg::ref_ptr<vsg::DescriptorImage> convergedTiles;  // R32UI per tile
+    vsg::ref_ptr<vsg::DescriptorBuffer> unconvergedTiles; // one counter per slot
+
+private:
+    struct PushConstants
+    {
+        float errorThreshold;
+        uint32_t minSamples;
+        uint32_t slot;
+    };
+    struct Slot
+    {
+        int64_t accumulation = -1;
+        uint32_t sampleIndex = 0;
+    };
+    static constexpr uint32_t MaxSlots = 8;
+
+    uint32_t readCounter(uint32_t slot) const;
+    void writeCounter(uint32_t slot, uint32_t value) const;
+
+    uint32_t slotCount;
+    std::array<Slot, MaxSlots> slots;
+    int64_t submission = -1, accumulation = -1;
+    vsg::ref_ptr<vsg::Device> device;
+
+    vsg::ref_ptr<vsg::BindComputePipeline> bindPipeline;
+    vsg::ref_ptr<vsg::BindDescriptorSet> bindDescriptorSet;
+    vsg::ref_ptr<vsg::Value<PushConstants>> pushConstValue;
+};
@@ -0,0 +1,205 @@
+#include <renderModules/AsyncCompute.hpp>
+
+namespace
+{
+    vsg::ref_ptr<IlluminationBuffer> createIlluminationBufferLike(const vsg::ref_ptr<IlluminationBuffer>& illuminationBuffer)
+    {
+        auto width = illuminationBuffer->width, height = illuminationBuffer->height;
+        if (illuminationBuffer.cast<IlluminationBufferFinal>())
+            return IlluminationBufferFinal::create(width, height);
+        if (illuminationBuffer.cast<IlluminationBufferFinalDirIndir>())
+            return IlluminationBufferFinalDirIndir::create(width, height);
+        if (illuminationBuffer.cast<IlluminationBufferFinalDemodulated>())
+            return IlluminationBufferFinalDemodulated::create(width, height);
+        if (illuminationBuffer.cast<IlluminationBufferDemodulated>())
+            return IlluminationBufferDemodulated::create(width, height);
+        if (illuminationBuffer.cast<IlluminationBufferDemodulatedFloat>())
+            return IlluminationBufferDemodulatedFloat::create(width, height);
+        if (illuminationBuffer.cast<IlluminationBufferFinalFloat>())
+            return IlluminationBufferFinalFloat::create(width, height);
+        throw vsg::Exception{"Error: AsyncCompute::AsyncCompute(...) Illumination buffer not supported."};
+    }
+
+    // submits the recorded commands waiting for and signaling the frame counts of timeline semaphores. The n-th
+    // submission waits until waitSemaphore reached n - waitLag and sets signalSemaphore to n
+    class TimelineSubmitTask : public vsg::Inherit<vsg::RecordAndSubmitTask, TimelineSubmitTask>
+    {
+    public:
+        TimelineSubmitTask(vsg::Device* device, vsg::ref_ptr<vsg::Semaphore> waitSemaphore, uint64_t waitLag,
+                           vsg::ref_ptr<vsg::Semaphore> signalSemaphore) :
+            Inherit(device, 3), waitSemaphore(waitSemaphore), waitLag(waitLag), signalSemaphore(signalSemaphore)
+        {
+        }
+
+        VkResult finish(vsg::CommandBuffers& recordedCommandBuffers) override
+        {
+            auto currentFence = fence();
+            std::vector<VkCommandBuffer> vkCommandBuffers;
+            for (auto& commandBuffer : recordedCommandBuffers)
+            {
+                if (commandBuffer->level() == VK_COMMAND_BUFFER_LEVEL_PRIMARY)
+                    vkCommandBuffers.push_back(*commandBuffer);
+                currentFence->dependentCommandBuffers().emplace_back(commandBuffer);
+            }
+
+            ++frameCount;
+            // the semaphores start at 0, so the first waits of the graphics queue are already satisfied
+            uint64_t waitValue = frameCount > waitLag ? frameCount - waitLag : 0;
+            uint64_t signalValue = frameCount;
+            VkSemaphore vkWaitSemaphore = *waitSemaphore, vkSignalSemaphore = *signalSemaphore;
+            VkPipelineStageFlags waitStages = waitSemaphore->pipelineStageFlags();
+
+            VkTimelineSemaphoreSubmitInfo timelineInfo{};
+            timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineInfo.waitSemaphoreValueCount = 1;
+            timelineInfo.pWaitSemaphoreValues = &waitValue;
+            timelineInfo.signalSemaphoreValueCount = 1;
+            timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.pNext = &timelineInfo;
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &vkWaitSemaphore;
+            submitInfo.pWaitDstStageMask = &waitStages;
+            submitInfo.commandBufferCount = static_cast<uint32_t>(vkCommandBuffers.size());
+            submitInfo.pCommandBuffers = vkCommandBuffers.data();
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &vkSignalSemaphore;
+            return queue->submit(submitInfo, currentFence);
+        }
+
+    private:
+        vsg::ref_ptr<vsg::Semaphore> waitSemaphore;
+        uint64_t waitLag;
+        vsg::ref_ptr<vsg::Semaphore> signalSemaphore;
+        uint64_t frameCount = 0;
+    };
+
+    vsg::ref_ptr<vsg::Semaphore> createTimelineSemaphore(vsg::Device* device, VkPipelineStageFlags waitStages)
+    {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+        return vsg::Semaphore::create(device, waitStages, &typeInfo);
+    }
+}
+
+AsyncCompute::AsyncCompute(vsg::ref_ptr<vsg::Device> device, int graphicsQueueFamily, int computeQueueFamily, uint32_t computeQueueIndex,
+                           vsg::ref_ptr<GBuffer> gBuffer, vsg::ref_ptr<IlluminationBuffer> illuminationBuffer) :
+    device(device),
+    graphicsQueueFamily(graphicsQueueFamily),
+    computeQueueFamily(computeQueueFamily),
+    computeQueueIndex(computeQueueIndex),
+    gBuffer(gBuffer),
+    illuminationBuffer(illuminationBuffer)
+{
+    if (gBuffer)
+        computeGBuffer = GBuffer::create(gBuffer->width, gBuffer->height);
+    computeIlluminationBuffer = createIlluminationBufferLike(illuminationBuffer);
+
+    // the copies are written by the graphics queue and read by the compute queue without ownership transfers
+    if (graphicsQueueFamily != computeQueueFamily)
+    {
+        for (auto& [srcImage, dstImage] : imagePairs())
+        {
+            dstImage->sharingMode = VK_SHARING_MODE_CONCURRENT;
+            dstImage->queueFamilyIndices = {static_cast<uint32_t>(graphicsQueueFamily), static_cast<uint32_t>(computeQueueFamily)};
+        }
+    }
+}
+
+std::vector<std::pair<vsg::ref_ptr<vsg::Image>, vsg::ref_ptr<vsg::Image>>> AsyncCompute::imagePairs() const
+{
+    auto image = [](const vsg::ref_ptr<vsg::DescriptorImage>& descriptorImage) { return descriptorImage->imageInfoList[0]->imageView->image; };
+    std::vector<std::pair<vsg::ref_ptr<vsg::Image>, vsg::ref_ptr<vsg::Image>>> pairs;
+    if (gBuffer)
+    {
+        pairs = {{image(gBuffer->depth), image(computeGBuffer->depth)},
+                 {image(gBuffer->normal), image(computeGBuffer->normal)},
+                 {image(gBuffer->material), image(computeGBuffer->material)},
+                 {image(gBuffer->albedo), image(computeGBuffer->albedo)},
+                 {image(gBuffer->volume), image(computeGBuffer->volume)}};
+    }
+    for (size_t i = 0; i < illuminationBuffer->illuminationImages.size(); ++i)
+        pairs.emplace_back(image(illuminationBuffer->illuminationImages[i]), image(computeIlluminationBuffer->illuminationImages[i]));
+    return pairs;
+}
+
+void AsyncCompute::compile(vsg::Context& context)
+{
+    if (gBuffer)
+    {
+        gBuffer->compile(context);
+        computeGBuffer->compile(context);
+    }
+    illuminationBuffer->compile(context);
+    computeIlluminationBuffer->compile(context);
+}
+
+void AsyncCompute::updateImageLayouts(vsg::Context& context)
+{
+    if (gBuffer)
+    {
+        gBuffer->updateImageLayouts(context);
+        computeGBuffer->updateImageLayouts(context);
+    }
+    illuminationBuffer->updateImageLayouts(context);
+    computeIlluminationBuffer->updateImageLayouts(context);
+}
+
+void AsyncCompute::addCopyToCommandGraph(vsg::ref_ptr<vsg::Commands> commands)
+{
+    // all images stay in the general layout, the copies are made visible to the compute queue by the semaphore
+    VkImageSubresourceRange resourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    auto before = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                               VK_PIPELINE_STAGE_TRANSFER_BIT, 0);
+    // the next frame may only overwrite the sources once they have been copied
+    auto after = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                              VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+    auto copyImages = vsg::Commands::create();
+    for (auto& [srcImage, dstImage] : imagePairs())
+    {
+        before->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                                                    VK_IMAGE_LAYOUT_GENERAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, srcImage,
+                                                    resourceRange));
+
+        auto copyImage = vsg::CopyImage::create();
+        copyImage->srcImage = srcImage;
+        copyImage->srcImageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        copyImage->dstImage = dstImage;
+        copyImage->dstImageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        copyImage->regions = {VkImageCopy{
+                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                {0, 0, 0},
+                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                {0, 0, 0},
+                srcImage->extent
+        }};
+        copyImages->addChild(copyImage);
+    }
+    commands->addChild(before);
+    commands->addChild(copyImages);
+    commands->addChild(after);
+}
+
+void AsyncCompute::assignRecordAndSubmitTasks(vsg::ref_ptr<vsg::Viewer> viewer, vsg::ref_ptr<vsg::CommandGraph> graphicsGraph,
+                                              vsg::ref_ptr<vsg::Node> computeCommands)
+{
+    // graphics frame n copies into the images compute frame n - 1 reads, only the copy has to wait for it
+    auto graphicsDone = createTimelineSemaphore(device.get(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    auto computeDone = createTimelineSemaphore(device.get(), VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    auto graphicsTask = TimelineSubmitTask::create(device.get(), computeDone, 1, graphicsDone);
+    graphicsTask->commandGraphs = {graphicsGraph};
+    graphicsTask->queue = device->getQueue(graphicsQueueFamily);
+
+    auto computeGraph = vsg::CommandGraph::create(device.get(), computeQueueFamily);
+    computeGraph->addChild(computeCommands);
+    auto computeTask = TimelineSubmitTask::create(device.get(), graphicsDone, 0, computeDone);
+    computeTask->commandGraphs = {computeGraph};
+    computeTask->queue = device->getQueue(computeQueueFamily, computeQueueIndex);
+
+    viewer->recordAndSubmitTasks = {graphicsTask, computeTask};
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <buffers/GBuffer.hpp>
+#include <buffers/IlluminationBuffer.hpp>
+
+#include <vsg/all.h>
+
+// Frame pipeline with the compute work on its own queue ---------------------------------
+// The graphics queue traces frame N+1 while the compute queue accumulates and denoises frame N. The GBuffer and
+// illumination buffer are double buffered: the last commands of the graphics queue copy them into a second set which
+// the compute modules are created with, so the next frame can overwrite the first set right away. Each queue counts
+// its frames on a timeline semaphore. The compute frame waits for the copy of its graphics frame and the copy of the
+// next graphics frame waits for the previous compute frame, everything before the copy overlaps with the denoising.
+class AsyncCompute : public vsg::Inherit<vsg::Object, AsyncCompute>
+{
+public:
+    AsyncCompute(vsg::ref_ptr<vsg::Device> device, int graphicsQueueFamily, int computeQueueFamily, uint32_t computeQueueIndex,
+                 vsg::ref_ptr<GBuffer> gBuffer, vsg::ref_ptr<IlluminationBuffer> illuminationBuffer);
+
+    // copies of the buffers written on the graphics queue, the modules on the compute queue have to read these.
+    // computeGBuffer is null without GBuffer
+    vsg::ref_ptr<GBuffer> computeGBuffer;
+    vsg::ref_ptr<IlluminationBuffer> computeIlluminationBuffer;
+
+    void compile(vsg::Context& context);
+    void updateImageLayouts(vsg::Context& context);
+    // appends the copy to the compute set, has to follow all commands writing the buffers
+    void addCopyToCommandGraph(vsg::ref_ptr<vsg::Commands> commands);
+    // replaces the record and submit tasks of the viewer with one task per queue
+    void assignRecordAndSubmitTasks(vsg::ref_ptr<vsg::Viewer> viewer, vsg::ref_ptr<vsg::CommandGraph> graphicsGraph,
+                                    vsg::ref_ptr<vsg::Node> computeCommands);
+
+private:
+    std::vector<std::pair<vsg::ref_ptr<vsg::Image>, vsg::ref_ptr<vsg::Image>>> imagePairs() const;
+
+    vsg::ref_ptr<vsg::Device> device;
+    int graphicsQueueFamily, computeQueueFamily;
+    uint32_t computeQueueIndex;
+    vsg::ref_ptr<GBuffer> gBuffer;
+    vsg::ref_ptr<IlluminationBuffer> illuminationBuffer;
+};
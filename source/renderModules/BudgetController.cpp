@@ -0,0 +1,93 @@
+#include <renderModules/BudgetController.hpp>
+
+#include <algorithm>
+#include <iomanip>
+
+namespace
+{
+    // longer than the query pool ring of the profiler, the latest results are at most that many frames old
+    const size_t kFrameLevelRing = 16;
+}
+
+BudgetController::BudgetController(vsg::ref_ptr<Profiler> profiler, uint32_t levelCount, double budgetMs, std::string name) :
+    profiler(profiler),
+    levelCount(levelCount),
+    budgetMs(budgetMs),
+    name(std::move(name)),
+    frameLevels(kFrameLevelRing, 0),
+    levelFrames(levelCount, 0)
+{
+    if (levelCount == 0)
+        throw vsg::Exception{"Error: BudgetController::BudgetController(...) needs at least one level."};
+}
+
+void BudgetController::setFallback(vsg::ref_ptr<BudgetController> controller)
+{
+    if (controller.get() == this || (controller && controller->primary))
+        throw vsg::Exception{"Error: BudgetController::setFallback(...) the controller is already a fallback."};
+    if (fallback)
+        fallback->primary = nullptr;
+    fallback = controller;
+    if (fallback)
+        fallback->primary = this;
+}
+
+bool BudgetController::matchesScope(const std::string& name, const std::vector<std::string>& prefixes)
+{
+    return std::any_of(prefixes.begin(), prefixes.end(), [&](const std::string& prefix) { return name.compare(0, prefix.size(), prefix) == 0; });
+}
+
+uint32_t BudgetController::update()
+{
+    ++frame;
+    auto latest = profiler->getLatestGpuFrameIndex();
+    if (latest > measuredFrame && frame - latest < static_cast<int64_t>(kFrameLevelRing))
+    {
+        measuredFrame = latest;
+        const auto& times = profiler->getLatestGpuTimes();
+        std::vector<double> timesMs(times.size());
+        std::transform(times.begin(), times.end(), timesMs.begin(), [](double t) { return t / 1000.0; });
+        measure(profiler->getGpuScopeNames(), timesMs, frameLevels[latest % kFrameLevelRing]);
+
+        // the primary drops first and the fallback rises first
+        bool mayDrop = !primary || primary->level + 1 == primary->levelCount;
+        bool mayRise = !fallback || fallback->level == 0;
+        if (predict(level) > budgetMs)
+        {
+            auto next = level;
+            while (mayDrop && next + 1 < levelCount && predict(next) > budgetMs)
+                ++next;
+            if (next != level)
+                ++switches;
+            level = next;
+            framesBelow = 0;
+        }
+        else if (mayRise && level > 0 && predict(level - 1) < headroom * budgetMs)
+        {
+            if (++framesBelow >= riseFrames)
+            {
+                --level;
+                ++switches;
+                framesBelow = 0;
+            }
+        }
+        else
+            framesBelow = 0;
+    }
+    frameLevels[frame % kFrameLevelRing] = level;
+    ++levelFrames[level];
+    return level;
+}
+
+void BudgetController::printStatistics(std::ostream& out) const
+{
+    out << name << " for a budget of " << std::fixed << std::setprecision(2) << budgetMs << " ms, " << switches << " switches" << std::endl;
+    for (uint32_t i = 0; i < levelCount; ++i)
+    {
+        out << "level " << i << " (";
+        printLevel(out, i);
+        out << "): " << levelFrames[i] << " frames";
+        printLevelTime(out, i);
+        out << std::endl;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <io/Profiler.hpp>
+
+#include <vsg/all.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Budget controller ------------------------------------------------------------------------
+// Picks a level of every frame so the gpu time of the timed passes stays within a budget. Level 0 is the most
+// expensive one. The subclasses measure the latest collected frame and predict the time of the levels from it.
+// A frame over the budget drops to the highest level predicted within it right away, a higher level is only taken
+// after its prediction stayed below the headroom for riseFrames frames.
+// A fallback controller takes over once this one reached its lowest level: the fallback only drops while this one is
+// at its lowest level and this one only rises while the fallback is at level 0. The fallback has to be updated first.
+class BudgetController : public vsg::Inherit<vsg::Object, BudgetController>
+{
+public:
+    double headroom = .85;
+    uint32_t riseFrames = 30;
+
+    // returns the level of the current frame, has to be called once per frame after Profiler::beginFrame()
+    uint32_t update();
+    uint32_t getLevel() const { return level; }
+    void setFallback(vsg::ref_ptr<BudgetController> controller);
+    void printStatistics(std::ostream& out) const;
+
+protected:
+    BudgetController(vsg::ref_ptr<Profiler> profiler, uint32_t levelCount, double budgetMs, std::string name);
+
+    // takes the gpu times of the latest collected frame, which was rendered at the given level
+    virtual void measure(const std::vector<std::string>& scopeNames, const std::vector<double>& timesMs, uint32_t measuredLevel) = 0;
+    virtual double predict(uint32_t targetLevel) const = 0;
+    // the settings of a level in its statistics line
+    virtual void printLevel(std::ostream& out, uint32_t printedLevel) const = 0;
+    // the measured time of a level, printed after its frame count
+    virtual void printLevelTime(std::ostream&, uint32_t) const {}
+
+    // true if the name starts with one of the prefixes
+    static bool matchesScope(const std::string& name, const std::vector<std::string>& prefixes);
+
+    vsg::ref_ptr<Profiler> profiler;
+    uint32_t levelCount;
+    double budgetMs;
+
+private:
+    std::string name;
+    vsg::ref_ptr<BudgetController> fallback;
+    const BudgetController* primary = nullptr;
+
+    uint32_t level = 0;
+    int64_t frame = -1, measuredFrame = -1;
+    uint32_t framesBelow = 0, switches = 0;
+    std::vector<uint32_t> frameLevels; // levels of the frames which are not yet measured, a ring
+    std::vector<uint64_t> levelFrames;
+};
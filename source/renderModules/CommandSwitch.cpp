@@ -0,0 +1,25 @@
+#include <renderModules/CommandSwitch.hpp>
+
+void CommandSwitch::traverse(vsg::Visitor& visitor)
+{
+    for (auto& child : children)
+        child->accept(visitor);
+}
+
+void CommandSwitch::traverse(vsg::ConstVisitor& visitor) const
+{
+    for (const auto& child : children)
+        child->accept(visitor);
+}
+
+void CommandSwitch::compile(vsg::Context& context)
+{
+    for (auto& child : children)
+        child->compile(context);
+}
+
+void CommandSwitch::record(vsg::CommandBuffer& commandBuffer) const
+{
+    if (active < children.size())
+        children[active]->record(commandBuffer);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <vsg/all.h>
+
+#include <vector>
+
+// Command switch ---------------------------------------------------------------------
+// Records only the active one of its commands, the vsg::Switch for command lists. All commands are compiled and
+// visited, so the active one can change from frame to frame without compiling anything.
+class CommandSwitch : public vsg::Inherit<vsg::Command, CommandSwitch>
+{
+public:
+    std::vector<vsg::ref_ptr<vsg::Command>> children;
+    size_t active = 0;
+
+    void addChild(vsg::ref_ptr<vsg::Command> child) { children.push_back(child); }
+
+    void traverse(vsg::Visitor& visitor) override;
+    void traverse(vsg::ConstVisitor& visitor) const override;
+    void compile(vsg::Context& context) override;
+    void record(vsg::CommandBuffer& commandBuffer) const override;
+};
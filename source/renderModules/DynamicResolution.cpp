@@ -0,0 +1,34 @@
+#include <renderModules/DynamicResolution.hpp>
+
+DynamicResolution::DynamicResolution(vsg::ref_ptr<Profiler> profiler, std::vector<vsg::uivec2> resolutions, double budgetMs,
+                                     std::vector<std::string> fixedScopes) :
+    Inherit(profiler, static_cast<uint32_t>(resolutions.size()), budgetMs, "Dynamic resolution"),
+    resolutions(std::move(resolutions)),
+    fixedScopes(std::move(fixedScopes))
+{
+}
+
+void DynamicResolution::measure(const std::vector<std::string>& scopeNames, const std::vector<double>& timesMs, uint32_t measuredLevel)
+{
+    double scaledMs = 0;
+    fixedMs = 0;
+    for (size_t i = 0; i < timesMs.size(); ++i)
+    {
+        // scopes which were not recorded are negative
+        if (timesMs[i] < 0)
+            continue;
+        (matchesScope(scopeNames[i], fixedScopes) ? fixedMs : scaledMs) += timesMs[i];
+    }
+    const auto& measured = resolutions[measuredLevel];
+    msPerPixel = scaledMs / (static_cast<double>(measured.x) * measured.y);
+}
+
+double DynamicResolution::predict(uint32_t targetLevel) const
+{
+    return fixedMs + msPerPixel * resolutions[targetLevel].x * resolutions[targetLevel].y;
+}
+
+void DynamicResolution::printLevel(std::ostream& out, uint32_t printedLevel) const
+{
+    out << resolutions[printedLevel].x << "x" << resolutions[printedLevel].y;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <renderModules/BudgetController.hpp>
+
+#include <vsg/all.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Dynamic resolution -----------------------------------------------------------------------
+// Picks the internal resolution of every frame so the gpu time of the timed passes stays within a budget. Level 0 is
+// the highest resolution. The time of a level is predicted from the latest collected frame, the scopes which depend on
+// the resolution are scaled by the pixel counts and the fixed scopes, like the upscaling to the window, are added as they are.
+class DynamicResolution : public vsg::Inherit<BudgetController, DynamicResolution>
+{
+public:
+    // the fixed scopes are prefixes of the names of the profiler scopes which do not depend on the resolution
+    DynamicResolution(vsg::ref_ptr<Profiler> profiler, std::vector<vsg::uivec2> resolutions, double budgetMs, std::vector<std::string> fixedScopes);
+
+protected:
+    void measure(const std::vector<std::string>& scopeNames, const std::vector<double>& timesMs, uint32_t measuredLevel) override;
+    double predict(uint32_t targetLevel) const override;
+    void printLevel(std::ostream& out, uint32_t printedLevel) const override;
+
+private:
+    std::vector<vsg::uivec2> resolutions;
+    std::vector<std::string> fixedScopes;
+
+    double msPerPixel = 0;
+    double fixedMs = 0; // time of the fixed scopes in the latest measured frame
+};
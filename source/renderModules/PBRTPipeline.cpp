@@ -1,9 +1,17 @@
 #include <renderModules/PBRTPipeline.hpp>
+#include <renderModules/PipelineStructs.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <tuple>
 
 namespace
 {
+    // cloud specialization constants of runs which do not set them
+    const int kDefaultVptBundle = 1;
+    const int kDefaultVptLimit = 1536;
+    const int kDefaultCloudStatSteps = 128;
+
     struct ConstantInfos
     {
         uint32_t lightCount;
@@ -25,18 +33,45 @@ namespace
 
 PBRTPipeline::PBRTPipeline(vsg::ref_ptr<vsg::Node> scene, vsg::ref_ptr<GBuffer> gBuffer,
                  vsg::ref_ptr<IlluminationBuffer> illuminationBuffer, vsg::ref_ptr<GradientProjector> gradProjector,
-                 bool writeGBuffer, RayTracingRayOrigin rayTracingRayOrigin, vsg::CommandLine& args) :
+                 bool writeGBuffer, RayTracingRayOrigin rayTracingRayOrigin, vsg::CommandLine& args,
+                 vsg::ref_ptr<AdaptiveSampler> adaptiveSampler, vsg::ref_ptr<TextureCompressor> textureCompressor,
+                 vsg::ref_ptr<VBuffer> primaryVBuffer) :
     width(illuminationBuffer->illuminationImages[0]->imageInfoList[0]->imageView->image->extent.width),
     height(illuminationBuffer->illuminationImages[0]->imageInfoList[0]->imageView->image->extent.height),
     maxRecursionDepth(2),
     illuminationBuffer(illuminationBuffer),
     gBuffer(gBuffer),
-    gradientProjector(gradProjector)
+    gradientProjector(gradProjector),
+    adaptiveSampler(adaptiveSampler),
+    textureCompressor(textureCompressor),
+    primaryVBuffer(primaryVBuffer)
 {
     if (writeGBuffer) assert(gBuffer);
     bool useExternalGBuffer = rayTracingRayOrigin == RayTracingRayOrigin::GBUFFER;
     setupPipeline(scene, useExternalGBuffer, args);
 }
+PBRTPipeline::PBRTPipeline(vsg::ref_ptr<PBRTPipeline> scenePipeline, vsg::ref_ptr<GBuffer> gBuffer,
+                 vsg::ref_ptr<IlluminationBuffer> illuminationBuffer, vsg::ref_ptr<GradientProjector> gradProjector,
+                 vsg::ref_ptr<AdaptiveSampler> adaptiveSampler, vsg::ref_ptr<VBuffer> primaryVBuffer) :
+    lightSamplingMethod(scenePipeline->lightSamplingMethod),
+    geometryTypes(scenePipeline->geometryTypes),
+    width(illuminationBuffer->illuminationImages[0]->imageInfoList[0]->imageView->image->extent.width),
+    height(illuminationBuffer->illuminationImages[0]->imageInfoList[0]->imageView->image->extent.height),
+    maxRecursionDepth(scenePipeline->maxRecursionDepth),
+    gBuffer(gBuffer),
+    illuminationBuffer(illuminationBuffer),
+    gradientProjector(gradProjector),
+    adaptiveSampler(adaptiveSampler),
+    primaryVBuffer(primaryVBuffer),
+    scenePipeline(scenePipeline->scenePipeline ? scenePipeline->scenePipeline : scenePipeline),
+    rayTracingPipelineLayout(scenePipeline->rayTracingPipelineLayout),
+    bindingMap(scenePipeline->bindingMap)
+{
+    const auto& owner = sceneOwner();
+    auto descriptorSet = vsg::DescriptorSet::create(owner.bindRayTracingDescriptorSet->descriptorSet->setLayout, owner.sceneDescriptors);
+    bindRayTracingDescriptorSet = vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rayTracingPipelineLayout, descriptorSet);
+    addOutputDescriptors();
+}
 void PBRTPipeline::setTlas(vsg::ref_ptr<vsg::AccelerationStructure> as)
 {
     auto tlas = as.cast<vsg::TopLevelAccelerationStructure>();
@@ -62,21 +97,78 @@ void PBRTPipeline::updateImageLayouts(vsg::Context &context)
 {
     illuminationBuffer->updateImageLayouts(context);
 }
-void PBRTPipeline::addTraceRaysToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph, vsg::ref_ptr<vsg::PushConstants> pushConstants)
+void PBRTPipeline::addTraceRaysToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph)
 {
     auto pipelineBarrier = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
         VK_DEPENDENCY_DEVICE_GROUP_BIT);
-    commandGraph->addChild(bindRayTracingPipeline);
-    commandGraph->addChild(bindRayTracingDescriptorSet);
-    commandGraph->addChild(pushConstants);
-    auto traceRays = vsg::TraceRays::create();
-    traceRays->bindingTable = shaderBindingTable;
-    traceRays->width = width;
-    traceRays->height = height;
-    traceRays->depth = 1;
-    commandGraph->addChild(traceRays);
+    auto createTraceRays = [&](vsg::ref_ptr<vsg::RayTracingShaderBindingTable> bindingTable) {
+        auto traceRays = vsg::TraceRays::create();
+        traceRays->bindingTable = bindingTable;
+        traceRays->width = width;
+        traceRays->height = height;
+        traceRays->depth = 1;
+        return traceRays;
+    };
+    const auto& owner = sceneOwner();
+    if (owner.cloudPipelines.empty())
+    {
+        cloudSwitch = {};
+        commandGraph->addChild(owner.bindRayTracingPipeline);
+        commandGraph->addChild(bindRayTracingDescriptorSet);
+        commandGraph->addChild(createTraceRays(owner.shaderBindingTable));
+        commandGraph->addChild(pipelineBarrier);
+        return;
+    }
+
+    // the variants share the layout, so the descriptor set stays bound across the switch
+    cloudSwitch = CommandSwitch::create();
+    for (const auto& [bindPipeline, bindingTable] : owner.cloudPipelines)
+    {
+        auto variant = vsg::Commands::create();
+        variant->addChild(bindPipeline);
+        variant->addChild(bindRayTracingDescriptorSet);
+        variant->addChild(createTraceRays(bindingTable));
+        cloudSwitch->addChild(variant);
+    }
+    cloudSwitch->active = owner.cloudVariantPipelines.front();
+    commandGraph->addChild(cloudSwitch);
     commandGraph->addChild(pipelineBarrier);
 }
+void PBRTPipeline::setCloudVariants(const std::vector<CloudQuality>& qualities)
+{
+    if (scenePipeline)
+    {
+        scenePipeline->setCloudVariants(qualities);
+        return;
+    }
+    // the pipelines of the same variants are kept
+    if (qualities == cloudQualities)
+        return;
+    cloudQualities = qualities;
+    cloudPipelines.clear();
+    cloudVariantPipelines.clear();
+    std::vector<CloudQuality> pipelineQualities;
+    for (const auto& quality : qualities)
+    {
+        auto it = std::find(pipelineQualities.begin(), pipelineQualities.end(), quality);
+        cloudVariantPipelines.push_back(static_cast<size_t>(it - pipelineQualities.begin()));
+        if (it != pipelineQualities.end())
+            continue;
+        pipelineQualities.push_back(quality);
+        cloudPipelines.push_back(createRayTracingPipeline(quality));
+    }
+}
+void PBRTPipeline::selectCloudVariant(size_t variant)
+{
+    const auto& owner = sceneOwner();
+    if (cloudSwitch && variant < owner.cloudVariantPipelines.size())
+        cloudSwitch->active = owner.cloudVariantPipelines[variant];
+}
+PBRTPipeline::CloudQuality PBRTPipeline::getCloudQuality() const
+{
+    const auto& owner = sceneOwner();
+    return {owner.vptBundle, owner.vptLimit, owner.cloudStatSteps};
+}
 vsg::ref_ptr<IlluminationBuffer> PBRTPipeline::getIlluminationBuffer() const
 {
     return illuminationBuffer;
@@ -85,7 +177,10 @@ void PBRTPipeline::setupPipeline(vsg::Node *scene, bool useExternalGbuffer, vsg:
 {
     // parsing data from scene
     RayTracingSceneDescriptorCreationVisitor buildDescriptorBinding;
+    buildDescriptorBinding.textureCompressor = textureCompressor;
+    buildDescriptorBinding.quantizeVolumes = args.read("--quantizeVolumes");
     scene->accept(buildDescriptorBinding);
+    if (textureCompressor) textureCompressor->compress();
     geometryTypes = buildDescriptorBinding.geometryType;
 
     const int maxLights = 800;
@@ -120,19 +215,87 @@ void PBRTPipeline::setupPipeline(vsg::Node *scene, bool useExternalGbuffer, vsg:
          cloudHitShader->getDescriptorSetLayoutBindingsMap(),
          cloudIntShader->getDescriptorSetLayoutBindingsMap()});
 
-    cloudHitShader->specializationConstants = {
-            {0, vsg::intValue::create(args.value(1, "--vptBundle"))},
-            {4, vsg::intValue::create(args.value(1536, "--vptLimit"))},
-            {5, vsg::intValue::create(args.value(128, "--cloudStatSteps"))},
-    };
+    vptBundle = args.value(kDefaultVptBundle, "--vptBundle");
+    vptLimit = args.value(kDefaultVptLimit, "--vptLimit");
+    cloudStatSteps = args.value(kDefaultCloudStatSteps, "--cloudStatSteps");
 
     auto descriptorSetLayout = vsg::DescriptorSetLayout::create(bindingMap.begin()->second.bindings);
     // auto rayTracingPipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{descriptorSetLayout}, vsg::PushConstantRanges{{VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(RayTracingPushConstants)}});
     auto pushConstRanges = raygenShader->getPushConstantRanges();
     for (auto &range : pushConstRanges) range.stageFlags |= VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-    auto rayTracingPipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{descriptorSetLayout},
-                                                                pushConstRanges);
-    auto shaderStage = vsg::ShaderStages{raygenShader, raymissShader, shadowMissShader, closesthitShader, anyHitShader, cloudHitShader, cloudIntShader};
+    rayTracingPipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{descriptorSetLayout},
+                                                           pushConstRanges);
+    shaderStages = vsg::ShaderStages{raygenShader, raymissShader, shadowMissShader, closesthitShader, anyHitShader, cloudHitShader, cloudIntShader};
+    createRayTracingPipeline();
+    auto descriptorSet = vsg::DescriptorSet::create(descriptorSetLayout, vsg::Descriptors{});
+    bindRayTracingDescriptorSet = vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rayTracingPipelineLayout, descriptorSet);
+
+    buildDescriptorBinding.updateDescriptor(bindRayTracingDescriptorSet, bindingMap);
+    // creating the constant infos uniform buffer object
+    auto constantInfos = ConstantInfosValue::create();
+    constantInfos->value().lightCount = buildDescriptorBinding.packedLights.size();
+    constantInfos->value().lightStrengthSum = buildDescriptorBinding.packedLights.back().inclusiveStrength;
+    constantInfos->value().maxRecursionDepth = maxRecursionDepth;
+    constantInfos->value().extinction = vsg::vec4(1024, 1024, 1024, 0);
+    constantInfos->value().scattering = vsg::vec4(1, 1, 1, 0);
+    constantInfos->value().sunDirection = vsg::normalize(vsg::vec4(0.5826, 0.7660, 0.2717, 0));
+    constantInfos->value().sunColor = vsg::vec4(2.6, 2.5, 2.3, 0);
+    uint32_t uniformBufferBinding = vsg::ShaderStage::getSetBindingIndex(bindingMap, "Infos").second;
+    auto constantInfosDescriptor = vsg::DescriptorBuffer::create(constantInfos, uniformBufferBinding, 0);
+    bindRayTracingDescriptorSet->descriptorSet->descriptors.push_back(constantInfosDescriptor);
+    sceneDescriptors = bindRayTracingDescriptorSet->descriptorSet->descriptors;
+    addOutputDescriptors();
+}
+void PBRTPipeline::addOutputDescriptors()
+{
+    frameParametersBuffer = FrameParameters::createUniformBuffer(sizeof(RayTracingPushConstants));
+    uint32_t frameParametersBinding = vsg::ShaderStage::getSetBindingIndex(bindingMap, "FrameParameters").second;
+    bindRayTracingDescriptorSet->descriptorSet->descriptors.push_back(
+        vsg::DescriptorBuffer::create(vsg::BufferInfoList{frameParametersBuffer}, frameParametersBinding, 0));
+
+    // update the descriptor sets
+    illuminationBuffer->updateDescriptor(bindRayTracingDescriptorSet, bindingMap);
+    if (gBuffer)
+        gBuffer->updateDescriptor(bindRayTracingDescriptorSet, bindingMap);
+    if (gradientProjector)
+        gradientProjector->updateDescriptor(bindRayTracingDescriptorSet, bindingMap);
+    if (adaptiveSampler)
+        adaptiveSampler->updateDescriptor(bindRayTracingDescriptorSet, bindingMap);
+    if (primaryVBuffer)
+        primaryVBuffer->updateDescriptor(bindRayTracingDescriptorSet, bindingMap);
+}
+bool PBRTPipeline::updateSpecializationConstants(vsg::CommandLine& args)
+{
+    if (scenePipeline)
+        return scenePipeline->updateSpecializationConstants(args);
+    // omitted values go back to the defaults, not to the values of the previous run
+    int newVptBundle = args.value(kDefaultVptBundle, "--vptBundle");
+    int newVptLimit = args.value(kDefaultVptLimit, "--vptLimit");
+    int newCloudStatSteps = args.value(kDefaultCloudStatSteps, "--cloudStatSteps");
+    if (newVptBundle == vptBundle && newVptLimit == vptLimit && newCloudStatSteps == cloudStatSteps)
+        return false;
+    vptBundle = newVptBundle;
+    vptLimit = newVptLimit;
+    cloudStatSteps = newCloudStatSteps;
+    createRayTracingPipeline();
+    return true;
+}
+void PBRTPipeline::createRayTracingPipeline()
+{
+    std::tie(bindRayTracingPipeline, shaderBindingTable) = createRayTracingPipeline(getCloudQuality());
+}
+std::pair<vsg::ref_ptr<vsg::BindRayTracingPipeline>, vsg::ref_ptr<vsg::RayTracingShaderBindingTable>> PBRTPipeline::createRayTracingPipeline(const CloudQuality& quality) const
+{
+    // the cloud hit stage is copied so that every pipeline keeps its own constants, the shader module is shared
+    auto stages = shaderStages;
+    auto& cloudHitShader = stages[5];
+    cloudHitShader = vsg::ShaderStage::create(cloudHitShader->stage, cloudHitShader->entryPointName, cloudHitShader->module);
+    cloudHitShader->specializationConstants = {
+            {0, vsg::intValue::create(quality.vptBundle)},
+            {4, vsg::intValue::create(quality.vptLimit)},
+            {5, vsg::intValue::create(quality.cloudStatSteps)},
+    };
+
     auto raygenShaderGroup = vsg::RayTracingShaderGroup::create();
     raygenShaderGroup->type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
     raygenShaderGroup->generalShader = 0;
@@ -156,35 +319,12 @@ void PBRTPipeline::setupPipeline(vsg::Node *scene, bool useExternalGbuffer, vsg:
 
     auto shaderGroups = vsg::RayTracingShaderGroups{
         raygenShaderGroup, raymissShaderGroup, shadowMissShaderGroup, closesthitShaderGroup, transparenthitShaderGroup, cloudShaderGroup};
-    shaderBindingTable = vsg::RayTracingShaderBindingTable::create();
+    auto shaderBindingTable = vsg::RayTracingShaderBindingTable::create();
     shaderBindingTable->bindingTableEntries.raygenGroups = {raygenShaderGroup};
     shaderBindingTable->bindingTableEntries.raymissGroups = {raymissShaderGroup, shadowMissShaderGroup};
     shaderBindingTable->bindingTableEntries.hitGroups = {closesthitShaderGroup, transparenthitShaderGroup, cloudShaderGroup};
-    auto pipeline = vsg::RayTracingPipeline::create(rayTracingPipelineLayout, shaderStage, shaderGroups, shaderBindingTable, 1);
-    bindRayTracingPipeline = vsg::BindRayTracingPipeline::create(pipeline);
-    auto descriptorSet = vsg::DescriptorSet::create(descriptorSetLayout, vsg::Descriptors{});
-    bindRayTracingDescriptorSet = vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rayTracingPipelineLayout, descriptorSet);
-
-    buildDescriptorBinding.updateDescriptor(bindRayTracingDescriptorSet, bindingMap);
-    // creating the constant infos uniform buffer object
-    auto constantInfos = ConstantInfosValue::create();
-    constantInfos->value().lightCount = buildDescriptorBinding.packedLights.size();
-    constantInfos->value().lightStrengthSum = buildDescriptorBinding.packedLights.back().inclusiveStrength;
-    constantInfos->value().maxRecursionDepth = maxRecursionDepth;
-    constantInfos->value().extinction = vsg::vec4(1024, 1024, 1024, 0);
-    constantInfos->value().scattering = vsg::vec4(1, 1, 1, 0);
-    constantInfos->value().sunDirection = vsg::normalize(vsg::vec4(0.5826, 0.7660, 0.2717, 0));
-    constantInfos->value().sunColor = vsg::vec4(2.6, 2.5, 2.3, 0);
-    uint32_t uniformBufferBinding = vsg::ShaderStage::getSetBindingIndex(bindingMap, "Infos").second;
-    auto constantInfosDescriptor = vsg::DescriptorBuffer::create(constantInfos, uniformBufferBinding, 0);
-    bindRayTracingDescriptorSet->descriptorSet->descriptors.push_back(constantInfosDescriptor);
-
-    // update the descriptor sets
-    illuminationBuffer->updateDescriptor(bindRayTracingDescriptorSet, bindingMap);
-    if (gBuffer)
-        gBuffer->updateDescriptor(bindRayTracingDescriptorSet, bindingMap);
-    if (gradientProjector)
-        gradientProjector->updateDescriptor(bindRayTracingDescriptorSet, bindingMap);
+    auto pipeline = vsg::RayTracingPipeline::create(rayTracingPipelineLayout, stages, shaderGroups, shaderBindingTable, 1);
+    return {vsg::BindRayTracingPipeline::create(pipeline), shaderBindingTable};
 }
 vsg::ref_ptr<vsg::ShaderStage> PBRTPipeline::setupRaygenShader(std::string raygenPath, bool useExternalGBuffer)
 {
@@ -218,6 +358,14 @@ vsg::ref_ptr<vsg::ShaderStage> PBRTPipeline::setupRaygenShader(std::string rayge
         defines.push_back("GBUFFER");
     if (gradientProjector)
         defines.push_back("TEMP_GRADIENT");
+    if (adaptiveSampler)
+    {
+        if (!illuminationBuffer.cast<IlluminationBufferFinalFloat>())
+            throw vsg::Exception{"Error: PBRTPipeline::setupRaygenShader(...) Adaptive sampling needs the final image illumination buffer."};
+        defines.push_back("ADAPTIVE_SAMPLING");
+    }
+    if (primaryVBuffer)
+        defines.push_back("PRIMARY_VBUFFER");
 
     switch(lightSamplingMethod){
         case LightSamplingMethod::SampleSurfaceStrength:
@@ -4,7 +4,11 @@
 #include <buffers/IlluminationBuffer.hpp>
 #include <scene/RayTracingVisitor.hpp>
 #include <buffers/AccumulationBuffer.hpp>
+#include <buffers/VBuffer.hpp>
+#include <buffers/FrameParameters.hpp>
 #include <renderModules/denoisers/A_SVGF.hpp>
+#include <renderModules/AdaptiveSampler.hpp>
+#include <renderModules/CommandSwitch.hpp>
 
 #include <vsg/all.h>
 #include <vsgXchange/glsl.h>
@@ -23,13 +27,38 @@ public:
     PBRTPipeline(vsg::ref_ptr<vsg::Node> scene, vsg::ref_ptr<GBuffer> gBuffer,
                  vsg::ref_ptr<IlluminationBuffer> illuminationBuffer, vsg::ref_ptr<GradientProjector> gradProjector,
                  bool writeGBuffer, RayTracingRayOrigin rayTracingRayOrigin,
-                 vsg::CommandLine& args);
+                 vsg::CommandLine& args, vsg::ref_ptr<AdaptiveSampler> adaptiveSampler = {},
+                 vsg::ref_ptr<TextureCompressor> textureCompressor = {}, vsg::ref_ptr<VBuffer> primaryVBuffer = {});
+    // traces the scene of scenePipeline into buffers of the same kind at another resolution. The scene descriptors and
+    // the ray tracing pipelines are shared, only the descriptors of the output images are created
+    PBRTPipeline(vsg::ref_ptr<PBRTPipeline> scenePipeline, vsg::ref_ptr<GBuffer> gBuffer,
+                 vsg::ref_ptr<IlluminationBuffer> illuminationBuffer, vsg::ref_ptr<GradientProjector> gradProjector,
+                 vsg::ref_ptr<AdaptiveSampler> adaptiveSampler = {}, vsg::ref_ptr<VBuffer> primaryVBuffer = {});
 
     void setTlas(vsg::ref_ptr<vsg::AccelerationStructure> as);
     void compile(vsg::Context& context);
     void updateImageLayouts(vsg::Context& context);
-    void addTraceRaysToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph, vsg::ref_ptr<vsg::PushConstants> pushConstants);
+    void addTraceRaysToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph);
+    // recreates only the ray tracing pipeline if the cloud specialization constants changed, returns true if so
+    bool updateSpecializationConstants(vsg::CommandLine& args);
+
+    // specialization constants of the cloud hit shader
+    struct CloudQuality
+    {
+        int vptBundle, vptLimit, cloudStatSteps;
+        bool operator==(const CloudQuality& other) const
+        {
+            return vptBundle == other.vptBundle && vptLimit == other.vptLimit && cloudStatSteps == other.cloudStatSteps;
+        }
+    };
+    CloudQuality getCloudQuality() const;
+    // precompiles a ray tracing pipeline for every quality, has to be called before addTraceRaysToCommandGraph() which
+    // then traces with the selected one. An empty list goes back to the pipeline of the command line values
+    void setCloudVariants(const std::vector<CloudQuality>& qualities);
+    void selectCloudVariant(size_t variant);
     vsg::ref_ptr<IlluminationBuffer> getIlluminationBuffer() const;
+    // uniform buffer of the camera and frame number, a RayTracingPushConstants written through FrameParameters
+    vsg::ref_ptr<vsg::BufferInfo> frameParametersBuffer;
     enum class LightSamplingMethod{
         SampleSurfaceStrength,
         SampleLightStrength,
@@ -38,23 +67,47 @@ public:
 private:
     void setupPipeline(vsg::Node* scene, bool useExternalGBuffer, vsg::CommandLine& args);
     vsg::ref_ptr<vsg::ShaderStage> setupRaygenShader(std::string raygenPath, bool useExternalGBuffer);
+    void createRayTracingPipeline();
+    void addOutputDescriptors();
+    // the pipeline owning the scene descriptors and the ray tracing pipelines
+    const PBRTPipeline& sceneOwner() const { return scenePipeline ? *scenePipeline : *this; }
+    std::pair<vsg::ref_ptr<vsg::BindRayTracingPipeline>, vsg::ref_ptr<vsg::RayTracingShaderBindingTable>> createRayTracingPipeline(const CloudQuality& quality) const;
 
     std::vector<uint32_t> geometryTypes;
     uint32_t width, height, maxRecursionDepth, samplePerPixel;
+    int vptBundle, vptLimit, cloudStatSteps;
 
     // TODO: add buffers here
     vsg::ref_ptr<GBuffer> gBuffer;
     vsg::ref_ptr<IlluminationBuffer> illuminationBuffer;
     vsg::ref_ptr<GradientProjector> gradientProjector;
+    vsg::ref_ptr<AdaptiveSampler> adaptiveSampler;
+    vsg::ref_ptr<TextureCompressor> textureCompressor;
+    // if set the primary hits are taken from its mesh and primitive ids instead of being traced
+    vsg::ref_ptr<VBuffer> primaryVBuffer;
+
+    // set if the scene is shared with another pipeline
+    vsg::ref_ptr<PBRTPipeline> scenePipeline;
+    // the descriptors of the scene without the per resolution images
+    vsg::Descriptors sceneDescriptors;
 
     //resources which have to be added as childs to a scenegraph for rendering
     vsg::ref_ptr<vsg::BindRayTracingPipeline> bindRayTracingPipeline;
     vsg::ref_ptr<vsg::BindDescriptorSet> bindRayTracingDescriptorSet;
-    vsg::ref_ptr<vsg::PushConstants> pushConstants;
+
+    // kept to recreate the pipeline with different specialization constants
+    vsg::ShaderStages shaderStages;
+    vsg::ref_ptr<vsg::PipelineLayout> rayTracingPipelineLayout;
 
     //shader binding table for trace rays
     vsg::ref_ptr<vsg::RayTracingShaderBindingTable> shaderBindingTable;
 
+    // precompiled pipelines of the cloud qualities, variants with the same constants share one
+    std::vector<std::pair<vsg::ref_ptr<vsg::BindRayTracingPipeline>, vsg::ref_ptr<vsg::RayTracingShaderBindingTable>>> cloudPipelines;
+    std::vector<CloudQuality> cloudQualities;
+    std::vector<size_t> cloudVariantPipelines;
+    vsg::ref_ptr<CommandSwitch> cloudSwitch;
+
     //binding map containing all descriptor bindings in the shaders
     vsg::BindingMap bindingMap;
 };
@@ -9,4 +9,5 @@ struct RayTracingPushConstants{
     vsg::mat4 prevView;
     uint32_t frameNumber;
     uint32_t sampleNumber;
+    uint32_t cameraInVolume;  // the primary hits of the VBuffer miss the medium around the camera
 };
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include <renderModules/QualityController.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+QualityController::QualityController(vsg::ref_ptr<Profiler> profiler, uint32_t levelCount, double budgetMs,
+                                     std::vector<std::string> qualityScopes) :
+    Inherit(profiler, levelCount, budgetMs, "Quality control"),
+    qualityScopes(std::move(qualityScopes)),
+    levelCosts(levelCount, -1.0)
+{
+}
+
+std::vector<PBRTPipeline::CloudQuality> QualityController::createCloudLevels(const PBRTPipeline::CloudQuality& top)
+{
+    // the step limit bounds the cost of the densest clouds, the statistic steps that of every cloud ray
+    cloudLevels.clear();
+    for (uint32_t i = 0; i < levelCount; ++i)
+    {
+        auto quality = top;
+        quality.vptLimit = std::max(std::min(top.vptLimit, 64), static_cast<int>(top.vptLimit * std::pow(0.75, i)));
+        quality.cloudStatSteps = std::max(std::min(top.cloudStatSteps, 8), top.cloudStatSteps >> i);
+        cloudLevels.push_back(quality);
+    }
+    return cloudLevels;
+}
+
+std::vector<A_SVGF::Quality> QualityController::createDenoiserLevels(const A_SVGF::Quality& top)
+{
+    denoiserLevels.clear();
+    for (uint32_t i = 0; i < levelCount; ++i)
+    {
+        auto quality = top;
+        quality.atrousIterations = std::max(std::min(top.atrousIterations, 1), top.atrousIterations - static_cast<int>(i + 1) / 2);
+        quality.cloudReproPoints = std::max(std::min(top.cloudReproPoints, 1), top.cloudReproPoints - static_cast<int>(i));
+        // fewer atrous iterations leave more noise, the history is weighted higher instead
+        quality.temporalAlpha = top.temporalAlpha * static_cast<float>(std::pow(0.75, top.atrousIterations - quality.atrousIterations));
+        denoiserLevels.push_back(quality);
+    }
+    return denoiserLevels;
+}
+
+double QualityController::estimate(uint32_t targetLevel) const
+{
+    if (levelCosts[targetLevel] >= 0)
+        return levelCosts[targetLevel];
+    for (uint32_t distance = 1; distance < levelCount; ++distance)
+    {
+        if (targetLevel >= distance && levelCosts[targetLevel - distance] >= 0)
+            return levelCosts[targetLevel - distance] * std::pow(levelCostRatio, -static_cast<double>(distance));
+        if (targetLevel + distance < levelCount && levelCosts[targetLevel + distance] >= 0)
+            return levelCosts[targetLevel + distance] * std::pow(levelCostRatio, distance);
+    }
+    return 0;
+}
+
+void QualityController::measure(const std::vector<std::string>& scopeNames, const std::vector<double>& timesMs, uint32_t measuredLevel)
+{
+    double qualityMs = 0;
+    otherMs = 0;
+    for (size_t i = 0; i < timesMs.size(); ++i)
+    {
+        // scopes which were not recorded are negative
+        if (timesMs[i] < 0)
+            continue;
+        (matchesScope(scopeNames[i], qualityScopes) ? qualityMs : otherMs) += timesMs[i];
+    }
+    auto& cost = levelCosts[measuredLevel];
+    cost = cost < 0 ? qualityMs : costSmoothing * qualityMs + (1 - costSmoothing) * cost;
+}
+
+void QualityController::printLevel(std::ostream& out, uint32_t printedLevel) const
+{
+    if (!cloudLevels.empty())
+        out << "vptLimit " << cloudLevels[printedLevel].vptLimit << ", vptBundle " << cloudLevels[printedLevel].vptBundle << ", cloudStatSteps " << cloudLevels[printedLevel].cloudStatSteps;
+    if (!cloudLevels.empty() && !denoiserLevels.empty())
+        out << ", ";
+    if (!denoiserLevels.empty())
+        out << "atrousIters " << denoiserLevels[printedLevel].atrousIterations << ", cloudReproPoints " << denoiserLevels[printedLevel].cloudReproPoints
+            << ", tempAlpha " << std::defaultfloat << denoiserLevels[printedLevel].temporalAlpha << std::fixed;
+}
+
+void QualityController::printLevelTime(std::ostream& out, uint32_t printedLevel) const
+{
+    if (levelCosts[printedLevel] >= 0)
+        out << ", quality passes " << levelCosts[printedLevel] << " ms";
+}
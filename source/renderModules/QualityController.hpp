@@ -0,0 +1,47 @@
+#pragma once
+#include <renderModules/BudgetController.hpp>
+#include <renderModules/PBRTPipeline.hpp>
+#include <renderModules/denoisers/A_SVGF.hpp>
+
+#include <vsg/all.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Quality controller -----------------------------------------------------------------------
+// Picks the quality level of every frame so the gpu time of the timed passes stays within a budget. Level 0 are the
+// command line values of the cloud and denoiser settings, every further level lowers them. The modules precompile a
+// variant per level, so a switch only selects other pipelines.
+// The time of the scopes depending on the quality is tracked per level, a level which was not measured yet is
+// estimated from its nearest measured one.
+class QualityController : public vsg::Inherit<BudgetController, QualityController>
+{
+public:
+    // the quality scopes are prefixes of the names of the profiler scopes which depend on the level
+    QualityController(vsg::ref_ptr<Profiler> profiler, uint32_t levelCount, double budgetMs, std::vector<std::string> qualityScopes);
+
+    double costSmoothing = .25;
+    double levelCostRatio = 1.25; // assumed cost of a level relative to the next lower one until it is measured
+
+    // settings of every level derived from the command line values, also kept for the report
+    std::vector<PBRTPipeline::CloudQuality> createCloudLevels(const PBRTPipeline::CloudQuality& top);
+    std::vector<A_SVGF::Quality> createDenoiserLevels(const A_SVGF::Quality& top);
+
+protected:
+    void measure(const std::vector<std::string>& scopeNames, const std::vector<double>& timesMs, uint32_t measuredLevel) override;
+    double predict(uint32_t targetLevel) const override { return otherMs + estimate(targetLevel); }
+    void printLevel(std::ostream& out, uint32_t printedLevel) const override;
+    void printLevelTime(std::ostream& out, uint32_t printedLevel) const override;
+
+private:
+    double estimate(uint32_t targetLevel) const;
+
+    std::vector<std::string> qualityScopes;
+    std::vector<PBRTPipeline::CloudQuality> cloudLevels;
+    std::vector<A_SVGF::Quality> denoiserLevels;
+
+    double otherMs = 0; // time of the scopes which do not depend on the level in the latest measured frame
+    std::vector<double> levelCosts; // smoothed time of the quality scopes, negative until a level was measured
+};
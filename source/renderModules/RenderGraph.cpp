@@ -0,0 +1,308 @@
+#include <renderModules/RenderGraph.hpp>
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+
+namespace
+{
+    const VkAccessFlags kWriteAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                       VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+    // synchronization state of an image between the passes
+    struct ImageState
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL;
+        // last write (or layout transition) and the reads after it
+        VkPipelineStageFlags writeStages = 0, readStages = 0;
+        VkAccessFlags writeAccess = 0;
+        // stages and accesses the last write has been made visible to
+        VkPipelineStageFlags visibleStages = 0;
+        VkAccessFlags visibleAccess = 0;
+    };
+
+    bool overlaps(const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b)
+    {
+        return a.first <= b.second && b.first <= a.second;
+    }
+
+    VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+void RenderGraph::Pass::read(vsg::ref_ptr<vsg::Image> image, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout)
+{
+    addAccess({image, stages, access, layout});
+}
+
+void RenderGraph::Pass::write(vsg::ref_ptr<vsg::Image> image, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout)
+{
+    addAccess({image, stages, access, layout});
+}
+
+void RenderGraph::Pass::addAccess(const ImageAccess& imageAccess)
+{
+    // one access per image and pass, a pass reading and writing an image is synchronized as a write
+    for (auto& existing : accesses)
+    {
+        if (existing.image != imageAccess.image)
+            continue;
+        if (existing.layout != imageAccess.layout)
+            throw vsg::Exception{"Error: RenderGraph::Pass::addAccess(...) " + name + " accesses an image in two layouts."};
+        existing.stages |= imageAccess.stages;
+        existing.access |= imageAccess.access;
+        return;
+    }
+    accesses.push_back(imageAccess);
+}
+
+void RenderGraph::Pass::copy(vsg::ref_ptr<vsg::Image> srcImage, vsg::ref_ptr<vsg::Image> dstImage)
+{
+    read(srcImage, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+    write(dstImage, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    auto copyCmd = vsg::CopyImage::create();
+    copyCmd->srcImage = srcImage;
+    copyCmd->srcImageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    copyCmd->dstImage = dstImage;
+    copyCmd->dstImageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    copyCmd->regions = {VkImageCopy{
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            {0, 0, 0},
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            {0, 0, 0},
+            srcImage->extent
+    }};
+    commands->addChild(copyCmd);
+}
+
+vsg::ref_ptr<RenderGraph::Pass> RenderGraph::addPass(const std::string& name)
+{
+    passes.push_back(Pass::create(name));
+    return passes.back();
+}
+
+void RenderGraph::addTransientImage(vsg::ref_ptr<vsg::Image> image)
+{
+    transientImages.push_back(image);
+}
+
+std::vector<std::pair<size_t, size_t>> RenderGraph::transientLifetimes() const
+{
+    // images without accesses get an empty lifetime and may share memory with every other image
+    std::vector<std::pair<size_t, size_t>> lifetimes(transientImages.size(), {passes.size(), 0});
+    for (size_t i = 0; i < transientImages.size(); ++i)
+    {
+        for (size_t p = 0; p < passes.size(); ++p)
+        {
+            for (const auto& access : passes[p]->accesses)
+            {
+                if (access.image != transientImages[i])
+                    continue;
+                lifetimes[i].first = std::min(lifetimes[i].first, p);
+                lifetimes[i].second = p;
+            }
+        }
+    }
+    return lifetimes;
+}
+
+void RenderGraph::compile(vsg::Context& context)
+{
+    if (!transientMemory.empty())
+        return;
+    auto lifetimes = transientLifetimes();
+    std::vector<VkMemoryRequirements> requirements;
+    for (auto& image : transientImages)
+    {
+        image->compile(context.device);
+        requirements.push_back(image->getMemoryRequirements(context.deviceID));
+        transientImageSize += requirements.back().size;
+    }
+
+    // largest images first, each goes to the lowest offset not used by an image living at the same time
+    std::vector<size_t> order(transientImages.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return requirements[a].size > requirements[b].size; });
+    std::vector<VkMemoryRequirements> blocks;
+    std::vector<std::vector<size_t>> blockImages;
+    placements.assign(transientImages.size(), {});
+    for (size_t i : order)
+    {
+        const auto& req = requirements[i];
+        size_t block = 0;
+        while (block < blocks.size() && !(blocks[block].memoryTypeBits & req.memoryTypeBits))
+            ++block;
+        if (block == blocks.size())
+        {
+            blocks.push_back({0, 1, req.memoryTypeBits});
+            blockImages.emplace_back();
+        }
+
+        std::vector<VkDeviceSize> candidates{0};
+        for (size_t j : blockImages[block])
+        {
+            if (overlaps(lifetimes[i], lifetimes[j]))
+                candidates.push_back(alignUp(placements[j].offset + placements[j].size, req.alignment));
+        }
+        std::sort(candidates.begin(), candidates.end());
+        VkDeviceSize offset = candidates.back();
+        for (VkDeviceSize candidate : candidates)
+        {
+            bool free = std::none_of(blockImages[block].begin(), blockImages[block].end(), [&](size_t j) {
+                return overlaps(lifetimes[i], lifetimes[j]) && candidate < placements[j].offset + placements[j].size &&
+                       placements[j].offset < candidate + req.size;
+            });
+            if (free)
+            {
+                offset = candidate;
+                break;
+            }
+        }
+        placements[i] = {block, offset, req.size};
+        blocks[block].size = std::max(blocks[block].size, offset + req.size);
+        blocks[block].alignment = std::max(blocks[block].alignment, req.alignment);
+        blocks[block].memoryTypeBits &= req.memoryTypeBits;
+        blockImages[block].push_back(i);
+    }
+
+    for (const auto& block : blocks)
+    {
+        transientMemory.push_back(vsg::DeviceMemory::create(context.device, block, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
+        transientMemorySize += block.size;
+    }
+    for (size_t i = 0; i < transientImages.size(); ++i)
+    {
+        if (transientImages[i]->bind(transientMemory[placements[i].memory].get(), placements[i].offset) != VK_SUCCESS)
+            throw vsg::Exception{"Error: RenderGraph::compile(...) Failed to bind transient image memory."};
+    }
+}
+
+void RenderGraph::shareTransientMemory(const RenderGraph& other)
+{
+    if (other.transientImages != transientImages || (!transientImages.empty() && other.transientMemory.empty()))
+        throw vsg::Exception{"Error: RenderGraph::shareTransientMemory(...) the graphs have to share compiled transient images."};
+    transientMemory = other.transientMemory;
+    placements = other.placements;
+    transientImageSize = other.transientImageSize;
+    transientMemorySize = other.transientMemorySize;
+}
+
+void RenderGraph::record(vsg::ref_ptr<vsg::Commands> commandGraph, const std::function<void(const Pass&)>& afterPass) const
+{
+    auto lifetimes = transientLifetimes();
+    std::map<const vsg::Image*, size_t> transientIndices;
+    for (size_t i = 0; i < transientImages.size(); ++i)
+        transientIndices[transientImages[i].get()] = i;
+
+    // images sharing memory with each transient image including itself. Their lifetimes do not overlap, so at the
+    // first access of an image their states are those of their last accesses, in this frame or the previous one
+    std::vector<std::vector<const vsg::Image*>> aliases(transientImages.size());
+    for (size_t i = 0; i < transientImages.size(); ++i)
+    {
+        for (size_t j = 0; j < transientImages.size(); ++j)
+        {
+            bool shared = !placements.empty() && placements[j].memory == placements[i].memory &&
+                          placements[j].offset < placements[i].offset + placements[i].size &&
+                          placements[i].offset < placements[j].offset + placements[j].size;
+            if (j == i || shared)
+                aliases[i].push_back(transientImages[j].get());
+        }
+    }
+
+    // only images written by the passes are synchronized
+    std::map<const vsg::Image*, ImageState> states;
+    for (const auto& pass : passes)
+    {
+        for (const auto& access : pass->accesses)
+        {
+            if (access.access & kWriteAccess)
+                states[access.image.get()] = ImageState{};
+        }
+    }
+    for (const auto& [image, index] : transientIndices)
+        states[image] = ImageState{};
+
+    // the first run leaves the states of the end of a frame which the second run starts from
+    for (bool emit : {false, true})
+    {
+        for (size_t p = 0; p < passes.size(); ++p)
+        {
+            VkPipelineStageFlags srcStages = 0, dstStages = 0;
+            std::vector<vsg::ref_ptr<vsg::ImageMemoryBarrier>> barriers;
+            for (const auto& access : passes[p]->accesses)
+            {
+                auto stateIt = states.find(access.image.get());
+                if (stateIt == states.end())
+                    continue;
+                auto& state = stateIt->second;
+                auto transient = transientIndices.find(access.image.get());
+                if (transient != transientIndices.end() && lifetimes[transient->second].first == p)
+                {
+                    // the content is discarded, the previous accesses to the memory have to finish first
+                    ImageState discarded;
+                    discarded.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                    for (const auto* alias : aliases[transient->second])
+                    {
+                        discarded.writeStages |= states[alias].writeStages | states[alias].readStages;
+                        discarded.writeAccess |= states[alias].writeAccess;
+                    }
+                    state = discarded;
+                }
+
+                bool writes = access.access & kWriteAccess;
+                bool layoutChange = state.layout != access.layout;
+                VkPipelineStageFlags waitStages = 0;
+                if (writes || layoutChange)
+                    waitStages = state.writeStages | state.readStages;
+                else if ((access.stages & ~state.visibleStages) || (access.access & ~state.visibleAccess))
+                    waitStages = state.writeStages;
+
+                bool barrier = waitStages || layoutChange;
+                if (barrier)
+                {
+                    VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+                    barriers.push_back(vsg::ImageMemoryBarrier::create(state.writeAccess, access.access, state.layout, access.layout,
+                                                                       VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, access.image, range));
+                    srcStages |= waitStages ? waitStages : VkPipelineStageFlags(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+                    dstStages |= access.stages;
+                }
+
+                if (writes || layoutChange)
+                {
+                    state.layout = access.layout;
+                    state.writeStages = access.stages;
+                    state.writeAccess = access.access & kWriteAccess;
+                    state.readStages = 0;
+                    state.visibleStages = writes ? 0 : access.stages;
+                    state.visibleAccess = writes ? 0 : access.access;
+                }
+                else
+                {
+                    state.readStages |= access.stages;
+                    if (barrier)
+                    {
+                        state.visibleStages |= access.stages;
+                        state.visibleAccess |= access.access;
+                    }
+                }
+            }
+            if (!emit)
+                continue;
+
+            if (!barriers.empty())
+            {
+                auto pipelineBarrier = vsg::PipelineBarrier::create(srcStages, dstStages, 0);
+                for (auto& imageBarrier : barriers)
+                    pipelineBarrier->add(imageBarrier);
+                commandGraph->addChild(pipelineBarrier);
+            }
+            for (auto& command : passes[p]->commands->children)
+                commandGraph->addChild(command);
+            if (afterPass)
+                afterPass(*passes[p]);
+        }
+    }
+}
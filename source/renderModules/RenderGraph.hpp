@@ -0,0 +1,76 @@
+#pragma once
+#include <vsg/all.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Frame graph for the compute passes of a module ------------------------------------
+// Passes declare the images they read and write, record() inserts only the barriers these accesses need instead of
+// a compute->compute barrier after every dispatch. The passes run every frame, so the first accesses of a frame are
+// synchronized against the last ones of the previous frame. Images which are not written by a pass of the graph are
+// assumed to be synchronized by the module writing them, like before.
+// Transient images only hold data between their first and last access within a frame. They are placed in a shared
+// allocation by compile(), images whose lifetimes do not overlap share memory, and start each frame undefined.
+class RenderGraph : public vsg::Inherit<vsg::Object, RenderGraph>
+{
+public:
+    struct ImageAccess
+    {
+        vsg::ref_ptr<vsg::Image> image;
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkImageLayout layout;
+    };
+
+    class Pass : public vsg::Inherit<vsg::Object, Pass>
+    {
+    public:
+        explicit Pass(const std::string& name) : name(name) {}
+
+        void read(vsg::ref_ptr<vsg::Image> image, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                  VkAccessFlags access = VK_ACCESS_SHADER_READ_BIT, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+        void write(vsg::ref_ptr<vsg::Image> image, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                   VkAccessFlags access = VK_ACCESS_SHADER_WRITE_BIT, VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL);
+        // adds a CopyImage of the whole image in GENERAL layout together with its accesses
+        void copy(vsg::ref_ptr<vsg::Image> srcImage, vsg::ref_ptr<vsg::Image> dstImage);
+
+        std::string name;
+        std::vector<ImageAccess> accesses;
+        vsg::ref_ptr<vsg::Commands> commands = vsg::Commands::create();
+
+    private:
+        void addAccess(const ImageAccess& imageAccess);
+    };
+
+    // passes are recorded in the order they are added
+    vsg::ref_ptr<Pass> addPass(const std::string& name);
+    void addTransientImage(vsg::ref_ptr<vsg::Image> image);
+
+    // creates the transient images and binds them to the shared memory, has to be called before anything else
+    // compiles them
+    void compile(vsg::Context& context);
+    // places the transient images in the memory of the compiled graph other instead, for alternative pass sequences
+    // of a module. Both have to declare the same transient images and their lifetimes have to overlap the same way
+    void shareTransientMemory(const RenderGraph& other);
+    // appends the commands of all passes with their barriers, afterPass is called after the commands of each pass
+    void record(vsg::ref_ptr<vsg::Commands> commandGraph, const std::function<void(const Pass&)>& afterPass = {}) const;
+
+    // sizes of the transient images and of the memory they were placed in, valid after compile()
+    VkDeviceSize transientImageSize = 0, transientMemorySize = 0;
+
+private:
+    // first and last pass accessing each transient image
+    std::vector<std::pair<size_t, size_t>> transientLifetimes() const;
+
+    std::vector<vsg::ref_ptr<Pass>> passes;
+    std::vector<vsg::ref_ptr<vsg::Image>> transientImages;
+    std::vector<vsg::ref_ptr<vsg::DeviceMemory>> transientMemory;
+    // memory range of each transient image, the index selects transientMemory
+    struct Placement
+    {
+        size_t memory;
+        VkDeviceSize offset, size;
+    };
+    std::vector<Placement> placements;
+};
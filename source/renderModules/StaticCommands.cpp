@@ -0,0 +1,58 @@
+#include <renderModules/StaticCommands.hpp>
+
+#include <algorithm>
+
+StaticCommands::StaticCommands(vsg::ref_ptr<vsg::Commands> commands, uint32_t slotCount, int queueFamily) :
+    commands(commands),
+    queueFamily(queueFamily),
+    commandBuffers(slotCount),
+    recorded(slotCount, false)
+{
+}
+
+void StaticCommands::invalidate()
+{
+    std::fill(recorded.begin(), recorded.end(), false);
+}
+
+void StaticCommands::traverse(vsg::Visitor& visitor)
+{
+    commands->accept(visitor);
+}
+
+void StaticCommands::traverse(vsg::ConstVisitor& visitor) const
+{
+    commands->accept(visitor);
+}
+
+void StaticCommands::compile(vsg::Context& context)
+{
+    commands->compile(context);
+}
+
+void StaticCommands::record(vsg::CommandBuffer& commandBuffer) const
+{
+    auto index = slot % commandBuffers.size();
+    auto& buffer = commandBuffers[index];
+    if (!buffer)
+    {
+        if (!commandPool)
+            commandPool = vsg::CommandPool::create(commandBuffer.getDevice(), queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+        buffer = vsg::CommandBuffer::create(commandBuffer.getDevice(), commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    }
+    if (!recorded[index])
+    {
+        // no render pass is inherited, beginning the buffer resets it
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+        vkBeginCommandBuffer(*buffer, &beginInfo);
+        commands->record(*buffer);
+        vkEndCommandBuffer(*buffer);
+        recorded[index] = true;
+    }
+    VkCommandBuffer vk_commandBuffer = *buffer;
+    vkCmdExecuteCommands(commandBuffer, 1, &vk_commandBuffer);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <vsg/all.h>
+
+#include <cstdint>
+#include <vector>
+
+// Static commands --------------------------------------------------------------------
+// Records its commands once per slot into a secondary command buffer and only executes that buffer afterwards, so the
+// commands are not traversed every frame. The slot has to be set before recording and may only be reused when its
+// previous frame is done, like the query pools of the profiler. Everything changing from frame to frame has to be
+// read from buffers, see FrameParameters. invalidate() records all slots again, e.g. after a CommandSwitch changed.
+class StaticCommands : public vsg::Inherit<vsg::Command, StaticCommands>
+{
+public:
+    StaticCommands(vsg::ref_ptr<vsg::Commands> commands, uint32_t slotCount, int queueFamily);
+
+    vsg::ref_ptr<vsg::Commands> commands;
+    uint32_t slot = 0;
+
+    void invalidate();
+
+    void traverse(vsg::Visitor& visitor) override;
+    void traverse(vsg::ConstVisitor& visitor) const override;
+    void compile(vsg::Context& context) override;
+    void record(vsg::CommandBuffer& commandBuffer) const override;
+
+private:
+    int queueFamily;
+    mutable vsg::ref_ptr<vsg::CommandPool> commandPool;
+    mutable std::vector<vsg::ref_ptr<vsg::CommandBuffer>> commandBuffers;
+    mutable std::vector<bool> recorded;
+};
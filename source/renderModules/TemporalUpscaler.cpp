@@ -0,0 +1,152 @@
+#include <renderModules/TemporalUpscaler.hpp>
+#include <renderModules/PipelineStructs.hpp>
+
+namespace
+{
+    vsg::ref_ptr<vsg::ImageView> createImageView(uint32_t width, uint32_t height, VkImageUsageFlags usage)
+    {
+        auto image = vsg::Image::create();
+        image->imageType = VK_IMAGE_TYPE_2D;
+        image->format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        image->extent = {width, height, 1};
+        image->mipLevels = 1;
+        image->arrayLayers = 1;
+        image->samples = VK_SAMPLE_COUNT_1_BIT;
+        image->tiling = VK_IMAGE_TILING_OPTIMAL;
+        image->usage = usage;
+        image->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        image->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        return vsg::ImageView::create(image, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+}
+
+TemporalUpscaler::TemporalUpscaler(uint32_t width, uint32_t height, uint32_t workWidth, uint32_t workHeight) :
+    width(width),
+    height(height),
+    workWidth(workWidth),
+    workHeight(workHeight)
+{
+    sampler = vsg::Sampler::create();
+    sampler->addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler->addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    // the final image is also read back and converted for the window, so it keeps the float format of the illumination
+    auto imageView = createImageView(width, height, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    auto imageInfo = vsg::ImageInfo::create(vsg::ref_ptr<vsg::Sampler>{}, imageView, VK_IMAGE_LAYOUT_GENERAL);
+    finalImage = vsg::DescriptorImage::create(imageInfo, finalImageBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+
+    imageView = createImageView(width, height, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    imageInfo = vsg::ImageInfo::create(sampler, imageView, VK_IMAGE_LAYOUT_GENERAL);
+    historyImage = vsg::DescriptorImage::create(imageInfo, historyBinding, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+
+    frameParametersBuffer = FrameParameters::createUniformBuffer(sizeof(RayTracingPushConstants));
+}
+
+size_t TemporalUpscaler::addInput(vsg::ref_ptr<AccumulationBuffer> accBuffer, vsg::ref_ptr<vsg::DescriptorImage> denoised)
+{
+    auto denoisedView = denoised->imageInfoList[0]->imageView;
+    denoisedView->image->usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    auto inputExtent = denoisedView->image->extent;
+
+    auto computeStage = vsg::ShaderStage::read(VK_SHADER_STAGE_COMPUTE_BIT, "main", "shaders/temporalUpscale.comp.spv");
+    if (!computeStage)
+        throw vsg::Exception{"Error: TemporalUpscaler::addInput(...) failed to load shaders/temporalUpscale.comp.spv."};
+    computeStage->specializationConstants = vsg::ShaderStage::SpecializationConstants{
+        {0, vsg::intValue::create(width)},
+        {1, vsg::intValue::create(height)},
+        {2, vsg::intValue::create(workWidth)},
+        {3, vsg::intValue::create(workHeight)},
+        {4, vsg::intValue::create(inputExtent.width)},
+        {5, vsg::intValue::create(inputExtent.height)}
+    };
+
+    auto bindingMap = computeStage->getDescriptorSetLayoutBindingsMap();
+    auto descriptorSetLayout = vsg::DescriptorSetLayout::create(bindingMap.begin()->second.bindings);
+    // the denoised image is sampled bilinearly, its own descriptor stays a storage image
+    auto denoisedInfo = vsg::ImageInfo::create(sampler, denoisedView, VK_IMAGE_LAYOUT_GENERAL);
+    auto descriptorSet = vsg::DescriptorSet::create(descriptorSetLayout, vsg::Descriptors{
+                                                        vsg::DescriptorImage::create(accBuffer->motion->imageInfoList[0], motionBinding, 0,
+                                                                                     VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+                                                        vsg::DescriptorImage::create(denoisedInfo, denoisedBinding, 0,
+                                                                                     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER),
+                                                        finalImage,
+                                                        historyImage,
+                                                        vsg::DescriptorBuffer::create(vsg::BufferInfoList{frameParametersBuffer}, frameParametersBinding, 0)
+        });
+
+    auto pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{descriptorSetLayout}, vsg::PushConstantRanges{});
+    auto pipeline = vsg::ComputePipeline::create(pipelineLayout, computeStage);
+    inputs.push_back({vsg::BindComputePipeline::create(pipeline),
+                      vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, descriptorSet)});
+    return inputs.size() - 1;
+}
+
+void TemporalUpscaler::compile(vsg::Context& context)
+{
+    finalImage->compile(context);
+    historyImage->compile(context);
+}
+
+void TemporalUpscaler::updateImageLayouts(vsg::Context& context)
+{
+    VkImageSubresourceRange resourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    auto historyLayout = vsg::ImageMemoryBarrier::create(VK_ACCESS_NONE_KHR, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                         VK_IMAGE_LAYOUT_GENERAL, 0, 0, historyImage->imageInfoList[0]->imageView->image,
+                                                         resourceRange);
+    auto finalLayout = vsg::ImageMemoryBarrier::create(VK_ACCESS_NONE_KHR, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                       VK_IMAGE_LAYOUT_GENERAL, 0, 0, finalImage->imageInfoList[0]->imageView->image,
+                                                       resourceRange);
+    auto pipelineBarrier = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                                        VK_DEPENDENCY_BY_REGION_BIT, historyLayout, finalLayout);
+    context.commands.push_back(pipelineBarrier);
+}
+
+void TemporalUpscaler::addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph, size_t input)
+{
+    auto srcImage = finalImage->imageInfoList[0]->imageView->image;
+    auto dstImage = historyImage->imageInfoList[0]->imageView->image;
+    VkImageSubresourceRange resourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+    // the denoiser wrote the input, the previous frame still reads the final image for the readback or the window
+    auto inputBarrier = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                                     VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+    inputBarrier->add(vsg::MemoryBarrier::create(VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT));
+    commandGraph->addChild(inputBarrier);
+
+    commandGraph->addChild(inputs[input].bindPipeline);
+    commandGraph->addChild(inputs[input].bindDescriptorSet);
+    commandGraph->addChild(vsg::Dispatch::create(uint32_t(ceil(float(width) / float(workWidth))), uint32_t(ceil(float(height) / float(workHeight))),
+                                                 1));
+
+    // the final image becomes the history of the next frame
+    auto copyBarrier = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0);
+    copyBarrier->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                                                     VK_IMAGE_LAYOUT_GENERAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, srcImage, resourceRange));
+    copyBarrier->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                                                     VK_IMAGE_LAYOUT_GENERAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, dstImage, resourceRange));
+    commandGraph->addChild(copyBarrier);
+
+    auto copyImage = vsg::CopyImage::create();
+    copyImage->srcImage = srcImage;
+    copyImage->srcImageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    copyImage->dstImage = dstImage;
+    copyImage->dstImageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    copyImage->regions = {VkImageCopy{
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            {0, 0, 0},
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            {0, 0, 0},
+            {width, height, 1}
+    }};
+    commandGraph->addChild(copyImage);
+
+    auto historyBarrier = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0);
+    historyBarrier->add(vsg::MemoryBarrier::create(VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+                                                   VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT));
+    commandGraph->addChild(historyBarrier);
+}
+
+vsg::ref_ptr<vsg::DescriptorImage> TemporalUpscaler::getFinalDescriptorImage() const
+{
+    return finalImage;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <buffers/AccumulationBuffer.hpp>
+#include <buffers/FrameParameters.hpp>
+
+#include <vsg/all.h>
+
+#include <cstdint>
+
+// Temporal upscaler ------------------------------------------------------------------------
+// Reconstructs the output resolution from a denoised image of a lower internal resolution with a history at output
+// resolution, reprojected by the motion of the accumulator. Every internal resolution is added as an input with its
+// own pipeline, all inputs share the final image and the history so the resolution can change from frame to frame.
+class TemporalUpscaler : public vsg::Inherit<vsg::Object, TemporalUpscaler>
+{
+public:
+    uint32_t motionBinding = 0, denoisedBinding = 1, finalImageBinding = 2, historyBinding = 3, frameParametersBinding = 4;
+
+    TemporalUpscaler(uint32_t width, uint32_t height, uint32_t workWidth = 16, uint32_t workHeight = 16);
+
+    // returns the index of the input, the denoised image has the internal resolution of the accumulation buffer
+    size_t addInput(vsg::ref_ptr<AccumulationBuffer> accBuffer, vsg::ref_ptr<vsg::DescriptorImage> denoised);
+
+    void compile(vsg::Context& context);
+    void updateImageLayouts(vsg::Context& context);
+    void addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph, size_t input);
+    vsg::ref_ptr<vsg::DescriptorImage> getFinalDescriptorImage() const;
+
+    // uniform buffer of the frame number, the RayTracingPushConstants of the ray tracing written through FrameParameters
+    vsg::ref_ptr<vsg::BufferInfo> frameParametersBuffer;
+
+private:
+    struct Input
+    {
+        vsg::ref_ptr<vsg::BindComputePipeline> bindPipeline;
+        vsg::ref_ptr<vsg::BindDescriptorSet> bindDescriptorSet;
+    };
+
+    uint32_t width, height, workWidth, workHeight;
+
+    std::vector<Input> inputs;
+    vsg::ref_ptr<vsg::DescriptorImage> finalImage, historyImage;
+    vsg::ref_ptr<vsg::Sampler> sampler;
+};
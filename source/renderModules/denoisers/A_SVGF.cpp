@@ -29,6 +29,11 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+// tile of AtrousFused.comp and the shared memory it may use, 32 KB are available on all desktop GPUs
+const uint32_t kFusedTileSize = 16;
+const uint32_t kFusedTexelBytes = 28;
+const uint32_t kFusedSharedMemory = 32 * 1024;
+
 vsg::ref_ptr<vsg::ImageInfo> createImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage = 0)
 {
     auto image = vsg::Image::create();
@@ -58,6 +63,8 @@ A_SVGF::A_SVGF(uint32_t width, uint32_t height, vsg::ref_ptr<GBuffer> gBuffer,
     NumIterations = args.value(5, "--atrousIters");
     FilterKernel = args.value(1, "--atrousFilter");
     TemporalAlpha = args.value(0.01f, "--tempAlpha");
+    FusedIterations = args.value(0, "--atrousFused");
+    CloudReproPoints = args.value(3, "--cloudReproPoints");
     PerPass<const char*> shaderNames{"shaders/a-svgf/CreateGradientSamples.comp.spv",
                         "shaders/a-svgf/AtrousGradient.comp.spv",
                         "shaders/a-svgf/TemporalAccumulation.comp.spv",
@@ -72,7 +79,7 @@ A_SVGF::A_SVGF(uint32_t width, uint32_t height, vsg::ref_ptr<GBuffer> gBuffer,
         {0, vsg::intValue::create(FilterKernel)}
     };
     shaderStages.tempAccum->specializationConstants = {
-            {1, vsg::intValue::create(args.value(3, "--cloudReproPoints"))}
+            {1, vsg::intValue::create(CloudReproPoints)}
     };
 
     vsg::DescriptorSetLayoutBindings layoutBindings0 = {
@@ -93,6 +100,7 @@ A_SVGF::A_SVGF(uint32_t width, uint32_t height, vsg::ref_ptr<GBuffer> gBuffer,
         {14, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_ALL, nullptr},
         {15, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_ALL, nullptr},
         {16, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_ALL, nullptr},
+        {17, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL, nullptr},
         {99, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_ALL, nullptr},
     };
 
@@ -110,8 +118,8 @@ A_SVGF::A_SVGF(uint32_t width, uint32_t height, vsg::ref_ptr<GBuffer> gBuffer,
 
     auto setLayout0 = vsg::DescriptorSetLayout::create(layoutBindings0), setLayout1 = vsg::DescriptorSetLayout::create(layoutBindings1);
 
-    auto pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{setLayout0, setLayout1},
-         vsg::PushConstantRanges{{VK_SHADER_STAGE_COMPUTE_BIT, 0, 64 + sizeof(ASvgfPushConst)}});
+    pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{setLayout0, setLayout1},
+         vsg::PushConstantRanges{{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ASvgfPushConst)}});
 
     pipelines = shaderStages.map<vsg::ref_ptr<vsg::ComputePipeline>>([&](const auto& shader) {
         return vsg::ComputePipeline::create(pipelineLayout, shader);
@@ -121,6 +129,10 @@ A_SVGF::A_SVGF(uint32_t width, uint32_t height, vsg::ref_ptr<GBuffer> gBuffer,
         return vsg::BindComputePipeline::create(pipeline);
     });
 
+    tempAccumStage = shaderStages.tempAccum;
+    bindTempAccumPipelines[CloudReproPoints] = bindPipelines.tempAccum;
+    finalParity = DiffAtrousIterations + planAtrousPasses(NumIterations).size();
+
     // create internal resources.
     uint32_t gradWidth = (width + GradientDownsample - 1) / GradientDownsample, gradHeight = (height + GradientDownsample - 1) / GradientDownsample;
     diffA1 = createImage(gradWidth, gradHeight, VK_FORMAT_R32G32B32A32_SFLOAT);
@@ -137,6 +149,8 @@ A_SVGF::A_SVGF(uint32_t width, uint32_t height, vsg::ref_ptr<GBuffer> gBuffer,
     varB = createImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
     color_hist = createImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_TRANSFER_DST_BIT);
     debug_img = createImage(width, height, VK_FORMAT_R32G32B32A32_SFLOAT);
+    projConstantValue = vsg::Value<ASvgfFrameConst>::create();
+    reprojectionBuffer = FrameParameters::createUniformBuffer(sizeof(ASvgfFrameConst));
 
     vsg::Descriptors desc0 {
         vsg::DescriptorImage::create(/*irradiance*/illuBuffer->illuminationImages[0]->imageInfoList, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
@@ -156,6 +170,7 @@ A_SVGF::A_SVGF(uint32_t width, uint32_t height, vsg::ref_ptr<GBuffer> gBuffer,
         vsg::DescriptorImage::create(gradProjector->prevVisBuffer->imageInfoList, 14, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER),
         vsg::DescriptorImage::create(gBuffer->volume->imageInfoList, 15, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
         vsg::DescriptorImage::create(accum_volume_prev, 16, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+        vsg::DescriptorBuffer::create(vsg::BufferInfoList{reprojectionBuffer}, 17, 0),
         vsg::DescriptorImage::create(debug_img, 99, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
     };
 
@@ -189,11 +204,89 @@ A_SVGF::A_SVGF(uint32_t width, uint32_t height, vsg::ref_ptr<GBuffer> gBuffer,
     bindDescriptorSet1A = vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, ds1A);
     bindDescriptorSet1B = vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, ds1B);
 
-    projConstantValue = vsg::mat4Value::create();
+    setQualityVariants({});
+}
+
+std::vector<A_SVGF::AtrousPass> A_SVGF::planAtrousPasses(int iterations) const
+{
+    // group the atrous iterations into fused dispatches while tile and halo fit into the shared memory budget
+    std::vector<AtrousPass> atrousPasses;
+    for (int level = 0; level < iterations;)
+    {
+        AtrousPass pass{level, 1, atrousFootprint(FilterKernel, 1 << level)};
+        while (pass.levelCount < FusedIterations && level + pass.levelCount < iterations)
+        {
+            int halo = pass.halo + atrousFootprint(FilterKernel, 1 << (level + pass.levelCount));
+            uint32_t sharedWidth = kFusedTileSize + 2 * halo;
+            if (sharedWidth * sharedWidth * kFusedTexelBytes > kFusedSharedMemory)
+                break;
+            pass.halo = halo;
+            ++pass.levelCount;
+        }
+        atrousPasses.push_back(pass);
+        level += pass.levelCount;
+    }
+    return atrousPasses;
+}
+
+vsg::ref_ptr<vsg::BindComputePipeline> A_SVGF::fusedPipeline(int halo)
+{
+    auto& bindPipeline = bindFusedPipelines[halo];
+    if (bindPipeline)
+        return bindPipeline;
+    if (!fusedStage)
+        fusedStage = vsg::ShaderStage::read(VK_SHADER_STAGE_COMPUTE_BIT, "main", "shaders/a-svgf/AtrousFused.comp.spv");
+    // the halo sizes the shared memory, so every halo needs its own pipeline
+    auto stage = vsg::ShaderStage::create(VK_SHADER_STAGE_COMPUTE_BIT, "main", fusedStage->module);
+    stage->specializationConstants = vsg::ShaderStage::SpecializationConstants{
+        {0, vsg::intValue::create(FilterKernel)},
+        {2, vsg::intValue::create(halo)}
+    };
+    bindPipeline = vsg::BindComputePipeline::create(vsg::ComputePipeline::create(pipelineLayout, stage));
+    return bindPipeline;
+}
+
+vsg::ref_ptr<vsg::BindComputePipeline> A_SVGF::tempAccumPipeline(int cloudReproPoints)
+{
+    auto& bindPipeline = bindTempAccumPipelines[cloudReproPoints];
+    if (bindPipeline)
+        return bindPipeline;
+    auto stage = vsg::ShaderStage::create(VK_SHADER_STAGE_COMPUTE_BIT, "main", tempAccumStage->module);
+    stage->specializationConstants = vsg::ShaderStage::SpecializationConstants{
+        {1, vsg::intValue::create(cloudReproPoints)}
+    };
+    bindPipeline = vsg::BindComputePipeline::create(vsg::ComputePipeline::create(pipelineLayout, stage));
+    return bindPipeline;
+}
+
+void A_SVGF::setQualityVariants(const std::vector<Quality>& qualities)
+{
+    renderGraphs.clear();
+    variantGraphs.clear();
+    std::vector<Quality> graphQualities;
+    for (const auto& quality : qualities.empty() ? std::vector<Quality>{getQuality()} : qualities)
+    {
+        auto it = std::find(graphQualities.begin(), graphQualities.end(), quality);
+        variantGraphs.push_back(static_cast<size_t>(it - graphQualities.begin()));
+        if (it != graphQualities.end())
+            continue;
+        graphQualities.push_back(quality);
+        renderGraphs.push_back(createPasses(quality));
+    }
+}
+
+void A_SVGF::selectQualityVariant(size_t variant)
+{
+    if (variantSwitch && variant < variantGraphs.size())
+        variantSwitch->active = variantGraphs[variant];
 }
 
 void A_SVGF::compile(vsg::Context &ctx)
 {
+    // binds the transient images to their shared memory before the descriptors compile them
+    renderGraphs.front()->compile(ctx);
+    for (size_t i = 1; i < renderGraphs.size(); ++i)
+        renderGraphs[i]->shareTransientMemory(*renderGraphs.front());
     for (auto &desc : bindDescriptorSet0->descriptorSet->descriptors)
         desc->compile(ctx);
     for (auto &desc : bindDescriptorSet1A->descriptorSet->descriptors)
@@ -202,7 +295,41 @@ void A_SVGF::compile(vsg::Context &ctx)
         desc->compile(ctx);
 }
 
-void A_SVGF::addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph, vsg::ref_ptr<vsg::QueryPool> queryPool, std::vector<std::string> &queryNames)
+void A_SVGF::addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph, vsg::ref_ptr<Profiler> profiler)
+{
+    auto record = [&](const RenderGraph& renderGraph, vsg::ref_ptr<vsg::Commands> commands) {
+        renderGraph.record(commands, [&](const RenderGraph::Pass& pass) {
+            if (!pass.name.empty())
+                profiler->addGpuScope(commands, pass.name, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        });
+    };
+    if (renderGraphs.size() == 1)
+    {
+        variantSwitch = {};
+        record(*renderGraphs.front(), commandGraph);
+        return;
+    }
+
+    variantSwitch = CommandSwitch::create();
+    for (const auto& renderGraph : renderGraphs)
+    {
+        // the barriers of a graph expect the previous frame to end with its own passes, after a switch it ended
+        // with those of another variant
+        auto variant = vsg::Commands::create();
+        auto switchBarrier = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0);
+        switchBarrier->add(vsg::MemoryBarrier::create(VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                                                      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT |
+                                                      VK_ACCESS_TRANSFER_WRITE_BIT));
+        variant->addChild(switchBarrier);
+        record(*renderGraph, variant);
+        variantSwitch->addChild(variant);
+    }
+    variantSwitch->active = variantGraphs.front();
+    commandGraph->addChild(variantSwitch);
+}
+
+vsg::ref_ptr<RenderGraph> A_SVGF::createPasses(const Quality& quality)
 {
     // Passes to run:
     // 1. Create Gradient Samples
@@ -210,195 +337,157 @@ void A_SVGF::addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph,
     // 3. Temporal Accumulation
     // 4. Estimate Variance
     // 5. Atrous
-
+    auto renderGraph = RenderGraph::create();
+    auto atrousPasses = planAtrousPasses(quality.atrousIterations);
     auto pushConstVal = vsg::Value<ASvgfPushConst>::create(ASvgfPushConst{
         0,
         0,
         GradientDownsample,
-        TemporalAlpha,
+        quality.temporalAlpha,
         ModulateAlbedo,
+        1,
+        -1,
     });
 
     auto tileWidth = (width + 7) / 8, tileHeight = (height + 7) / 8;
     auto gradWidth = (width + GradientDownsample - 1) / GradientDownsample, gradHeight = (height + GradientDownsample - 1) / GradientDownsample;
     auto gradTileWidth = (gradWidth + 7) / 8, gradTileHeight = (gradHeight + 7) / 8;
+    // images bound to bindings 8 and 9 of set 1 for each of the ping-pong sets
+    auto varianceIn = [&](size_t parity) { return (parity & 1 ? varB : varA)->imageView->image; };
+    auto varianceOut = [&](size_t parity) { return (parity & 1 ? varA : varB)->imageView->image; };
 
     // 1. Create Gradient Samples
-    commandGraph->addChild(bindPipelines.createGradSamples);
-    commandGraph->addChild(bindDescriptorSet0);
-    commandGraph->addChild(bindDescriptorSet1A);
-    commandGraph->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, projConstantValue));
-    commandGraph->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 64, pushConstVal));
-    commandGraph->addChild(vsg::Dispatch::create(gradTileWidth, gradTileHeight, 1));
-    commandGraph->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-    queryNames.emplace_back("CrGradSam");
-
-    auto pipelineBarrier = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
-    commandGraph->addChild(pipelineBarrier);
+    auto pass = renderGraph->addPass("CrGradSam");
+    pass->write(diffA1->imageView->image);
+    pass->write(diffA2->imageView->image);
+    pass->commands->addChild(bindPipelines.createGradSamples);
+    pass->commands->addChild(bindDescriptorSet0);
+    pass->commands->addChild(bindDescriptorSet1A);
+    pass->commands->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstVal));
+    pass->commands->addChild(vsg::Dispatch::create(gradTileWidth, gradTileHeight, 1));
 
     // 2. Atrous Gradient
-    commandGraph->addChild(bindPipelines.atrousGrad);
     for (int i = 0; i < DiffAtrousIterations; i++)
     {
         // swap the diff textures around each iteration.
-        commandGraph->addChild(bindDescriptorSet1A);
-        std::swap(bindDescriptorSet1A, bindDescriptorSet1B);
+        bool swapped = i & 1;
+        pass = renderGraph->addPass(i + 1 == DiffAtrousIterations ? "AtrousGrad" : "");
+        pass->read((swapped ? diffB1 : diffA1)->imageView->image);
+        pass->read((swapped ? diffB2 : diffA2)->imageView->image);
+        pass->write((swapped ? diffA1 : diffB1)->imageView->image);
+        pass->write((swapped ? diffA2 : diffB2)->imageView->image);
+        if (i == 0)
+            pass->commands->addChild(bindPipelines.atrousGrad);
+        pass->commands->addChild(swapped ? bindDescriptorSet1B : bindDescriptorSet1A);
 
         pushConstVal = vsg::Value<ASvgfPushConst>::create(ASvgfPushConst{
                 i,
                 1 << i,
                 GradientDownsample,
-                TemporalAlpha,
+                quality.temporalAlpha,
                 ModulateAlbedo,
+                1,
+                -1,
         });
-        commandGraph->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 64, pushConstVal));
-        commandGraph->addChild(vsg::Dispatch::create(gradTileWidth, gradTileHeight, 1));
-        commandGraph->addChild(pipelineBarrier);
+        pass->commands->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstVal));
+        pass->commands->addChild(vsg::Dispatch::create(gradTileWidth, gradTileHeight, 1));
     }
-    commandGraph->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-    queryNames.emplace_back("AtrousGrad");
 
-    // 3. Temporal Accumulation
-    commandGraph->addChild(bindPipelines.tempAccum);
-    commandGraph->addChild(bindDescriptorSet1A);
-    commandGraph->addChild(vsg::Dispatch::create(tileWidth, tileHeight, 1));
-    commandGraph->addChild(pipelineBarrier);
-    commandGraph->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-    queryNames.emplace_back("TempAcc");
+    // 3. Temporal Accumulation, does not read the gradients as long as antilag is not ported
+    pass = renderGraph->addPass("TempAcc");
+    for (auto& img : {color_hist, accum_moments_prev, accum_histlen_prev, accum_volume_prev})
+        pass->read(img->imageView->image);
+    for (auto& img : {accum_color, accum_moments, accum_histlen, debug_img})
+        pass->write(img->imageView->image);
+    pass->commands->addChild(tempAccumPipeline(quality.cloudReproPoints));
+    pass->commands->addChild((DiffAtrousIterations & 1) ? bindDescriptorSet1B : bindDescriptorSet1A);
+    pass->commands->addChild(vsg::Dispatch::create(tileWidth, tileHeight, 1));
 
     // 4. Estimate Variance
-    commandGraph->addChild(bindPipelines.estVariance);
-    commandGraph->addChild(vsg::Dispatch::create(tileWidth, tileHeight, 1));
-    commandGraph->addChild(pipelineBarrier);
-    commandGraph->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-    queryNames.emplace_back("EstVar");
+    pass = renderGraph->addPass("EstVar");
+    for (auto& img : {accum_color, accum_moments, accum_histlen})
+        pass->read(img->imageView->image);
+    pass->write(varianceIn(DiffAtrousIterations));
+    pass->commands->addChild(bindPipelines.estVariance);
+    pass->commands->addChild(vsg::Dispatch::create(tileWidth, tileHeight, 1));
 
-    if (NumIterations == 0)
-    {
-        auto copyCmd = vsg::CopyImage::create();
-        copyCmd->srcImage = (DiffAtrousIterations & 1) ? varB->imageView->image : varA->imageView->image;
-        copyCmd->srcImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-        copyCmd->dstImage = color_hist->imageView->image;
-        copyCmd->dstImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-        copyCmd->regions = {VkImageCopy{
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                {0, 0, 0},
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                {0, 0, 0},
-                {width, height, 1}
-        }};
-        commandGraph->addChild(copyCmd);
-        commandGraph->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-        queryNames.emplace_back("CopyColor");
-    }
+    if (quality.atrousIterations == 0)
+        renderGraph->addPass("CopyColor")->copy(varianceIn(DiffAtrousIterations), color_hist->imageView->image);
 
     // 5. Atrous
-    commandGraph->addChild(bindPipelines.atrous);
-    for (int i = 0; i < NumIterations; i++)
+    for (size_t p = 0; p < atrousPasses.size(); p++)
     {
-        if (HistoryTap == i - 1)
-        {
-            auto copyCmd = vsg::CopyImage::create();
-            copyCmd->srcImage = ((DiffAtrousIterations + i) & 1) ? varB->imageView->image : varA->imageView->image;
-            copyCmd->srcImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            copyCmd->dstImage = color_hist->imageView->image;
-            copyCmd->dstImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            copyCmd->regions = {VkImageCopy{
-                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                    {0, 0, 0},
-                    {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                    {0, 0, 0},
-                    {width, height, 1}
-            }};
-            commandGraph->addChild(copyCmd);
-            commandGraph->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-            queryNames.emplace_back("CopyColor");
-        }
-
-        // swap the textures around each iteration.
-        commandGraph->addChild(bindDescriptorSet1A);
-        std::swap(bindDescriptorSet1A, bindDescriptorSet1B);
+        const auto& atrousPass = atrousPasses[p];
+        bool fused = atrousPass.levelCount > 1;
+        int lastLevel = atrousPass.firstLevel + atrousPass.levelCount - 1;
+        // fused passes write the history tap themselves
+        bool historyInPass = HistoryTap >= atrousPass.firstLevel && HistoryTap <= lastLevel;
+        size_t parity = DiffAtrousIterations + p;
+
+        if (fused)
+            pass = renderGraph->addPass(std::string("AtrousFused") + std::to_string(atrousPass.firstLevel) + "-" + std::to_string(lastLevel));
+        else
+            pass = renderGraph->addPass(std::string("Atrous") + std::to_string(atrousPass.firstLevel));
+        pass->read(varianceIn(parity));
+        pass->write(varianceOut(parity));
+        if (fused && historyInPass)
+            pass->write(color_hist->imageView->image);
+        pass->commands->addChild(fused ? fusedPipeline(atrousPass.halo) : bindPipelines.atrous);
+        // swap the textures around each pass.
+        pass->commands->addChild((parity & 1) ? bindDescriptorSet1B : bindDescriptorSet1A);
 
         pushConstVal = vsg::Value<ASvgfPushConst>::create(ASvgfPushConst{
-                i,
-                1 << i,
+                atrousPass.firstLevel,
+                1 << atrousPass.firstLevel,
                 GradientDownsample,
-                TemporalAlpha,
-                ModulateAlbedo && i == NumIterations - 1,
+                quality.temporalAlpha,
+                ModulateAlbedo && lastLevel == quality.atrousIterations - 1,
+                atrousPass.levelCount,
+                fused && historyInPass ? HistoryTap : -1,
         });
-        commandGraph->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 64, pushConstVal));
-        commandGraph->addChild(vsg::Dispatch::create(tileWidth, tileHeight, 1));
-        commandGraph->addChild(pipelineBarrier);
-        commandGraph->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-        queryNames.emplace_back(std::string("Atrous") + std::to_string(i));
+        pass->commands->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstVal));
+        if (fused)
+            pass->commands->addChild(vsg::Dispatch::create((width + kFusedTileSize - 1) / kFusedTileSize, (height + kFusedTileSize - 1) / kFusedTileSize, 1));
+        else
+            pass->commands->addChild(vsg::Dispatch::create(tileWidth, tileHeight, 1));
+
+        if (!fused && historyInPass)
+            renderGraph->addPass("CopyColor")->copy(varianceOut(parity), color_hist->imageView->image);
     }
 
-    if (NumIterations > 0 && HistoryTap == NumIterations - 1)
-    {
-        auto copyCmd = vsg::CopyImage::create();
-        copyCmd->srcImage = ((DiffAtrousIterations + NumIterations) & 1) ? varB->imageView->image : varA->imageView->image;
-        copyCmd->srcImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-        copyCmd->dstImage = color_hist->imageView->image;
-        copyCmd->dstImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-        copyCmd->regions = {VkImageCopy{
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                {0, 0, 0},
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-                {0, 0, 0},
-                {width, height, 1}
-        }};
-        commandGraph->addChild(copyCmd);
-        commandGraph->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-        queryNames.emplace_back("CopyColor");
-    }
+    // variants with the other parity end in the intermediate image, the following modules read the final one
+    size_t resultParity = DiffAtrousIterations + atrousPasses.size();
+    if ((resultParity & 1) != (finalParity & 1))
+        renderGraph->addPass("")->copy(varianceIn(resultParity), varianceIn(finalParity));
 
     // copy accum to prev
-    auto copyCmd = vsg::CopyImage::create();
-    copyCmd->srcImage = accum_histlen->imageView->image;
-    copyCmd->srcImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    copyCmd->dstImage = accum_histlen_prev->imageView->image;
-    copyCmd->dstImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    copyCmd->regions = {VkImageCopy{
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-            {0, 0, 0},
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-            {0, 0, 0},
-            {width, height, 1}
-    }};
-    commandGraph->addChild(copyCmd);
-    copyCmd = vsg::CopyImage::create();
-    copyCmd->srcImage = accum_moments->imageView->image;
-    copyCmd->srcImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    copyCmd->dstImage = accum_moments_prev->imageView->image;
-    copyCmd->dstImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    copyCmd->regions = {VkImageCopy{
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-            {0, 0, 0},
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-            {0, 0, 0},
-            {width, height, 1}
-    }};
-    commandGraph->addChild(copyCmd);
-    copyCmd = vsg::CopyImage::create();
-    copyCmd->srcImage = bindDescriptorSet0->descriptorSet->descriptors[15].cast<vsg::DescriptorImage>()->imageInfoList[0]->imageView->image;
-    copyCmd->srcImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    copyCmd->dstImage = accum_volume_prev->imageView->image;
-    copyCmd->dstImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    copyCmd->regions = {VkImageCopy{
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-            {0, 0, 0},
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
-            {0, 0, 0},
-            {width, height, 1}
-    }};
-    commandGraph->addChild(copyCmd);
-    commandGraph->addChild(vsg::WriteTimestamp::create(queryPool, queryPool->queryCount++, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT));
-    queryNames.emplace_back("CopyHist");
+    pass = renderGraph->addPass("CopyHist");
+    pass->copy(accum_histlen->imageView->image, accum_histlen_prev->imageView->image);
+    pass->copy(accum_moments->imageView->image, accum_moments_prev->imageView->image);
+    pass->copy(bindDescriptorSet0->descriptorSet->descriptors[15].cast<vsg::DescriptorImage>()->imageInfoList[0]->imageView->image,
+               accum_volume_prev->imageView->image);
+
+    // the final image is read by the following modules and the copy to the window
+    renderGraph->addPass("")->read(varianceIn(finalParity),
+                                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                   VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+
+    // everything but the history and the final image only lives within a frame
+    for (auto& img : {diffA1, diffA2, diffB1, diffB2, accum_color, accum_moments, accum_histlen})
+        renderGraph->addTransientImage(img->imageView->image);
+    renderGraph->addTransientImage(varianceOut(finalParity));
+    return renderGraph;
+}
+
+int A_SVGF::atrousFootprint(int filterKernel, int stepSize)
+{
+    int radius = filterKernel == 1 || (filterKernel == 4 && stepSize == 1) ? 1 : 2;
+    return std::max(radius * stepSize, 1);
 }
 
 vsg::ref_ptr<vsg::DescriptorImage> A_SVGF::getFinalDescriptorImage() const
 {
-    auto img = ((DiffAtrousIterations + NumIterations) & 1) ? varB : varA;
+    auto img = (finalParity & 1) ? varB : varA;
     return vsg::DescriptorImage::create(img, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
 }
 
@@ -407,7 +496,9 @@ void A_SVGF::updateImageLayouts(vsg::Context &context)
     auto barr = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
 
     VkImageSubresourceRange rr{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-    for (auto& img : {diffA1, diffA2, diffB1, diffB2, accum_color, accum_moments, accum_histlen, accum_moments_prev, accum_histlen_prev, accum_volume_prev, varA, varB, color_hist, debug_img})
+    // the transient images are transitioned by the render graph every frame
+    auto finalImage = (finalParity & 1) ? varB : varA;
+    for (auto& img : {accum_moments_prev, accum_histlen_prev, accum_volume_prev, finalImage, color_hist, debug_img})
     {
         barr->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_NONE_KHR, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, 0, img->imageView->image, rr));
     }
@@ -415,17 +506,29 @@ void A_SVGF::updateImageLayouts(vsg::Context &context)
     context.commands.emplace_back(barr);
 }
 
+void A_SVGF::addFrameParameters(FrameParameters& frameParameters)
+{
+    frameParameters.add(projConstantValue, reprojectionBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
 void A_SVGF::updatePushConstants(vsg::dmat4 projMatrix, vsg::dmat4 viewMatrix) {
     // no projection on the z values!
     projMatrix(2, 2) = 1;
     projMatrix(2, 3) = 0;
     projMatrix(3, 2) = 0;
     projMatrix(3, 3) = 1;
-    projConstantValue->value() = prevProjMatrix * prevViewMatrix * inverse(viewMatrix) * inverse(projMatrix);
+    projConstantValue->value().reprojectionMatrix = prevProjMatrix * prevViewMatrix * inverse(viewMatrix) * inverse(projMatrix);
+    projConstantValue->value().resetHistory = historyReset;
+    historyReset = false;
     prevProjMatrix = projMatrix;
     prevViewMatrix = viewMatrix;
 }
 
+void A_SVGF::resetHistory()
+{
+    historyReset = true;
+}
+
 // clear command
 class ClearColorImage : public vsg::Inherit<vsg::Command, ClearColorImage>
 {
@@ -526,6 +629,12 @@ GradientProjector::GradientProjector(vsg::ref_ptr<VBuffer> vBuffer)
             {2, vsg::intValue::create(height)},
     };
 
+    pushConstValue = vsg::Value<GradientProjectPushConst>::create(GradientProjectPushConst{
+        vsg::mat4(),
+        0
+    });
+    frameParametersBuffer = FrameParameters::createUniformBuffer(sizeof(GradientProjectPushConst));
+
     auto bindingMap = shaderProject->getDescriptorSetLayoutBindingsMap();
     auto dsetLayout = vsg::DescriptorSetLayout::create(bindingMap.begin()->second.bindings);
     auto descriptorSet = vsg::DescriptorSet::create(dsetLayout, vsg::Descriptors{
@@ -534,10 +643,9 @@ GradientProjector::GradientProjector(vsg::ref_ptr<VBuffer> vBuffer)
         vsg::DescriptorImage::create(vBuffer->visBuffer->imageInfoList[0], 2, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER),
         mergedVisBuffer,
         gradientSamples,
+        vsg::DescriptorBuffer::create(vsg::BufferInfoList{frameParametersBuffer}, 5, 0),
     });
-    auto pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{dsetLayout}, vsg::PushConstantRanges{
-        {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GradientProjectPushConst)}
-    });
+    auto pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{dsetLayout}, vsg::PushConstantRanges{});
     bindProject = vsg::BindComputePipeline::create(vsg::ComputePipeline::create(pipelineLayout, shaderProject));
     bindDescriptorSetP = vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, descriptorSet);
 
@@ -604,11 +712,6 @@ void GradientProjector::addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> co
 
     commandGraph->addChild(bindProject);
     commandGraph->addChild(bindDescriptorSetP);
-    pushConstValue = vsg::Value<GradientProjectPushConst>::create(GradientProjectPushConst{
-        vsg::mat4(),
-        0
-    });
-    commandGraph->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstValue));
     auto gradWidth = (width + GradientDownsample - 1) / GradientDownsample, gradHeight = (height + GradientDownsample - 1) / GradientDownsample;
     auto gradTileWidth = (gradWidth + 7) / 8, gradTileHeight = (gradHeight + 7) / 8;
     commandGraph->addChild(vsg::Dispatch::create(gradTileWidth, gradTileHeight, 1));
@@ -650,6 +753,11 @@ void GradientProjector::updateDescriptor(vsg::BindDescriptorSet *descSet, const
     descSet->descriptorSet->descriptors.push_back(merged);
 }
 
+void GradientProjector::addFrameParameters(FrameParameters& frameParameters)
+{
+    frameParameters.add(pushConstValue, frameParametersBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
+
 void GradientProjector::updatePushConstants(vsg::dmat4 projMatrixD, vsg::dmat4 viewMatrixD, unsigned int frameNum) {
     vsg::mat4 projMatrix{projMatrixD};
     vsg::mat4 viewMatrix{viewMatrixD};
@@ -31,9 +31,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <vsg/all.h>
 #include <buffers/AccumulationBuffer.hpp>
+#include <buffers/FrameParameters.hpp>
 #include <buffers/GBuffer.hpp>
 #include <buffers/VBuffer.hpp>
 #include <buffers/IlluminationBuffer.hpp>
+#include <io/Profiler.hpp>
+#include <renderModules/CommandSwitch.hpp>
+#include <renderModules/RenderGraph.hpp>
+
+#include <map>
+#include <vector>
 
 struct ASvgfPushConst {
     int iteration;
@@ -41,8 +48,17 @@ struct ASvgfPushConst {
     int gradientDownsample;
     float temporal_alpha;
     int modulate_albedo;
+    int level_count;    // AtrousFused only
+    int history_level;  // AtrousFused only
 };
 
+// read from a uniform buffer, see FrameParameters
+struct ASvgfFrameConst {
+    vsg::mat4 reprojectionMatrix;
+    unsigned resetHistory;
+};
+
+// read from a uniform buffer, see FrameParameters
 struct GradientProjectPushConst {
     vsg::mat4 reprojectionMatrix;
     unsigned frameNum;
@@ -58,6 +74,8 @@ public:
     void updateImageLayouts(vsg::Context& context) const;
     void updateDescriptor(vsg::BindDescriptorSet* descSet, const vsg::BindingMap& bindingMap) const;
     void updatePushConstants(vsg::dmat4 projMatrix, vsg::dmat4 viewMatrix, unsigned frameNum);
+    // the reprojection is read from a uniform buffer written by the frame parameters
+    void addFrameParameters(FrameParameters& frameParameters);
 
     uint32_t width, height;
     int GradientDownsample = 3;
@@ -69,6 +87,7 @@ private:
     vsg::ref_ptr<vsg::BindComputePipeline> bindCreateImg, bindProject;
     vsg::ref_ptr<vsg::BindDescriptorSet> bindDescriptorSetCI, bindDescriptorSetP;
     vsg::ref_ptr<vsg::Value<GradientProjectPushConst>> pushConstValue;
+    vsg::ref_ptr<vsg::BufferInfo> frameParametersBuffer;
     vsg::mat4 prevProjMatrix, prevViewMatrix;
 };
 
@@ -79,10 +98,31 @@ public:
            vsg::ref_ptr<GradientProjector> gradProjector, vsg::CommandLine&);
 
     void compile(vsg::Context&);
-    void addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph, vsg::ref_ptr<vsg::QueryPool> queryPool, std::vector<std::string> &queryNames);
+    void addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph, vsg::ref_ptr<Profiler> profiler);
     vsg::ref_ptr<vsg::DescriptorImage> getFinalDescriptorImage() const;
     void updateImageLayouts(vsg::Context& context);
     void updatePushConstants(vsg::dmat4 projMatrix, vsg::dmat4 viewMatrix);
+    // the temporal accumulation of the next frame starts without history
+    void resetHistory();
+    // the reprojection of the temporal accumulation is read from a uniform buffer written by the frame parameters
+    void addFrameParameters(FrameParameters& frameParameters);
+
+    // settings which can change from frame to frame, every variant is an own pass sequence with its pipelines
+    struct Quality
+    {
+        int atrousIterations, cloudReproPoints;
+        float temporalAlpha;
+        bool operator==(const Quality& other) const
+        {
+            return atrousIterations == other.atrousIterations && cloudReproPoints == other.cloudReproPoints &&
+                   temporalAlpha == other.temporalAlpha;
+        }
+    };
+    Quality getQuality() const { return {NumIterations, CloudReproPoints, TemporalAlpha}; }
+    // precompiles the passes of every quality, has to be called before compile(). addDispatchToCommandGraph() then
+    // runs the selected one, all write the final image of the command line values. An empty list goes back to those
+    void setQualityVariants(const std::vector<Quality>& qualities);
+    void selectQualityVariant(size_t variant);
 
     int   GradientDownsample = 3;
     bool  ModulateAlbedo = true;
@@ -90,12 +130,21 @@ public:
     int   HistoryTap = 0;
     int   FilterKernel = 1;
     float TemporalAlpha = 0.1f;
+    int   CloudReproPoints = 3;
     int   DiffAtrousIterations = 5;
     int   GradientFilterRadius = 2;
     bool  NormalizeGradient = true;
     bool  ShowAntilagAlpha  = false;
+    int   FusedIterations = 0; // maximum number of atrous iterations per dispatch of AtrousFused.comp, 0 or 1 disables it
+
+    // radius of the pixels read by one atrous iteration, has to match footprint() in AtrousFused.comp
+    static int atrousFootprint(int filterKernel, int stepSize);
 
 private:
+    // declares the passes with their image accesses, the gradients, the accumulation and the intermediate variance
+    // are transient and share their memory
+    vsg::ref_ptr<RenderGraph> createPasses(const Quality& quality);
+
     uint32_t width, height;
 
     template<typename T>
@@ -114,14 +163,34 @@ private:
         }
     };
 
+    // iterations run by one dispatch, passes with more than one level use AtrousFused.comp with the given halo
+    struct AtrousPass {
+        int firstLevel, levelCount, halo;
+    };
+    std::vector<AtrousPass> planAtrousPasses(int iterations) const;
+    // pipelines by halo and by cloud reprojection points, created on first use
+    vsg::ref_ptr<vsg::BindComputePipeline> fusedPipeline(int halo);
+    vsg::ref_ptr<vsg::BindComputePipeline> tempAccumPipeline(int cloudReproPoints);
+    std::map<int, vsg::ref_ptr<vsg::BindComputePipeline>> bindFusedPipelines, bindTempAccumPipelines;
+    vsg::ref_ptr<vsg::ShaderStage> fusedStage, tempAccumStage;
+    vsg::ref_ptr<vsg::PipelineLayout> pipelineLayout;
+
     PerPass<vsg::ref_ptr<vsg::ComputePipeline>> pipelines;
     PerPass<vsg::ref_ptr<vsg::BindComputePipeline>> bindPipelines;
     vsg::ref_ptr<vsg::BindDescriptorSet> bindDescriptorSet0, bindDescriptorSet1A, bindDescriptorSet1B;
+    // one graph per distinct quality, the first one owns the transient memory
+    std::vector<vsg::ref_ptr<RenderGraph>> renderGraphs;
+    std::vector<size_t> variantGraphs;
+    vsg::ref_ptr<CommandSwitch> variantSwitch;
+    // ping-pong parity of the final image, fixed by the command line iterations
+    size_t finalParity = 0;
 
     // Resources
     vsg::ref_ptr<vsg::ImageInfo> diffA1, diffA2, diffB1, diffB2, accum_color, accum_moments, accum_histlen,
         accum_moments_prev, accum_histlen_prev, accum_volume_prev, varA, varB, color_hist, debug_img;
 
-    vsg::ref_ptr<vsg::mat4Value> projConstantValue;
+    vsg::ref_ptr<vsg::Value<ASvgfFrameConst>> projConstantValue;
+    vsg::ref_ptr<vsg::BufferInfo> reprojectionBuffer;
     vsg::dmat4 prevProjMatrix, prevViewMatrix;
+    bool historyReset = false;
 };
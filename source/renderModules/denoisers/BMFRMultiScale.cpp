@@ -0,0 +1,201 @@
+#include <renderModules/denoisers/BMFRMultiScale.hpp>
+
+#include <renderModules/PipelineStructs.hpp>
+
+#include <string>
+
+namespace
+{
+    vsg::ref_ptr<vsg::ImageInfo> createImageInfo(uint32_t width, uint32_t height, uint32_t layers, VkFormat format, VkImageUsageFlags usage)
+    {
+        auto image = vsg::Image::create();
+        image->imageType = VK_IMAGE_TYPE_2D;
+        image->format = format;
+        image->extent.width = width;
+        image->extent.height = height;
+        image->extent.depth = 1;
+        image->mipLevels = 1;
+        image->arrayLayers = layers;
+        image->samples = VK_SAMPLE_COUNT_1_BIT;
+        image->tiling = VK_IMAGE_TILING_OPTIMAL;
+        image->usage = usage;
+        image->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        image->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        auto imageView = vsg::ImageView::create(image, VK_IMAGE_ASPECT_COLOR_BIT);
+        imageView->viewType = layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+        return vsg::ImageInfo::create(vsg::ref_ptr<vsg::Sampler>{}, imageView, VK_IMAGE_LAYOUT_GENERAL);
+    }
+}
+
+BMFRMultiScale::BMFRMultiScale(uint32_t width, uint32_t height, vsg::ref_ptr<GBuffer> gBuffer, vsg::ref_ptr<IlluminationBuffer> illuBuffer,
+                               vsg::ref_ptr<AccumulationBuffer> accBuffer, vsg::ref_ptr<vsg::DescriptorImage> averageImage,
+                               vsg::ref_ptr<vsg::DescriptorImage> averageSquaredImage, uint32_t filterRadius) :
+    width(width),
+    height(height),
+    sampler(vsg::Sampler::create())
+{
+    if (!illuBuffer.cast<IlluminationBufferDemodulated>() && !illuBuffer.cast<IlluminationBufferDemodulatedFloat>())
+        throw vsg::Exception{"Error: BMFRMultiScale::BMFRMultiScale(...) Illumination Buffer type is required to be IlluminationBufferDemodulated/Float."};
+    //adding usage bits to illumination buffer
+    illuBuffer->illuminationImages[0]->imageInfoList[0]->imageView->image->usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    auto preComputeStage = vsg::ShaderStage::read(VK_SHADER_STAGE_COMPUTE_BIT, "main", "shaders/bmfrMultiPre.comp.spv");
+    auto fitModule = vsg::ShaderStage::read(VK_SHADER_STAGE_COMPUTE_BIT, "main", "shaders/bmfrMultiFit.comp.spv")->module;
+    auto postComputeStage = vsg::ShaderStage::read(VK_SHADER_STAGE_COMPUTE_BIT, "main", "shaders/bmfrMultiPost.comp.spv");
+    preComputeStage->specializationConstants = vsg::ShaderStage::SpecializationConstants{
+        {0, vsg::intValue::create(width)},
+        {1, vsg::intValue::create(height)},
+        {2, vsg::intValue::create(workWidth)},
+        {3, vsg::intValue::create(workHeight)}
+    };
+    postComputeStage->specializationConstants = vsg::ShaderStage::SpecializationConstants{
+        {0, vsg::intValue::create(width)},
+        {1, vsg::intValue::create(height)},
+        {2, vsg::intValue::create(workWidth)},
+        {3, vsg::intValue::create(workHeight)},
+        {7, vsg::intValue::create(blockSizes[0])},
+        {8, vsg::intValue::create(blockSizes[1])},
+        {9, vsg::intValue::create(blockSizes[2])},
+        {10, vsg::intValue::create(filterRadius)}
+    };
+
+    // denoised illumination accumulation
+    auto imageInfo = createImageInfo(width, height, 2, VK_FORMAT_R16G16B16A16_SFLOAT,
+                                     VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    accumulatedIllumination = vsg::DescriptorImage::create(imageInfo, denoisedBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    auto sampledImageInfo = vsg::ImageInfo::create(sampler, imageInfo->imageView, VK_IMAGE_LAYOUT_GENERAL);
+    auto sampledAccIllu = vsg::DescriptorImage::create(sampledImageInfo, sampledDenIlluBinding, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+
+    imageInfo = createImageInfo(width, height, 1, VK_FORMAT_B8G8R8A8_UNORM,
+                                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    finalIllumination = vsg::DescriptorImage::create(imageInfo, finalBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+
+    // shared features at image resolution, the fits mirror the padding of their blocks into the image
+    imageInfo = createImageInfo(width, height, amtOfSharedFeatures, VK_FORMAT_R16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+    featureBuffer = vsg::DescriptorImage::create(imageInfo, featureBufferBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+
+    for (size_t i = 0; i < blockSizes.size(); ++i)
+    {
+        imageInfo = createImageInfo(width / blockSizes[i] + 2, height / blockSizes[i] + 2, amtOfWeightLayers, VK_FORMAT_R32_SFLOAT,
+                                    VK_IMAGE_USAGE_STORAGE_BIT);
+        weights[i] = vsg::DescriptorImage::create(imageInfo, weightsBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    }
+
+    vsg::DescriptorSetLayoutBindings layoutBindings;
+    for (uint32_t binding : {depthBinding, normalBinding, materialBinding, albedoBinding, motionBinding, sampleBinding, finalBinding,
+                             denoisedBinding, featureBufferBinding, weightsBinding, averageBinding, averageSquaredBinding, weights1Binding, weights2Binding})
+        layoutBindings.push_back({binding, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr});
+    for (uint32_t binding : {sampledDenIlluBinding, noisyBinding})
+        layoutBindings.push_back({binding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr});
+    auto descriptorSetLayout = vsg::DescriptorSetLayout::create(layoutBindings);
+    auto pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{descriptorSetLayout},
+        vsg::PushConstantRanges{
+            {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(RayTracingPushConstants)}
+        });
+
+    auto illuminationInfo = illuBuffer->illuminationImages[0]->imageInfoList[0];
+    illuminationInfo->sampler = sampler;
+    for (size_t i = 0; i < blockSizes.size(); ++i)
+    {
+        // filling descriptor set
+        vsg::Descriptors descriptors{
+            vsg::DescriptorImage::create(gBuffer->depth->imageInfoList[0], depthBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+            vsg::DescriptorImage::create(gBuffer->normal->imageInfoList[0], normalBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+            vsg::DescriptorImage::create(gBuffer->material->imageInfoList[0], materialBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+            vsg::DescriptorImage::create(gBuffer->albedo->imageInfoList[0], albedoBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+            vsg::DescriptorImage::create(accBuffer->motion->imageInfoList[0], motionBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+            vsg::DescriptorImage::create(accBuffer->spp->imageInfoList[0], sampleBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+            vsg::DescriptorImage::create(illuminationInfo, noisyBinding, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER),
+            vsg::DescriptorImage::create(averageImage->imageInfoList[0], averageBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+            vsg::DescriptorImage::create(averageSquaredImage->imageInfoList[0], averageSquaredBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+            accumulatedIllumination,
+            finalIllumination,
+            sampledAccIllu,
+            featureBuffer,
+            vsg::DescriptorImage::create(weights[i]->imageInfoList[0], weightsBinding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+            vsg::DescriptorImage::create(weights[(i + 1) % 3]->imageInfoList[0], weights1Binding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+            vsg::DescriptorImage::create(weights[(i + 2) % 3]->imageInfoList[0], weights2Binding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+        };
+        bindDescriptorSets[i] = vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
+                                                               vsg::DescriptorSet::create(descriptorSetLayout, descriptors));
+
+        auto fitComputeStage = vsg::ShaderStage::create(VK_SHADER_STAGE_COMPUTE_BIT, "main", fitModule);
+        fitComputeStage->specializationConstants = vsg::ShaderStage::SpecializationConstants{
+            {0, vsg::intValue::create(width)},
+            {1, vsg::intValue::create(height)},
+            {2, vsg::intValue::create(fittingKernels[i])},
+            {3, vsg::intValue::create(1)},
+            {4, vsg::intValue::create(blockSizes[i])}
+        };
+        bindFitPipelines[i] = vsg::BindComputePipeline::create(vsg::ComputePipeline::create(pipelineLayout, fitComputeStage));
+    }
+
+    bindPrePipeline = vsg::BindComputePipeline::create(vsg::ComputePipeline::create(pipelineLayout, preComputeStage));
+    bindPostPipeline = vsg::BindComputePipeline::create(vsg::ComputePipeline::create(pipelineLayout, postComputeStage));
+}
+void BMFRMultiScale::compile(vsg::Context& context)
+{
+    accumulatedIllumination->compile(context);
+    finalIllumination->compile(context);
+    featureBuffer->compile(context);
+    for (auto& weightImage : weights)
+        weightImage->compile(context);
+}
+void BMFRMultiScale::updateImageLayouts(vsg::Context& context)
+{
+    auto pipelineBarrier = vsg::PipelineBarrier::create(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                                        VK_DEPENDENCY_BY_REGION_BIT);
+    for (auto& descriptorImage : {accumulatedIllumination, finalIllumination, featureBuffer, weights[0], weights[1], weights[2]})
+    {
+        auto image = descriptorImage->imageInfoList[0]->imageView->image;
+        VkImageSubresourceRange resourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, image->arrayLayers};
+        pipelineBarrier->add(vsg::ImageMemoryBarrier::create(VK_ACCESS_NONE_KHR, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                             VK_IMAGE_LAYOUT_GENERAL, 0, 0, image, resourceRange));
+    }
+    context.commands.push_back(pipelineBarrier);
+}
+void BMFRMultiScale::addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph, vsg::ref_ptr<vsg::PushConstants> pushConstants)
+{
+    renderGraph = RenderGraph::create();
+    auto featureImage = featureBuffer->imageInfoList[0]->imageView->image;
+    auto accumulatedImage = accumulatedIllumination->imageInfoList[0]->imageView->image;
+    auto finalImage = finalIllumination->imageInfoList[0]->imageView->image;
+
+    // shared pre pipeline
+    auto pass = renderGraph->addPass("BMFRPre");
+    pass->write(featureImage);
+    pass->commands->addChild(bindPrePipeline);
+    pass->commands->addChild(bindDescriptorSets[0]);
+    pass->commands->addChild(pushConstants);
+    pass->commands->addChild(vsg::Dispatch::create((width + workWidth - 1) / workWidth, (height + workHeight - 1) / workHeight, 1));
+
+    // fit pipelines, one per block size
+    for (size_t i = 0; i < blockSizes.size(); ++i)
+    {
+        pass = renderGraph->addPass("BMFRFit" + std::to_string(blockSizes[i]));
+        pass->read(featureImage);
+        pass->write(weights[i]->imageInfoList[0]->imageView->image);
+        pass->commands->addChild(bindFitPipelines[i]);
+        pass->commands->addChild(bindDescriptorSets[i]);
+        pass->commands->addChild(vsg::Dispatch::create(width / blockSizes[i] + 2, height / blockSizes[i] + 2, 1));
+    }
+
+    // post pipeline with the blending
+    pass = renderGraph->addPass("BMFRPost");
+    for (auto& weightImage : weights)
+        pass->read(weightImage->imageInfoList[0]->imageView->image);
+    pass->write(accumulatedImage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    pass->write(finalImage);
+    pass->commands->addChild(bindPostPipeline);
+    pass->commands->addChild(bindDescriptorSets[0]);
+    pass->commands->addChild(vsg::Dispatch::create((width + workWidth - 1) / workWidth, (height + workHeight - 1) / workHeight, 1));
+
+    // the final image is read by the following modules and the copy to the window
+    renderGraph->addPass("")->read(finalImage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                   VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+    renderGraph->record(commandGraph);
+}
+vsg::ref_ptr<vsg::DescriptorImage> BMFRMultiScale::getFinalDescriptorImage() const
+{
+    return finalIllumination;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <buffers/AccumulationBuffer.hpp>
+#include <buffers/GBuffer.hpp>
+#include <buffers/IlluminationBuffer.hpp>
+#include <renderModules/RenderGraph.hpp>
+
+#include <vsg/all.h>
+
+#include <array>
+
+// BMFR with 8x8, 16x16 and 32x32 blocks in one module. Replaces three BMFR instances and the BFRBlender:
+// the feature pre pass runs once and is shared, only the fit runs per block size, and a single post pass evaluates
+// the three fits, blends them by the variance of the accumulated illumination and accumulates the blended result.
+// The fits write separate weight images and run without barriers between them.
+class BMFRMultiScale : public vsg::Inherit<vsg::Object, BMFRMultiScale>
+{
+public:
+    // averageImage and averageSquaredImage are the images the BFRBlender reads
+    BMFRMultiScale(uint32_t width, uint32_t height, vsg::ref_ptr<GBuffer> gBuffer, vsg::ref_ptr<IlluminationBuffer> illuBuffer,
+                   vsg::ref_ptr<AccumulationBuffer> accBuffer, vsg::ref_ptr<vsg::DescriptorImage> averageImage,
+                   vsg::ref_ptr<vsg::DescriptorImage> averageSquaredImage, uint32_t filterRadius = 2);
+
+    void compile(vsg::Context& context);
+    void updateImageLayouts(vsg::Context& context);
+    void addDispatchToCommandGraph(vsg::ref_ptr<vsg::Commands> commandGraph, vsg::ref_ptr<vsg::PushConstants> pushConstants);
+    vsg::ref_ptr<vsg::DescriptorImage> getFinalDescriptorImage() const;
+
+    static constexpr std::array<uint32_t, 3> blockSizes{8, 16, 32};
+    static constexpr std::array<uint32_t, 3> fittingKernels{64, 256, 256};
+
+private:
+    uint32_t depthBinding = 0, normalBinding = 1, materialBinding = 2, albedoBinding = 3, motionBinding = 4, sampleBinding = 5, sampledDenIlluBinding = 6,
+             finalBinding = 7, noisyBinding = 8, denoisedBinding = 9, featureBufferBinding = 10, weightsBinding = 11, averageBinding = 12,
+             averageSquaredBinding = 13, weights1Binding = 14, weights2Binding = 15;
+    // normal and noisy illumination
+    uint32_t amtOfSharedFeatures = 6;
+    // weights of the 10 features for 3 color channels and the depth range of the block
+    uint32_t amtOfWeightLayers = 32;
+    uint32_t workWidth = 16, workHeight = 16;
+
+    uint32_t width, height;
+    vsg::ref_ptr<vsg::Sampler> sampler;
+    vsg::ref_ptr<vsg::BindComputePipeline> bindPrePipeline, bindPostPipeline;
+    std::array<vsg::ref_ptr<vsg::BindComputePipeline>, 3> bindFitPipelines;
+    vsg::ref_ptr<vsg::DescriptorImage> accumulatedIllumination, finalIllumination, featureBuffer;
+    std::array<vsg::ref_ptr<vsg::DescriptorImage>, 3> weights;
+    // the descriptor set of fit i has the weights of block size i at weightsBinding, the post pass uses the first one
+    std::array<vsg::ref_ptr<vsg::BindDescriptorSet>, 3> bindDescriptorSets;
+    vsg::ref_ptr<RenderGraph> renderGraph;
+};
@@ -0,0 +1,662 @@
+#include <renderModules/denoisers/CpuDenoiser.hpp>
+#include <io/HalfFloat.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace
+{
+    // rows filtered by one tile of the per pixel passes
+    const uint32_t kBandRows = 8;
+    // constants of bmfrGeneral.comp
+    const uint32_t kFeatureCount = 13;
+    const uint32_t kWeightCount = kFeatureCount - 3;
+    const float kEps = 1e-6f;
+    const float kNoiseAmount = 1e-4f;
+    const float kSecondBlendAlpha = 0.1f;
+    const float kPixelOffsets[16][2] = {{.7f, .85f}, {.95f, .5f}, {.43f, .76f}, {.97f, .03f}, {.37f, .58f}, {.03f, .36f}, {.81f, .46f}, {0.f, .78f},
+                                        {.36f, -.08f}, {-.06f, 0.f}, {.95f, .1f}, {.85f, .61f}, {.06f, .1f}, {.43f, .16f}, {0.f, .5f}, {.73f, .38f}};
+    // constants of the a-svgf shaders
+    const float kMaxHistoryLength = 64.0f;
+    const float kHistoryLengthThreshold = 4.0f;
+    const float kGaussianKernel[3][3] = {{1.0f / 16.0f, 1.0f / 8.0f, 1.0f / 16.0f}, {1.0f / 8.0f, 1.0f / 4.0f, 1.0f / 8.0f}, {1.0f / 16.0f, 1.0f / 8.0f, 1.0f / 16.0f}};
+
+    float random(uint32_t a)
+    {
+        a = (a + 0x7ed55d16) + (a << 12);
+        a = (a ^ 0xc761c23c) ^ (a >> 19);
+        a = (a + 0x165667b1) + (a << 5);
+        a = (a + 0xd3a2646c) ^ (a << 9);
+        a = (a + 0xfd7046c5) + (a << 3);
+        a = (a ^ 0xb55a4f09) ^ (a >> 16);
+        return float(a) / float(0xffffffffu);
+    }
+
+    int mirror(int x, int size)
+    {
+        if (x < 0) x = std::abs(x) - 1;
+        if (x >= size) x = 2 * size - x - 1;
+        // images smaller than two blocks would need more than one reflection
+        return std::clamp(x, 0, size - 1);
+    }
+
+    float luminance(const vsg::vec3& color)
+    {
+        return color.x * 0.299f + color.y * 0.587f + color.z * 0.114f;
+    }
+
+    vsg::vec3 uncompressNormal(const vsg::vec2& spherical)
+    {
+        return vsg::vec3(std::cos(spherical.y) * std::sin(spherical.x), std::sin(spherical.y) * std::sin(spherical.x), std::cos(spherical.x));
+    }
+
+    // remodulates the albedo and applies the gamma of the final images
+    vsg::vec4 toneMap(const vsg::vec3& illumination, const vsg::vec3& albedo, float alpha)
+    {
+        vsg::vec4 result(0, 0, 0, alpha);
+        for (int c = 0; c < 3; ++c)
+            result[c] = std::clamp(std::pow(std::max(0.0f, (albedo[c] + kEps) * illumination[c]), 1.0f / 2.2f), 0.0f, 1.0f);
+        return result;
+    }
+
+    // linear filtering with repeat addressing like the default sampler of the shaders
+    template<typename T>
+    T sampleBilinear(const std::vector<T>& image, uint32_t width, uint32_t height, const vsg::vec2& uv)
+    {
+        float x = uv.x * width - 0.5f, y = uv.y * height - 0.5f;
+        float fx = std::floor(x), fy = std::floor(y);
+        float wx = x - fx, wy = y - fy;
+        auto wrap = [](int c, uint32_t size) { return (c % int(size) + int(size)) % int(size); };
+        int x0 = wrap(int(fx), width), x1 = wrap(int(fx) + 1, width), y0 = wrap(int(fy), height), y1 = wrap(int(fy) + 1, height);
+        auto at = [&](int px, int py) { return image[size_t(py) * width + px]; };
+        return (at(x0, y0) * (1 - wx) + at(x1, y0) * wx) * (1 - wy) + (at(x0, y1) * (1 - wx) + at(x1, y1) * wx) * wy;
+    }
+
+    float readFloat(const vsg::Data& data, size_t index)
+    {
+        if (data.getLayout().format == VK_FORMAT_R16_SFLOAT)
+            return halfToFloat(static_cast<const uint16_t*>(data.dataPointer())[index]);
+        return static_cast<const float*>(data.dataPointer())[index];
+    }
+
+    vsg::vec3 readRgb(const vsg::Data& data, size_t index)
+    {
+        switch (data.getLayout().format)
+        {
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        {
+            const auto* halfs = static_cast<const uint16_t*>(data.dataPointer()) + 4 * index;
+            return vsg::vec3(halfToFloat(halfs[0]), halfToFloat(halfs[1]), halfToFloat(halfs[2]));
+        }
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        {
+            const auto* bytes = static_cast<const uint8_t*>(data.dataPointer()) + 4 * index;
+            return vsg::vec3(bytes[0] / 255.0f, bytes[1] / 255.0f, bytes[2] / 255.0f);
+        }
+        default:
+        {
+            const auto* floats = static_cast<const float*>(data.dataPointer()) + 4 * index;
+            return vsg::vec3(floats[0], floats[1], floats[2]);
+        }
+        }
+    }
+
+    void checkImage(const vsg::ref_ptr<vsg::Data>& data, uint32_t width, uint32_t height, std::initializer_list<VkFormat> formats, const char* name)
+    {
+        if (!data)
+            throw vsg::Exception{std::string("Error: CpuDenoiser::denoise(...) ") + name + " image is missing"};
+        if (data->width() != width || data->height() != height)
+            throw vsg::Exception{std::string("Error: CpuDenoiser::denoise(...) ") + name + " image has a different size than the denoiser"};
+        if (std::find(formats.begin(), formats.end(), data->getLayout().format) == formats.end())
+            throw vsg::Exception{std::string("Error: CpuDenoiser::denoise(...) ") + name + " image has an unsupported format"};
+    }
+}
+
+class CpuDenoiser::TileOperation : public vsg::Inherit<vsg::Operation, CpuDenoiser::TileOperation>
+{
+public:
+    TileOperation(const std::function<void(uint32_t)>* tileFunction, std::atomic<uint32_t>* nextTile, uint32_t tileCount, vsg::ref_ptr<vsg::Latch> latch) :
+        tileFunction(tileFunction), nextTile(nextTile), tileCount(tileCount), latch(latch) {}
+
+    void run() override
+    {
+        // tiles are taken until none are left, so workers which finish early take over the remaining work of the others
+        for (uint32_t tile = (*nextTile)++; tile < tileCount; tile = (*nextTile)++)
+            (*tileFunction)(tile);
+        latch->count_down();
+    }
+
+private:
+    const std::function<void(uint32_t)>* tileFunction; // forEachTile waits for all operations
+    std::atomic<uint32_t>* nextTile;
+    uint32_t tileCount;
+    vsg::ref_ptr<vsg::Latch> latch;
+};
+
+CpuDenoiser::CpuDenoiser(uint32_t width, uint32_t height, Type type, uint32_t blockSize, vsg::CommandLine& args, uint32_t numThreads) :
+    width(width),
+    height(height),
+    type(type),
+    blockSize(blockSize),
+    blendAlpha(type == Type::BMFR ? 0.1f : 1.0f),
+    numThreads(numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency())),
+    threads(vsg::OperationThreads::create(this->numThreads))
+{
+    atrousIterations = args.value(5, "--atrousIters");
+    filterKernel = args.value(1, "--atrousFilter");
+    temporalAlpha = args.value(0.01f, "--tempAlpha");
+    if (type == Type::BMFR && (blockSize < 2 || blockSize * blockSize < kFeatureCount))
+        throw vsg::Exception{"Error: CpuDenoiser::CpuDenoiser(...) BMFR block size has to be at least 4"};
+
+    size_t pixelCount = size_t(width) * height;
+    depth.resize(pixelCount);
+    normal.resize(pixelCount);
+    albedo.resize(pixelCount);
+    color.resize(pixelCount);
+    sampleCounts.resize(pixelCount);
+    prevSampleCounts.resize(pixelCount);
+    prevDepth.resize(pixelCount);
+    reprojectedDepth.resize(pixelCount);
+    accumulated.resize(pixelCount);
+    prevAccumulated.resize(pixelCount);
+    prevNormal.resize(pixelCount);
+    motion.resize(pixelCount);
+    if (type == Type::BMFR)
+    {
+        denoised.resize(pixelCount);
+        prevDenoised.resize(pixelCount);
+    }
+    else
+    {
+        history.resize(pixelCount);
+        prevHistory.resize(pixelCount);
+        moments.resize(pixelCount);
+        prevMoments.resize(pixelCount);
+        historyLength.resize(pixelCount);
+        prevHistoryLength.resize(pixelCount);
+        varianceA.resize(pixelCount);
+        varianceB.resize(pixelCount);
+    }
+}
+
+vsg::ref_ptr<vsg::vec4Array2D> CpuDenoiser::denoise(int frame, const OfflineGBuffer& gBuffer, const OfflineIllumination& illumination,
+                                                    const CameraMatrices& current, const CameraMatrices& previous)
+{
+    loadFrame(gBuffer, illumination);
+    accumulate(frame, current, previous);
+
+    auto output = vsg::vec4Array2D::create(width, height, vsg::Data::Layout{VK_FORMAT_R32G32B32A32_SFLOAT});
+    if (type == Type::BMFR)
+        bmfr(frame, output->data());
+    else
+        svgf(output->data());
+
+    // the current buffers become the previous ones of the next frame
+    std::swap(depth, prevDepth);
+    std::swap(normal, prevNormal);
+    std::swap(accumulated, prevAccumulated);
+    std::swap(sampleCounts, prevSampleCounts);
+    std::swap(denoised, prevDenoised);
+    std::swap(history, prevHistory);
+    std::swap(moments, prevMoments);
+    std::swap(historyLength, prevHistoryLength);
+    return output;
+}
+
+void CpuDenoiser::forEachTile(uint32_t tileCount, const std::function<void(uint32_t)>& tileFunction)
+{
+    std::atomic<uint32_t> nextTile{0};
+    uint32_t operationCount = std::min(numThreads, tileCount);
+    auto latch = vsg::Latch::create(static_cast<int>(operationCount));
+    for (uint32_t i = 0; i < operationCount; ++i)
+        threads->add(TileOperation::create(&tileFunction, &nextTile, tileCount, latch));
+    threads->run();
+    latch->wait();
+}
+
+void CpuDenoiser::forEachRow(const std::function<void(uint32_t)>& rowFunction)
+{
+    forEachTile((height + kBandRows - 1) / kBandRows, [&](uint32_t band) {
+        for (uint32_t y = band * kBandRows; y < std::min((band + 1) * kBandRows, height); ++y)
+            rowFunction(y);
+    });
+}
+
+void CpuDenoiser::loadFrame(const OfflineGBuffer& gBuffer, const OfflineIllumination& illumination)
+{
+    checkImage(gBuffer.depth, width, height, {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R16_SFLOAT}, "depth");
+    checkImage(gBuffer.normal, width, height, {VK_FORMAT_R32G32_SFLOAT}, "normal");
+    checkImage(illumination.noisy, width, height, {VK_FORMAT_R32G32B32A32_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT}, "illumination");
+    // without albedo the illumination is not remodulated
+    if (gBuffer.albedo)
+        checkImage(gBuffer.albedo, width, height, {VK_FORMAT_R8G8B8A8_UNORM}, "albedo");
+
+    const auto* normals = static_cast<const vsg::vec2*>(gBuffer.normal->dataPointer());
+    forEachRow([&](uint32_t y) {
+        for (size_t i = size_t(y) * width; i < size_t(y + 1) * width; ++i)
+        {
+            depth[i] = readFloat(*gBuffer.depth, i);
+            normal[i] = uncompressNormal(normals[i]);
+            albedo[i] = gBuffer.albedo ? readRgb(*gBuffer.albedo, i) : vsg::vec3(1, 1, 1);
+            color[i] = readRgb(*illumination.noisy, i);
+        }
+    });
+}
+
+void CpuDenoiser::accumulate(int frame, const CameraMatrices& current, const CameraMatrices& previous)
+{
+    // same math as accumulator.comp with combined matrices
+    vsg::vec4 curOrigin = current.invView[2];
+    curOrigin /= curOrigin.w;
+    vsg::vec4 prevOrigin = previous.invView[2];
+    prevOrigin /= prevOrigin.w;
+    vsg::vec2 sizeScale(width / (width - 0.5f), height / (height - 0.5f));
+
+    forEachRow([&](uint32_t y) {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            size_t i = size_t(y) * width + x;
+            vsg::vec4 clip((x + 0.5f) / width * 2 - 1, (y + 0.5f) / height * 2 - 1, 1, 1);
+            vsg::vec4 dir = current.invView * clip;
+            dir /= dir.w + 1e-9f;
+            dir -= curOrigin;
+            dir = -dir / vsg::length(dir);
+            vsg::vec4 p = curOrigin + dir * depth[i];
+            vsg::vec4 prevPos = previous.view * p;
+            float preDepth = vsg::length(vsg::vec3(p.x - prevOrigin.x, p.y - prevOrigin.y, p.z - prevOrigin.z));
+            prevPos /= prevPos.w;
+            vsg::vec2 uv((prevPos.x + 1) * 0.5f * sizeScale.x, (prevPos.y + 1) * 0.5f * sizeScale.y);
+
+            bool reprojected = false;
+            float samples = 1;
+            vsg::vec3 prevColor;
+            if (frame > 0 && uv.x >= 0 && uv.y >= 0 && uv.x <= 1 && uv.y <= 1)
+            {
+                // relative depth error, pixels further away from the camera are blended more easily
+                float depthDissimilarity = sampleBilinear(prevDepth, width, height, uv) / preDepth - 1;
+                if (std::abs(depthDissimilarity) <= 0.01f)
+                {
+                    reprojected = true;
+                    prevColor = sampleBilinear(prevAccumulated, width, height, uv);
+                    samples += sampleBilinear(prevSampleCounts, width, height, uv);
+                }
+            }
+            motion[i] = reprojected ? uv : vsg::vec2(-1, -1);
+            // the sample count image is R8 with 1/256 steps
+            sampleCounts[i] = std::min(samples, 256.0f);
+            reprojectedDepth[i] = preDepth;
+            if (reprojected)
+            {
+                float alpha = std::max(1.0f / samples, blendAlpha);
+                accumulated[i] = prevColor * (1 - alpha) + color[i] * alpha;
+            }
+            else
+                accumulated[i] = color[i];
+        }
+    });
+}
+
+void CpuDenoiser::bmfr(int frame, vsg::vec4* output)
+{
+    // one tile per block does the pre, fit and post passes of the block at once
+    uint32_t blocksX = width / blockSize + 2, blocksY = height / blockSize + 2;
+    forEachTile(blocksX * blocksY, [&](uint32_t block) { bmfrBlock(frame, block % blocksX, block / blocksX, output); });
+}
+
+void CpuDenoiser::bmfrBlock(int frame, uint32_t blockX, uint32_t blockY, vsg::vec4* output)
+{
+    const uint32_t pixelCount = blockSize * blockSize;
+    const int offsetX = int(float(blockSize) * kPixelOffsets[frame % 16][0]), offsetY = int(float(blockSize) * kPixelOffsets[frame % 16][1]);
+
+    // features column by column, row r of a column belongs to the local pixel (r / blockSize, r % blockSize) as in bmfrFit.comp
+    std::vector<float> features(kFeatureCount * pixelCount), u(pixelCount);
+    std::vector<size_t> pixels(pixelCount);
+    std::vector<uint8_t> inside(pixelCount);
+    auto column = [&](uint32_t feature) { return features.data() + size_t(feature) * pixelCount; };
+
+    float minDepth = std::numeric_limits<float>::max(), maxDepth = std::numeric_limits<float>::lowest();
+    for (uint32_t row = 0; row < pixelCount; ++row)
+    {
+        uint32_t localX = row / blockSize, localY = row % blockSize;
+        int absoluteX = int(blockX * blockSize + localX) - offsetX, absoluteY = int(blockY * blockSize + localY) - offsetY;
+        int imageX = mirror(absoluteX, int(width)), imageY = mirror(absoluteY, int(height));
+        size_t i = size_t(imageY) * width + imageX;
+        pixels[row] = i;
+        inside[row] = absoluteX == imageX && absoluteY == imageY;
+        minDepth = std::min(minDepth, depth[i]);
+        maxDepth = std::max(maxDepth, depth[i]);
+        column(0)[row] = 1;
+        column(1)[row] = normal[i].x;
+        column(2)[row] = normal[i].y;
+        column(3)[row] = normal[i].z;
+        column(4)[row] = localX / float(blockSize - 1);
+        column(5)[row] = localY / float(blockSize - 1);
+        column(6)[row] = depth[i];
+        column(10)[row] = accumulated[i].x;
+        column(11)[row] = accumulated[i].y;
+        column(12)[row] = accumulated[i].z;
+    }
+    float depthScale = 1.0f / (maxDepth - minDepth + kEps);
+    float* z = column(6);
+    for (uint32_t row = 0; row < pixelCount; ++row)
+        z[row] = (z[row] - minDepth) * depthScale;
+    for (uint32_t feature = 0; feature < 3; ++feature)
+    {
+        const float* source = column(4 + feature);
+        float* square = column(7 + feature);
+        for (uint32_t row = 0; row < pixelCount; ++row)
+            square[row] = source[row] * source[row];
+    }
+    // the post pass evaluates the unperturbed features
+    std::vector<float> unperturbed(features.begin(), features.begin() + size_t(kWeightCount) * pixelCount);
+
+    // noise keeps the least squares problem well conditioned for constant features
+    const uint32_t pixelBlockSquared = pixelCount * pixelCount;
+    for (uint32_t feature = 0; feature < kWeightCount; ++feature)
+    {
+        float* values = column(feature);
+        uint32_t seed = feature * pixelBlockSquared + uint32_t(frame) * kFeatureCount * pixelBlockSquared;
+        for (uint32_t row = 0; row < pixelCount; ++row)
+            values[row] += kNoiseAmount * 2.0f * (random(row + seed) - 0.5f);
+    }
+
+    // householder QR of the feature columns, the colours are transformed along as the last columns
+    float uLengthSquared = 0;
+    for (uint32_t col = 0; col < kWeightCount; ++col)
+    {
+        float* a = column(col);
+        float tail = 0;
+        for (uint32_t row = col + 1; row < pixelCount; ++row)
+            tail += a[row] * a[row];
+        float length = std::sqrt(tail + a[col] * a[col]);
+        std::fill(u.begin(), u.begin() + col, 0.0f);
+        std::copy(a + col, a + pixelCount, u.begin() + col);
+        u[col] -= length;
+        uLengthSquared = tail + u[col] * u[col];
+        a[col] = length;
+        for (uint32_t f = col + 1; f < kFeatureCount; ++f)
+        {
+            float* b = column(f);
+            float dot = 0;
+            for (uint32_t row = col; row < pixelCount; ++row)
+                dot += b[row] * u[row];
+            float scale = 2 * dot / uLengthSquared;
+            for (uint32_t row = col; row < pixelCount; ++row)
+                b[row] -= scale * u[row];
+        }
+    }
+
+    // back substitution, R[row][col] is stored in column col
+    vsg::vec3 weights[kWeightCount];
+    for (int i = int(kWeightCount) - 1; i >= 0; --i)
+    {
+        vsg::vec3 weight(column(kWeightCount)[i], column(kWeightCount + 1)[i], column(kWeightCount + 2)[i]);
+        for (uint32_t x = i + 1; x < kWeightCount; ++x)
+            weight -= weights[x] * column(x)[i];
+        weights[i] = weight / column(i)[i];
+    }
+    for (auto& weight : weights)
+    {
+        if (uLengthSquared == 0)
+            weight = vsg::vec3(0.2f, 0.2f, 0.2f);
+        for (int c = 0; c < 3; ++c)
+            if (std::isnan(weight[c]) || std::isinf(weight[c]))
+                weight[c] = 0;
+    }
+
+    for (uint32_t row = 0; row < pixelCount; ++row)
+    {
+        if (!inside[row])
+            continue;
+        size_t i = pixels[row];
+        vsg::vec3 denoisedColor;
+        for (uint32_t feature = 0; feature < kWeightCount; ++feature)
+            denoisedColor += weights[feature] * unperturbed[size_t(feature) * pixelCount + row];
+        for (int c = 0; c < 3; ++c)
+            denoisedColor[c] = std::clamp(denoisedColor[c], 0.0f, 10.0f);
+
+        if (frame > 0 && motion[i].x >= 0)
+        {
+            float alpha = std::max(1.0f / sampleCounts[i], kSecondBlendAlpha);
+            denoisedColor = denoisedColor * alpha + sampleBilinear(prevDenoised, width, height, motion[i]) * (1 - alpha);
+        }
+        denoised[i] = denoisedColor;
+        output[i] = toneMap(denoisedColor, albedo[i], 1);
+    }
+}
+
+void CpuDenoiser::svgfTemporal()
+{
+    forEachRow([&](uint32_t y) {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            size_t i = size_t(y) * width + x;
+            vsg::vec3 colorCurrent = accumulated[i];
+            float l = luminance(colorCurrent);
+            vsg::vec2 momentsCurrent(l, l * l);
+            vsg::vec2 posPrev(motion[i].x * (width - 1), motion[i].y * (height - 1));
+
+            vsg::vec3 colorPrev;
+            vsg::vec2 momentsPrev;
+            float sumW = 0, length = 0;
+            if (posPrev.x >= 0 && posPrev.y >= 0 && depth[i] > 0)
+            {
+                int px = int(posPrev.x - 0.5f), py = int(posPrev.y - 0.5f);
+                float wx = (posPrev.x - 0.5f) - std::floor(posPrev.x - 0.5f), wy = (posPrev.y - 0.5f) - std::floor(posPrev.y - 0.5f);
+                // bilinear interpolation, each tap is tested on its own and the weights are renormalized afterwards
+                for (int yy = 0; yy <= 1; ++yy)
+                {
+                    for (int xx = 0; xx <= 1; ++xx)
+                    {
+                        int qx = px + xx, qy = py + yy;
+                        if (qx < 0 || qy < 0 || qx >= int(width) || qy >= int(height))
+                            continue;
+                        size_t q = size_t(qy) * width + qx;
+                        // the depths are distances to the cameras, so the previous depth is compared to the distance to the previous camera
+                        if (vsg::dot(normal[i], prevNormal[q]) <= 0.95f || prevDepth[q] <= 0 || std::abs(prevDepth[q] / reprojectedDepth[i] - 1) > 0.01f)
+                            continue;
+                        float w = (xx == 0 ? 1 - wx : wx) * (yy == 0 ? 1 - wy : wy);
+                        colorPrev += prevHistory[q] * w;
+                        momentsPrev += prevMoments[q] * w;
+                        length += prevHistoryLength[q] * w;
+                        sumW += w;
+                    }
+                }
+            }
+
+            if (sumW > 0.01f && !std::isnan(colorPrev.x) && !std::isnan(colorPrev.y) && !std::isnan(colorPrev.z))
+            {
+                colorPrev /= sumW;
+                momentsPrev /= sumW;
+                length /= sumW;
+                float alphaColor = std::max(temporalAlpha, 1.0f / (length + 1));
+                float alphaMoments = std::max(0.6f, 1.0f / (length + 1));
+                history[i] = colorPrev * (1 - alphaColor) + colorCurrent * alphaColor;
+                moments[i] = momentsPrev * (1 - alphaMoments) + momentsCurrent * alphaMoments;
+                historyLength[i] = std::min(kMaxHistoryLength, length + 1);
+            }
+            else
+            {
+                history[i] = colorCurrent;
+                moments[i] = momentsCurrent;
+                historyLength[i] = 1;
+            }
+        }
+    });
+}
+
+void CpuDenoiser::svgfVariance()
+{
+    forEachRow([&](uint32_t y) {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            size_t i = size_t(y) * width + x;
+            vsg::vec2 m = moments[i];
+            vsg::vec3 c = history[i];
+            float length = historyLength[i];
+            float zCenter = depth[i];
+            if (length >= kHistoryLengthThreshold || zCenter <= 0)
+            {
+                varianceA[i] = vsg::vec4(c.x, c.y, c.z, std::max(0.0f, m.y - m.x * m.x));
+                continue;
+            }
+
+            // spatial estimate while the temporal one has too few samples
+            float deltaZ = std::abs(zCenter - (x + 1 < width ? depth[i + 1] : 0.0f));
+            float l = luminance(c);
+            m += vsg::vec2(l, l * l);
+            float sumW = 1;
+            int r = length > 1 ? 2 : 3;
+            for (int yy = -r; yy <= r; ++yy)
+            {
+                for (int xx = -r; xx <= r; ++xx)
+                {
+                    int qx = int(x) + xx, qy = int(y) + yy;
+                    if ((xx == 0 && yy == 0) || qx < 0 || qy < 0 || qx >= int(width) || qy >= int(height))
+                        continue;
+                    size_t q = size_t(qy) * width + qx;
+                    float lq = luminance(history[q]);
+                    float wz = std::abs(depth[q] - zCenter) / (deltaZ * std::sqrt(float(xx * xx + yy * yy)) + 1e-2f);
+                    float wn = std::pow(std::max(0.0f, vsg::dot(normal[q], normal[i])), 128.0f);
+                    float w = std::exp(-wz) * wn;
+                    if (std::isnan(w))
+                        w = 0;
+                    sumW += w;
+                    m += vsg::vec2(lq, lq * lq) * w;
+                    c += history[q] * w;
+                }
+            }
+            m /= sumW;
+            c /= sumW;
+            varianceA[i] = vsg::vec4(c.x, c.y, c.z, (1 + 3 * (1 - length / kHistoryLengthThreshold)) * std::max(0.0f, m.y - m.x * m.x));
+        }
+    });
+}
+
+void CpuDenoiser::svgfAtrous(int iteration, vsg::vec4* output)
+{
+    const int step = 1 << iteration;
+    const bool last = iteration + 1 == atrousIterations;
+    forEachRow([&](uint32_t y) {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            size_t i = size_t(y) * width + x;
+            vsg::vec4 colorCenter = varianceA[i];
+            float zCenter = depth[i];
+            float zGrad = std::abs((x + 1 < width && y + 1 < height ? depth[i + width + 1] : 0.0f) - zCenter);
+            float lCenter = luminance(vsg::vec3(colorCenter.x, colorCenter.y, colorCenter.z));
+
+            // the shader weights the center with kernel[0][0] as well
+            float varianceSum = colorCenter.w * kGaussianKernel[0][0];
+            for (int yy = -1; yy <= 1; ++yy)
+            {
+                for (int xx = -1; xx <= 1; ++xx)
+                {
+                    int qx = int(x) + xx, qy = int(y) + yy;
+                    if ((xx != 0 || yy != 0) && qx >= 0 && qy >= 0 && qx < int(width) && qy < int(height))
+                        varianceSum += varianceA[size_t(qy) * width + qx].w * kGaussianKernel[xx + 1][yy + 1];
+                }
+            }
+            float sigmaL = std::sqrt(std::max(varianceSum, 0.0f)) * 3.0f;
+
+            vsg::vec3 sumColor(colorCenter.x, colorCenter.y, colorCenter.z);
+            float sumVariance = colorCenter.w, sumWeight = 1;
+            auto tap = [&](int offsetX, int offsetY, float kernelWeight) {
+                int qx = int(x) + offsetX * step, qy = int(y) + offsetY * step;
+                if (qx < 0 || qy < 0 || qx >= int(width) || qy >= int(height))
+                    return;
+                size_t q = size_t(qy) * width + qx;
+                const vsg::vec4& colorP = varianceA[q];
+                float wl = std::abs(luminance(vsg::vec3(colorP.x, colorP.y, colorP.z)) - lCenter) / (sigmaL + 1e-10f);
+                // the shader scales the already stepped offset by the step size again
+                float wz = 3.0f * std::abs(depth[q] - zCenter) / (zGrad * std::sqrt(float(offsetX * offsetX + offsetY * offsetY)) * step * step + 1e-2f);
+                float wn = std::pow(std::max(0.0f, vsg::dot(normal[q], normal[i])), 128.0f);
+                float w = std::exp(-wl * wl - wz) * kernelWeight * wn;
+                sumColor += vsg::vec3(colorP.x, colorP.y, colorP.z) * w;
+                sumVariance += w * w * colorP.w;
+                sumWeight += w;
+            };
+            auto box = [&](int r) {
+                for (int yy = -r; yy <= r; ++yy)
+                    for (int xx = -r; xx <= r; ++xx)
+                        if (xx != 0 || yy != 0)
+                            tap(xx, yy, 1.0f);
+            };
+            auto subsampled = [&]() {
+                if ((iteration & 1) == 0)
+                {
+                    tap(-2, 0, 1.0f);
+                    tap(2, 0, 1.0f);
+                }
+                else
+                {
+                    tap(0, -2, 1.0f);
+                    tap(0, 2, 1.0f);
+                }
+                tap(-1, 1, 1.0f);
+                tap(1, 1, 1.0f);
+                tap(-1, -1, 1.0f);
+                tap(1, -1, 1.0f);
+            };
+
+            // only foreground pixels are filtered
+            if (zCenter > 0)
+            {
+                switch (filterKernel)
+                {
+                case 0:
+                {
+                    const int offsets[24][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}, {2, 0}, {0, 2}, {-2, 0}, {0, -2}, {1, 1}, {-1, 1}, {-1, -1}, {1, -1},
+                                                {1, 2}, {-1, 2}, {-1, -2}, {1, -2}, {2, 1}, {-2, 1}, {-2, -1}, {2, -1}, {2, 2}, {-2, 2}, {-2, -2}, {2, -2}};
+                    const float weights[6] = {2.0f / 3.0f, 1.0f / 6.0f, 4.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 36.0f};
+                    for (int t = 0; t < 24; ++t)
+                        tap(offsets[t][0], offsets[t][1], weights[t / 4]);
+                    break;
+                }
+                case 1: box(1); break;
+                case 2: box(2); break;
+                case 3: subsampled(); break;
+                case 4:
+                    if (step == 1)
+                        box(1);
+                    else
+                        subsampled();
+                    break;
+                case 5:
+                    if (step == 1)
+                        box(2);
+                    else
+                        subsampled();
+                    break;
+                }
+            }
+
+            sumColor /= sumWeight;
+            sumVariance /= sumWeight * sumWeight;
+            // the output of the first iteration is the colour history of the next frame
+            if (iteration == 0)
+                history[i] = sumColor;
+            if (last)
+                output[i] = toneMap(sumColor, albedo[i], sumVariance);
+            else
+                varianceB[i] = vsg::vec4(sumColor.x, sumColor.y, sumColor.z, sumVariance);
+        }
+    });
+    std::swap(varianceA, varianceB);
+}
+
+void CpuDenoiser::svgf(vsg::vec4* output)
+{
+    svgfTemporal();
+    svgfVariance();
+    for (int iteration = 0; iteration < atrousIterations; ++iteration)
+        svgfAtrous(iteration, output);
+    if (atrousIterations <= 0)
+    {
+        for (size_t i = 0; i < varianceA.size(); ++i)
+            output[i] = toneMap(vsg::vec3(varianceA[i].x, varianceA[i].y, varianceA[i].z), albedo[i], varianceA[i].w);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <io/RenderIO.hpp>
+
+#include <vsg/all.h>
+
+#include <functional>
+#include <vector>
+
+// CPU port of the offline denoising pipelines --------------------------------------
+// Runs the accumulator followed by BMFR or SVGF on the frames of an OfflineGBuffer/OfflineIllumination sequence
+// without a Vulkan device, so sequences can be denoised and regression tested on machines without a ray tracing GPU.
+// The passes follow accumulator.comp, bmfrPre/Fit/Post.comp and the a-svgf shaders; reads outside of the image are
+// skipped instead of returning zero and the SVGF reprojection tests depth and normal as there are no mesh ids offline.
+// Each pass is split into tiles (BMFR blocks or bands of rows) which the workers of a thread pool pull from a shared
+// counter. The regression stores the features of a block column by column, so its inner loops run over contiguous
+// floats and are vectorized by the compiler.
+class CpuDenoiser : public vsg::Inherit<vsg::Object, CpuDenoiser>
+{
+public:
+    enum class Type
+    {
+        BMFR,
+        SVGF
+    };
+
+    // SVGF reads --atrousIters, --atrousFilter and --tempAlpha from args like A_SVGF
+    CpuDenoiser(uint32_t width, uint32_t height, Type type, uint32_t blockSize, vsg::CommandLine& args, uint32_t numThreads = 0);
+
+    // denoises the next frame of the sequence, frames have to be passed in order starting with frame 0.
+    // Returns the tone mapped image in RGBA32F like the final image of the GPU denoisers
+    vsg::ref_ptr<vsg::vec4Array2D> denoise(int frame, const OfflineGBuffer& gBuffer, const OfflineIllumination& illumination,
+                                           const CameraMatrices& current, const CameraMatrices& previous);
+
+private:
+    class TileOperation;
+
+    // calls tileFunction for all tiles in [0, tileCount) on the thread pool and waits for them
+    void forEachTile(uint32_t tileCount, const std::function<void(uint32_t)>& tileFunction);
+    // calls rowFunction for all rows of the image, bands of rows are the tiles
+    void forEachRow(const std::function<void(uint32_t)>& rowFunction);
+
+    void loadFrame(const OfflineGBuffer& gBuffer, const OfflineIllumination& illumination);
+    void accumulate(int frame, const CameraMatrices& current, const CameraMatrices& previous);
+    void bmfr(int frame, vsg::vec4* output);
+    void bmfrBlock(int frame, uint32_t blockX, uint32_t blockY, vsg::vec4* output);
+    void svgfTemporal();
+    void svgfVariance();
+    void svgfAtrous(int iteration, vsg::vec4* output);
+    void svgf(vsg::vec4* output);
+
+    uint32_t width, height;
+    Type type;
+    uint32_t blockSize;
+    float blendAlpha;
+    int atrousIterations, filterKernel;
+    float temporalAlpha;
+    uint32_t numThreads;
+    vsg::ref_ptr<vsg::OperationThreads> threads;
+
+    // current frame
+    std::vector<float> depth;
+    std::vector<vsg::vec3> normal, albedo, color;
+    // accumulator, reprojectedDepth is the distance of a pixel to the previous camera
+    std::vector<float> sampleCounts, prevSampleCounts, prevDepth, reprojectedDepth;
+    std::vector<vsg::vec3> accumulated, prevAccumulated, prevNormal;
+    std::vector<vsg::vec2> motion;
+    // BMFR
+    std::vector<vsg::vec3> denoised, prevDenoised;
+    // SVGF
+    std::vector<vsg::vec3> history, prevHistory;
+    std::vector<vsg::vec2> moments, prevMoments;
+    std::vector<float> historyLength, prevHistoryLength;
+    std::vector<vsg::vec4> varianceA, varianceB;
+};
@@ -0,0 +1,248 @@
+#include <scene/MipmapGenerator.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+    // texels of a band of rows filtered by one operation
+    const uint32_t kBandTexels = 64 * 1024;
+
+    struct SrgbTables
+    {
+        std::array<float, 256> toLinear;
+        // linear values halfway between two neighbouring codes, encoding picks the nearest code
+        std::array<float, 255> thresholds;
+
+        SrgbTables()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                float c = i / 255.0f;
+                toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            for (int i = 0; i < 255; ++i)
+                thresholds[i] = 0.5f * (toLinear[i] + toLinear[i + 1]);
+        }
+        uint8_t toSrgb(float linear) const
+        {
+            return static_cast<uint8_t>(std::upper_bound(thresholds.begin(), thresholds.end(), linear) - thresholds.begin());
+        }
+    };
+    const SrgbTables& srgbTables()
+    {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+    bool isMipmappable(const vsg::Data& data)
+    {
+        auto format = data.getLayout().format;
+        if (format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB && format != VK_FORMAT_B8G8R8A8_UNORM &&
+            format != VK_FORMAT_B8G8R8A8_SRGB)
+            return false;
+        return data.stride() == 4 && data.depth() == 1 && data.getLayout().maxNumMipmaps <= 1 && (data.width() > 1 || data.height() > 1);
+    }
+}
+
+class MipmapGenerator::FilterOperation : public vsg::Inherit<vsg::Operation, MipmapGenerator::FilterOperation>
+{
+public:
+    FilterOperation(const Chain* chain, uint32_t level, uint32_t rowBegin, uint32_t rowEnd, vsg::ref_ptr<vsg::Latch> latch) :
+        chain(chain), level(level), rowBegin(rowBegin), rowEnd(rowEnd), latch(latch) {}
+
+    void run() override
+    {
+        filterRows(*chain, level, rowBegin, rowEnd);
+        latch->count_down();
+    }
+
+private:
+    const Chain* chain; // generate() waits for all operations
+    uint32_t level, rowBegin, rowEnd;
+    vsg::ref_ptr<vsg::Latch> latch;
+};
+
+MipmapGenerator::MipmapGenerator(uint32_t numThreads) :
+    numThreads(numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency()))
+{
+}
+
+void MipmapGenerator::apply(vsg::Object& object)
+{
+    object.traverse(*this);
+}
+
+void MipmapGenerator::apply(vsg::StateGroup& stateGroup)
+{
+    for (auto& state : stateGroup.stateCommands)
+    {
+        if (auto bds = state.cast<vsg::BindDescriptorSet>())
+            apply(*bds);
+    }
+    stateGroup.traverse(*this);
+}
+
+void MipmapGenerator::apply(vsg::BindDescriptorSet& bds)
+{
+    if (!bds.descriptorSet)
+        return;
+    // bindings of the assimp materials, see RayTracingSceneDescriptorCreationVisitor
+    for (const auto& descriptor : bds.descriptorSet->descriptors)
+    {
+        auto texture = descriptor.cast<vsg::DescriptorImage>();
+        if (!texture || texture->descriptorType != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || texture->imageInfoList.empty())
+            continue;
+        switch (texture->dstBinding)
+        {
+        case 0: // diffuse map
+        case 4: // emissive map
+        case 5: // specular map
+            add(texture->imageInfoList[0], Usage::Srgb);
+            break;
+        case 1: // metall roughness map
+        case 3: // light map
+            add(texture->imageInfoList[0], Usage::Linear);
+            break;
+        case 2: // normal map
+            add(texture->imageInfoList[0], Usage::Normal);
+            break;
+        }
+    }
+}
+
+void MipmapGenerator::add(vsg::ref_ptr<vsg::ImageInfo> imageInfo, Usage usage)
+{
+    if (!imageInfo || !imageInfo->imageView || !imageInfo->imageView->image || !imageInfo->imageView->image->data)
+        return;
+    const auto& data = imageInfo->imageView->image->data;
+    if (!isMipmappable(*data))
+        return;
+    // textures shared by several materials keep the usage they were first seen with
+    auto& chain = chains[data.get()];
+    if (!chain.data)
+    {
+        chain.usage = usage;
+        chain.data = data;
+    }
+    chain.imageInfos.push_back(imageInfo);
+}
+
+void MipmapGenerator::generate()
+{
+    if (chains.empty())
+        return;
+
+    // the base levels are copied into data with room for the full chain
+    uint32_t maxLevelCount = 0;
+    size_t totalSize = 0;
+    for (auto& [source, chain] : chains)
+    {
+        uint32_t width = source->width(), height = source->height();
+        auto layout = source->getLayout();
+        size_t texelCount = 0;
+        for (uint32_t w = width, h = height;; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u))
+        {
+            chain.offsets.push_back(texelCount);
+            texelCount += size_t(w) * h;
+            if (w == 1 && h == 1)
+                break;
+        }
+        layout.maxNumMipmaps = static_cast<uint8_t>(chain.offsets.size());
+        auto* texels = new vsg::ubvec4[texelCount];
+        std::copy_n(static_cast<const vsg::ubvec4*>(source->dataPointer()), size_t(width) * height, texels);
+        chain.data = vsg::ubvec4Array2D::create(width, height, texels, layout);
+        maxLevelCount = std::max(maxLevelCount, static_cast<uint32_t>(chain.offsets.size()));
+        totalSize += chain.data->dataSize();
+    }
+
+    auto threads = vsg::OperationThreads::create(numThreads);
+    for (uint32_t level = 1; level < maxLevelCount; ++level)
+    {
+        std::vector<vsg::ref_ptr<FilterOperation>> operations;
+        auto latch = vsg::Latch::create(0);
+        for (auto& [source, chain] : chains)
+        {
+            if (level >= chain.offsets.size())
+                continue;
+            uint32_t width = std::max(chain.data->width() >> level, 1u), height = std::max(chain.data->height() >> level, 1u);
+            uint32_t bandRows = std::max(kBandTexels / width, 1u);
+            for (uint32_t row = 0; row < height; row += bandRows)
+                operations.push_back(FilterOperation::create(&chain, level, row, std::min(row + bandRows, height), latch));
+        }
+        latch->set(static_cast<int>(operations.size()));
+        for (auto& operation : operations)
+            threads->add(operation);
+        threads->run();
+        latch->wait();
+    }
+
+    for (auto& [source, chain] : chains)
+    {
+        float levelCount = static_cast<float>(chain.offsets.size());
+        for (auto& imageInfo : chain.imageInfos)
+        {
+            imageInfo->imageView->image->data = chain.data;
+            imageInfo->imageView->image->mipLevels = static_cast<uint32_t>(chain.offsets.size());
+            // the mip levels uploaded by vsg are taken from the sampler
+            if (imageInfo->sampler && imageInfo->sampler->maxLod < levelCount)
+                imageInfo->sampler->maxLod = levelCount;
+        }
+    }
+    std::cout << "Generated mipmaps for " << chains.size() << " textures, " << totalSize / (1024 * 1024) << " MB" << std::endl;
+    chains.clear();
+}
+
+void MipmapGenerator::filterRows(const Chain& chain, uint32_t level, uint32_t rowBegin, uint32_t rowEnd)
+{
+    // 2x2 box filter, odd sizes drop the last row or column as a linear blit does
+    uint32_t sourceWidth = std::max(chain.data->width() >> (level - 1), 1u), sourceHeight = std::max(chain.data->height() >> (level - 1), 1u);
+    uint32_t width = std::max(sourceWidth / 2, 1u);
+    const auto* texels = static_cast<const uint8_t*>(chain.data->dataPointer());
+    const uint8_t* source = texels + chain.offsets[level - 1] * 4;
+    uint8_t* target = const_cast<uint8_t*>(texels) + chain.offsets[level] * 4;
+    const auto& tables = srgbTables();
+
+    for (uint32_t y = rowBegin; y < rowEnd; ++y)
+    {
+        const uint8_t* row0 = source + size_t(std::min(2 * y, sourceHeight - 1)) * sourceWidth * 4;
+        const uint8_t* row1 = source + size_t(std::min(2 * y + 1, sourceHeight - 1)) * sourceWidth * 4;
+        uint8_t* out = target + size_t(y) * width * 4;
+        for (uint32_t x = 0; x < width; ++x, out += 4)
+        {
+            uint32_t x0 = std::min(2 * x, sourceWidth - 1) * 4, x1 = std::min(2 * x + 1, sourceWidth - 1) * 4;
+            const uint8_t* p[4] = {row0 + x0, row0 + x1, row1 + x0, row1 + x1};
+            out[3] = static_cast<uint8_t>((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+            switch (chain.usage)
+            {
+            case Usage::Srgb:
+                for (int c = 0; c < 3; ++c)
+                    out[c] = tables.toSrgb(0.25f * (tables.toLinear[p[0][c]] + tables.toLinear[p[1][c]] + tables.toLinear[p[2][c]] + tables.toLinear[p[3][c]]));
+                break;
+            case Usage::Linear:
+                for (int c = 0; c < 3; ++c)
+                    out[c] = static_cast<uint8_t>((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+                break;
+            case Usage::Normal:
+            {
+                float n[3];
+                for (int c = 0; c < 3; ++c)
+                    n[c] = (p[0][c] + p[1][c] + p[2][c] + p[3][c]) / 510.0f - 1.0f;
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (length < 1e-6f)
+                {
+                    // opposing normals cancel out, the flat normal is used instead
+                    n[0] = n[1] = 0.0f;
+                    n[2] = length = 1.0f;
+                }
+                for (int c = 0; c < 3; ++c)
+                    out[c] = static_cast<uint8_t>(std::lround((n[c] / length * 0.5f + 0.5f) * 255.0f));
+                break;
+            }
+            }
+        }
+    }
+}
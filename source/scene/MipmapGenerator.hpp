@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vsg/all.h>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Mipmap generation for the material textures ---------------------------------------
+// Replaces the data of the RGBA8 material textures by data with a full mip chain, which the ray tracing shaders
+// sample with ray cone lods. Colour maps are filtered in linear space, normal maps are averaged as vectors and
+// renormalized. The levels are built one after another, each level is split into bands of rows which are filtered
+// for all textures at once on a pool of worker threads.
+class MipmapGenerator : public vsg::Visitor
+{
+public:
+    enum class Usage
+    {
+        Srgb,
+        Linear,
+        Normal
+    };
+
+    explicit MipmapGenerator(uint32_t numThreads = 0);
+
+    void apply(vsg::Object& object) override;
+    void apply(vsg::StateGroup& stateGroup) override;
+    void apply(vsg::BindDescriptorSet& bds) override;
+
+    // queues the image of a texture, data which already has mipmaps or is not RGBA8 is skipped
+    void add(vsg::ref_ptr<vsg::ImageInfo> imageInfo, Usage usage);
+    // builds the mip chains of all queued textures and assigns them to their images
+    void generate();
+
+private:
+    class FilterOperation;
+    struct Chain
+    {
+        Usage usage;
+        vsg::ref_ptr<vsg::Data> data;
+        std::vector<size_t> offsets; // in texels, one per level
+        std::vector<vsg::ref_ptr<vsg::ImageInfo>> imageInfos;
+    };
+
+    static void filterRows(const Chain& chain, uint32_t level, uint32_t rowBegin, uint32_t rowEnd);
+
+    uint32_t numThreads;
+    std::map<const vsg::Data*, Chain> chains;
+};
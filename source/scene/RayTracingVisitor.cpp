@@ -1,5 +1,8 @@
 #include "RayTracingVisitor.hpp"
 
+#include <scene/SparseVolume.hpp>
+#include <scene/VolumePyramids.hpp>
+
 RayTracingSceneDescriptorCreationVisitor::RayTracingSceneDescriptorCreationVisitor()
 {
     vsg::ubvec4 w{255, 255, 255, 255};
@@ -11,10 +14,13 @@ RayTracingSceneDescriptorCreationVisitor::RayTracingSceneDescriptorCreationVisit
     sampler->addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     sampler->addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     sampler->anisotropyEnable = VK_FALSE;
-    sampler->maxLod = 1;
+    sampler->maxLod = 0;
     _defaultTexture = vsg::DescriptorImage::create(sampler, white, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
     _dummyBuffer = vsg::floatArray::create(1, 0.0f);
     _dummyVolume = vsg::floatArray3D::create(1,1,1, 0.0f, vsg::Data::Layout{ VK_FORMAT_R32_SFLOAT });
+    _dummyMajorants = vsg::vec2Array3D::create(1,1,1, vsg::vec2(0.0f, 0.0f), vsg::Data::Layout{ VK_FORMAT_R32G32_SFLOAT });
+    _dummyBrickTable = vsg::uintArray3D::create(1,1,1, SparseVolume::kEmptyBrick, vsg::Data::Layout{ VK_FORMAT_R32_UINT });
+    _dummyPyramid = vsg::floatArray3D::create(1,1,1, 0.0f, vsg::Data::Layout{ VK_FORMAT_R32_SFLOAT });
 }
 void RayTracingSceneDescriptorCreationVisitor::apply(vsg::Object& object)
 {
@@ -263,9 +269,9 @@ void RayTracingSceneDescriptorCreationVisitor::apply(vsg::BindDescriptorSet& bds
             setTextures.insert(6);
             // check for opaqueness
             {
+                // only the base level, the data may contain mipmaps
                 auto data = d->imageInfoList[0]->imageView->image->data;
-                //int amt = data->dataSize() / data->stride();
-                for (int i = 0; i < data->dataSize() / data->stride() && geometryType.back() == 0; ++i)
+                for (uint32_t i = 0; i < data->width() * data->height() && geometryType.back() == 0; ++i)
                 {
                     void* d = static_cast<char*>(data->dataPointer()) + i * data->stride();
                     switch (data->getLayout().format)
@@ -306,6 +312,9 @@ void RayTracingSceneDescriptorCreationVisitor::apply(vsg::BindDescriptorSet& bds
         default:
             std::cout << "Unkown texture binding: " << descriptor->dstBinding << ". Could not properly detect material" << std::endl;
         }
+        // the opaqueness check above still reads the uncompressed data
+        if (texture && textureCompressor)
+            textureCompressor->add(texture, descriptor->dstBinding == 2 ? TextureCompressor::Usage::Normal : TextureCompressor::Usage::Color);
     }
 
     //setting the default texture for not set textures
@@ -348,11 +357,47 @@ void RayTracingSceneDescriptorCreationVisitor::apply(const vsg::Light& l)
 }
 void RayTracingSceneDescriptorCreationVisitor::apply(vsg::Volumetric& vol)
 {
+    auto sparseVolume = createSparseVolume(*vol.voxels, quantizeVolumes);
+    if (!sparseVolume.atlas)
+        throw vsg::Exception{"Error: RayTracingSceneDescriptorCreationVisitor::apply(vsg::Volumetric&) unsupported voxel format."};
+    std::cout << "Sparse volume: " << sparseVolume.storedBricks << " of " << sparseVolume.brickTable->valueCount() << " bricks stored, "
+              << sparseVolume.atlas->dataSize() / (1024 * 1024) << " MB atlas instead of " << vol.voxels->dataSize() / (1024 * 1024) << " MB" << std::endl;
+
+    // the atlas is clamped as the borders of its bricks, the tables are only read with texelFetch
     auto sampler = vsg::Sampler::create();
-    auto image = vol.voxels;
+    sampler->addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler->addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler->addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    auto tableSampler = vsg::Sampler::create();
+    tableSampler->magFilter = VK_FILTER_NEAREST;
+    tableSampler->minFilter = VK_FILTER_NEAREST;
+    tableSampler->addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    tableSampler->addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    tableSampler->addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    _volume.push_back(vsg::DescriptorImage::create(sampler, sparseVolume.atlas, 30, _volume.size()));
+    _majorants.push_back(vsg::DescriptorImage::create(tableSampler, sparseVolume.majorants, 34, _majorants.size()));
+    _brickTables.push_back(vsg::DescriptorImage::create(tableSampler, sparseVolume.brickTable, 35, _brickTables.size()));
 
-    auto desc = vsg::DescriptorImage::create(sampler, image, 30, _volume.size());
-    _volume.push_back(desc);
+    // coarse levels for secondary paths, the density levels are filtered across mips, the majorants are fetched
+    auto pyramids = createVolumePyramids(*vol.voxels, *sparseVolume.majorants);
+    std::cout << "Volume pyramids: " << pyramids.levels << " levels, "
+              << (pyramids.density->dataSize() + pyramids.majorants->dataSize()) / (1024 * 1024) << " MB" << std::endl;
+    auto pyramidSampler = vsg::Sampler::create();
+    auto pyramidTableSampler = vsg::Sampler::create();
+    for (auto& s : {pyramidSampler, pyramidTableSampler})
+    {
+        s->addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        s->addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        s->addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        s->maxLod = static_cast<float>(pyramids.levels);
+    }
+    pyramidTableSampler->magFilter = VK_FILTER_NEAREST;
+    pyramidTableSampler->minFilter = VK_FILTER_NEAREST;
+    pyramidTableSampler->mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    _densityPyramids.push_back(vsg::DescriptorImage::create(pyramidSampler, pyramids.density, 37, _densityPyramids.size()));
+    _coarseMajorants.push_back(vsg::DescriptorImage::create(pyramidTableSampler, pyramids.majorants, 38, _coarseMajorants.size()));
+    _volumeInfoArray.push_back({vsg::uivec4(vol.voxels->width(), vol.voxels->height(), vol.voxels->depth(), quantizeVolumes ? 1u : 0u)});
     geometryType.push_back(2);
 }
 
@@ -389,6 +434,12 @@ void RayTracingSceneDescriptorCreationVisitor::updateDescriptor(vsg::BindDescrip
         std::copy(_materialArray.begin(), _materialArray.end(), materials->data());
         _materials = vsg::DescriptorBuffer::create(materials, 13, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
     }
+    if (!_volumeInfos)
+    {
+        auto volumeInfos = vsg::Array<VolumeInfo>::create(std::max(_volumeInfoArray.size(), size_t(1)));
+        std::copy(_volumeInfoArray.begin(), _volumeInfoArray.end(), volumeInfos->data());
+        _volumeInfos = vsg::DescriptorBuffer::create(volumeInfos, 36, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    }
     if (!_instances)
     {
         auto instances = vsg::Array<ObjectInstance>::create(std::max(_instancesArray.size(), size_t(1)));
@@ -409,6 +460,10 @@ void RayTracingSceneDescriptorCreationVisitor::updateDescriptor(vsg::BindDescrip
 
         auto dummyVoxelSampler = vsg::Sampler::create();
         if (_volume.empty()) _volume.push_back(vsg::DescriptorImage::create(dummyVoxelSampler, _dummyVolume));
+        if (_majorants.empty()) _majorants.push_back(vsg::DescriptorImage::create(dummyVoxelSampler, _dummyMajorants));
+        if (_brickTables.empty()) _brickTables.push_back(vsg::DescriptorImage::create(dummyVoxelSampler, _dummyBrickTable));
+        if (_densityPyramids.empty()) _densityPyramids.push_back(vsg::DescriptorImage::create(dummyVoxelSampler, _dummyPyramid));
+        if (_coarseMajorants.empty()) _coarseMajorants.push_back(vsg::DescriptorImage::create(dummyVoxelSampler, _dummyPyramid));
 
         // setting the descriptor amount for the object arrays
         vsg::DescriptorSetLayoutBindings& bindings = descSet->descriptorSet->setLayout->bindings;
@@ -439,12 +494,25 @@ void RayTracingSceneDescriptorCreationVisitor::updateDescriptor(vsg::BindDescrip
         int specularInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "specularMap").second;
         std::find_if(bindings.begin(), bindings.end(), [&](VkDescriptorSetLayoutBinding& b) { return b.binding == specularInd; })->
             descriptorCount = static_cast<uint32_t>(_specular.size());
-        int volumeInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "gridImage").second;
+        int volumeInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "brickAtlas").second;
         std::find_if(bindings.begin(), bindings.end(), [&](VkDescriptorSetLayoutBinding& b) { return b.binding == volumeInd; })->
                 descriptorCount = static_cast<uint32_t>(_volume.size());
+        uint32_t majorantInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "majorantGrid").second;
+        std::find_if(bindings.begin(), bindings.end(), [&](VkDescriptorSetLayoutBinding& b) { return b.binding == majorantInd; })->
+                descriptorCount = static_cast<uint32_t>(_majorants.size());
+        uint32_t brickTableInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "brickTable").second;
+        std::find_if(bindings.begin(), bindings.end(), [&](VkDescriptorSetLayoutBinding& b) { return b.binding == brickTableInd; })->
+                descriptorCount = static_cast<uint32_t>(_brickTables.size());
+        uint32_t densityPyramidInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "densityPyramid").second;
+        std::find_if(bindings.begin(), bindings.end(), [&](VkDescriptorSetLayoutBinding& b) { return b.binding == densityPyramidInd; })->
+                descriptorCount = static_cast<uint32_t>(_densityPyramids.size());
+        uint32_t coarseMajorantInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "coarseMajorants").second;
+        std::find_if(bindings.begin(), bindings.end(), [&](VkDescriptorSetLayoutBinding& b) { return b.binding == coarseMajorantInd; })->
+                descriptorCount = static_cast<uint32_t>(_coarseMajorants.size());
     int lightInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "Lights").second;
     int matInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "Materials").second;
     int instancesInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "Instances").second;
+    int volumeInfosInd = vsg::ShaderStage::getSetBindingIndex(bindingMap, "Volumes").second;
 
     //adding all descriptors and updating their binding
     vsg::Descriptors descList;
@@ -478,12 +546,34 @@ void RayTracingSceneDescriptorCreationVisitor::updateDescriptor(vsg::BindDescrip
             d->dstBinding = volumeInd;
             descList.push_back(d);
         }
+    for (auto& d : _majorants)
+        {
+            d->dstBinding = majorantInd;
+            descList.push_back(d);
+        }
+    for (auto& d : _brickTables)
+        {
+            d->dstBinding = brickTableInd;
+            descList.push_back(d);
+        }
+    for (auto& d : _densityPyramids)
+        {
+            d->dstBinding = densityPyramidInd;
+            descList.push_back(d);
+        }
+    for (auto& d : _coarseMajorants)
+        {
+            d->dstBinding = coarseMajorantInd;
+            descList.push_back(d);
+        }
         _lights->dstBinding = lightInd;
         _materials->dstBinding = matInd;
         _instances->dstBinding = instancesInd;
+        _volumeInfos->dstBinding = volumeInfosInd;
         descList.push_back(_lights);
         descList.push_back(_materials);
         descList.push_back(_instances);
+        descList.push_back(_volumeInfos);
         for (auto& d : _positions)
         {
             d->dstBinding = posInd;
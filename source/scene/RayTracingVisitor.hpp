@@ -1,5 +1,7 @@
 #pragma once
 
+#include <scene/TextureCompressor.hpp>
+
 #include <vsg/all.h>
 #include <vector>
 
@@ -26,7 +28,7 @@ public:
     //getting the lights in the scene
     void apply(const vsg::Light& l);
 
-    //uploading volume data
+    //uploading volume data as sparse brick volume
     void apply(vsg::Volumetric& vol);
 
     void updateDescriptor(vsg::BindDescriptorSet* descSet, const vsg::BindingMap& bindingMap);
@@ -35,6 +37,10 @@ public:
     std::vector<vsg::Light::PackedLight> packedLights;
     //holds information about each geometry if it is opaque, non-opaque or volumetric
     std::vector<uint32_t> geometryType;
+    //if set, the textures are queued for block compression
+    vsg::ref_ptr<TextureCompressor> textureCompressor;
+    //stores the bricks of volumes with 8 bits per voxel
+    bool quantizeVolumes = false;
 protected:
     struct ObjectInstance{
         vsg::mat4 objectMat;
@@ -42,6 +48,9 @@ protected:
         uint32_t indexStride;
         int pad[2];
     };
+    struct VolumeInfo{
+        vsg::uivec4 size;   //voxel counts, w is 1 for quantized atlases
+    };
     struct WaveFrontMaterialPacked
     {
         vsg::vec4  ambientRoughness;
@@ -61,6 +70,12 @@ protected:
     std::vector<vsg::ref_ptr<vsg::DescriptorImage>> _emissive;
     std::vector<vsg::ref_ptr<vsg::DescriptorImage>> _specular;
     std::vector<vsg::ref_ptr<vsg::DescriptorImage>> _volume;
+    std::vector<vsg::ref_ptr<vsg::DescriptorImage>> _majorants;  //one majorant grid per volume
+    std::vector<vsg::ref_ptr<vsg::DescriptorImage>> _brickTables;
+    std::vector<vsg::ref_ptr<vsg::DescriptorImage>> _densityPyramids;
+    std::vector<vsg::ref_ptr<vsg::DescriptorImage>> _coarseMajorants;
+    std::vector<VolumeInfo> _volumeInfoArray;
+    vsg::ref_ptr<vsg::DescriptorBuffer> _volumeInfos;
     //buffers are available for each geometry
     std::vector<vsg::ref_ptr<vsg::DescriptorBuffer>> _positions;
     std::vector<vsg::ref_ptr<vsg::DescriptorBuffer>> _normals;
@@ -74,7 +89,7 @@ protected:
     vsg::MatrixStack _transformStack;
 
     vsg::ref_ptr<vsg::DescriptorImage> _defaultTexture;   //the default image is used for each texture that is not available
-    vsg::ref_ptr<vsg::Data> _dummyBuffer, _dummyVolume;
+    vsg::ref_ptr<vsg::Data> _dummyBuffer, _dummyVolume, _dummyMajorants, _dummyBrickTable, _dummyPyramid;
     bool firstStageGroup = true;                        //the first state group contains the default state which should be skipped
     bool meshEmissive = false;                          //set to true by a descriptor set that has emission
 };
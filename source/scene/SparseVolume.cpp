@@ -0,0 +1,88 @@
+#include <scene/SparseVolume.hpp>
+#include <io/HalfFloat.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+SparseVolume createSparseVolume(const vsg::Data& voxels, bool quantize)
+{
+    SparseVolume volume;
+    volume.majorants = createMajorantGrid(voxels);
+    if (!volume.majorants)
+        return volume;
+
+    uint32_t sizeX = voxels.width(), sizeY = voxels.height(), sizeZ = voxels.depth();
+    uint32_t gridX = volume.majorants->width(), gridY = volume.majorants->height(), gridZ = volume.majorants->depth();
+    volume.brickTable = vsg::uintArray3D::create(gridX, gridY, gridZ, SparseVolume::kEmptyBrick, vsg::Data::Layout{VK_FORMAT_R32_UINT});
+    for (const auto& range : *volume.majorants)
+        volume.storedBricks += range.x != range.y;
+
+    // the atlas is close to a cube, 3D images are limited to 2048 texels per axis on most devices
+    const uint32_t slotSize = SparseVolume::kSlotSize;
+    uint32_t slotsX = std::max(1u, static_cast<uint32_t>(std::ceil(std::cbrt(double(volume.storedBricks)))));
+    uint32_t slotsY = slotsX;
+    uint32_t slotsZ = std::max(1u, static_cast<uint32_t>((volume.storedBricks + slotsX * slotsY - 1) / (slotsX * slotsY)));
+    uint32_t atlasX = slotsX * slotSize, atlasY = slotsY * slotSize, atlasZ = slotsZ * slotSize;
+    if (atlasX > 2048)
+        throw vsg::Exception{"Error: createSparseVolume(...) too many occupied bricks for a 3D atlas."};
+
+    bool halfVoxels = voxels.getLayout().format == VK_FORMAT_R16_SFLOAT;
+    vsg::ref_ptr<vsg::ubyteArray3D> atlas8;
+    vsg::ref_ptr<vsg::ushortArray3D> atlas16;
+    vsg::ref_ptr<vsg::floatArray3D> atlas32;
+    if (quantize)
+        volume.atlas = atlas8 = vsg::ubyteArray3D::create(atlasX, atlasY, atlasZ, uint8_t(0), vsg::Data::Layout{VK_FORMAT_R8_UNORM});
+    else if (halfVoxels)
+        volume.atlas = atlas16 = vsg::ushortArray3D::create(atlasX, atlasY, atlasZ, uint16_t(0), vsg::Data::Layout{VK_FORMAT_R16_SFLOAT});
+    else
+        volume.atlas = atlas32 = vsg::floatArray3D::create(atlasX, atlasY, atlasZ, 0.0f, vsg::Data::Layout{VK_FORMAT_R32_SFLOAT});
+
+    const auto* halfs = static_cast<const uint16_t*>(voxels.dataPointer());
+    const auto* floats = static_cast<const float*>(voxels.dataPointer());
+    auto clampIndex = [](int64_t index, uint32_t size) { return static_cast<uint32_t>(std::clamp<int64_t>(index, 0, size - 1)); };
+
+    uint32_t slot = 0;
+    for (uint32_t cz = 0; cz < gridZ; ++cz)
+    {
+        for (uint32_t cy = 0; cy < gridY; ++cy)
+        {
+            for (uint32_t cx = 0; cx < gridX; ++cx)
+            {
+                vsg::vec2 range = volume.majorants->at(cx, cy, cz);
+                if (range.x == range.y)
+                    continue;
+                uint32_t sx = slot % slotsX, sy = (slot / slotsX) % slotsY, sz = slot / (slotsX * slotsY);
+                volume.brickTable->at(cx, cy, cz) = sx | (sy << 10) | (sz << 20);
+                ++slot;
+
+                // the border repeats the edge voxels of the volume like a clamping sampler
+                float scale = 255.0f / (range.y - range.x);
+                for (uint32_t z = 0; z < slotSize; ++z)
+                {
+                    uint32_t vz = clampIndex(int64_t(cz) * kMajorantCellSize + z - SparseVolume::kBrickBorder, sizeZ);
+                    for (uint32_t y = 0; y < slotSize; ++y)
+                    {
+                        uint32_t vy = clampIndex(int64_t(cy) * kMajorantCellSize + y - SparseVolume::kBrickBorder, sizeY);
+                        size_t row = (size_t(vz) * sizeY + vy) * sizeX;
+                        for (uint32_t x = 0; x < slotSize; ++x)
+                        {
+                            size_t index = row + clampIndex(int64_t(cx) * kMajorantCellSize + x - SparseVolume::kBrickBorder, sizeX);
+                            uint32_t ax = sx * slotSize + x, ay = sy * slotSize + y, az = sz * slotSize + z;
+                            if (atlas16)
+                                atlas16->at(ax, ay, az) = halfs[index];
+                            else if (atlas32)
+                                atlas32->at(ax, ay, az) = floats[index];
+                            else
+                            {
+                                float density = halfVoxels ? halfToFloat(halfs[index]) : floats[index];
+                                atlas8->at(ax, ay, az) = static_cast<uint8_t>(std::clamp(std::lround((density - range.x) * scale), 0l, 255l));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return volume;
+}
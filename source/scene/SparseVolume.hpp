@@ -0,0 +1,28 @@
+#pragma once
+
+#include <scene/VolumeMajorants.hpp>
+
+#include <vsg/all.h>
+
+#include <cstdint>
+
+// Sparse brick representation of a density volume -----------------------------------
+// The volume is split into bricks that match the cells of its majorant grid. Bricks with a constant density, which
+// includes the empty ones, are dropped and sampled from the majorant grid. The others are copied with a border of one
+// voxel into slots of a 3D atlas, so that trilinear filtering inside a brick matches the dense volume. The brick
+// table holds the packed atlas slot of each brick (10 bits per axis) or kEmptyBrick. Quantized atlases store 8 bit
+// values relative to the majorant range of the brick.
+struct SparseVolume
+{
+    static const uint32_t kEmptyBrick = 0xFFFFFFFFu;
+    static const uint32_t kBrickBorder = 1;
+    static const uint32_t kSlotSize = kMajorantCellSize + 2 * kBrickBorder;
+
+    vsg::ref_ptr<vsg::Data> atlas;              // R8_UNORM if quantized, otherwise the format of the voxels
+    vsg::ref_ptr<vsg::uintArray3D> brickTable;  // R32_UINT
+    vsg::ref_ptr<vsg::vec2Array3D> majorants;
+    size_t storedBricks = 0;
+};
+
+// voxels have to be R32_SFLOAT or R16_SFLOAT, returns an empty atlas for other data
+SparseVolume createSparseVolume(const vsg::Data& voxels, bool quantize);
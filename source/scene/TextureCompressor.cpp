@@ -0,0 +1,523 @@
+#include <scene/TextureCompressor.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+    // has to be increased whenever the encoded output changes, invalidates the disk cache
+    const uint32_t kEncoderVersion = 1;
+
+    using Block = std::array<std::array<uint8_t, 4>, 16>;
+
+    bool isCompressible(const vsg::Data& image)
+    {
+        auto format = image.getLayout().format;
+        if (format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB && format != VK_FORMAT_B8G8R8A8_UNORM)
+            return false;
+        return image.stride() == 4 && image.depth() == 1 && image.width() >= 4 && image.height() >= 4 && image.width() % 4 == 0 && image.height() % 4 == 0;
+    }
+
+    // little endian bit writer for one block
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(uint8_t* out, size_t size) :
+            out(out) { std::memset(out, 0, size); }
+        void write(uint32_t value, uint32_t bits)
+        {
+            for (uint32_t i = 0; i < bits; ++i, ++position)
+                out[position / 8] |= ((value >> i) & 1u) << (position % 8);
+        }
+
+    private:
+        uint8_t* out;
+        uint32_t position = 0;
+    };
+
+    void encodeBC4Block(const Block& block, int channel, uint8_t* out)
+    {
+        uint8_t minValue = 255, maxValue = 0;
+        for (const auto& pixel : block)
+        {
+            minValue = std::min(minValue, pixel[channel]);
+            maxValue = std::max(maxValue, pixel[channel]);
+        }
+        // endpoint 0 > endpoint 1 selects the 8 value palette, equal endpoints decode to the endpoint for index 0
+        std::array<int, 8> palette{maxValue, minValue};
+        for (int i = 2; i < 8; ++i)
+            palette[i] = ((8 - i) * maxValue + (i - 1) * minValue + 3) / 7;
+
+        BitWriter writer(out, 8);
+        writer.write(maxValue, 8);
+        writer.write(minValue, 8);
+        for (const auto& pixel : block)
+        {
+            uint32_t best = 0;
+            int bestError = 256;
+            for (uint32_t i = 0; i < 8 && maxValue != minValue; ++i)
+            {
+                int error = std::abs(palette[i] - pixel[channel]);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = i;
+                }
+            }
+            writer.write(best, 3);
+        }
+    }
+
+    // BC7 mode 6: one subset, RGBA endpoints with 7 bits and a p-bit each, 4 bit indices
+    const std::array<int, 16> kBC7Weights{0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    struct BC7Endpoint
+    {
+        std::array<int, 4> quantized; // 7 bits
+        int pBit;
+        std::array<int, 4> decoded() const
+        {
+            return {quantized[0] << 1 | pBit, quantized[1] << 1 | pBit, quantized[2] << 1 | pBit, quantized[3] << 1 | pBit};
+        }
+    };
+
+    // opaque blocks keep the p-bit at 1, so that the alpha decodes to exactly 255
+    BC7Endpoint quantizeBC7Endpoint(const std::array<float, 4>& value, bool opaque)
+    {
+        BC7Endpoint best{};
+        float bestError = INFINITY;
+        for (int pBit = opaque ? 1 : 0; pBit < 2; ++pBit)
+        {
+            BC7Endpoint endpoint{};
+            endpoint.pBit = pBit;
+            float error = 0;
+            for (int c = 0; c < 4; ++c)
+            {
+                endpoint.quantized[c] = std::clamp(static_cast<int>(std::lround((value[c] - pBit) / 2.0f)), 0, 127);
+                float difference = float(endpoint.quantized[c] << 1 | pBit) - value[c];
+                error += difference * difference;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                best = endpoint;
+            }
+        }
+        return best;
+    }
+
+    // chooses the closest palette entry per pixel, returns the squared error of the block
+    int findBC7Indices(const Block& block, const BC7Endpoint& e0, const BC7Endpoint& e1, std::array<int, 16>& indices)
+    {
+        auto a = e0.decoded(), b = e1.decoded();
+        std::array<std::array<int, 4>, 16> palette;
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 4; ++c)
+                palette[i][c] = ((64 - kBC7Weights[i]) * a[c] + kBC7Weights[i] * b[c] + 32) >> 6;
+
+        int totalError = 0;
+        for (int p = 0; p < 16; ++p)
+        {
+            int bestError = INT32_MAX;
+            for (int i = 0; i < 16; ++i)
+            {
+                int error = 0;
+                for (int c = 0; c < 4; ++c)
+                {
+                    int difference = palette[i][c] - block[p][c];
+                    error += difference * difference;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    indices[p] = i;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    void encodeBC7Block(const Block& block, uint8_t* out)
+    {
+        bool opaque = std::all_of(block.begin(), block.end(), [](const auto& pixel) { return pixel[3] == 255; });
+
+        // endpoints on the principal axis of the block colours
+        std::array<float, 4> mean{};
+        for (const auto& pixel : block)
+            for (int c = 0; c < 4; ++c)
+                mean[c] += pixel[c] / 16.0f;
+        float covariance[4][4] = {};
+        for (const auto& pixel : block)
+            for (int i = 0; i < 4; ++i)
+                for (int j = 0; j < 4; ++j)
+                    covariance[i][j] += (pixel[i] - mean[i]) * (pixel[j] - mean[j]);
+        std::array<float, 4> axis{1, 1, 1, 1};
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            std::array<float, 4> next{};
+            for (int i = 0; i < 4; ++i)
+                for (int j = 0; j < 4; ++j)
+                    next[i] += covariance[i][j] * axis[j];
+            float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+            if (length < 1e-6f)
+                break;
+            for (int i = 0; i < 4; ++i)
+                axis[i] = next[i] / length;
+        }
+        float minT = INFINITY, maxT = -INFINITY;
+        for (const auto& pixel : block)
+        {
+            float t = 0;
+            for (int c = 0; c < 4; ++c)
+                t += (pixel[c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        std::array<float, 4> start, end;
+        for (int c = 0; c < 4; ++c)
+        {
+            start[c] = std::clamp(mean[c] + minT * axis[c], 0.0f, 255.0f);
+            end[c] = std::clamp(mean[c] + maxT * axis[c], 0.0f, 255.0f);
+        }
+        BC7Endpoint e0 = quantizeBC7Endpoint(start, opaque), e1 = quantizeBC7Endpoint(end, opaque);
+        std::array<int, 16> indices;
+        int error = findBC7Indices(block, e0, e1, indices);
+
+        // one least squares refit of the endpoints to the chosen weights
+        float aa = 0, ab = 0, bb = 0;
+        std::array<float, 4> xa{}, xb{};
+        for (int p = 0; p < 16; ++p)
+        {
+            float w = kBC7Weights[indices[p]] / 64.0f;
+            aa += (1 - w) * (1 - w);
+            ab += (1 - w) * w;
+            bb += w * w;
+            for (int c = 0; c < 4; ++c)
+            {
+                xa[c] += (1 - w) * block[p][c];
+                xb[c] += w * block[p][c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::abs(determinant) > 1e-6f)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                start[c] = std::clamp((bb * xa[c] - ab * xb[c]) / determinant, 0.0f, 255.0f);
+                end[c] = std::clamp((aa * xb[c] - ab * xa[c]) / determinant, 0.0f, 255.0f);
+            }
+            BC7Endpoint r0 = quantizeBC7Endpoint(start, opaque), r1 = quantizeBC7Endpoint(end, opaque);
+            std::array<int, 16> refitIndices;
+            if (findBC7Indices(block, r0, r1, refitIndices) < error)
+            {
+                e0 = r0;
+                e1 = r1;
+                indices = refitIndices;
+            }
+        }
+
+        // the most significant bit of the first index is implicit zero
+        if (indices[0] >= 8)
+        {
+            std::swap(e0, e1);
+            for (auto& index : indices)
+                index = 15 - index;
+        }
+
+        BitWriter writer(out, 16);
+        writer.write(1u << 6, 7);
+        for (int c = 0; c < 4; ++c)
+        {
+            writer.write(e0.quantized[c], 7);
+            writer.write(e1.quantized[c], 7);
+        }
+        writer.write(e0.pBit, 1);
+        writer.write(e1.pBit, 1);
+        writer.write(indices[0], 3);
+        for (int p = 1; p < 16; ++p)
+            writer.write(indices[p], 4);
+    }
+
+    // 2x2 box filter, odd sizes repeat the last row or column
+    std::vector<uint8_t> downsample(const std::vector<uint8_t>& source, uint32_t width, uint32_t height)
+    {
+        uint32_t targetWidth = std::max(width / 2, 1u), targetHeight = std::max(height / 2, 1u);
+        std::vector<uint8_t> target(targetWidth * targetHeight * 4);
+        for (uint32_t y = 0; y < targetHeight; ++y)
+        {
+            uint32_t y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (uint32_t x = 0; x < targetWidth; ++x)
+            {
+                uint32_t x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                for (int c = 0; c < 4; ++c)
+                {
+                    uint32_t sum = source[(y0 * width + x0) * 4 + c] + source[(y0 * width + x1) * 4 + c] +
+                                   source[(y1 * width + x0) * 4 + c] + source[(y1 * width + x1) * 4 + c];
+                    target[(y * targetWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+        return target;
+    }
+
+    vsg::ref_ptr<vsg::Sampler> copySampler(const vsg::Sampler* source, float maxLod)
+    {
+        auto sampler = vsg::Sampler::create();
+        if (source)
+        {
+            sampler->magFilter = source->magFilter;
+            sampler->minFilter = source->minFilter;
+            sampler->mipmapMode = source->mipmapMode;
+            sampler->addressModeU = source->addressModeU;
+            sampler->addressModeV = source->addressModeV;
+            sampler->addressModeW = source->addressModeW;
+            sampler->anisotropyEnable = source->anisotropyEnable;
+            sampler->maxAnisotropy = source->maxAnisotropy;
+        }
+        sampler->maxLod = maxLod;
+        return sampler;
+    }
+}
+
+class TextureCompressor::EncodeOperation : public vsg::Inherit<vsg::Operation, TextureCompressor::EncodeOperation>
+{
+public:
+    EncodeOperation(const TextureCompressor* compressor, Entry* entry, vsg::ref_ptr<vsg::Latch> latch) :
+        compressor(compressor), entry(entry), latch(latch) {}
+
+    void run() override
+    {
+        compressor->encodeEntry(*entry);
+        latch->count_down();
+    }
+
+private:
+    const TextureCompressor* compressor; // compress() waits for all operations
+    Entry* entry;
+    vsg::ref_ptr<vsg::Latch> latch;
+};
+
+TextureCompressor::TextureCompressor(const std::string& cacheDirectory, uint32_t numThreads) :
+    cacheDirectory(cacheDirectory),
+    numThreads(numThreads ? numThreads : std::max(1u, std::thread::hardware_concurrency()))
+{
+    if (!cacheDirectory.empty())
+    {
+        std::error_code errorCode;
+        std::filesystem::create_directories(cacheDirectory, errorCode);
+    }
+}
+
+void TextureCompressor::add(vsg::ref_ptr<vsg::DescriptorImage> texture, Usage usage)
+{
+    auto& imageInfo = texture->imageInfoList[0];
+    if (!imageInfo || !imageInfo->imageView || !imageInfo->imageView->image || !imageInfo->imageView->image->data)
+        return;
+    auto& entry = entries[{imageInfo->imageView->image->data.get(), usage}];
+    if (!entry.source)
+    {
+        entry.source = imageInfo;
+        entry.usage = usage;
+    }
+    if (entry.compressed)
+        texture->imageInfoList = {entry.compressed};
+    else if (!entry.done)
+        entry.textures.push_back(texture);
+}
+
+void TextureCompressor::compress()
+{
+    std::vector<Entry*> pending;
+    for (auto& [key, entry] : entries)
+        if (!entry.done)
+            pending.push_back(&entry);
+    if (pending.empty())
+        return;
+
+    auto threads = vsg::OperationThreads::create(numThreads);
+    auto latch = vsg::Latch::create(static_cast<int>(pending.size()));
+    for (auto* entry : pending)
+        threads->add(EncodeOperation::create(this, entry, latch));
+    threads->run();
+    latch->wait();
+
+    size_t sourceSize = 0, compressedSize = 0, compressedCount = 0, cachedCount = 0;
+    for (auto* entry : pending)
+    {
+        entry->done = true;
+        if (entry->data)
+        {
+            const auto& source = *entry->source->imageView->image->data;
+            sourceSize += source.width() * source.height() * source.stride();
+            compressedSize += entry->data->dataSize();
+            ++compressedCount;
+            cachedCount += entry->fromCache;
+
+            entry->compressed = vsg::ImageInfo::create(copySampler(entry->source->sampler.get(), float(entry->data->getLayout().maxNumMipmaps)), entry->data);
+            auto& components = entry->compressed->imageView->components;
+            if (entry->data->getLayout().format == VK_FORMAT_BC4_UNORM_BLOCK)
+                components = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_ONE};
+            else if (entry->data->getLayout().format == VK_FORMAT_BC5_UNORM_BLOCK)
+                components = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_ONE};
+            for (auto& texture : entry->textures)
+                texture->imageInfoList = {entry->compressed};
+        }
+        entry->textures.clear();
+        entry->data = {};
+    }
+    std::cout << "Compressed " << compressedCount << " of " << pending.size() << " textures (" << cachedCount << " from cache), "
+              << sourceSize / (1024 * 1024) << " MB base level to " << compressedSize / (1024 * 1024) << " MB with mipmaps" << std::endl;
+}
+
+void TextureCompressor::encodeEntry(Entry& entry) const
+{
+    const auto& source = *entry.source->imageView->image->data;
+    if (!isCompressible(source))
+        return;
+
+    std::filesystem::path cachePath;
+    if (!cacheDirectory.empty())
+    {
+        char filename[32];
+        std::snprintf(filename, sizeof(filename), "%016llx.vsgb", static_cast<unsigned long long>(hash(source, entry.usage)));
+        cachePath = std::filesystem::path(cacheDirectory) / filename;
+        std::error_code errorCode;
+        if (std::filesystem::exists(cachePath, errorCode))
+        {
+            auto cached = vsg::read_cast<vsg::Data>(cachePath.string());
+            if (cached && cached->width() * 4 == source.width() && cached->height() * 4 == source.height())
+            {
+                entry.data = cached;
+                entry.fromCache = true;
+                return;
+            }
+        }
+    }
+
+    entry.data = encode(source, entry.usage);
+    if (entry.data && !cachePath.empty())
+    {
+        // written to a temporary file first, equal textures may be encoded by several threads
+        auto temporaryPath = cachePath;
+        temporaryPath.replace_filename(cachePath.stem().string() + "-" + std::to_string(reinterpret_cast<uintptr_t>(&entry)) + ".tmp.vsgb");
+        std::error_code errorCode;
+        if (vsg::write(entry.data, temporaryPath.string()))
+            std::filesystem::rename(temporaryPath, cachePath, errorCode);
+        if (errorCode)
+            std::filesystem::remove(temporaryPath, errorCode);
+    }
+}
+
+vsg::ref_ptr<vsg::Data> TextureCompressor::encode(const vsg::Data& image, Usage usage)
+{
+    if (!isCompressible(image))
+        return {};
+
+    uint32_t width = image.width(), height = image.height();
+    // mip levels of the source are used where present, see MipmapGenerator, missing ones are box filtered
+    auto sourceOffsets = image.computeMipmapOffsets();
+    bool swapRedBlue = image.getLayout().format == VK_FORMAT_B8G8R8A8_UNORM;
+    auto loadLevel = [&](uint32_t levelIndex) {
+        uint32_t levelWidth = std::max(width >> levelIndex, 1u), levelHeight = std::max(height >> levelIndex, 1u);
+        std::vector<uint8_t> texels(levelWidth * levelHeight * 4);
+        std::memcpy(texels.data(), image.dataPointer(sourceOffsets[levelIndex]), texels.size());
+        if (swapRedBlue)
+            for (size_t i = 0; i < texels.size(); i += 4)
+                std::swap(texels[i], texels[i + 2]);
+        return texels;
+    };
+    std::vector<uint8_t> level = loadLevel(0);
+    bool grey = usage == Usage::Color;
+    for (size_t i = 0; i < level.size() && grey; i += 4)
+        grey = level[i] == level[i + 1] && level[i] == level[i + 2] && level[i + 3] == 255;
+
+    vsg::Data::Layout layout;
+    layout.format = usage == Usage::Normal ? VK_FORMAT_BC5_UNORM_BLOCK : grey ? VK_FORMAT_BC4_UNORM_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    layout.blockWidth = 4;
+    layout.blockHeight = 4;
+    size_t blockSize = layout.format == VK_FORMAT_BC4_UNORM_BLOCK ? 8 : 16;
+
+    // mip levels as computed by vsg::Data for the block counts
+    uint32_t blocksX = width / 4, blocksY = height / 4;
+    uint32_t levelCount = 1;
+    size_t blockCount = blocksX * blocksY;
+    for (uint32_t x = blocksX, y = blocksY; x > 1 || y > 1; ++levelCount)
+    {
+        x = std::max(x / 2, 1u);
+        y = std::max(y / 2, 1u);
+        blockCount += x * y;
+    }
+    layout.maxNumMipmaps = levelCount;
+
+    vsg::block64* blocks64 = blockSize == 8 ? new vsg::block64[blockCount] : nullptr;
+    vsg::block128* blocks128 = blockSize == 16 ? new vsg::block128[blockCount] : nullptr;
+    uint8_t* out = blocks64 ? blocks64[0] : blocks128[0];
+    uint32_t levelWidth = width, levelHeight = height;
+    for (uint32_t levelIndex = 0; levelIndex < levelCount; ++levelIndex)
+    {
+        uint32_t levelBlocksX = std::max(blocksX >> levelIndex, 1u), levelBlocksY = std::max(blocksY >> levelIndex, 1u);
+        for (uint32_t by = 0; by < levelBlocksY; ++by)
+        {
+            for (uint32_t bx = 0; bx < levelBlocksX; ++bx, out += blockSize)
+            {
+                // levels smaller than a block repeat their last row and column
+                Block block;
+                for (uint32_t p = 0; p < 16; ++p)
+                {
+                    uint32_t x = std::min(bx * 4 + p % 4, levelWidth - 1), y = std::min(by * 4 + p / 4, levelHeight - 1);
+                    std::memcpy(block[p].data(), &level[(y * levelWidth + x) * 4], 4);
+                }
+                if (layout.format == VK_FORMAT_BC7_UNORM_BLOCK)
+                    encodeBC7Block(block, out);
+                else if (layout.format == VK_FORMAT_BC4_UNORM_BLOCK)
+                    encodeBC4Block(block, 0, out);
+                else
+                {
+                    encodeBC4Block(block, 0, out);
+                    encodeBC4Block(block, 1, out + 8);
+                }
+            }
+        }
+        if (levelIndex + 1 < levelCount)
+        {
+            level = levelIndex + 1 < sourceOffsets.size() ? loadLevel(levelIndex + 1) : downsample(level, levelWidth, levelHeight);
+            levelWidth = std::max(levelWidth / 2, 1u);
+            levelHeight = std::max(levelHeight / 2, 1u);
+        }
+    }
+
+    if (blocks64)
+        return vsg::block64Array2D::create(blocksX, blocksY, blocks64, layout);
+    return vsg::block128Array2D::create(blocksX, blocksY, blocks128, layout);
+}
+
+uint64_t TextureCompressor::hash(const vsg::Data& image, Usage usage)
+{
+    // FNV-1a over 64 bit words
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t value = 0xcbf29ce484222325ull;
+    auto add = [&](uint64_t word) { value = (value ^ word) * prime; };
+    add(kEncoderVersion);
+    add(static_cast<uint64_t>(usage));
+    add(image.getLayout().format);
+    add(image.width());
+    add(image.height());
+    const auto* bytes = static_cast<const uint8_t*>(image.dataPointer());
+    size_t size = image.dataSize(), i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        add(word);
+    }
+    for (; i < size; ++i)
+        add(bytes[i]);
+    return value;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vsg/all.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Block compression of the ray tracing textures --------------------------------------
+// Colour textures are encoded to BC7, or to BC4 with a grey swizzle if they are grey and opaque. Normal maps are
+// encoded to BC5, the ray tracing shaders reconstruct the z component. Each unique texture is encoded once with its
+// mip chain on a pool of worker threads. With a cache directory the results are stored as .vsgb files keyed by a
+// hash of the source texels, so later runs only load them.
+class TextureCompressor : public vsg::Inherit<vsg::Object, TextureCompressor>
+{
+public:
+    enum class Usage
+    {
+        Color,
+        Normal
+    };
+
+    // an empty cache directory disables the disk cache
+    explicit TextureCompressor(const std::string& cacheDirectory = {}, uint32_t numThreads = 0);
+
+    // queues a texture of the ray tracing descriptors, compress() replaces its image info by the compressed one
+    void add(vsg::ref_ptr<vsg::DescriptorImage> texture, Usage usage);
+    // encodes or loads all queued textures. Textures that can not be compressed stay unchanged
+    void compress();
+
+    // encodes RGBA8 data whose width and height are multiples of 4, returns an empty ref_ptr for other data
+    static vsg::ref_ptr<vsg::Data> encode(const vsg::Data& image, Usage usage);
+    static uint64_t hash(const vsg::Data& image, Usage usage);
+
+private:
+    class EncodeOperation;
+    struct Entry
+    {
+        vsg::ref_ptr<vsg::ImageInfo> source;
+        Usage usage;
+        bool done = false;
+        bool fromCache = false;
+        vsg::ref_ptr<vsg::Data> data;
+        vsg::ref_ptr<vsg::ImageInfo> compressed;
+        std::vector<vsg::ref_ptr<vsg::DescriptorImage>> textures;
+    };
+
+    void encodeEntry(Entry& entry) const;
+
+    std::string cacheDirectory;
+    uint32_t numThreads;
+    // entries stay after compress(), pipelines that are created again reuse the compressed images
+    std::map<std::pair<const vsg::Data*, Usage>, Entry> entries;
+};
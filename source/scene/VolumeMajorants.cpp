@@ -0,0 +1,63 @@
+#include <scene/VolumeMajorants.hpp>
+#include <io/HalfFloat.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+vsg::ref_ptr<vsg::vec2Array3D> createMajorantGrid(const vsg::Data& voxels)
+{
+    auto format = voxels.getLayout().format;
+    if (format != VK_FORMAT_R32_SFLOAT && format != VK_FORMAT_R16_SFLOAT)
+        return {};
+    uint32_t sizeX = voxels.width(), sizeY = voxels.height(), sizeZ = voxels.depth();
+    uint32_t gridX = (sizeX + kMajorantCellSize - 1) / kMajorantCellSize;
+    uint32_t gridY = (sizeY + kMajorantCellSize - 1) / kMajorantCellSize;
+    uint32_t gridZ = (sizeZ + kMajorantCellSize - 1) / kMajorantCellSize;
+
+    // half volumes are converted once
+    std::vector<float> converted;
+    const auto* density = static_cast<const float*>(voxels.dataPointer());
+    if (format == VK_FORMAT_R16_SFLOAT)
+    {
+        converted.resize(size_t(sizeX) * sizeY * sizeZ);
+        const auto* halfs = static_cast<const uint16_t*>(voxels.dataPointer());
+        for (size_t i = 0; i < converted.size(); ++i)
+            converted[i] = halfToFloat(halfs[i]);
+        density = converted.data();
+    }
+
+    auto grid = vsg::vec2Array3D::create(gridX, gridY, gridZ, vsg::Data::Layout{VK_FORMAT_R32G32_SFLOAT});
+    // trilinear filtering inside a cell reads one voxel across its borders, so the voxel ranges of neighbouring
+    // cells overlap
+    auto range = [](uint32_t cell, uint32_t size) {
+        return std::make_pair(cell * kMajorantCellSize == 0 ? 0u : cell * kMajorantCellSize - 1,
+                              std::min((cell + 1) * kMajorantCellSize, size - 1));
+    };
+    for (uint32_t cz = 0; cz < gridZ; ++cz)
+    {
+        auto [z0, z1] = range(cz, sizeZ);
+        for (uint32_t cy = 0; cy < gridY; ++cy)
+        {
+            auto [y0, y1] = range(cy, sizeY);
+            for (uint32_t cx = 0; cx < gridX; ++cx)
+            {
+                auto [x0, x1] = range(cx, sizeX);
+                float minValue = std::numeric_limits<float>::max(), maxValue = std::numeric_limits<float>::lowest();
+                for (uint32_t z = z0; z <= z1; ++z)
+                {
+                    for (uint32_t y = y0; y <= y1; ++y)
+                    {
+                        const float* row = density + (size_t(z) * sizeY + y) * sizeX;
+                        auto [rowMin, rowMax] = std::minmax_element(row + x0, row + x1 + 1);
+                        minValue = std::min(minValue, *rowMin);
+                        maxValue = std::max(maxValue, *rowMax);
+                    }
+                }
+                grid->at(cx, cy, cz) = vsg::vec2(minValue, maxValue);
+            }
+        }
+    }
+    return grid;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <vsg/all.h>
+
+#include <cstdint>
+
+// Majorant grid of a density volume -------------------------------------------------
+// Each cell of the grid covers kMajorantCellSize^3 voxels and stores the minimum and maximum density (RG32) that
+// trilinear filtering can return inside the cell, so the range includes the voxels of the neighbouring border.
+// The volume shaders use the maximum as local majorant for delta tracking and skip empty cells. The cell size has
+// to match c_MajorantCellSize in cloud.rchit.
+const uint32_t kMajorantCellSize = 8;
+
+// voxels have to be R32_SFLOAT or R16_SFLOAT, returns an empty ref_ptr for other data
+vsg::ref_ptr<vsg::vec2Array3D> createMajorantGrid(const vsg::Data& voxels);
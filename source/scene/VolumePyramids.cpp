@@ -0,0 +1,160 @@
+#include <scene/VolumePyramids.hpp>
+#include <scene/VolumeMajorants.hpp>
+#include <io/HalfFloat.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+    uint32_t roundUp(uint32_t value, uint32_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    // offsets of the levels of a mip chain whose sizes halve exactly
+    std::vector<size_t> levelOffsets(const vsg::uivec3& size, uint32_t levels)
+    {
+        std::vector<size_t> offsets;
+        size_t offset = 0;
+        for (uint32_t level = 0; level < levels; ++level)
+        {
+            offsets.push_back(offset);
+            offset += size_t(size.x >> level) * (size.y >> level) * (size.z >> level);
+        }
+        offsets.push_back(offset);
+        return offsets;
+    }
+
+    // combines the 2x2x2 children of each texel of the next level
+    template<typename Combine>
+    void reduceLevel(const float* source, const vsg::uivec3& sourceSize, float* target, Combine combine)
+    {
+        uint32_t sizeX = sourceSize.x / 2, sizeY = sourceSize.y / 2, sizeZ = sourceSize.z / 2;
+        auto at = [&](uint32_t x, uint32_t y, uint32_t z) { return source[(size_t(z) * sourceSize.y + y) * sourceSize.x + x]; };
+        for (uint32_t z = 0; z < sizeZ; ++z)
+            for (uint32_t y = 0; y < sizeY; ++y)
+                for (uint32_t x = 0; x < sizeX; ++x)
+                    *target++ = combine(combine(combine(at(2 * x, 2 * y, 2 * z), at(2 * x + 1, 2 * y, 2 * z)),
+                                                combine(at(2 * x, 2 * y + 1, 2 * z), at(2 * x + 1, 2 * y + 1, 2 * z))),
+                                        combine(combine(at(2 * x, 2 * y, 2 * z + 1), at(2 * x + 1, 2 * y, 2 * z + 1)),
+                                                combine(at(2 * x, 2 * y + 1, 2 * z + 1), at(2 * x + 1, 2 * y + 1, 2 * z + 1))));
+    }
+
+    // maximum over the 3x3x3 neighbourhood of each cell, one axis after another
+    void dilate(const float* source, const vsg::uivec3& size, float* target)
+    {
+        std::vector<float> current(source, source + size_t(size.x) * size.y * size.z), next(current.size());
+        const size_t strides[3] = {1, size.x, size_t(size.x) * size.y};
+        const uint32_t sizes[3] = {size.x, size.y, size.z};
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (size_t i = 0; i < current.size(); ++i)
+            {
+                uint32_t coordinate = static_cast<uint32_t>(i / strides[axis] % sizes[axis]);
+                float value = current[i];
+                if (coordinate > 0) value = std::max(value, current[i - strides[axis]]);
+                if (coordinate + 1 < sizes[axis]) value = std::max(value, current[i + strides[axis]]);
+                next[i] = value;
+            }
+            std::swap(current, next);
+        }
+        std::copy(current.begin(), current.end(), target);
+    }
+}
+
+VolumePyramids createVolumePyramids(const vsg::Data& voxels, const vsg::vec2Array3D& majorantGrid)
+{
+    VolumePyramids pyramids;
+    auto format = voxels.getLayout().format;
+    if (format != VK_FORMAT_R32_SFLOAT && format != VK_FORMAT_R16_SFLOAT)
+        return pyramids;
+    uint32_t sizeX = voxels.width(), sizeY = voxels.height(), sizeZ = voxels.depth();
+    vsg::uivec3 blocks((sizeX + kPyramidBlockSize - 1) / kPyramidBlockSize, (sizeY + kPyramidBlockSize - 1) / kPyramidBlockSize,
+                       (sizeZ + kPyramidBlockSize - 1) / kPyramidBlockSize);
+    uint32_t minBlocks = std::min({blocks.x, blocks.y, blocks.z});
+    uint32_t coarsest = 0;
+    while (coarsest + 1 < kMaxPyramidLevels && (2u << coarsest) <= minBlocks)
+        ++coarsest;
+    pyramids.levels = coarsest + 1;
+    uint32_t multiple = 1u << coarsest;
+
+    // averages of the voxel blocks, accumulated slice by slice so the voxels are read in memory order
+    vsg::uivec3 densitySize(roundUp(blocks.x, multiple), roundUp(blocks.y, multiple), roundUp(blocks.z, multiple));
+    auto densityOffsets = levelOffsets(densitySize, pyramids.levels);
+    auto* density = new float[densityOffsets.back()];
+    const auto* halfs = static_cast<const uint16_t*>(voxels.dataPointer());
+    const auto* floats = static_cast<const float*>(voxels.dataPointer());
+    std::vector<double> sums(size_t(blocks.x) * blocks.y);
+    for (uint32_t bz = 0; bz < blocks.z; ++bz)
+    {
+        std::fill(sums.begin(), sums.end(), 0.0);
+        uint32_t z0 = bz * kPyramidBlockSize, z1 = std::min(z0 + kPyramidBlockSize, sizeZ);
+        for (uint32_t z = z0; z < z1; ++z)
+        {
+            for (uint32_t y = 0; y < sizeY; ++y)
+            {
+                size_t row = (size_t(z) * sizeY + y) * sizeX;
+                double* blockRow = sums.data() + size_t(y / kPyramidBlockSize) * blocks.x;
+                for (uint32_t x = 0; x < sizeX; ++x)
+                    blockRow[x / kPyramidBlockSize] += format == VK_FORMAT_R16_SFLOAT ? halfToFloat(halfs[row + x]) : floats[row + x];
+            }
+        }
+        for (uint32_t by = 0; by < blocks.y; ++by)
+        {
+            uint32_t countY = std::min((by + 1) * kPyramidBlockSize, sizeY) - by * kPyramidBlockSize;
+            for (uint32_t bx = 0; bx < blocks.x; ++bx)
+            {
+                uint32_t countX = std::min((bx + 1) * kPyramidBlockSize, sizeX) - bx * kPyramidBlockSize;
+                density[(size_t(bz) * densitySize.y + by) * densitySize.x + bx] =
+                    static_cast<float>(sums[size_t(by) * blocks.x + bx] / (double(countX) * countY * (z1 - z0)));
+            }
+        }
+    }
+    // the padding repeats the edge blocks like a clamping sampler
+    for (uint32_t z = 0; z < densitySize.z; ++z)
+    {
+        for (uint32_t y = 0; y < densitySize.y; ++y)
+        {
+            if (z < blocks.z && y < blocks.y)
+            {
+                float* row = density + (size_t(z) * densitySize.y + y) * densitySize.x;
+                std::fill(row + blocks.x, row + densitySize.x, row[blocks.x - 1]);
+                continue;
+            }
+            const float* source = density + (size_t(std::min(z, blocks.z - 1)) * densitySize.y + std::min(y, blocks.y - 1)) * densitySize.x;
+            std::copy(source, source + densitySize.x, density + (size_t(z) * densitySize.y + y) * densitySize.x);
+        }
+    }
+    for (uint32_t level = 1; level < pyramids.levels; ++level)
+        reduceLevel(density + densityOffsets[level - 1], densitySize / (1u << (level - 1)), density + densityOffsets[level],
+                    [](float a, float b) { return 0.5f * (a + b); });
+
+    // maxima of the majorant grid, cells outside of the volume are empty
+    vsg::uivec3 gridSize(majorantGrid.width(), majorantGrid.height(), majorantGrid.depth());
+    vsg::uivec3 majorantSize(roundUp(gridSize.x, multiple), roundUp(gridSize.y, multiple), roundUp(gridSize.z, multiple));
+    auto majorantOffsets = levelOffsets(majorantSize, pyramids.levels);
+    auto* majorants = new float[majorantOffsets.back()];
+    std::vector<float> maxima(majorantOffsets[1], 0.0f), coarser;
+    for (uint32_t z = 0; z < gridSize.z; ++z)
+        for (uint32_t y = 0; y < gridSize.y; ++y)
+            for (uint32_t x = 0; x < gridSize.x; ++x)
+                maxima[(size_t(z) * majorantSize.y + y) * majorantSize.x + x] = majorantGrid.at(x, y, z).y;
+    for (uint32_t level = 0; level < pyramids.levels; ++level)
+    {
+        vsg::uivec3 levelSize = majorantSize / (1u << level);
+        dilate(maxima.data(), levelSize, majorants + majorantOffsets[level]);
+        if (level + 1 == pyramids.levels)
+            break;
+        coarser.resize(majorantOffsets[level + 2] - majorantOffsets[level + 1]);
+        reduceLevel(maxima.data(), levelSize, coarser.data(), [](float a, float b) { return std::max(a, b); });
+        std::swap(maxima, coarser);
+    }
+
+    vsg::Data::Layout layout{VK_FORMAT_R32_SFLOAT};
+    layout.maxNumMipmaps = static_cast<uint8_t>(pyramids.levels);
+    pyramids.density = vsg::floatArray3D::create(densitySize.x, densitySize.y, densitySize.z, density, layout);
+    pyramids.majorants = vsg::floatArray3D::create(majorantSize.x, majorantSize.y, majorantSize.z, majorants, layout);
+    return pyramids;
+}
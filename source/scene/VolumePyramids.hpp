@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vsg/all.h>
+
+#include <cstdint>
+
+// Coarse levels of a density volume -------------------------------------------------
+// The density pyramid starts with the averages of kPyramidBlockSize^3 voxels and halves from there as the mip chain
+// of a 3D image (R32F). Its size is padded by repeating the edge texels so that every level covers the volume
+// exactly. The majorant pyramid holds one maximum per cell of kMajorantCellSize * 2^j voxels in level j, taken over
+// the neighbouring cells as well, so it bounds the trilinear lookups of density level j. The shaders sample the
+// coarse levels for secondary paths, the full resolution stays in the sparse atlas. kPyramidBlockSize has to match
+// c_PyramidBlockSize in cloud.rchit.
+const uint32_t kPyramidBlockSize = 4;
+const uint32_t kMaxPyramidLevels = 5;
+
+struct VolumePyramids
+{
+    vsg::ref_ptr<vsg::floatArray3D> density;    // R32_SFLOAT with mips
+    vsg::ref_ptr<vsg::floatArray3D> majorants;  // R32_SFLOAT with the same number of mips
+    uint32_t levels = 0;
+};
+
+// voxels have to be R32_SFLOAT or R16_SFLOAT and majorantGrid the result of createMajorantGrid(voxels),
+// returns empty pyramids for other data
+VolumePyramids createVolumePyramids(const vsg::Data& voxels, const vsg::vec2Array3D& majorantGrid);
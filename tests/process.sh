@@ -2,8 +2,8 @@
 
 ## mogrify all the files
 find -name '*.exr' | xargs -n 16 -P 8 magick mogrify -format png -alpha off -monitor
-# re-encode flip PNGs since their compression rates are abysmal
-find -name 'flip*.png' | xargs -n 16 -P 8 magick mogrify -depth 24 -define png:compression-filter=5 -define png:compression-level=6 -define png:compression-strategy=1
+# re-encode flip PNGs since their compression rates are abysmal, they only exist when run.py was called with --flip
+find -name 'flip*.png' | xargs -r -n 16 -P 8 magick mogrify -depth 24 -define png:compression-filter=5 -define png:compression-level=6 -define png:compression-strategy=1
 
 ## copy relevant files for comparison
 
@@ -16,15 +16,17 @@ for catg in alpha bundle iters repro statsteps; do
     # copy perf data files
     for i in $(seq 0 5); do
       test -f $dir/out_$i.txt && cp $dir/out_$i.txt upload/$catg/${dir#$catg}_$i.txt
+      test -f $dir/out_$i.csv && cp $dir/out_$i.csv upload/$catg/${dir#$catg}_$i.csv
+      test -f $dir/out_$i.metrics.csv && cp $dir/out_$i.metrics.csv upload/$catg/${dir#$catg}_$i.metrics.csv
     done
     # copy other files
     for name in t0 t1 t2_1 t3_1 t4_128 t5_9; do
       cp $dir/$name.png upload/$catg/${dir#$catg}_$name.png
-      cp $dir/flip.$name.*.png upload/$catg/${dir#$catg}_$name.flip.png
-      cat $dir/$name.flip.csv >>upload/$catg/all.flip.csv
+      test -f $dir/$name.flip.csv && cp $dir/flip.$name.*.png upload/$catg/${dir#$catg}_$name.flip.png
+      test -f $dir/$name.flip.csv && cat $dir/$name.flip.csv >>upload/$catg/all.flip.csv
     done
   done
-  sed -i '3~2d' upload/$catg/all.flip.csv
+  test -f upload/$catg/all.flip.csv && sed -i '3~2d' upload/$catg/all.flip.csv
 done
 
 # special for limit: only want t0 and t5_9
@@ -32,43 +34,48 @@ for dir in limit*; do
   # copy perf data files
   for i in $(seq 0 5); do
     test -f $dir/out_$i.txt && cp $dir/out_$i.txt upload/limit/${dir#limit}_$i.txt
+    test -f $dir/out_$i.csv && cp $dir/out_$i.csv upload/limit/${dir#limit}_$i.csv
+    test -f $dir/out_$i.metrics.csv && cp $dir/out_$i.metrics.csv upload/limit/${dir#limit}_$i.metrics.csv
   done
   # copy other files
   for name in t0 t5_9; do
     cp $dir/$name.png upload/limit/${dir#limit}_$name.png
-    cp $dir/flip.$name.*.png upload/limit/${dir#limit}_$name.flip.png
-    cat $dir/$name.flip.csv >>upload/limit/all.flip.csv
+    test -f $dir/$name.flip.csv && cp $dir/flip.$name.*.png upload/limit/${dir#limit}_$name.flip.png
+    test -f $dir/$name.flip.csv && cat $dir/$name.flip.csv >>upload/limit/all.flip.csv
   done
 done
-sed -i '3~2d' upload/limit/all.flip.csv
+test -f upload/limit/all.flip.csv && sed -i '3~2d' upload/limit/all.flip.csv
 
 # special for filters: directories have an underscore
 for dir in filter*; do
   # copy perf data files
   for i in $(seq 0 5); do
     test -f $dir/out_$i.txt && cp $dir/out_$i.txt upload/filter/${dir#filter_}_$i.txt
+    test -f $dir/out_$i.csv && cp $dir/out_$i.csv upload/filter/${dir#filter_}_$i.csv
+    test -f $dir/out_$i.metrics.csv && cp $dir/out_$i.metrics.csv upload/filter/${dir#filter_}_$i.metrics.csv
   done
   # copy other files
   for name in t0 t5_9; do
     cp $dir/$name.png upload/filter/${dir#filter_}_$name.png
-    cp $dir/flip.$name.*.png upload/filter/${dir#filter_}_$name.flip.png
-    cat $dir/$name.flip.csv >>upload/filter/all.flip.csv
+    test -f $dir/$name.flip.csv && cp $dir/flip.$name.*.png upload/filter/${dir#filter_}_$name.flip.png
+    test -f $dir/$name.flip.csv && cat $dir/$name.flip.csv >>upload/filter/all.flip.csv
   done
 done
-sed -i '3~2d' upload/filter/all.flip.csv
+test -f upload/filter/all.flip.csv && sed -i '3~2d' upload/filter/all.flip.csv
 
 # presets
 for dir in quality fast balanced; do
   for i in $(seq 0 5); do
     cp $dir/out_$i.txt upload/${dir}_$i.txt
+    test -f $dir/out_$i.metrics.csv && cp $dir/out_$i.metrics.csv upload/${dir}_$i.metrics.csv
   done
   for name in t0 t1 t2_1 t3_1 t4_128 t5_9; do
     cp $dir/$name.png upload/${dir}_$name.png
-    cp $dir/flip.$name.*.png upload/${dir}_$name.flip.png
-    cat $dir/$name.flip.csv >>upload/all.flip.csv
+    test -f $dir/$name.flip.csv && cp $dir/flip.$name.*.png upload/${dir}_$name.flip.png
+    test -f $dir/$name.flip.csv && cat $dir/$name.flip.csv >>upload/all.flip.csv
   done
 done
-sed -i '3~2d' upload/all.flip.csv
+test -f upload/all.flip.csv && sed -i '3~2d' upload/all.flip.csv
 
 # reference
 for name in t0 t1 t2_1 t3_1 t4_128 t5_9; do
@@ -1,3 +1,4 @@
+import csv
 import subprocess
 import sys
 import os
@@ -5,6 +6,8 @@ from pathlib import Path
 
 exe_path = sys.argv[1]
 data_path = sys.argv[2]
+# the FLIP tool is only needed for the error images, the metrics are computed by the renderer
+run_flip_tool = len(sys.argv) > 3 and sys.argv[3] == "--flip"
 
 base_config_1 = {"i": 1940, "-f": 1, "--spp": 1, "cam": 1}
 
@@ -84,13 +87,39 @@ configs = {
     "filter_sub": {"--denoiser": "asvgf", "--atrousFilter": 3},
     "filter_sub3": {"--denoiser": "asvgf", "--atrousFilter": 4},
     "filter_sub5": {"--denoiser": "asvgf", "--atrousFilter": 5},
+
+    # primary hits from the vbuffer, compared against the same settings with traced primary rays
+    "primary_rt": {},
+    "primary_vbuffer": {"--primaryVisibility": "vbuffer", "reference": "primary_rt"},
+
+    # traced and denoised at a lower internal resolution and upscaled temporally, at a fixed scale and picked per frame
+    "upscale_scale0.7": {"--denoiser": "asvgf", "--renderScale": "0.7"},
+    "upscale_budget16": {"--denoiser": "asvgf", "--frameBudget": "16.6"},
+    "quality_budget16": {"--denoiser": "asvgf", "--qualityBudget": "16.6"},
+    # the quality drops first, the resolution once the lowest quality is reached
+    "quality_upscale_budget16": {"--denoiser": "asvgf", "--qualityBudget": "16.6", "--frameBudget": "16.6"},
+
+    # the commands recorded once per frame slot, has to match the images of the same settings recorded every frame
+    "static_iters5": {"--denoiser": "asvgf", "--atrousIters": 5, "--staticCommands": None, "reference": "iters5"},
 }
 
+
+# configs other configs are compared against, their images are needed by the metrics of the later runs
+reference_configs = {"reference"} | {overrides["reference"] for overrides in configs.values() if "reference" in overrides}
+
+
+# only the last frames of the converged sequence are compared by flip
+def compared_by_flip(file):
+    return not file.name.startswith("t4_") or file.name in ("t4_127.exr", "t4_128.exr")
+
+
 config_idx = 1
 for name, overrides in configs.items():
     print(name, f"({config_idx}/{len(configs)})")
     config_idx += 1
     disabled_cases = overrides.get("disabled", [])
+    # configs are compared against the reference config unless they name another one
+    config_refdir = Path(os.getcwd(), overrides.get("reference", "reference"))
 
     outdir = Path(os.getcwd(), name)
     outdir.mkdir(parents=True, exist_ok=True)
@@ -106,12 +135,17 @@ for name, overrides in configs.items():
         # path arguments that need processing
         args = ["-i", f"{data_path}cloud-{config['i']}.xyz",
                 "--cam", f"{os.getcwd()}/test{config['cam']}.json",
-                "--exportIllumination", f"{outdir}/{config['export']}.exr"]
+                "--exportIllumination", f"{outdir}/{config['export']}.exr",
+                "--profile", f"{outdir}/out_{i}.csv"]
+        if name != "reference":
+            args += ["--metricsReference", f"{config_refdir}/{config['export']}.exr",
+                     "--metrics", f"{outdir}/out_{i}.metrics.csv"]
 
         # rest of the arguments
         for key in config.keys():
             if key.startswith("-"):
-                args += [key, str(config[key])]
+                # flags without a value are None
+                args += [key] if config[key] is None else [key, str(config[key])]
 
         # exec command with output redirection
         with open(outname, 'w') as outfile:
@@ -119,19 +153,92 @@ for name, overrides in configs.items():
             outfile.flush()
             done = subprocess.run([exe_path] + args, stdout=outfile, cwd=os.path.dirname(exe_path))
 
-    if 4 not in disabled_cases:
-        # delete extra pictures to reduce work for flip
-        files_to_delete = list(outdir.glob("t4_*.exr"))
-        files_to_delete.remove(Path(outdir, "t4_127.exr"))
-        files_to_delete.remove(Path(outdir, "t4_128.exr"))
-        for file in files_to_delete:
-            file.unlink()
-
-refdir = Path(os.getcwd(), "reference")
+    if 4 not in disabled_cases and name not in reference_configs:
+        # delete extra pictures to save space, references keep all frames for the metrics of the configs compared to them
+        for file in outdir.glob("t4_*.exr"):
+            if not compared_by_flip(file):
+                file.unlink()
+
+# CPU record cost of the commands recorded every frame against the commands recorded once per frame slot
+def mean_cpu_time(config_name, scope):
+    times = []
+    for profile_path in Path(os.getcwd(), config_name).glob("out_*.csv"):
+        if profile_path.name.endswith(".metrics.csv"):
+            continue
+        with open(profile_path) as profile_file:
+            times += [float(row[f"cpu:{scope}"]) for row in csv.DictReader(profile_file) if row.get(f"cpu:{scope}")]
+    return sum(times) / len(times) if times else float("nan")
+
+
+print(f"RecordAndSubmit: recorded every frame {mean_cpu_time('iters5', 'RecordAndSubmit'):.1f} us, "
+      f"static {mean_cpu_time('static_iters5', 'RecordAndSubmit'):.1f} us")
+
+# the CPU denoisers have to match the GPU denoisers on the same offline buffers within a tolerance. The buffers are
+# exported from the moving camera case without denoising, the GPU output is the reference of the CPU output.
+# SVGF has no GPU counterpart on offline buffers, A-SVGF needs the scene for its gradients
+offline_case = cases[5]
+offline_denoisers = {"bmfr": {"min_psnr": 35, "max_flip": 0.05}}
+offline_dir = Path(os.getcwd(), "offline")
+offline_dir.mkdir(parents=True, exist_ok=True)
+offline_frames = offline_case["-f"]
+offline_buffers = ["--depths", f"{offline_dir}/depth_%d.exr", "--normals", f"{offline_dir}/normal_%d.exr",
+                   "--albedos", f"{offline_dir}/albedo_%d.exr", "--materials", f"{offline_dir}/material_%d.exr",
+                   "--illuminations", f"{offline_dir}/t_%d.exr", "--matrices", f"{offline_dir}/matrices.json"]
+
+
+def run_offline(outname, args):
+    with open(outname, 'w') as outfile:
+        outfile.write(" ".join(args) + "\n")
+        outfile.flush()
+        subprocess.run([exe_path] + args, stdout=outfile, cwd=os.path.dirname(exe_path))
+
+
+print("offline buffers")
+run_offline(Path(offline_dir, "out.txt"),
+            ["-i", f"{data_path}cloud-{offline_case['i']}.xyz", "--cam", f"{os.getcwd()}/test{offline_case['cam']}.json",
+             "-f", str(offline_frames), "--spp", str(offline_case["--spp"]), "--denoiser", "none",
+             "--exportDepth", f"{offline_dir}/depth_%d.exr", "--exportNormal", f"{offline_dir}/normal_%d.exr",
+             "--exportAlbedo", f"{offline_dir}/albedo_%d.exr", "--exportMaterial", f"{offline_dir}/material_%d.exr",
+             "--exportIllumination", f"{offline_dir}/t_%d.exr", "--exportMatrices", f"{offline_dir}/matrices.json"])
+offline_failures = []
+for denoiser, tolerance in offline_denoisers.items():
+    print("offline", denoiser)
+    gpu_dir = Path(os.getcwd(), f"offline_gpu_{denoiser}")
+    cpu_dir = Path(os.getcwd(), f"offline_cpu_{denoiser}")
+    gpu_dir.mkdir(parents=True, exist_ok=True)
+    cpu_dir.mkdir(parents=True, exist_ok=True)
+    run_offline(Path(gpu_dir, "out.txt"), ["-f", str(offline_frames), "--denoiser", denoiser,
+                                           "--exportIllumination", f"{gpu_dir}/t_%d.exr"] + offline_buffers)
+    run_offline(Path(cpu_dir, "out.txt"), ["-f", str(offline_frames), "--denoiser", denoiser, "--cpuDenoiser",
+                                           "--exportIllumination", f"{cpu_dir}/t_%d.exr",
+                                           "--metricsReference", f"{gpu_dir}/t_%d.exr",
+                                           "--metrics", f"{cpu_dir}/out.metrics.csv"] + offline_buffers)
+    # a missing or short metrics file fails as well, the metrics only report missing references on stderr
+    metrics_path = Path(cpu_dir, "out.metrics.csv")
+    rows = []
+    if metrics_path.exists():
+        with open(metrics_path) as metrics_file:
+            rows = list(csv.DictReader(metrics_file))
+    if len(rows) < offline_frames:
+        offline_failures.append(f"{denoiser}: {len(rows)} of {offline_frames} frames compared")
+        continue
+    psnr = sum(float(row["psnr"]) for row in rows) / len(rows)
+    flip = sum(float(row["flip"]) for row in rows) / len(rows)
+    print(f"offline {denoiser}: PSNR {psnr:.2f}, FLIP {flip:.4f}")
+    if psnr < tolerance["min_psnr"] or flip > tolerance["max_flip"]:
+        offline_failures.append(f"{denoiser}: PSNR {psnr:.2f} (min {tolerance['min_psnr']}), FLIP {flip:.4f} (max {tolerance['max_flip']})")
 
 # run flip for quality comparison
-for name, overrides in configs.items():
-    outdir = Path(os.getcwd(), name)
-    for file in outdir.glob("*.exr"):
-        subprocess.run(["flip", "-r", Path(refdir, file.name), "-t", file, "-d", outdir, "-nexm", "-c",
-                        file.with_suffix(".flip.csv")])
+if run_flip_tool:
+    for name, overrides in configs.items():
+        outdir = Path(os.getcwd(), name)
+        config_refdir = Path(os.getcwd(), overrides.get("reference", "reference"))
+        for file in filter(compared_by_flip, outdir.glob("*.exr")):
+            subprocess.run(["flip", "-r", Path(config_refdir, file.name), "-t", file, "-d", outdir, "-nexm", "-c",
+                            file.with_suffix(".flip.csv")])
+
+if offline_failures:
+    print("CPU denoisers do not match the GPU denoisers:")
+    for failure in offline_failures:
+        print("  " + failure)
+    sys.exit(1)